@@ -83,6 +83,21 @@ typedef int (*check_alloc_entity_func)(ir_entity *ent);
  */
 FIRM_API void optimize_funccalls(void);
 
+/**
+ * Devirtualizes indirect calls.
+ *
+ * Computes the possible callees of all calls with cgana(). Calls with a
+ * single possible callee are turned into direct calls. Calls whose callee
+ * set contains a dominant target (the only known callee or the method
+ * selected by the static type of a Member) are speculatively devirtualized:
+ * the call address is compared with the target, which is called directly
+ * if they are equal and via the original indirect call otherwise. The
+ * direct calls can be inlined afterwards.
+ *
+ * Invalidates the callee information.
+ */
+FIRM_API void opt_devirtualize_calls(void);
+
 /**
  * Does Partial Redundancy Elimination combined with
  * Global Value Numbering.
@@ -300,6 +315,37 @@ FIRM_API void remove_phi_cycles(ir_graph *irg);
  */
 FIRM_API void proc_cloning(float threshold);
 
+/**
+ * Performs interprocedural sparse conditional constant and range
+ * propagation over the callgraph.
+ *
+ * Values passed at all reachable call sites of a function whose address is
+ * not taken are propagated into its arguments, values returned by all
+ * reachable Returns of a function are propagated into the results of its
+ * calls. Arguments and call results with a constant value are replaced,
+ * Cond nodes with a known direction get a constant selector and arguments
+ * with a known value range are confirmed.
+ *
+ * Run local optimizations and control flow optimization afterwards to
+ * remove the impossible branches.
+ *
+ * This algorithm destroys the link field of entities and nodes.
+ */
+FIRM_API void ipsccp(void);
+
+/**
+ * Removes dead parameters and results of functions which cannot be called
+ * from outside of the compilation unit.
+ *
+ * Parameters which are not used and results which are ignored by all
+ * callers are removed from the method type and all calls. Pointer
+ * parameters only used to load a scalar are passed by value instead if the
+ * function does not write memory and loads the value on all paths.
+ *
+ * Invalidates the callee information.
+ */
+FIRM_API void dead_argument_elimination(void);
+
 /**
  * Reassociation.
  *
@@ -369,6 +415,24 @@ FIRM_API void normalize_n_returns(ir_graph *irg);
  */
 FIRM_API void scalar_replacement_opt(ir_graph *irg);
 
+/**
+ * Performs escape analysis and promotes heap allocations to the stack.
+ *
+ * Calls of functions with the mtp_property_malloc property and Alloc nodes
+ * with a constant size of at most @p max_size bytes are replaced by frame
+ * entities if they are not inside a loop and the allocated object does not
+ * escape the function. Free nodes and calls of deallocation routines for
+ * these objects are removed. Run scalar_replacement_opt() afterwards to
+ * break up the promoted objects.
+ *
+ * @param irg       the graph which should be optimized
+ * @param max_size  the maximum size of a promoted object
+ * @param is_free   callback returning non-zero for entities of deallocation
+ *                  routines taking the object as only argument, may be NULL
+ */
+FIRM_API void escape_analysis(ir_graph *irg, unsigned max_size,
+                              check_alloc_entity_func is_free);
+
 /**
  * Optimizes tail-recursion calls by converting them into loops.
  * Depends on the flag opt_tail_recursion.
@@ -402,6 +466,9 @@ typedef void (*opt_ptr)(ir_graph *irg);
 /**
  * Heuristic inliner. Calculates a benefice value for every call and inlines
  * those calls with a value higher than the threshold.
+ * Calls are weighted by their execution frequency, which is taken from
+ * profile data if available and estimated otherwise. Calls on cold paths are
+ * only inlined if the callee is tiny.
  *
  * @param maxsize             Do not inline any calls if a method has more than
  *                            maxsize firm nodes.  It may reach this limit by
@@ -413,6 +480,31 @@ typedef void (*opt_ptr)(ir_graph *irg);
 FIRM_API void inline_functions(unsigned maxsize, int inline_threshold,
                                opt_ptr after_inline_opt);
 
+/**
+ * Heuristic inliner with a program wide code growth budget. Like
+ * inline_functions() but instead of limiting the size of each function, the
+ * budget is spent on the calls with the highest benefice, so hot call sites
+ * are inlined first.
+ *
+ * @param growth              maximum growth of the program in percent of its
+ *                            firm nodes
+ * @param inline_threshold    inlining threshold
+ * @param after_inline_opt    optimizations performed immediately after inlining
+ *                            some calls
+ */
+FIRM_API void inline_functions_growth(unsigned growth, int inline_threshold,
+                                      opt_ptr after_inline_opt);
+
+/**
+ * Partial inliner. Looks for functions which start with a cheap test leading
+ * to an early return. The remainder of such a function is outlined into a
+ * new local function and only the small head is inlined into all direct
+ * callers, so the fast path avoids the call overhead.
+ *
+ * @param max_head_size  maximum number of firm nodes of an inlined head
+ */
+FIRM_API void partial_inline_functions(unsigned max_head_size);
+
 /**
  * Combines congruent blocks into one.
  *
@@ -439,6 +531,43 @@ FIRM_API void do_loop_unrolling(ir_graph *irg);
  */
 FIRM_API void do_loop_peeling(ir_graph *irg);
 
+/**
+ * Replaces innermost loops filling or copying memory element by element with
+ * calls to memset or memcpy.
+ *
+ * The calls are guarded by a trip count check (and a check that the copied
+ * areas do not overlap), the original loop remains as fallback.
+ *
+ * @param irg  The graph whose loops will be processed
+ */
+FIRM_API void opt_loop_idioms(ir_graph *irg);
+
+/**
+ * Forms superblocks along the frequently executed traces of a graph.
+ *
+ * Join points on a trace are duplicated for the trace predecessor (tail
+ * duplication), so each trace is only entered at its head. Running
+ * optimize_cf() afterwards merges the resulting straight-line blocks.
+ *
+ * @param irg         The graph to optimize
+ * @param max_growth  The maximal number of duplicated nodes in percent of the
+ *                    graph size
+ */
+FIRM_API void opt_superblocks(ir_graph *irg, unsigned max_growth);
+
+/**
+ * Inserts prefetches for loads in innermost loops whose address changes by a
+ * constant stride in each iteration.
+ *
+ * Does nothing if the target has no prefetch instructions. Loops with a known
+ * trip count whose data fits into the first level cache are skipped.
+ *
+ * @param irg         The graph to optimize
+ * @param iterations  The number of iterations to prefetch ahead, 0 derives it
+ *                    from the prefetch distance of the target
+ */
+FIRM_API void opt_prefetch(ir_graph *irg, unsigned iterations);
+
 /**
  * Removes all entities which are unused.
  *
@@ -449,6 +578,25 @@ FIRM_API void do_loop_peeling(ir_graph *irg);
  */
 FIRM_API void garbage_collect_entities(void);
 
+/**
+ * Folds structurally identical functions of the program.
+ *
+ * Of each class of identical functions only the first one in the program
+ * keeps its body. The others are removed, or replaced by an alias if they are
+ * externally visible, when they do not need a unique address
+ * (IR_LINKAGE_NO_IDENTITY). Otherwise direct calls are redirected to the
+ * remaining function and their body is replaced by a call to it.
+ */
+FIRM_API void opt_fold_identical_functions(void);
+
+/**
+ * Computes a hash of @p irg which only depends on the structure of the graph,
+ * i.e. opcodes, modes, attributes and edges, but not on node identities.
+ * Structurally identical graphs produce the same hash. Modes, entities and
+ * constants are hashed by name and value, so the hash is stable across runs.
+ */
+FIRM_API unsigned irg_structural_hash(ir_graph *irg);
+
 /**
  * Performs dead node elimination by copying the ir graph to a new obstack.
  *
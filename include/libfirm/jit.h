@@ -72,6 +72,110 @@ FIRM_API unsigned be_get_function_size(ir_jit_function_t const *function);
  */
 FIRM_API void be_emit_function(char *buffer, ir_jit_function_t *function);
 
+/**
+ * Back the executable memory of \p segment with huge pages if the operating
+ * system supports it. Must be called before the first function of the
+ * segment is installed.
+ */
+FIRM_API void be_jit_segment_use_huge_pages(ir_jit_segment_t *segment,
+                                            int enable);
+
+/**
+ * Emit \p function into executable memory of its segment and return the
+ * address of the code. The memory stays valid until the function is freed
+ * with be_jit_free_function() or the segment is destroyed.
+ */
+FIRM_API void const *be_jit_install_function(ir_jit_function_t *function);
+
+/**
+ * Release \p function together with its executable memory if it was installed
+ * with be_jit_install_function(). Functions not freed explicitly are released
+ * when their segment is destroyed.
+ */
+FIRM_API void be_jit_free_function(ir_jit_function_t *function);
+
+/**
+ * Persistent cache of jit compiled functions in a directory.
+ */
+typedef struct ir_jit_cache_t ir_jit_cache_t;
+
+/**
+ * Create a cache storing its entries in the existing directory \p directory.
+ * Entries are only reused by the same libfirm version with the same target
+ * and backend options, so the cache must be created after the target is
+ * initialized. Returns NULL if the cache cannot be used.
+ */
+FIRM_API ir_jit_cache_t *be_new_jit_cache(char const *directory);
+
+/**
+ * Destroy \p cache. The entries stay in its directory.
+ */
+FIRM_API void be_destroy_jit_cache(ir_jit_cache_t *cache);
+
+/**
+ * Like be_jit_compile() but loads the function from \p cache if a graph with
+ * the same structure was compiled before, otherwise the compiled function is
+ * added to the cache. The graph is not compiled in the first case.
+ * Relocations against global entities which are not referenced by the graph
+ * itself, like library functions used by the backend, are resolved by the
+ * linker name of the entity. If no such entity exists, the graph is compiled.
+ */
+FIRM_API ir_jit_function_t *be_jit_compile_cached(ir_jit_cache_t *cache,
+                                                  ir_jit_segment_t *segment,
+                                                  ir_graph *irg);
+
+/**
+ * Lazily compiling jit runtime. Hands out stubs for functions which compile
+ * the function when it is called for the first time.
+ */
+typedef struct ir_jit_runtime_t ir_jit_runtime_t;
+
+/**
+ * Optimization pipeline applied to a copy of a graph before it is compiled.
+ */
+typedef void (*ir_jit_optimize_func)(ir_graph *irg);
+
+/**
+ * Create a new lazily compiling jit runtime.
+ *
+ * A function is compiled after applying \p baseline (which may be NULL) when
+ * it is called for the first time. If \p optimized is not NULL and
+ * \p hot_threshold is not zero, the function is compiled again after
+ * applying \p optimized once it has been called \p hot_threshold more
+ * times, and later calls enter the new code.
+ *
+ * Compilation happens on the thread calling the function, so the runtime must
+ * not be used from multiple threads.
+ *
+ * Returns NULL if the target does not support lazy compilation.
+ */
+FIRM_API ir_jit_runtime_t *be_new_jit_runtime(ir_jit_optimize_func baseline,
+                                              ir_jit_optimize_func optimized,
+                                              unsigned hot_threshold);
+
+/**
+ * Destroy jit runtime \p runtime and all code created by it.
+ */
+FIRM_API void be_destroy_jit_runtime(ir_jit_runtime_t *runtime);
+
+/**
+ * Return a callable stub for the function of graph \p irg and set it as
+ * address of the graph's entity, see be_jit_set_entity_addr().
+ *
+ * The graph has to be lowered for the target already and must stay alive
+ * while \p runtime exists: Each compilation works on a copy of it.
+ */
+FIRM_API void const *be_jit_runtime_add(ir_jit_runtime_t *runtime,
+                                        ir_graph *irg);
+
+/**
+ * Return how often the function of \p entity has been compiled by
+ * \p runtime: 0 if it was not called yet, 1 after the baseline compilation
+ * and 2 after the optimized recompilation.
+ */
+FIRM_API unsigned be_jit_runtime_get_tier(ir_jit_runtime_t const *runtime,
+                                          ir_entity const *entity);
+
 /** @} */
 
 #include "end.h"
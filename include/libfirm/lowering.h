@@ -80,10 +80,13 @@ FIRM_API void lower_CopyB(ir_graph *irg, unsigned max_small_size,
 
 /**
  * Lowers all Switches (Cond nodes with non-boolean mode) depending on spare_size.
- * They will either remain the same or be converted into if-cascades.
+ * The cases are clustered into dense ranges which remain table switches, bit
+ * tests for few targets and single comparisons. The clusters are selected
+ * by a binary decision tree, which is balanced by the block execution
+ * frequencies if they are available.
  *
  * @param irg        The ir graph to be lowered.
- * @param small_switch  If switch has <= cases then change it to an if-cascade.
+ * @param small_switch  Ranges with <= cases are not turned into table switches.
  * @param spare_size Allowed spare size for table switches in machine words.
  *                   (Default in edgfe: 128)
  * @param selector_mode mode which must be used for Switch selector
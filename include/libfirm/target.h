@@ -82,6 +82,17 @@ FIRM_API int ir_target_supports_pic(void);
  */
 FIRM_API int ir_target_fast_unaligned_memaccess(void);
 
+/**
+ * Returns the number of bytes a strided access should be prefetched ahead or
+ * 0 if the target has no prefetch instructions.
+ */
+FIRM_API unsigned ir_target_prefetch_distance(void);
+
+/**
+ * Returns the size of the first level data cache in bytes (0 if unknown).
+ */
+FIRM_API unsigned ir_target_data_cache_size(void);
+
 /**
  * Returns supported float arithmetic mode or NULL if mode_D and mode_F
  * are supported natively.
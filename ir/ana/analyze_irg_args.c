@@ -185,6 +185,9 @@ static void analyze_ent_args(ir_entity *ent)
 	for (size_t i = nparams; i-- > 0; )
 		rw_info[i] = ptr_access_none;
 
+	/* analyze_arg() marks the visited nodes */
+	inc_irg_visited(irg);
+
 	/* search for arguments with mode reference
 	   to analyze them.*/
 	foreach_irn_out_r(irg_args, i, arg) {
@@ -494,18 +494,17 @@ static void callee_ana_node(ir_node *node, pset *methods);
 static void callee_ana_proj(ir_node *node, unsigned n, pset *methods)
 {
 	assert(get_irn_mode(node) == mode_T);
-	if (get_irn_link(node) == MARK) {
+	if (irn_visited_else_mark(node)) {
 		/* already visited */
 		return;
 	}
-	set_irn_link(node, MARK);
 
 	switch (get_irn_opcode(node)) {
 	case iro_Proj: {
 		/* proj_proj: in a correct graph we now get an op_Tuple or a node
 		 * returning a free method. */
 		ir_node *pred = get_Proj_pred(node);
-		if (get_irn_link(pred) != MARK) {
+		if (!irn_visited(pred)) {
 			if (is_Tuple(pred)) {
 				callee_ana_proj(get_Tuple_pred(pred, get_Proj_num(node)), n, methods);
 			} else {
@@ -535,11 +534,10 @@ static void callee_ana_node(ir_node *node, pset *methods)
 {
 	assert(mode_is_reference(get_irn_mode(node)) || is_Bad(node));
 	/* Beware of recursion */
-	if (get_irn_link(node) == MARK) {
+	if (irn_visited_else_mark(node)) {
 		/* already visited */
 		return;
 	}
-	set_irn_link(node, MARK);
 
 	switch (get_irn_opcode(node)) {
 	case iro_Const:
@@ -602,14 +600,23 @@ static void callee_ana_node(ir_node *node, pset *methods)
 }
 
 /**
- * Walker: Analyses every Call node and calculates an array of possible
- * callees for that call.
+ * Walker: Collects all Call nodes.
  */
-static void callee_walker(ir_node *call, void *env)
+static void collect_calls(ir_node *node, void *env)
 {
-	(void)env;
-	if (!is_Call(call))
-		return;
+	ir_node ***calls = (ir_node***)env;
+	if (is_Call(node))
+		ARR_APP1(ir_node*, *calls, node);
+}
+
+/**
+ * Calculates an array of possible callees for a Call node.
+ */
+static void callee_ana_call(ir_node *call)
+{
+	/* each call needs a fresh visited set, as the address computations
+	 * may be shared between calls */
+	inc_irg_visited(get_irn_irg(call));
 
 	pset *methods = pset_new_ptr_default();
 	callee_ana_node(get_Call_ptr(call), methods);
@@ -639,9 +646,14 @@ static void callee_ana(void)
 	/* analyse all graphs */
 	foreach_irp_irg(i, irg) {
 		assure_irg_properties(irg, IR_GRAPH_PROPERTY_NO_TUPLES);
-		ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
-		irg_walk_graph(irg, callee_walker, NULL, NULL);
-		ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
+		ir_node **calls = NEW_ARR_F(ir_node*, 0);
+		irg_walk_graph(irg, NULL, collect_calls, &calls);
+		ir_reserve_resources(irg, IR_RESOURCE_IRN_VISITED);
+		for (size_t c = 0, n = ARR_LEN(calls); c < n; ++c) {
+			callee_ana_call(calls[c]);
+		}
+		ir_free_resources(irg, IR_RESOURCE_IRN_VISITED);
+		DEL_ARR_F(calls);
 		set_irg_callee_info_state(irg, irg_callee_info_consistent);
 	}
 	set_irp_callee_info_state(irg_callee_info_consistent);
@@ -172,7 +172,7 @@ void TEMPLATE_emit_function(ir_graph *irg)
 	TEMPLATE_register_emitters();
 
 	/* create the block schedule */
-	ir_node **block_schedule = be_create_block_schedule(irg);
+	ir_node **block_schedule = be_create_block_schedule(irg, NULL);
 
 	/* emit assembler prolog */
 	ir_entity *entity = get_irg_entity(irg);
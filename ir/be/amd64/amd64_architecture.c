@@ -0,0 +1,393 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       amd64 cpu variants and their instruction costs
+ *
+ * The latencies and throughputs are rounded measurements of the integer
+ * and scalar SSE instructions the backend emits.
+ */
+#include "amd64_architecture.h"
+
+#include "amd64_new_nodes.h"
+#include "gen_amd64_new_nodes.h"
+#include "irtools.h"
+#include "lc_opts.h"
+#include "lc_opts_enum.h"
+
+typedef enum amd64_cpu_t {
+	cpu_none = 0,
+	cpu_generic,
+	cpu_k8,
+	cpu_core2,
+	cpu_sandybridge,
+	cpu_haswell,
+	cpu_skylake,
+	cpu_znver1,
+	cpu_znver3,
+} amd64_cpu_t;
+
+static amd64_cpu_t arch     = cpu_generic;
+static amd64_cpu_t opt_arch = cpu_none;
+
+static const lc_opt_enum_int_items_t arch_items[] = {
+	{ "x86-64",      cpu_generic },
+	{ "generic",     cpu_generic },
+	{ "k8",          cpu_k8 },
+	{ "opteron",     cpu_k8 },
+	{ "athlon64",    cpu_k8 },
+	{ "core2",       cpu_core2 },
+	{ "sandybridge", cpu_sandybridge },
+	{ "ivybridge",   cpu_sandybridge },
+	{ "haswell",     cpu_haswell },
+	{ "broadwell",   cpu_haswell },
+	{ "skylake",     cpu_skylake },
+	{ "znver1",      cpu_znver1 },
+	{ "znver2",      cpu_znver1 },
+	{ "znver3",      cpu_znver3 },
+	{ NULL,          cpu_none }
+};
+
+static lc_opt_enum_int_var_t arch_var = {
+	(int*)&arch, arch_items
+};
+
+static lc_opt_enum_int_var_t opt_arch_var = {
+	(int*)&opt_arch, arch_items
+};
+
+static const lc_opt_table_entry_t amd64_architecture_options[] = {
+	LC_OPT_ENT_ENUM_INT("arch", "select the instruction architecture",   &arch_var),
+	LC_OPT_ENT_ENUM_INT("tune", "optimize for instruction architecture", &opt_arch_var),
+	LC_OPT_LAST
+};
+
+/* costs for unknown cpus, favoring recent ones */
+static const amd64_cpu_costs_t generic_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   2 },
+		[AMD64_INSN_LEA]   = {  1,   2 },
+		[AMD64_INSN_CMOV]  = {  1,   2 },
+		[AMD64_INSN_IMUL]  = {  3,   4 },
+		[AMD64_INSN_DIV]   = { 40,  96 },
+		[AMD64_INSN_LOAD]  = {  4,   2 },
+		[AMD64_INSN_STORE] = {  5,   4 },
+		[AMD64_INSN_FADD]  = {  4,   2 },
+		[AMD64_INSN_FMUL]  = {  4,   2 },
+		[AMD64_INSN_FDIV]  = { 14,  20 },
+		[AMD64_INSN_CVT]   = {  5,   4 },
+		[AMD64_INSN_X87]   = {  4,   4 },
+	},
+	.branch_miss = 16,
+};
+
+static const amd64_cpu_costs_t k8_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   1 },
+		[AMD64_INSN_LEA]   = {  2,   2 },
+		[AMD64_INSN_CMOV]  = {  1,   1 },
+		[AMD64_INSN_IMUL]  = {  4,   8 },
+		[AMD64_INSN_DIV]   = { 71, 284 },
+		[AMD64_INSN_LOAD]  = {  3,   2 },
+		[AMD64_INSN_STORE] = {  4,   4 },
+		[AMD64_INSN_FADD]  = {  4,   4 },
+		[AMD64_INSN_FMUL]  = {  4,   4 },
+		[AMD64_INSN_FDIV]  = { 20,  68 },
+		[AMD64_INSN_CVT]   = {  6,   8 },
+		[AMD64_INSN_X87]   = {  4,   4 },
+	},
+	.branch_miss = 10,
+};
+
+static const amd64_cpu_costs_t core2_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   2 },
+		[AMD64_INSN_LEA]   = {  1,   4 },
+		[AMD64_INSN_CMOV]  = {  2,   4 },
+		[AMD64_INSN_IMUL]  = {  5,   8 },
+		[AMD64_INSN_DIV]   = { 60, 200 },
+		[AMD64_INSN_LOAD]  = {  3,   4 },
+		[AMD64_INSN_STORE] = {  5,   4 },
+		[AMD64_INSN_FADD]  = {  3,   4 },
+		[AMD64_INSN_FMUL]  = {  5,   4 },
+		[AMD64_INSN_FDIV]  = { 20,  80 },
+		[AMD64_INSN_CVT]   = {  4,   4 },
+		[AMD64_INSN_X87]   = {  3,   4 },
+	},
+	.branch_miss = 15,
+};
+
+static const amd64_cpu_costs_t sandybridge_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   2 },
+		[AMD64_INSN_LEA]   = {  1,   2 },
+		[AMD64_INSN_CMOV]  = {  2,   4 },
+		[AMD64_INSN_IMUL]  = {  3,   4 },
+		[AMD64_INSN_DIV]   = { 60, 160 },
+		[AMD64_INSN_LOAD]  = {  4,   2 },
+		[AMD64_INSN_STORE] = {  5,   4 },
+		[AMD64_INSN_FADD]  = {  3,   4 },
+		[AMD64_INSN_FMUL]  = {  5,   4 },
+		[AMD64_INSN_FDIV]  = { 22,  88 },
+		[AMD64_INSN_CVT]   = {  4,   4 },
+		[AMD64_INSN_X87]   = {  3,   4 },
+	},
+	.branch_miss = 15,
+};
+
+static const amd64_cpu_costs_t haswell_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   2 },
+		[AMD64_INSN_LEA]   = {  1,   2 },
+		[AMD64_INSN_CMOV]  = {  2,   2 },
+		[AMD64_INSN_IMUL]  = {  3,   4 },
+		[AMD64_INSN_DIV]   = { 60, 140 },
+		[AMD64_INSN_LOAD]  = {  4,   2 },
+		[AMD64_INSN_STORE] = {  5,   4 },
+		[AMD64_INSN_FADD]  = {  3,   4 },
+		[AMD64_INSN_FMUL]  = {  5,   2 },
+		[AMD64_INSN_FDIV]  = { 20,  56 },
+		[AMD64_INSN_CVT]   = {  4,   4 },
+		[AMD64_INSN_X87]   = {  3,   4 },
+	},
+	.branch_miss = 15,
+};
+
+static const amd64_cpu_costs_t skylake_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   2 },
+		[AMD64_INSN_LEA]   = {  1,   2 },
+		[AMD64_INSN_CMOV]  = {  1,   2 },
+		[AMD64_INSN_IMUL]  = {  3,   4 },
+		[AMD64_INSN_DIV]   = { 42, 100 },
+		[AMD64_INSN_LOAD]  = {  4,   2 },
+		[AMD64_INSN_STORE] = {  4,   4 },
+		[AMD64_INSN_FADD]  = {  4,   2 },
+		[AMD64_INSN_FMUL]  = {  4,   2 },
+		[AMD64_INSN_FDIV]  = { 14,  16 },
+		[AMD64_INSN_CVT]   = {  5,   4 },
+		[AMD64_INSN_X87]   = {  3,   4 },
+	},
+	.branch_miss = 16,
+};
+
+static const amd64_cpu_costs_t znver1_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   1 },
+		[AMD64_INSN_LEA]   = {  2,   2 },
+		[AMD64_INSN_CMOV]  = {  1,   1 },
+		[AMD64_INSN_IMUL]  = {  3,   4 },
+		[AMD64_INSN_DIV]   = { 30, 120 },
+		[AMD64_INSN_LOAD]  = {  4,   2 },
+		[AMD64_INSN_STORE] = {  4,   4 },
+		[AMD64_INSN_FADD]  = {  3,   2 },
+		[AMD64_INSN_FMUL]  = {  4,   2 },
+		[AMD64_INSN_FDIV]  = { 13,  20 },
+		[AMD64_INSN_CVT]   = {  5,   4 },
+		[AMD64_INSN_X87]   = {  5,   4 },
+	},
+	.branch_miss = 19,
+};
+
+static const amd64_cpu_costs_t znver3_costs = {
+	.insns = {
+		[AMD64_INSN_ALU]   = {  1,   1 },
+		[AMD64_INSN_SHIFT] = {  1,   1 },
+		[AMD64_INSN_LEA]   = {  1,   1 },
+		[AMD64_INSN_CMOV]  = {  1,   1 },
+		[AMD64_INSN_IMUL]  = {  3,   4 },
+		[AMD64_INSN_DIV]   = { 14,  28 },
+		[AMD64_INSN_LOAD]  = {  4,   2 },
+		[AMD64_INSN_STORE] = {  4,   2 },
+		[AMD64_INSN_FADD]  = {  3,   2 },
+		[AMD64_INSN_FMUL]  = {  3,   2 },
+		[AMD64_INSN_FDIV]  = { 13,  18 },
+		[AMD64_INSN_CVT]   = {  4,   4 },
+		[AMD64_INSN_X87]   = {  5,   4 },
+	},
+	.branch_miss = 16,
+};
+
+amd64_cpu_costs_t const *amd64_costs = &generic_costs;
+
+void amd64_setup_cg_config(void)
+{
+	if (opt_arch == cpu_none)
+		opt_arch = arch;
+
+	switch (opt_arch) {
+	case cpu_k8:          amd64_costs = &k8_costs;          break;
+	case cpu_core2:       amd64_costs = &core2_costs;       break;
+	case cpu_sandybridge: amd64_costs = &sandybridge_costs; break;
+	case cpu_haswell:     amd64_costs = &haswell_costs;     break;
+	case cpu_skylake:     amd64_costs = &skylake_costs;     break;
+	case cpu_znver1:      amd64_costs = &znver1_costs;      break;
+	case cpu_znver3:      amd64_costs = &znver3_costs;      break;
+	default:
+	case cpu_generic:     amd64_costs = &generic_costs;     break;
+	}
+}
+
+/**
+ * Returns the instruction class of @p node. Sets @p rmw if the instruction
+ * also loads and stores its destination operand.
+ */
+static amd64_insn_class_t get_insn_class(ir_node const *const node,
+                                         bool *const rmw)
+{
+	*rmw = false;
+	switch ((amd64_opcodes)get_amd64_irn_opcode(node)) {
+	case iro_amd64_add_mem:
+	case iro_amd64_and_mem:
+	case iro_amd64_neg_mem:
+	case iro_amd64_not_mem:
+	case iro_amd64_or_mem:
+	case iro_amd64_pop_am:
+	case iro_amd64_push_am:
+	case iro_amd64_sub_mem:
+	case iro_amd64_xor_mem:
+		*rmw = true;
+		return AMD64_INSN_ALU;
+
+	case iro_amd64_sar_mem:
+	case iro_amd64_shl_mem:
+	case iro_amd64_shr_mem:
+		*rmw = true;
+		return AMD64_INSN_SHIFT;
+
+	case iro_amd64_sar:
+	case iro_amd64_shl:
+	case iro_amd64_shr:
+		return AMD64_INSN_SHIFT;
+
+	case iro_amd64_lea:
+		return AMD64_INSN_LEA;
+
+	case iro_amd64_cmovcc:
+		return AMD64_INSN_CMOV;
+
+	case iro_amd64_imul:
+	case iro_amd64_imul_1op:
+	case iro_amd64_mul:
+		return AMD64_INSN_IMUL;
+
+	case iro_amd64_div:
+	case iro_amd64_idiv:
+		return AMD64_INSN_DIV;
+
+	case iro_amd64_fild:
+	case iro_amd64_fld:
+	case iro_amd64_mov_gp:
+	case iro_amd64_movdqa:
+	case iro_amd64_movdqu:
+	case iro_amd64_movs:
+	case iro_amd64_movs_xmm:
+		return amd64_loads(node) ? AMD64_INSN_LOAD : AMD64_INSN_ALU;
+
+	case iro_amd64_pop_reg:
+		return AMD64_INSN_LOAD;
+
+	case iro_amd64_fisttp:
+	case iro_amd64_fst:
+	case iro_amd64_fstp:
+	case iro_amd64_mov_store:
+	case iro_amd64_movdqu_store:
+	case iro_amd64_movs_store_xmm:
+	case iro_amd64_push_reg:
+		return AMD64_INSN_STORE;
+
+	case iro_amd64_adds:
+	case iro_amd64_haddpd:
+	case iro_amd64_subpd:
+	case iro_amd64_subs:
+	case iro_amd64_ucomis:
+		return AMD64_INSN_FADD;
+
+	case iro_amd64_muls:
+		return AMD64_INSN_FMUL;
+
+	case iro_amd64_divs:
+	case iro_amd64_fdiv:
+		return AMD64_INSN_FDIV;
+
+	case iro_amd64_cvtsd2ss:
+	case iro_amd64_cvtsi2sd:
+	case iro_amd64_cvtsi2ss:
+	case iro_amd64_cvtss2sd:
+	case iro_amd64_cvttsd2si:
+	case iro_amd64_cvttss2si:
+		return AMD64_INSN_CVT;
+
+	case iro_amd64_fadd:
+	case iro_amd64_fmul:
+	case iro_amd64_fsub:
+	case iro_amd64_fucomi:
+		return AMD64_INSN_X87;
+
+	default:
+		return AMD64_INSN_ALU;
+	}
+}
+
+unsigned amd64_get_op_estimated_cost(ir_node const *const node)
+{
+	if (!is_amd64_irn(node))
+		return 1;
+
+	if (is_amd64_copyB_i(node)) {
+		unsigned const size = get_amd64_copyb_attr_const(node)->size;
+		return 20 + size * 4 / 3;
+	}
+
+	bool                            rmw;
+	amd64_insn_class_t const        cls   = get_insn_class(node, &rmw);
+	amd64_insn_cost_t  const *const insns = amd64_costs->insns;
+	unsigned                        cost  = insns[cls].latency;
+	/* memory operands delay the operation by the load */
+	if (rmw) {
+		cost += insns[AMD64_INSN_LOAD].latency
+		      + insns[AMD64_INSN_STORE].latency;
+	} else if (cls != AMD64_INSN_LOAD && amd64_loads(node)) {
+		cost += insns[AMD64_INSN_LOAD].latency;
+	}
+	return cost;
+}
+
+int amd64_evaluate_insn(insn_kind const kind, ir_mode const *const mode,
+                        ir_tarval *const tv)
+{
+	(void)mode;
+	(void)tv;
+	amd64_insn_cost_t const *const insns = amd64_costs->insns;
+	switch (kind) {
+	case MUL:
+		return insns[AMD64_INSN_IMUL].latency;
+	case LEA:
+		return insns[AMD64_INSN_LEA].latency;
+	case SHIFT:
+		return insns[AMD64_INSN_SHIFT].latency;
+	case ADD:
+	case SUB:
+	case ZERO:
+		return insns[AMD64_INSN_ALU].latency;
+	default:
+		return 1;
+	}
+}
+
+void amd64_init_architecture(void)
+{
+	lc_opt_entry_t *be_grp    = lc_opt_get_grp(firm_opt_get_root(), "be");
+	lc_opt_entry_t *amd64_grp = lc_opt_get_grp(be_grp, "amd64");
+	lc_opt_add_table(amd64_grp, amd64_architecture_options);
+}
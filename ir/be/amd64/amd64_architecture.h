@@ -0,0 +1,71 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       amd64 cpu variants and their instruction costs
+ */
+#ifndef FIRM_BE_AMD64_AMD64_ARCHITECTURE_H
+#define FIRM_BE_AMD64_AMD64_ARCHITECTURE_H
+
+#include "firm_types.h"
+#include "irarch.h"
+
+/** Instructions with similar costs. */
+typedef enum amd64_insn_class_t {
+	AMD64_INSN_ALU,   /**< simple integer operations and moves */
+	AMD64_INSN_SHIFT, /**< shifts */
+	AMD64_INSN_LEA,   /**< lea with a scaled index */
+	AMD64_INSN_CMOV,  /**< conditional moves */
+	AMD64_INSN_IMUL,  /**< integer multiplication */
+	AMD64_INSN_DIV,   /**< 64bit integer division */
+	AMD64_INSN_LOAD,  /**< load hitting the first level cache */
+	AMD64_INSN_STORE, /**< store, the latency is until the value gets
+	                       forwarded to a load */
+	AMD64_INSN_FADD,  /**< SSE addition, subtraction and comparison */
+	AMD64_INSN_FMUL,  /**< SSE multiplication */
+	AMD64_INSN_FDIV,  /**< SSE and x87 division */
+	AMD64_INSN_CVT,   /**< conversions involving float values */
+	AMD64_INSN_X87,   /**< x87 arithmetic */
+	AMD64_INSN_LAST = AMD64_INSN_X87
+} amd64_insn_class_t;
+
+typedef struct amd64_insn_cost_t {
+	unsigned latency;    /**< cycles until the result can be used */
+	unsigned throughput; /**< reciprocal throughput in quarter cycles */
+} amd64_insn_cost_t;
+
+typedef struct amd64_cpu_costs_t {
+	amd64_insn_cost_t insns[AMD64_INSN_LAST + 1];
+	unsigned          branch_miss; /**< cycles lost by a mispredicted branch */
+} amd64_cpu_costs_t;
+
+/** The costs of the cpu selected by the tune option. */
+extern amd64_cpu_costs_t const *amd64_costs;
+
+/** Initialize the amd64 architecture module. */
+void amd64_init_architecture(void);
+
+/** Selects the cost tables according to the current user settings. */
+void amd64_setup_cg_config(void);
+
+/**
+ * Returns the estimated cycle count of the amd64 node @p node.
+ */
+unsigned amd64_get_op_estimated_cost(ir_node const *node);
+
+/**
+ * Evaluate the costs of an instruction. Used by the irarch multiplication
+ * lowerer.
+ *
+ * @param kind   the instruction
+ * @param mode   the mode of the instruction
+ * @param tv     for MUL instruction, the multiplication constant
+ *
+ * @return the cost
+ */
+int amd64_evaluate_insn(insn_kind kind, ir_mode const *mode, ir_tarval *tv);
+
+#endif
@@ -10,6 +10,7 @@
 #include "amd64_abi.h"
 #include "amd64_bearch_t.h"
 
+#include "amd64_architecture.h"
 #include "amd64_emitter.h"
 #include "amd64_finish.h"
 #include "amd64_new_nodes.h"
@@ -27,6 +28,7 @@
 #include "gen_amd64_regalloc_if.h"
 #include "irarch.h"
 #include "ircons.h"
+#include "irdom.h"
 #include "iredges_t.h"
 #include "irgmod.h"
 #include "irgopt.h"
@@ -378,6 +380,25 @@ static void amd64_set_frame_entity(ir_node *node, ir_entity *entity,
 	attr->addr.immediate.entity = entity;
 }
 
+/**
+ * Returns the size of the spill slot read by @p node. An operation with a
+ * folded reload reads only the part of the slot it operates on, but the slot
+ * must still hold the whole register written by amd64_new_spill().
+ */
+static x86_insn_size_t get_spillslot_size(ir_node const *const node)
+{
+	amd64_addr_attr_t const *const attr = get_amd64_addr_attr_const(node);
+	if (attr->base.op_mode != AMD64_OP_REG_ADDR)
+		return attr->base.size;
+
+	amd64_binop_addr_attr_t const *const binop_attr
+		= get_amd64_binop_addr_attr_const(node);
+	arch_register_req_t const *const req
+		= arch_get_irn_register_req_in(node, binop_attr->u.reg_input);
+	return req->cls == &amd64_reg_classes[CLASS_amd64_xmm] ? X86_SIZE_128
+	                                                        : X86_SIZE_64;
+}
+
 /**
  * Collects nodes that need frame entities assigned.
  */
@@ -390,14 +411,15 @@ static void amd64_collect_frame_entity_nodes(ir_node *node, void *data)
 	amd64_addr_attr_t const *attr = get_amd64_addr_attr_const(node);
 	x86_imm32_t       const *imm  = &attr->addr.immediate;
 	if (imm->kind == X86_IMM_FRAMEENT && imm->entity == NULL) {
-		be_fec_env_t  *const env      = (be_fec_env_t*)data;
+		be_fec_env_t   *const env       = (be_fec_env_t*)data;
+		x86_insn_size_t const slot_size = get_spillslot_size(node);
 		unsigned size;
 		unsigned po2align;
-		if (attr->base.size == X86_SIZE_80) {
+		if (slot_size == X86_SIZE_80) {
 			size     = 12;
 			po2align = 2;
 		} else {
-			size     = x86_bytes_from_size(attr->base.size);
+			size     = x86_bytes_from_size(slot_size);
 			po2align = log2_floor(size);
 		}
 		be_load_needs_frame_entity(env, node, size, po2align);
@@ -422,7 +444,7 @@ static void amd64_select_instructions(ir_graph *irg)
 	be_dump(DUMP_BE, irg, "opt");
 }
 
-static void introduce_epilogue(ir_node *ret, bool omit_fp)
+static void introduce_epilogue(ir_node *ret, bool omit_fp, bool red_zone)
 {
 	ir_graph *irg      = get_irn_irg(ret);
 	ir_node  *block    = get_nodes_block(ret);
@@ -443,7 +465,7 @@ static void introduce_epilogue(ir_node *ret, bool omit_fp)
 
 		set_irn_n(ret, n_amd64_ret_mem, curr_mem);
 		set_irn_n(ret, n_rbp,           curr_bp);
-	} else {
+	} else if (!red_zone) {
 		ir_type *frame_type = get_irg_frame_type(irg);
 		unsigned frame_size = get_type_size(frame_type);
 		ir_node *incsp = amd64_new_IncSP(block, curr_sp, -(int)frame_size,
@@ -459,7 +481,8 @@ static void introduce_epilogue(ir_node *ret, bool omit_fp)
 	}
 }
 
-static void introduce_prologue(ir_graph *const irg, bool omit_fp)
+static void introduce_prologue(ir_graph *const irg, bool omit_fp,
+                               bool red_zone)
 {
 	const arch_register_t *sp         = &amd64_registers[REG_RSP];
 	const arch_register_t *bp         = &amd64_registers[REG_RBP];
@@ -485,13 +508,18 @@ static void introduce_prologue(ir_graph *const irg, bool omit_fp)
 		arch_copy_irn_out_info(curr_bp, 0, initial_bp);
 		edges_reroute_except(initial_bp, curr_bp, push);
 
+		if (red_zone) {
+			edges_reroute_except(initial_sp, curr_sp, push);
+			return;
+		}
+
 		ir_node *incsp = amd64_new_IncSP(block, curr_sp, frame_size, false);
 		sched_add_after(curr_bp, incsp);
 		edges_reroute_except(initial_sp, incsp, push);
 
 		/* make sure the initial IncSP is really used by someone */
 		be_keep_if_unused(incsp);
-	} else {
+	} else if (!red_zone) {
 		ir_node *const incsp = amd64_new_IncSP(block, initial_sp,
 		                                       frame_size, false);
 		sched_add_after(start, incsp);
@@ -499,15 +527,47 @@ static void introduce_prologue(ir_graph *const irg, bool omit_fp)
 	}
 }
 
-static void introduce_prologue_epilogue(ir_graph *irg, bool omit_fp)
+/**
+ * Introduces the prologue and epilogues. With @p red_zone the frame is kept
+ * below the stack pointer without adjusting it.
+ */
+static void introduce_prologue_epilogue(ir_graph *irg, bool omit_fp,
+                                        bool red_zone)
 {
 	/* introduce epilogue for every return node */
 	foreach_irn_in(get_irg_end_block(irg), i, ret) {
 		assert(is_amd64_ret(ret));
-		introduce_epilogue(ret, omit_fp);
+		introduce_epilogue(ret, omit_fp, red_zone);
 	}
 
-	introduce_prologue(irg, omit_fp);
+	introduce_prologue(irg, omit_fp, red_zone);
+}
+
+static void check_red_zone(ir_node *node, void *env)
+{
+	/* calls and pushes write below the stack pointer */
+	if (be_is_IncSP(node) || is_amd64_call(node) || is_amd64_push_am(node)
+	 || is_amd64_push_reg(node) || is_amd64_sub_sp(node)) {
+		bool *can_use_red_zone = (bool*)env;
+		*can_use_red_zone = false;
+	}
+}
+
+/**
+ * Checks whether the frame of @p irg fits into the red zone, the area below
+ * the stack pointer, which signal handlers leave alone. This requires that
+ * the function itself never writes below the stack pointer.
+ */
+static bool can_use_red_zone(ir_graph *const irg)
+{
+	if (amd64_no_red_zone || ir_platform.amd64_x64abi)
+		return false;
+	if (get_type_size(get_irg_frame_type(irg)) > AMD64_RED_ZONE_SIZE)
+		return false;
+
+	bool can_use_red_zone = true;
+	irg_walk_graph(irg, check_red_zone, NULL, &can_use_red_zone);
+	return can_use_red_zone;
 }
 
 static bool node_has_sp_base(ir_node const *const node,
@@ -562,6 +622,8 @@ static void amd64_sp_sim(ir_node *const node, stack_pointer_state_t *state)
 	} else if (is_amd64_push_reg(node)) {
 		/* 64-bit register size */
 		state->offset       += AMD64_REGISTER_SIZE;
+	} else if (is_amd64_pop_reg(node)) {
+		state->offset       -= AMD64_REGISTER_SIZE;
 	} else if (is_amd64_leave(node)) {
 		state->offset        = 0;
 		state->align_padding = 0;
@@ -587,9 +649,9 @@ int amd64_get_sp_change(ir_node *const node)
 /**
  * Called immediately before emit phase.
  */
-static void amd64_finish_and_emit(ir_graph *irg)
+static void amd64_before_emit(ir_graph *irg)
 {
-	amd64_irg_data_t const *const irg_data = amd64_get_irg_data(irg);
+	amd64_irg_data_t       *const irg_data = amd64_get_irg_data(irg);
 	bool                    const omit_fp  = irg_data->omit_fp;
 
 	/* create and coalesce frame entities */
@@ -606,7 +668,9 @@ static void amd64_finish_and_emit(ir_graph *irg)
 
 	irg_block_walk_graph(irg, NULL, amd64_after_ra_walker, NULL);
 
-	introduce_prologue_epilogue(irg, omit_fp);
+	bool const red_zone = can_use_red_zone(irg);
+	irg_data->red_zone = red_zone;
+	introduce_prologue_epilogue(irg, omit_fp, red_zone);
 
 	/* fix stack entity offsets */
 	be_fix_stack_nodes(irg, &amd64_registers[REG_RSP]);
@@ -620,11 +684,6 @@ static void amd64_finish_and_emit(ir_graph *irg)
 	amd64_simulate_graph_x87(irg);
 
 	amd64_peephole_optimization(irg);
-
-	/* emit code */
-	be_timer_push(T_EMIT);
-	amd64_emit_function(irg);
-	be_timer_pop(T_EMIT);
 }
 
 static void amd64_finish(void)
@@ -632,13 +691,121 @@ static void amd64_finish(void)
 	amd64_free_opcodes();
 }
 
-static const regalloc_if_t amd64_regalloc_if = {
-	.spill_cost  = 7,
-	.reload_cost = 5,
-	.new_spill   = amd64_new_spill,
-	.new_reload  = amd64_new_reload,
+/**
+ * Checks whether the reload at input @p i of @p node can be replaced by a
+ * memory operand of @p node.
+ */
+static bool amd64_possible_memory_operand(ir_node const *const node,
+                                          unsigned const i)
+{
+	if (!is_amd64_irn(node))
+		return false;
+
+	switch ((amd64_opcodes)get_amd64_irn_opcode(node)) {
+	case iro_amd64_add:
+	case iro_amd64_and:
+	case iro_amd64_cmp:
+	case iro_amd64_imul:
+	case iro_amd64_or:
+	case iro_amd64_sub:
+	case iro_amd64_test:
+	case iro_amd64_xor:
+	/* only scalar SSE operations, packed ones require aligned memory */
+	case iro_amd64_adds:
+	case iro_amd64_muls:
+	case iro_amd64_subs:
+	case iro_amd64_ucomis:
+		break;
+	default:
+		return false;
+	}
+
+	if (get_amd64_attr_const(node)->op_mode != AMD64_OP_REG_REG)
+		return false;
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	if (i != attr->u.reg_input) {
+		/* the reload is the destination operand, swap the operands */
+		if (!(arch_get_irn_flags(node) & amd64_arch_irn_flag_commutative_binop)
+		 && !is_amd64_test(node))
+			return false;
+		assert(i == attr->base.addr.base_input);
+	}
+
+	ir_node const *const load = get_Proj_pred(get_irn_n(node, i));
+	return is_amd64_mov_gp(load) || is_amd64_movdqu(load);
+}
+
+static void amd64_perform_memory_operand(ir_node *const node, unsigned const i)
+{
+	if (!amd64_possible_memory_operand(node, i))
+		return;
+
+	amd64_binop_addr_attr_t *const attr  = get_amd64_binop_addr_attr(node);
+	ir_node                 *const op    = get_irn_n(node, i);
+	ir_node                 *const load  = get_Proj_pred(op);
+	unsigned                 const other = i == attr->u.reg_input
+		? attr->base.addr.base_input : attr->u.reg_input;
+	x86_addr_t const *const load_addr = &get_amd64_addr_attr_const(load)->addr;
+	ir_node          *const in[]      = {
+		get_irn_n(node, other),
+		get_irn_n(load, load_addr->base_input),
+		get_irn_n(load, load_addr->mem_input),
+	};
+	bool const is_xmm = arch_get_irn_register_req_in(node, other)->cls
+	                 == &amd64_reg_classes[CLASS_amd64_xmm];
+	set_irn_in(node, ARRAY_SIZE(in), in);
+	arch_set_irn_register_reqs_in(node, is_xmm ? xmm_reg_mem_reqs
+	                                           : gp_am_reqs[2]);
+
+	attr->base.base.op_mode = AMD64_OP_REG_ADDR;
+	attr->base.addr         = (x86_addr_t) {
+		.immediate.kind = X86_IMM_FRAMEENT,
+		.variant        = X86_ADDR_BASE,
+		.base_input     = 1,
+		.mem_input      = 2,
+	};
+	attr->u.reg_input = 0;
+
+	/* kill the reload */
+	assert(get_irn_n_edges(op) == 0);
+	assert(get_irn_n_edges(load) == 1);
+	sched_remove(load);
+	kill_node(op);
+	kill_node(load);
+}
+
+/* the spill and reload costs are set by amd64_init() */
+static regalloc_if_t amd64_regalloc_if = {
+	.new_spill              = amd64_new_spill,
+	.new_reload             = amd64_new_reload,
+	.perform_memory_operand = amd64_perform_memory_operand,
 };
 
+static bool lower_for_emit(ir_graph *const irg, unsigned *const sp_is_non_ssa)
+{
+	if (!be_step_first(irg))
+		return false;
+
+	struct obstack *obst = be_get_be_obst(irg);
+	be_birg_from_irg(irg)->isa_link = OALLOCZ(obst, amd64_irg_data_t);
+
+	be_birg_from_irg(irg)->non_ssa_regs = sp_is_non_ssa;
+	amd64_select_instructions(irg);
+
+	be_step_schedule(irg);
+
+	be_timer_push(T_RA_PREPARATION);
+	be_sched_fix_flags(irg, &amd64_reg_classes[CLASS_amd64_flags], NULL,
+	                   NULL, NULL);
+	be_timer_pop(T_RA_PREPARATION);
+
+	be_step_regalloc(irg, &amd64_regalloc_if);
+
+	amd64_before_emit(irg);
+	return true;
+}
+
 static void amd64_generate_code(FILE *output, const char *cup_name)
 {
 	amd64_constants = pmap_create();
@@ -647,31 +814,49 @@ static void amd64_generate_code(FILE *output, const char *cup_name)
 	rbitset_set(sp_is_non_ssa, REG_RSP);
 
 	foreach_irp_irg(i, irg) {
-		if (!be_step_first(irg))
+		if (!lower_for_emit(irg, sp_is_non_ssa))
 			continue;
 
-		struct obstack *obst = be_get_be_obst(irg);
-		be_birg_from_irg(irg)->isa_link = OALLOCZ(obst, amd64_irg_data_t);
+		be_timer_push(T_EMIT);
+		if (be_options.emit_object) {
+			amd64_emit_object_function(irg);
+		} else {
+			amd64_emit_function(irg);
+		}
+		be_timer_pop(T_EMIT);
 
-		be_birg_from_irg(irg)->non_ssa_regs = sp_is_non_ssa;
-		amd64_select_instructions(irg);
+		be_step_last(irg);
+	}
 
-		be_step_schedule(irg);
+	be_finish();
+	pmap_destroy(amd64_constants);
+}
 
-		be_timer_push(T_RA_PREPARATION);
-		be_sched_fix_flags(irg, &amd64_reg_classes[CLASS_amd64_flags], NULL,
-		                   NULL, NULL);
-		be_timer_pop(T_RA_PREPARATION);
+static ir_jit_function_t *amd64_jit_compile(ir_jit_segment_t *const segment,
+                                            ir_graph *const irg)
+{
+	unsigned *const sp_is_non_ssa = rbitset_alloca(N_AMD64_REGISTERS);
+	rbitset_set(sp_is_non_ssa, REG_RSP);
 
-		be_step_regalloc(irg, &amd64_regalloc_if);
+	/* The code may end up anywhere in the address space, so reference
+	 * everything relative to the instruction pointer. */
+	be_pic_style_t const pic_style = ir_platform.pic_style;
+	if (pic_style == BE_PIC_NONE)
+		ir_platform.pic_style = BE_PIC_ELF_PLT;
+	amd64_constants = pmap_create();
 
-		amd64_finish_and_emit(irg);
+	ir_jit_function_t *res = NULL;
+	if (lower_for_emit(irg, sp_is_non_ssa)) {
+		be_timer_push(T_EMIT);
+		res = amd64_emit_jit(segment, irg);
+		be_timer_pop(T_EMIT);
 
 		be_step_last(irg);
 	}
 
-	be_finish();
 	pmap_destroy(amd64_constants);
+	ir_platform.pic_style = pic_style;
+	return res;
 }
 
 static const ir_settings_arch_dep_t amd64_arch_dep = {
@@ -683,7 +868,7 @@ static const ir_settings_arch_dep_t amd64_arch_dep = {
 	.also_use_subs        = true,
 	.maximum_shifts       = 4,
 	.highest_shift_amount = 63,
-	.evaluate             = NULL,
+	.evaluate             = amd64_evaluate_insn,
 	.max_bits_for_mulh    = 32,
 };
 
@@ -731,8 +916,9 @@ static void amd64_lower_for_target(void)
 		be_after_transform(irg, "lower-copyb");
 	}
 
-	ir_builtin_kind supported[6];
+	ir_builtin_kind supported[7];
 	size_t  s = 0;
+	supported[s++] = ir_bk_prefetch;
 	supported[s++] = ir_bk_ffs;
 	supported[s++] = ir_bk_clz;
 	supported[s++] = ir_bk_ctz;
@@ -755,8 +941,99 @@ static void amd64_init_types(void)
 	ir_platform.va_list_type = amd64_build_va_list_type();
 }
 
+/**
+ * Returns the instruction class of the instruction the firm node @p node
+ * becomes.
+ */
+static amd64_insn_class_t get_speculated_insn_class(ir_node const *const node)
+{
+	ir_mode *const mode = get_irn_mode(node);
+	if (is_Conv(node)) {
+		ir_mode *const op_mode = get_irn_mode(get_Conv_op(node));
+		return mode_is_float(mode) || mode_is_float(op_mode)
+		     ? AMD64_INSN_CVT : AMD64_INSN_ALU;
+	}
+	if (mode == x86_mode_E)
+		return AMD64_INSN_X87;
+	if (mode_is_float(mode))
+		return is_Mul(node) ? AMD64_INSN_FMUL : AMD64_INSN_FADD;
+
+	switch (get_irn_opcode(node)) {
+	case iro_Mul:
+	case iro_Mulh:
+		return AMD64_INSN_IMUL;
+	case iro_Shl:
+	case iro_Shr:
+	case iro_Shrs:
+		return AMD64_INSN_SHIFT;
+	default:
+		return AMD64_INSN_ALU;
+	}
+}
+
+/**
+ * Checks whether computing @p node before the branch on a compare in
+ * @p sel_block stays within @p budget.
+ */
+static bool is_speculation_cheap(ir_node const *const node,
+                                 ir_node const *const sel_block,
+                                 int *const budget)
+{
+	if (is_irn_constlike(node))
+		return true;
+	ir_node  *const block = get_nodes_block(node);
+	ir_graph *const irg   = get_irn_irg(node);
+	if (block == sel_block
+	 || (irg_has_properties(irg, IR_GRAPH_PROPERTY_CONSISTENT_DOMINANCE)
+	  && block_dominates(block, sel_block)))
+		return true;
+
+	/* no Phis and no results of memory accesses, calls or divisions, which
+	 * could trap */
+	if (is_Phi(node) || is_Proj(node) || get_irn_mode(node) == mode_T)
+		return false;
+
+	amd64_insn_class_t const cls = get_speculated_insn_class(node);
+	*budget -= amd64_costs->insns[cls].throughput;
+	if (*budget < 0)
+		return false;
+	foreach_irn_in(node, i, pred) {
+		if (!is_speculation_cheap(pred, sel_block, budget))
+			return false;
+	}
+	return true;
+}
+
+static int amd64_is_mux_allowed(ir_node const *const sel,
+                                ir_node const *const mux_false,
+                                ir_node const *const mux_true)
+{
+	/* middleend can handle some things */
+	if (ir_is_optimizable_mux(sel, mux_false, mux_true))
+		return true;
+
+	/* we can handle cmov and setcc for general purpose values */
+	ir_mode *const mode = get_irn_mode(mux_true);
+	if (get_mode_arithmetic(mode) != irma_twos_complement
+	 || get_mode_size_bits(mode) > 64 || !is_Cmp(sel))
+		return false;
+	/* the x87 simulator might swap the operands of the compare, which changes
+	 * the treatment of unordered results */
+	if (get_irn_mode(get_Cmp_left(sel)) == x86_mode_E)
+		return false;
+
+	/* the instructions, which get executed regardless of the condition, may
+	 * occupy the execution units for an eighth of the cycles lost by a
+	 * mispredicted branch (the throughput is given in quarter cycles) */
+	int            budget    = amd64_costs->branch_miss / 2;
+	ir_node *const sel_block = get_nodes_block(sel);
+	return is_speculation_cheap(mux_true, sel_block, &budget)
+	    && is_speculation_cheap(mux_false, sel_block, &budget);
+}
+
 static void amd64_init(void)
 {
+	amd64_setup_cg_config();
 	amd64_init_types();
 	amd64_register_init();
 	amd64_create_opcodes();
@@ -765,13 +1042,16 @@ static void amd64_init(void)
 
 	ir_target.experimental = "the amd64 backend is experimental and unfinished (consider the ia32 backend)";
 	ir_target.fast_unaligned_memaccess = true;
+	ir_target.allow_ifconv             = amd64_is_mux_allowed;
 	ir_target.float_int_overflow       = ir_overflow_indefinite;
-}
-
-static unsigned amd64_get_op_estimated_cost(const ir_node *node)
-{
-	(void)node;/* TODO */
-	return 1;
+	ir_target.prefetch_distance        = 256;
+	ir_target.data_cache_size          = 32 * 1024;
+
+	/* the spiller compares these with the estimated costs of rematerializing
+	 * a value */
+	amd64_insn_cost_t const *const insns = amd64_costs->insns;
+	amd64_regalloc_if.reload_cost = insns[AMD64_INSN_LOAD].latency + 1;
+	amd64_regalloc_if.spill_cost  = insns[AMD64_INSN_STORE].latency + 2;
 }
 
 /** we don't have a concept of aliasing registers, so enumerate them
@@ -810,6 +1090,11 @@ arch_isa_if_t const amd64_isa_if = {
 	.init                  = amd64_init,
 	.finish                = amd64_finish,
 	.generate_code         = amd64_generate_code,
+	.jit_compile           = amd64_jit_compile,
+	.emit_function         = amd64_emit_jit_function,
+	.jit_relocation_size   = amd64_get_jit_relocation_size,
+	.elf_target            = &amd64_elf_target,
+	.jit_stubs             = &amd64_jit_stubs,
 	.lower_for_target      = amd64_lower_for_target,
 	.additional_reg_names  = amd64_additional_reg_names,
 	.handle_intrinsics     = amd64_handle_intrinsics,
@@ -820,12 +1105,13 @@ BE_REGISTER_MODULE_CONSTRUCTOR(be_init_arch_amd64)
 void be_init_arch_amd64(void)
 {
 	static const lc_opt_table_entry_t options[] = {
-		LC_OPT_ENT_BOOL("no-red-zone", "gcc compatibility",                &amd64_use_red_zone),
+		LC_OPT_ENT_BOOL("no-red-zone", "gcc compatibility",                &amd64_no_red_zone),
 		LC_OPT_LAST
 	};
 	lc_opt_entry_t *be_grp    = lc_opt_get_grp(firm_opt_get_root(), "be");
 	lc_opt_entry_t *amd64_grp = lc_opt_get_grp(be_grp, "amd64");
 	lc_opt_add_table(amd64_grp, options);
 
+	amd64_init_architecture();
 	amd64_init_transform();
 }
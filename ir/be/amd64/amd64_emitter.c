@@ -620,8 +620,8 @@ static void emit_amd64_jmp_switch(const ir_node *node)
 	be_emit_jump_table(node, &attr->swtch, entry_mode, emit_jumptable_target);
 }
 
-static x86_condition_code_t determine_final_cc(ir_node const *const flags,
-                                               x86_condition_code_t cc)
+x86_condition_code_t amd64_determine_final_cc(ir_node const *const flags,
+                                              x86_condition_code_t cc)
 {
 	if (is_amd64_fucomi(flags)) {
 		amd64_x87_attr_t const *const attr = get_amd64_x87_attr_const(flags);
@@ -631,6 +631,29 @@ static x86_condition_code_t determine_final_cc(ir_node const *const flags,
 	return cc;
 }
 
+arch_register_t const *amd64_get_cmov_source(ir_node const *const node,
+                                             x86_condition_code_t *const cc)
+{
+	arch_register_t const *const out
+		= arch_get_irn_register_out(node, pn_amd64_cmovcc_res);
+	arch_register_t const *const val_true
+		= arch_get_irn_register_in(node, n_amd64_cmovcc_val_true);
+	*cc = get_amd64_cc_attr_const(node)->cc;
+	if (val_true == out) {
+		/* the true value is already in place, move the false value */
+		*cc = x86_negate_condition_code(*cc);
+		return arch_get_irn_register_in(node, n_amd64_cmovcc_val_false);
+	}
+	return val_true;
+}
+
+static void emit_amd64_cmovcc(const ir_node *node)
+{
+	x86_condition_code_t         cc;
+	arch_register_t const *const src = amd64_get_cmov_source(node, &cc);
+	amd64_emitf(node, "cmov%PX %R, %D0", (int)cc, src);
+}
+
 /**
  * Emit a Compare with conditional branch.
  */
@@ -638,7 +661,7 @@ static void emit_amd64_jcc(const ir_node *irn)
 {
 	const ir_node         *flags = get_irn_n(irn, n_amd64_jcc_flags);
 	const amd64_cc_attr_t *attr  = get_amd64_cc_attr_const(irn);
-	x86_condition_code_t   cc    = determine_final_cc(flags, attr->cc);
+	x86_condition_code_t   cc    = amd64_determine_final_cc(flags, attr->cc);
 
 	be_cond_branch_projs_t projs = be_get_cond_branch_projs(irn);
 
@@ -790,6 +813,7 @@ static void amd64_register_emitters(void)
 	/* register all emitter functions defined in spec */
 	amd64_register_spec_emitters();
 
+	be_set_emitter(op_amd64_cmovcc,     emit_amd64_cmovcc);
 	be_set_emitter(op_amd64_jcc,        emit_amd64_jcc);
 	be_set_emitter(op_amd64_jmp,        emit_amd64_jmp);
 	be_set_emitter(op_amd64_jmp_switch, emit_amd64_jmp_switch);
@@ -835,6 +859,23 @@ static void amd64_gen_block(ir_node *block)
 	}
 }
 
+/**
+ * Emits the initial call frame information of a function (part).
+ */
+static void amd64_emit_callframe(void)
+{
+	if (omit_fp) {
+		be_dwarf_callframe_register(&amd64_registers[REG_RSP]);
+	} else {
+		/* well not entirely correct here, we should emit this after the
+		 * "movq rsp, rbp" */
+		be_dwarf_callframe_register(&amd64_registers[REG_RBP]);
+		/* TODO: do not hardcode the following */
+		be_dwarf_callframe_offset(16);
+		be_dwarf_callframe_spilloffset(&amd64_registers[REG_RBP], -16);
+	}
+}
+
 void amd64_emit_function(ir_graph *irg)
 {
 	ir_entity *entity = get_irg_entity(irg);
@@ -842,35 +883,43 @@ void amd64_emit_function(ir_graph *irg)
 	/* register all emitter functions */
 	amd64_register_emitters();
 
-	ir_node **blk_sched = be_create_block_schedule(irg);
+	size_t    n_hot;
+	ir_node **blk_sched = be_create_block_schedule(irg, &n_hot);
+	size_t    n_blocks  = ARR_LEN(blk_sched);
 
 	be_gas_emit_function_prolog(entity, 4, NULL);
 
 	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
 
 	be_emit_init_cf_links(blk_sched);
+	/* there is no fallthrough into the cold part */
+	if (n_hot < n_blocks)
+		set_irn_link(blk_sched[n_hot], NULL);
 
 	amd64_irg_data_t const *const irg_data = amd64_get_irg_data(irg);
 	omit_fp = irg_data->omit_fp;
 
 	if (omit_fp) {
+		/* the stack pointer does not move for a frame in the red zone */
 		ir_type *frame_type = get_irg_frame_type(irg);
-		frame_type_size = get_type_size(frame_type);
-		be_dwarf_callframe_register(&amd64_registers[REG_RSP]);
-	} else {
-		/* well not entirely correct here, we should emit this after the
-		 * "movq rsp, rbp" */
-		be_dwarf_callframe_register(&amd64_registers[REG_RBP]);
-		/* TODO: do not hardcode the following */
-		be_dwarf_callframe_offset(16);
-		be_dwarf_callframe_spilloffset(&amd64_registers[REG_RBP], -16);
+		frame_type_size = irg_data->red_zone ? 0 : get_type_size(frame_type);
 	}
+	amd64_emit_callframe();
 
-	for (size_t i = 0, n = ARR_LEN(blk_sched); i < n; ++i) {
+	for (size_t i = 0; i < n_hot; ++i) {
 		ir_node *block = blk_sched[i];
 		amd64_gen_block(block);
 	}
-	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
-
 	be_gas_emit_function_epilog(entity);
+
+	if (n_hot < n_blocks) {
+		be_gas_emit_cold_function_prolog(entity);
+		amd64_emit_callframe();
+		for (size_t i = n_hot; i < n_blocks; ++i) {
+			ir_node *block = blk_sched[i];
+			amd64_gen_block(block);
+		}
+		be_gas_emit_cold_function_epilog(entity);
+	}
+	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
 }
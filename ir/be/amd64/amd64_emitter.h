@@ -10,7 +10,10 @@
 #ifndef FIRM_BE_AMD64_AMD64_EMITTER_H
 #define FIRM_BE_AMD64_AMD64_EMITTER_H
 
+#include "amd64_encode.h"
+#include "be_types.h"
 #include "firm_types.h"
+#include "../ia32/x86_node.h"
 
 /**
  * fmt  parameter               output
@@ -28,4 +31,18 @@ void amd64_emitf(ir_node const *node, char const *fmt, ...);
 
 void amd64_emit_function(ir_graph *irg);
 
+/**
+ * Returns the condition code to test for a branch on the result of @p flags,
+ * which is inverted for reversed x87 comparisons.
+ */
+x86_condition_code_t amd64_determine_final_cc(ir_node const *flags,
+                                              x86_condition_code_t cc);
+
+/**
+ * Returns the register a cmovcc moves to its result and the condition code
+ * for the move in @p cc.
+ */
+arch_register_t const *amd64_get_cmov_source(ir_node const *node,
+                                             x86_condition_code_t *cc);
+
 #endif
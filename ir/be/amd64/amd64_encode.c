@@ -0,0 +1,1747 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       amd64 binary encoding/emission
+ *
+ * Jit compiled code may be placed anywhere in the address space, so all
+ * references that are not guaranteed to be in reach of a 32bit displacement
+ * go through a constant pool emitted behind the function: Float constants
+ * and jump tables are placed into the pool and called functions as well as
+ * GOT entries get a pool slot holding their 64bit absolute address.
+ *
+ * Code for object files is linked, so it references other entities directly
+ * and only jump tables are placed into the pool.
+ */
+#include "amd64_encode.h"
+
+#include "amd64_bearch_t.h"
+#include "amd64_emitter.h"
+#include "amd64_new_nodes.h"
+#include "array.h"
+#include "bearch.h"
+#include "beblocksched.h"
+#include "beemithlp.h"
+#include "beelf.h"
+#include "begnuas.h"
+#include "bejit.h"
+#include "benode.h"
+#include "besched.h"
+#include "gen_amd64_emitter.h"
+#include "gen_amd64_regalloc_if.h"
+#include "irnodehashmap.h"
+#include "panic.h"
+#include "platform_t.h"
+#include "pmap.h"
+#include "tv_t.h"
+#include "util.h"
+#include <stdint.h>
+
+typedef enum pool_kind_t {
+	POOL_CONSTANT,   /**< initialized data of a constant entity */
+	POOL_JUMP_TABLE, /**< jump table of a switch */
+	POOL_SLOT,       /**< 64bit absolute address of an entity */
+} pool_kind_t;
+
+typedef struct pool_entry_t {
+	pool_kind_t    kind;
+	unsigned       fragment_num;
+	ir_entity     *entity;
+	ir_node const *node;         /**< the switch of a jump table */
+} pool_entry_t;
+
+static bool             for_object;    /**< encoding for an object file */
+static ir_nodehashmap_t block_fragmentnum;
+static pool_entry_t   **pool;           /**< pool entries in emission order */
+static pmap            *pool_data;      /**< entity -> data pool entry */
+static pmap            *pool_slots;     /**< entity -> address pool entry */
+static unsigned         first_pool_fragment;
+static struct obstack   pool_obst;
+
+/** REX prefix and its bits */
+enum {
+	REX   = 0x40,
+	REX_B = 0x01, /**< extension of the r/m, base or opcode register */
+	REX_X = 0x02, /**< extension of the index register */
+	REX_R = 0x04, /**< extension of the reg field */
+	REX_W = 0x08, /**< 64bit operand size */
+};
+
+/** The mod encoding of the ModR/M */
+enum Mod {
+	MOD_IND          = 0x00, /**< [reg1] */
+	MOD_IND_BYTE_OFS = 0x40, /**< [reg1 + byte ofs] */
+	MOD_IND_WORD_OFS = 0x80, /**< [reg1 + word ofs] */
+	MOD_REG          = 0xC0  /**< reg1 */
+};
+
+typedef enum enc_flags_t {
+	ENC_NONE = 0,
+	ENC_W    = 1U << 0, /**< 64bit operand size */
+	ENC_REG8 = 1U << 1, /**< the reg field is an 8bit register */
+	ENC_RM8  = 1U << 2, /**< the r/m field is an 8bit register */
+} enc_flags_t;
+ENUM_BITSET(enc_flags_t)
+
+/** create R/M encoding for ModR/M */
+static uint8_t ENC_RM(unsigned const regnum)
+{
+	return regnum & 0x07;
+}
+
+/** create REG encoding for ModR/M */
+static uint8_t ENC_REG(unsigned const regnum)
+{
+	return (regnum & 0x07) << 3;
+}
+
+/** create encoding for a SIB byte */
+static uint8_t ENC_SIB(uint8_t scale, uint8_t index, uint8_t base)
+{
+	return scale << 6 | (index & 0x07) << 3 | (base & 0x07);
+}
+
+static bool is_8bit_val(int64_t const v)
+{
+	return -128 <= v && v < 128;
+}
+
+/**
+ * Without a REX prefix the 8bit registers 4-7 are ah, ch, dh and bh instead
+ * of spl, bpl, sil and dil.
+ */
+static bool needs_rex8(unsigned const regnum)
+{
+	return 4 <= regnum && regnum < 8;
+}
+
+static enc_flags_t get_size_flags(x86_insn_size_t const size)
+{
+	switch (size) {
+	case X86_SIZE_8:  return ENC_REG8 | ENC_RM8;
+	case X86_SIZE_64: return ENC_W;
+	case X86_SIZE_16:
+	case X86_SIZE_32:
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	return ENC_NONE;
+}
+
+static uint8_t get_size_prefix(x86_insn_size_t const size)
+{
+	return size == X86_SIZE_16 ? 0x66 : 0;
+}
+
+/** Emits opcodes of up to 3 bytes, most significant byte first. */
+static void enc_opcode(unsigned const opcode)
+{
+	if (opcode > 0xFFFF)
+		be_emit8(opcode >> 16);
+	if (opcode > 0xFF)
+		be_emit8(opcode >> 8);
+	be_emit8(opcode);
+}
+
+static void enc_rex(unsigned const bits, bool const force)
+{
+	if (bits != 0 || force)
+		be_emit8(REX | bits);
+}
+
+static void enc_segment(x86_segment_selector_t const segment)
+{
+	switch (segment) {
+	case X86_SEGMENT_DEFAULT:               return;
+	case X86_SEGMENT_CS:      be_emit8(0x2E); return;
+	case X86_SEGMENT_SS:      be_emit8(0x36); return;
+	case X86_SEGMENT_DS:      be_emit8(0x3E); return;
+	case X86_SEGMENT_ES:      be_emit8(0x26); return;
+	case X86_SEGMENT_FS:      be_emit8(0x64); return;
+	case X86_SEGMENT_GS:      be_emit8(0x65); return;
+	}
+	panic("invalid segment");
+}
+
+static pool_entry_t *new_pool_entry(pool_kind_t const kind,
+                                    ir_entity *const entity)
+{
+	pool_entry_t *const entry = OALLOCZ(&pool_obst, pool_entry_t);
+	entry->kind         = kind;
+	entry->entity       = entity;
+	entry->fragment_num = first_pool_fragment + ARR_LEN(pool);
+	ARR_APP1(pool_entry_t*, pool, entry);
+	return entry;
+}
+
+/** Returns the pool slot holding the address of @p entity. */
+static pool_entry_t const *get_pool_slot(ir_entity *const entity)
+{
+	pool_entry_t *entry = pmap_get(pool_entry_t, pool_slots, entity);
+	if (entry == NULL) {
+		entry = new_pool_entry(POOL_SLOT, entity);
+		pmap_insert(pool_slots, entity, entry);
+	}
+	return entry;
+}
+
+/**
+ * Emit a 32bit relocation for @p imm. @p adjust is added to the offset, so
+ * PC relative relocations can account for the bytes following them.
+ */
+static void enc_relocation(x86_imm32_t const *const imm, int32_t const adjust)
+{
+	ir_entity *entity = imm->entity;
+	int32_t    offset = imm->offset + adjust;
+	if (entity == NULL) {
+		be_emit32(offset);
+		return;
+	}
+
+	x86_immediate_kind_t kind = imm->kind;
+	pool_entry_t const  *entry;
+	if (kind == X86_IMM_GOTPCREL && !for_object) {
+		/* the pool slot serves as GOT entry */
+		entry = get_pool_slot(entity);
+		kind  = X86_IMM_PCREL;
+	} else {
+		entry = pmap_get(pool_entry_t, pool_data, entity);
+	}
+
+	if (entry != NULL) {
+		be_emit_reloc_fragment(4, kind, entry->fragment_num, offset);
+	} else {
+		be_emit_reloc_entity(4, kind, entity, offset);
+	}
+}
+
+static void enc_imm(x86_imm32_t const *const imm, unsigned const imm_size)
+{
+	switch (imm_size) {
+	case 1: be_emit8(imm->offset);     return;
+	case 2: be_emit16(imm->offset);    return;
+	case 4: enc_relocation(imm, 0);    return;
+	}
+	panic("invalid immediate size");
+}
+
+static unsigned get_imm_size(x86_insn_size_t const size)
+{
+	switch (size) {
+	case X86_SIZE_8:  return 1;
+	case X86_SIZE_16: return 2;
+	case X86_SIZE_32:
+	case X86_SIZE_64: return 4;
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("invalid immediate size");
+}
+
+/**
+ * Emits the destination of a jump, whose opcode has @p long_opcode_len bytes.
+ * The jump becomes @p short_opcode with an 8bit displacement if in reach.
+ */
+static void enc_jmp_destination(ir_node const *const cfop,
+                                uint8_t const short_opcode,
+                                unsigned const long_opcode_len)
+{
+	assert(get_irn_mode(cfop) == mode_X);
+	ir_node const *const dest_block = be_emit_get_cfop_target(cfop);
+	unsigned const fragment_num
+		= PTR_TO_INT(ir_nodehashmap_get(void, &block_fragmentnum, dest_block));
+	be_emit_reloc_jump(X86_IMM_PCREL, fragment_num, short_opcode,
+	                   long_opcode_len);
+}
+
+/* end emit routines, all emitters following here should only use the functions
+   above. */
+
+/**
+ * Emit an instruction with register operands in the reg and r/m field.
+ *
+ * @param reg  register number or opcode extension for the reg field
+ */
+static void enc_op_rr(uint8_t const prefix, unsigned const opcode,
+                      enc_flags_t const flags, unsigned const reg,
+                      arch_register_t const *const rm)
+{
+	unsigned const rm_enc = rm->encoding;
+	if (prefix != 0)
+		be_emit8(prefix);
+	unsigned bits = 0;
+	if (flags & ENC_W)
+		bits |= REX_W;
+	if (reg & 0x08)
+		bits |= REX_R;
+	if (rm_enc & 0x08)
+		bits |= REX_B;
+	bool const force = ((flags & ENC_REG8) && needs_rex8(reg))
+	                || ((flags & ENC_RM8) && needs_rex8(rm_enc));
+	enc_rex(bits, force);
+	enc_opcode(opcode);
+	be_emit8(MOD_REG | ENC_REG(reg) | ENC_RM(rm_enc));
+}
+
+static unsigned get_base_encoding(ir_node const *const node,
+                                  x86_addr_t const *const addr)
+{
+	return arch_get_irn_register_in(node, addr->base_input)->encoding;
+}
+
+static unsigned get_index_encoding(ir_node const *const node,
+                                   x86_addr_t const *const addr)
+{
+	return arch_get_irn_register_in(node, addr->index_input)->encoding;
+}
+
+/**
+ * Emit the ModR/M byte, SIB byte and displacement of a memory operand.
+ *
+ * @param reg       content of the reg field: either a register number or an
+ *                  opcode extension
+ * @param imm_size  number of immediate bytes following the displacement
+ */
+static void enc_mod_am(unsigned const reg, ir_node const *const node,
+                       x86_addr_t const *const addr, unsigned const imm_size)
+{
+	x86_imm32_t const *const imm     = &addr->immediate;
+	x86_addr_variant_t const variant = addr->variant;
+	if (variant == X86_ADDR_RIP) {
+		/* displacement is relative to the end of the instruction */
+		be_emit8(MOD_IND | ENC_REG(reg) | ENC_RM(0x05));
+		enc_relocation(imm, -4 - (int32_t)imm_size);
+		return;
+	}
+
+	/* set the mod part depending on displacement */
+	unsigned modrm    = 0;
+	unsigned emitoffs = 0;
+	if (imm->entity) {
+		modrm   |= MOD_IND_WORD_OFS;
+		emitoffs = 32;
+	} else if (imm->offset == 0) {
+		modrm   |= MOD_IND;
+		emitoffs = 0;
+	} else if (is_8bit_val(imm->offset)) {
+		modrm   |= MOD_IND_BYTE_OFS;
+		emitoffs = 8;
+	} else {
+		modrm   |= MOD_IND_WORD_OFS;
+		emitoffs = 32;
+	}
+
+	unsigned base_enc;
+	if (x86_addr_variant_has_base(variant)) {
+		base_enc = get_base_encoding(node, addr);
+	} else {
+		/* Use the RBP encoding + MOD_IND in the SIB byte if there is NO base
+		 * register. There is always a 32bit offset present in this case. */
+		modrm    = MOD_IND;
+		base_enc = 0x05;
+		emitoffs = 32;
+	}
+
+	/* Determine if we need a SIB byte. */
+	bool     emitsib = false;
+	unsigned sib     = 0;
+	if (x86_addr_variant_has_index(variant)) {
+		/* R/M set to RSP means SIB. */
+		modrm  |= ENC_RM(0x04);
+		sib     = ENC_SIB(addr->log_scale, get_index_encoding(node, addr),
+		                  base_enc);
+		emitsib = true;
+	} else if (!x86_addr_variant_has_base(variant)) {
+		/* an absolute address needs a SIB byte, because plain R/M RBP is RIP
+		 * relative in 64bit mode. */
+		modrm  |= ENC_RM(0x04);
+		sib     = ENC_SIB(0, 0x04, 0x05);
+		emitsib = true;
+	} else if ((base_enc & 0x07) == 0x04) {
+		/* for the above reason we are forced to emit a SIB when base is RSP
+		 * or R12. Only the base is used, index must be RSP too, which means no
+		 * index. */
+		modrm  |= ENC_RM(0x04);
+		sib     = ENC_SIB(0, 0x04, 0x04);
+		emitsib = true;
+	} else {
+		modrm |= ENC_RM(base_enc);
+	}
+
+	/* We are forced to emit an 8bit offset as RBP/R13 base without offset is
+	 * a special case for SIB without base register. */
+	if ((base_enc & 0x07) == 0x05 && emitoffs == 0) {
+		modrm    |= MOD_IND_BYTE_OFS;
+		emitoffs  = 8;
+	}
+
+	modrm |= ENC_REG(reg);
+
+	be_emit8(modrm);
+	if (emitsib)
+		be_emit8(sib);
+
+	/* emit displacement */
+	if (emitoffs == 8) {
+		be_emit8((unsigned)imm->offset);
+	} else if (emitoffs == 32) {
+		enc_relocation(imm, 0);
+	}
+}
+
+/**
+ * Emit an instruction with a register number or opcode extension @p reg in the
+ * reg field and the memory operand @p addr.
+ */
+static void enc_op_am(uint8_t const prefix, unsigned const opcode,
+                      enc_flags_t const flags, unsigned const reg,
+                      ir_node const *const node, x86_addr_t const *const addr,
+                      unsigned const imm_size)
+{
+	enc_segment(addr->segment);
+	if (prefix != 0)
+		be_emit8(prefix);
+	unsigned bits = 0;
+	if (flags & ENC_W)
+		bits |= REX_W;
+	if (reg & 0x08)
+		bits |= REX_R;
+	if (x86_addr_variant_has_base(addr->variant)
+	 && get_base_encoding(node, addr) & 0x08)
+		bits |= REX_B;
+	if (x86_addr_variant_has_index(addr->variant)
+	 && get_index_encoding(node, addr) & 0x08)
+		bits |= REX_X;
+	enc_rex(bits, (flags & ENC_REG8) && needs_rex8(reg));
+	enc_opcode(opcode);
+	enc_mod_am(reg, node, addr, imm_size);
+}
+
+/**
+ * Emit an instruction whose r/m operand is described by the address attribute
+ * of @p node, which is either a register or a memory operand.
+ */
+static void enc_op_addr(uint8_t const prefix, unsigned const opcode,
+                        enc_flags_t const flags, unsigned const reg,
+                        ir_node const *const node, unsigned const imm_size)
+{
+	x86_addr_t const *const addr = &get_amd64_addr_attr_const(node)->addr;
+	if (addr->variant == X86_ADDR_REG) {
+		arch_register_t const *const rm
+			= arch_get_irn_register_in(node, addr->base_input);
+		enc_op_rr(prefix, opcode, flags, reg, rm);
+	} else {
+		enc_op_am(prefix, opcode, flags, reg, node, addr, imm_size);
+	}
+}
+
+static arch_register_t const *get_binop_reg(ir_node const *const node)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	return arch_get_irn_register_in(node, attr->u.reg_input);
+}
+
+static void enc_mov(arch_register_t const *const src,
+                    arch_register_t const *const dst)
+{
+	enc_op_rr(0, 0x89, ENC_W, src->encoding, dst); // movq %src, %dst
+}
+
+void amd64_enc_simple(unsigned const opcode)
+{
+	enc_opcode(opcode);
+}
+
+void amd64_enc_binop(ir_node const *const node, unsigned const code)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	x86_insn_size_t const size   = attr->base.base.size;
+	uint8_t         const prefix = get_size_prefix(size);
+	enc_flags_t     const flags  = get_size_flags(size);
+	unsigned        const op     = size == X86_SIZE_8 ? 0x00 : 0x01;
+	switch ((amd64_op_mode_t)attr->base.base.op_mode) {
+	case AMD64_OP_REG_IMM:
+	case AMD64_OP_ADDR_IMM: {
+		x86_imm32_t const *const imm = &attr->u.immediate;
+		/* Try to use the short form with 8bit sign extended immediate. */
+		if (size != X86_SIZE_8 && !imm->entity && is_8bit_val(imm->offset)) {
+			enc_op_addr(prefix, 0x83, flags & ENC_W, code, node, 1);
+			enc_imm(imm, 1);
+		} else {
+			unsigned const imm_size = get_imm_size(size);
+			enc_op_addr(prefix, 0x80 | op, flags & ~ENC_REG8, code, node,
+			            imm_size);
+			enc_imm(imm, imm_size);
+		}
+		return;
+	}
+	case AMD64_OP_REG_REG: {
+		arch_register_t const *const src = arch_get_irn_register_in(node, 1);
+		enc_op_addr(prefix, code << 3 | op, flags, src->encoding, node, 0);
+		return;
+	}
+	case AMD64_OP_ADDR_REG: {
+		arch_register_t const *const src = get_binop_reg(node);
+		enc_op_addr(prefix, code << 3 | op, flags, src->encoding, node, 0);
+		return;
+	}
+	case AMD64_OP_REG_ADDR: {
+		arch_register_t const *const dst = get_binop_reg(node);
+		enc_op_addr(prefix, code << 3 | 0x02 | op, flags, dst->encoding, node,
+		            0);
+		return;
+	}
+	default:
+		break;
+	}
+	panic("invalid op_mode for binop %+F", node);
+}
+
+static void enc_test(ir_node const *const node)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	x86_insn_size_t const size   = attr->base.base.size;
+	uint8_t         const prefix = get_size_prefix(size);
+	enc_flags_t     const flags  = get_size_flags(size);
+	unsigned        const op     = size == X86_SIZE_8 ? 0x00 : 0x01;
+	switch ((amd64_op_mode_t)attr->base.base.op_mode) {
+	case AMD64_OP_REG_IMM:
+	case AMD64_OP_ADDR_IMM: {
+		/* there is no form with sign extended 8bit immediate */
+		unsigned const imm_size = get_imm_size(size);
+		enc_op_addr(prefix, 0xF6 | op, flags & ~ENC_REG8, 0, node, imm_size);
+		enc_imm(&attr->u.immediate, imm_size);
+		return;
+	}
+	case AMD64_OP_REG_REG: {
+		arch_register_t const *const src = arch_get_irn_register_in(node, 1);
+		enc_op_addr(prefix, 0x84 | op, flags, src->encoding, node, 0);
+		return;
+	}
+	case AMD64_OP_ADDR_REG:
+	case AMD64_OP_REG_ADDR: {
+		arch_register_t const *const src = get_binop_reg(node);
+		enc_op_addr(prefix, 0x84 | op, flags, src->encoding, node, 0);
+		return;
+	}
+	default:
+		break;
+	}
+	panic("invalid op_mode for test %+F", node);
+}
+
+static void enc_imul(ir_node const *const node)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	x86_insn_size_t const size   = attr->base.base.size;
+	uint8_t         const prefix = get_size_prefix(size);
+	enc_flags_t     const flags  = get_size_flags(size);
+	assert(size != X86_SIZE_8);
+	switch ((amd64_op_mode_t)attr->base.base.op_mode) {
+	case AMD64_OP_REG_IMM: {
+		/* imul $imm, %reg is imul $imm, %reg, %reg */
+		x86_addr_t const *const addr = &attr->base.addr;
+		arch_register_t const *const reg
+			= arch_get_irn_register_in(node, addr->base_input);
+		x86_imm32_t const *const imm = &attr->u.immediate;
+		if (!imm->entity && is_8bit_val(imm->offset)) {
+			enc_op_rr(prefix, 0x6B, flags, reg->encoding, reg);
+			enc_imm(imm, 1);
+		} else {
+			unsigned const imm_size = get_imm_size(size);
+			enc_op_rr(prefix, 0x69, flags, reg->encoding, reg);
+			enc_imm(imm, imm_size);
+		}
+		return;
+	}
+	case AMD64_OP_REG_REG: {
+		x86_addr_t const *const addr = &attr->base.addr;
+		arch_register_t const *const dst
+			= arch_get_irn_register_in(node, addr->base_input);
+		arch_register_t const *const src = arch_get_irn_register_in(node, 1);
+		enc_op_rr(prefix, 0x0FAF, flags, dst->encoding, src);
+		return;
+	}
+	case AMD64_OP_REG_ADDR: {
+		arch_register_t const *const dst = get_binop_reg(node);
+		enc_op_addr(prefix, 0x0FAF, flags, dst->encoding, node, 0);
+		return;
+	}
+	default:
+		break;
+	}
+	panic("invalid op_mode for imul %+F", node);
+}
+
+void amd64_enc_shiftop(ir_node const *const node, uint8_t const ext)
+{
+	amd64_shift_attr_t const *const attr = get_amd64_shift_attr_const(node);
+	x86_insn_size_t const size   = attr->base.size;
+	uint8_t         const prefix = get_size_prefix(size);
+	enc_flags_t     const flags  = get_size_flags(size) & ~ENC_REG8;
+	unsigned        const op     = size == X86_SIZE_8 ? 0x00 : 0x01;
+	arch_register_t const *const reg = arch_get_irn_register_in(node, 0);
+	switch ((amd64_op_mode_t)attr->base.op_mode) {
+	case AMD64_OP_SHIFT_IMM:
+		if (attr->immediate == 1) {
+			enc_op_rr(prefix, 0xD0 | op, flags, ext, reg);
+		} else {
+			enc_op_rr(prefix, 0xC0 | op, flags, ext, reg);
+			be_emit8(attr->immediate);
+		}
+		return;
+	case AMD64_OP_SHIFT_REG:
+		assert(arch_get_irn_register_in(node, 1)->index == REG_GP_RCX);
+		enc_op_rr(prefix, 0xD2 | op, flags, ext, reg);
+		return;
+	default:
+		break;
+	}
+	panic("invalid op_mode for shiftop %+F", node);
+}
+
+void amd64_enc_shiftop_mem(ir_node const *const node, uint8_t const ext)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	assert(attr->base.base.op_mode == AMD64_OP_ADDR_IMM);
+	x86_insn_size_t const size   = attr->base.base.size;
+	uint8_t         const prefix = get_size_prefix(size);
+	enc_flags_t     const flags  = get_size_flags(size) & ~ENC_REG8;
+	unsigned        const op     = size == X86_SIZE_8 ? 0x00 : 0x01;
+	x86_imm32_t     const *const imm = &attr->u.immediate;
+	if (imm->offset == 1) {
+		enc_op_addr(prefix, 0xD0 | op, flags, ext, node, 0);
+	} else {
+		enc_op_addr(prefix, 0xC0 | op, flags, ext, node, 1);
+		enc_imm(imm, 1);
+	}
+}
+
+void amd64_enc_unop(ir_node const *const node, uint8_t const ext)
+{
+	x86_insn_size_t const size   = get_amd64_attr_const(node)->size;
+	uint8_t         const opcode = size == X86_SIZE_8 ? 0xF6 : 0xF7;
+	enc_flags_t     const flags  = get_size_flags(size) & ~ENC_REG8;
+	enc_op_addr(get_size_prefix(size), opcode, flags, ext, node, 0);
+}
+
+void amd64_enc_unop_out(ir_node const *const node, unsigned const opcode)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_addr(get_size_prefix(size), opcode, get_size_flags(size),
+	            out->encoding, node, 0);
+}
+
+void amd64_enc_prefetch(ir_node const *const node, uint8_t const ext)
+{
+	enc_op_addr(0, 0x0F18, ENC_NONE, ext, node, 0);
+}
+
+static void enc_lea(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_addr(get_size_prefix(size), 0x8D, get_size_flags(size),
+	            out->encoding, node, 0);
+}
+
+static void enc_mov_gp(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	switch (size) {
+	case X86_SIZE_8:  enc_op_addr(0, 0x0FB6, ENC_RM8, out->encoding, node, 0); return; // movzbl
+	case X86_SIZE_16: enc_op_addr(0, 0x0FB7, ENC_NONE, out->encoding, node, 0); return; // movzwl
+	case X86_SIZE_32: enc_op_addr(0, 0x8B,   ENC_NONE, out->encoding, node, 0); return; // movl
+	case X86_SIZE_64: enc_op_addr(0, 0x8B,   ENC_W,    out->encoding, node, 0); return; // movq
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("invalid insn mode");
+}
+
+static void enc_movs(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	switch (size) {
+	case X86_SIZE_8:  enc_op_addr(0, 0x0FBE, ENC_W | ENC_RM8, out->encoding, node, 0); return; // movsbq
+	case X86_SIZE_16: enc_op_addr(0, 0x0FBF, ENC_W, out->encoding, node, 0); return; // movswq
+	case X86_SIZE_32: enc_op_addr(0, 0x63,   ENC_W, out->encoding, node, 0); return; // movslq
+	case X86_SIZE_64:
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("invalid insn mode");
+}
+
+static void enc_mov_imm(ir_node const *const node)
+{
+	amd64_movimm_attr_t const *const attr = get_amd64_movimm_attr_const(node);
+	amd64_imm64_t       const *const imm  = &attr->immediate;
+	arch_register_t     const *const out  = arch_get_irn_register_out(node, 0);
+	unsigned            const        bits = out->encoding & 0x08 ? REX_B : 0;
+	if (imm->entity != NULL) {
+		assert(imm->kind == X86_IMM_ADDR);
+		assert((int32_t)imm->offset == imm->offset);
+		if (attr->base.size == X86_SIZE_64) {
+			enc_rex(REX_W | bits, false);
+			be_emit8(0xB8 + ENC_RM(out->encoding)); // movabsq $imm, %out
+			be_emit_reloc_entity(8, AMD64_RELOCATION_ABS64, imm->entity,
+			                     imm->offset);
+		} else {
+			enc_rex(bits, false);
+			be_emit8(0xB8 + ENC_RM(out->encoding)); // movl $imm, %out
+			be_emit_reloc_entity(4, X86_IMM_ADDR, imm->entity, imm->offset);
+		}
+		return;
+	}
+
+	int64_t const val = imm->offset;
+	if (attr->base.size != X86_SIZE_64 || (uint64_t)val <= UINT32_MAX) {
+		/* 32bit moves zero extend to 64bit */
+		enc_rex(bits, false);
+		be_emit8(0xB8 + ENC_RM(out->encoding)); // movl $imm, %out
+		be_emit32(val);
+	} else if ((int32_t)val == val) {
+		enc_op_rr(0, 0xC7, ENC_W, 0, out); // movq $imm, %out
+		be_emit32(val);
+	} else {
+		enc_rex(REX_W | bits, false);
+		be_emit8(0xB8 + ENC_RM(out->encoding)); // movabsq $imm, %out
+		be_emit32(val);
+		be_emit32((uint64_t)val >> 32);
+	}
+}
+
+static void enc_mov_store(ir_node const *const node)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	x86_insn_size_t const size   = attr->base.base.size;
+	uint8_t         const prefix = get_size_prefix(size);
+	enc_flags_t     const flags  = get_size_flags(size);
+	unsigned        const op     = size == X86_SIZE_8 ? 0x00 : 0x01;
+	switch ((amd64_op_mode_t)attr->base.base.op_mode) {
+	case AMD64_OP_ADDR_REG: {
+		arch_register_t const *const src = get_binop_reg(node);
+		enc_op_addr(prefix, 0x88 | op, flags, src->encoding, node, 0);
+		return;
+	}
+	case AMD64_OP_ADDR_IMM: {
+		unsigned const imm_size = get_imm_size(size);
+		enc_op_addr(prefix, 0xC6 | op, flags & ~ENC_REG8, 0, node, imm_size);
+		enc_imm(&attr->u.immediate, imm_size);
+		return;
+	}
+	default:
+		break;
+	}
+	panic("invalid op_mode for store %+F", node);
+}
+
+static void enc_xor_0(ir_node const *const node)
+{
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_rr(0, 0x31, ENC_NONE, out->encoding, out); // xorl %out, %out
+}
+
+static void enc_setcc(ir_node const *const node)
+{
+	x86_condition_code_t const cc  = get_amd64_cc_attr_const(node)->cc;
+	arch_register_t      const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_rr(0, 0x0F90 + (cc & 0x0F), ENC_RM8, 0, out);
+}
+
+static void enc_cmovcc(ir_node const *const node)
+{
+	x86_condition_code_t         cc;
+	arch_register_t const *const src  = amd64_get_cmov_source(node, &cc);
+	arch_register_t const *const out  = arch_get_irn_register_out(node, 0);
+	x86_insn_size_t        const size = get_amd64_attr_const(node)->size;
+	enc_op_rr(0, 0x0F40 + (cc & 0x0F), get_size_flags(size), out->encoding,
+	          src);
+}
+
+static void enc_cmpxchg(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	unsigned        const op   = size == X86_SIZE_8 ? 0x00 : 0x01;
+	arch_register_t const *const reg = get_binop_reg(node);
+	be_emit8(0xF0); // lock
+	enc_op_addr(get_size_prefix(size), 0x0FB0 | op, get_size_flags(size),
+	            reg->encoding, node, 0);
+}
+
+static void enc_push_am(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	enc_op_addr(get_size_prefix(size), 0xFF, ENC_NONE, 6, node, 0);
+}
+
+static void enc_pop_am(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	enc_op_addr(get_size_prefix(size), 0x8F, ENC_NONE, 0, node, 0);
+}
+
+static void enc_push_reg(ir_node const *const node)
+{
+	arch_register_t const *const reg
+		= arch_get_irn_register_in(node, n_amd64_push_reg_val);
+	enc_rex(reg->encoding & 0x08 ? REX_B : 0, false);
+	be_emit8(0x50 + ENC_RM(reg->encoding));
+}
+
+static void enc_pop_reg(ir_node const *const node)
+{
+	arch_register_t const *const reg
+		= arch_get_irn_register_out(node, pn_amd64_pop_reg_res);
+	enc_rex(reg->encoding & 0x08 ? REX_B : 0, false);
+	be_emit8(0x58 + ENC_RM(reg->encoding));
+}
+
+static void enc_sub_sp(ir_node const *const node)
+{
+	/* subq %in, %rsp */
+	amd64_enc_binop(node, 5);
+	/* movq %rsp, %out */
+	arch_register_t const *const out
+		= arch_get_irn_register_out(node, pn_amd64_sub_sp_addr);
+	enc_mov(&amd64_registers[REG_RSP], out);
+}
+
+static void enc_jmp(ir_node const *const cfop)
+{
+	be_emit8(0xE9);
+	enc_jmp_destination(cfop, 0xEB, 1);
+}
+
+static void enc_jump(ir_node const *const node)
+{
+	if (!be_is_fallthrough(node))
+		enc_jmp(node);
+}
+
+static void enc_jcc(x86_condition_code_t const cc, ir_node const *const cfop)
+{
+	be_emit8(0x0F);
+	be_emit8(0x80 + (cc & 0x0F));
+	enc_jmp_destination(cfop, 0x70 + (cc & 0x0F), 2);
+}
+
+static void enc_jp(ir_node const *const cfop)
+{
+	be_emit8(0x0F);
+	be_emit8(0x8A);
+	enc_jmp_destination(cfop, 0x7A, 2);
+}
+
+static void enc_amd64_jcc(ir_node const *const node)
+{
+	ir_node         const *const flags = get_irn_n(node, n_amd64_jcc_flags);
+	amd64_cc_attr_t const *const attr  = get_amd64_cc_attr_const(node);
+	x86_condition_code_t         cc    = amd64_determine_final_cc(flags, attr->cc);
+
+	be_cond_branch_projs_t projs = be_get_cond_branch_projs(node);
+
+	if (be_is_fallthrough(projs.t)) {
+		/* exchange both proj's so the second one can be omitted */
+		ir_node *const t = projs.t;
+		projs.t = projs.f;
+		projs.f = t;
+		cc      = x86_negate_condition_code(cc);
+	}
+
+	if (cc & x86_cc_float_parity_cases) {
+		/* Some floating point comparisons require a test of the parity flag,
+		 * which indicates that the result is unordered */
+		if (cc & x86_cc_negated) {
+			enc_jp(projs.t);
+		} else {
+			enc_jp(projs.f);
+		}
+	}
+	enc_jcc(cc, projs.t);
+
+	/* the second Proj might be a fallthrough */
+	enc_jump(projs.f);
+}
+
+static void enc_ijmp(ir_node const *const node)
+{
+	enc_op_addr(0, 0xFF, ENC_NONE, 4, node, 0); // jmp *%AM
+}
+
+static void enc_call(ir_node const *const node)
+{
+	amd64_addr_attr_t const *const attr = get_amd64_addr_attr_const(node);
+	if (attr->base.op_mode == AMD64_OP_IMM32 && for_object) {
+		/* like the assembler, let the linker route calls through the PLT */
+		x86_imm32_t imm = attr->addr.immediate;
+		if (imm.kind == X86_IMM_PCREL)
+			imm.kind = X86_IMM_PLT;
+		be_emit8(0xE8); // call imm32
+		enc_relocation(&imm, -4);
+	} else if (attr->base.op_mode == AMD64_OP_IMM32) {
+		/* the callee may be out of reach for a 32bit displacement, so call
+		 * indirectly through its pool slot */
+		x86_imm32_t const *const imm = &attr->addr.immediate;
+		assert(imm->entity != NULL);
+		pool_entry_t const *const slot = get_pool_slot(imm->entity);
+		be_emit8(0xFF); // call *slot(%rip)
+		be_emit8(MOD_IND | ENC_REG(2) | ENC_RM(0x05));
+		be_emit_reloc_fragment(4, X86_IMM_PCREL, slot->fragment_num,
+		                       imm->offset - 4);
+	} else {
+		enc_op_addr(0, 0xFF, ENC_NONE, 2, node, 0); // call *%AM
+	}
+}
+
+static void enc_copyB_prolog(unsigned const size)
+{
+	if (size & 1)
+		be_emit8(0xA4); // movsb
+	if (size & 2) {
+		be_emit8(0x66); // movsw
+		be_emit8(0xA5);
+	}
+	if (size & 4)
+		be_emit8(0xA5); // movsd
+}
+
+static void enc_copyB(ir_node const *const node)
+{
+	unsigned const size = get_amd64_copyb_attr_const(node)->size;
+	enc_copyB_prolog(size);
+	be_emit8(0xF3); // rep movsd
+	be_emit8(0xA5);
+}
+
+static void enc_copyB_i(ir_node const *const node)
+{
+	unsigned size = get_amd64_copyb_attr_const(node)->size;
+	enc_copyB_prolog(size);
+	for (size >>= 3; size-- > 0;) {
+		be_emit8(0x48); // movsq
+		be_emit8(0xA5);
+	}
+}
+
+static void enc_jmp_switch(ir_node const *const node)
+{
+	/* the jump table has already been registered as pool entry */
+	enc_op_addr(0, 0xFF, ENC_NONE, 4, node, 0); // jmp *%AM
+}
+
+static uint8_t get_xmm_scalar_prefix(x86_insn_size_t const size)
+{
+	switch (size) {
+	case X86_SIZE_32: return 0xF3;
+	case X86_SIZE_64: return 0xF2;
+	case X86_SIZE_8:
+	case X86_SIZE_16:
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("invalid insn mode");
+}
+
+void amd64_enc_xmm_binop(ir_node const *const node, uint8_t const prefix,
+                         unsigned const opcode)
+{
+	amd64_binop_addr_attr_t const *const attr
+		= get_amd64_binop_addr_attr_const(node);
+	switch ((amd64_op_mode_t)attr->base.base.op_mode) {
+	case AMD64_OP_REG_REG: {
+		x86_addr_t const *const addr = &attr->base.addr;
+		arch_register_t const *const dst
+			= arch_get_irn_register_in(node, addr->base_input);
+		arch_register_t const *const src = arch_get_irn_register_in(node, 1);
+		enc_op_rr(prefix, opcode, ENC_NONE, dst->encoding, src);
+		return;
+	}
+	case AMD64_OP_REG_ADDR: {
+		arch_register_t const *const dst = get_binop_reg(node);
+		enc_op_addr(prefix, opcode, ENC_NONE, dst->encoding, node, 0);
+		return;
+	}
+	default:
+		break;
+	}
+	panic("invalid op_mode for xmm binop %+F", node);
+}
+
+void amd64_enc_xmm_scalar(ir_node const *const node, unsigned const opcode)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	amd64_enc_xmm_binop(node, get_xmm_scalar_prefix(size), opcode);
+}
+
+void amd64_enc_xmm_packed(ir_node const *const node, unsigned const opcode)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	amd64_enc_xmm_binop(node, size == X86_SIZE_32 ? 0 : 0x66, opcode);
+}
+
+void amd64_enc_xmm_load(ir_node const *const node, uint8_t const prefix,
+                        unsigned const opcode)
+{
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_addr(prefix, opcode, ENC_NONE, out->encoding, node, 0);
+}
+
+void amd64_enc_xmm_store(ir_node const *const node, uint8_t const prefix,
+                         unsigned const opcode)
+{
+	arch_register_t const *const src = arch_get_irn_register_in(node, 0);
+	enc_op_addr(prefix, opcode, ENC_NONE, src->encoding, node, 0);
+}
+
+void amd64_enc_cvt(ir_node const *const node, uint8_t const prefix,
+                   unsigned const opcode)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_addr(prefix, opcode, size == X86_SIZE_64 ? ENC_W : ENC_NONE,
+	            out->encoding, node, 0);
+}
+
+static void enc_movs_xmm(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	amd64_enc_xmm_load(node, get_xmm_scalar_prefix(size), 0x0F10);
+}
+
+static void enc_movs_store_xmm(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	amd64_enc_xmm_store(node, get_xmm_scalar_prefix(size), 0x0F11);
+}
+
+static void enc_movd(ir_node const *const node)
+{
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_addr(0x66, 0x0F6E, ENC_W, out->encoding, node, 0); // movq %AM, %out
+}
+
+static void enc_movd_gp_xmm(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const in  = arch_get_irn_register_in(node, 0);
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_rr(0x66, 0x0F6E, size == X86_SIZE_64 ? ENC_W : ENC_NONE,
+	          out->encoding, in);
+}
+
+static void enc_movd_xmm_gp(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	arch_register_t const *const in  = arch_get_irn_register_in(node, 0);
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_rr(0x66, 0x0F7E, size == X86_SIZE_64 ? ENC_W : ENC_NONE,
+	          in->encoding, out);
+}
+
+static void enc_xorp_0(ir_node const *const node)
+{
+	x86_insn_size_t const size   = get_amd64_attr_const(node)->size;
+	uint8_t         const prefix = size == X86_SIZE_32 ? 0 : 0x66;
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	enc_op_rr(prefix, 0x0F57, ENC_NONE, out->encoding, out);
+}
+
+void amd64_enc_fsimple(uint8_t const opcode)
+{
+	be_emit8(0xD9);
+	be_emit8(opcode);
+}
+
+void amd64_enc_fbinop(ir_node const *const node, unsigned const op_fwd,
+                      unsigned const op_rev)
+{
+	x87_attr_t const *const x87 = &get_amd64_x87_attr_const(node)->x87;
+	unsigned          const op  = x87->reverse ? op_rev : op_fwd;
+	assert(!x87->pop || x87->res_in_reg);
+
+	unsigned char op0 = 0xD8;
+	if (x87->res_in_reg) op0 |= 0x04;
+	if (x87->pop)        op0 |= 0x02;
+	be_emit8(op0);
+	be_emit8(MOD_REG | ENC_REG(op) | ENC_RM(x87->reg->encoding));
+}
+
+void amd64_enc_fop_reg(ir_node const *const node, uint8_t const op0,
+                       uint8_t const op1)
+{
+	be_emit8(op0);
+	be_emit8(op1 + get_amd64_x87_attr_const(node)->x87.reg->encoding);
+}
+
+static void enc_fld(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	switch (size) {
+	case X86_SIZE_32: enc_op_addr(0, 0xD9, ENC_NONE, 0, node, 0); return; // flds
+	case X86_SIZE_64: enc_op_addr(0, 0xDD, ENC_NONE, 0, node, 0); return; // fldl
+	case X86_SIZE_80: enc_op_addr(0, 0xDB, ENC_NONE, 5, node, 0); return; // fldt
+	case X86_SIZE_8:
+	case X86_SIZE_16:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("unexpected mode size");
+}
+
+static void enc_fild(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	switch (size) {
+	case X86_SIZE_16: enc_op_addr(0, 0xDF, ENC_NONE, 0, node, 0); return; // filds
+	case X86_SIZE_32: enc_op_addr(0, 0xDB, ENC_NONE, 0, node, 0); return; // fildl
+	case X86_SIZE_64: enc_op_addr(0, 0xDF, ENC_NONE, 5, node, 0); return; // fildll
+	case X86_SIZE_8:
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("unexpected mode size");
+}
+
+static void enc_fisttp(ir_node const *const node)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	switch (size) {
+	case X86_SIZE_16: enc_op_addr(0, 0xDF, ENC_NONE, 1, node, 0); return; // fisttps
+	case X86_SIZE_32: enc_op_addr(0, 0xDB, ENC_NONE, 1, node, 0); return; // fisttpl
+	case X86_SIZE_64: enc_op_addr(0, 0xDD, ENC_NONE, 1, node, 0); return; // fisttpll
+	case X86_SIZE_8:
+	case X86_SIZE_80:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("unexpected mode size");
+}
+
+static void enc_fst_pop(ir_node const *const node, bool const pop)
+{
+	x86_insn_size_t const size = get_amd64_attr_const(node)->size;
+	switch (size) {
+		unsigned op;
+	case X86_SIZE_32: op = pop ? 3 : 2; enc_op_addr(0, 0xD9, ENC_NONE, op, node, 0); return; // fst[p]s
+	case X86_SIZE_64: op = pop ? 3 : 2; enc_op_addr(0, 0xDD, ENC_NONE, op, node, 0); return; // fst[p]l
+	case X86_SIZE_80:
+		/* There is only a pop variant for long double store. */
+		assert(pop);
+		enc_op_addr(0, 0xDB, ENC_NONE, 7, node, 0); // fstpt
+		return;
+	case X86_SIZE_8:
+	case X86_SIZE_16:
+	case X86_SIZE_128:
+		break;
+	}
+	panic("unexpected mode size");
+}
+
+static void enc_fst(ir_node const *const node)
+{
+	enc_fst_pop(node, amd64_get_x87_attr_const(node)->pop);
+}
+
+static void enc_fstp(ir_node const *const node)
+{
+	enc_fst_pop(node, true);
+}
+
+static void enc_fucomi(ir_node const *const node)
+{
+	x87_attr_t const *const attr = &get_amd64_x87_attr_const(node)->x87;
+	be_emit8(attr->pop ? 0xDF : 0xDB); // fucom[p]i
+	be_emit8(0xE8 + attr->reg->encoding);
+}
+
+static void enc_copy(ir_node const *const node)
+{
+	arch_register_t const *const in  = arch_get_irn_register_in(node, 0);
+	arch_register_t const *const out = arch_get_irn_register_out(node, 0);
+	if (in == out)
+		return;
+
+	arch_register_class_t const *const cls = out->cls;
+	if (cls == &amd64_reg_classes[CLASS_amd64_gp]) {
+		enc_mov(in, out);
+	} else if (cls == &amd64_reg_classes[CLASS_amd64_xmm]) {
+		enc_op_rr(0x66, 0x0F28, ENC_NONE, out->encoding, in); // movapd
+	} else if (cls == &amd64_reg_classes[CLASS_amd64_x87]) {
+		/* nothing to do */
+	} else {
+		panic("move not supported for this register class");
+	}
+}
+
+static void enc_perm(ir_node const *const node)
+{
+	arch_register_t       const *const reg0 = arch_get_irn_register_out(node, 0);
+	arch_register_t       const *const reg1 = arch_get_irn_register_out(node, 1);
+	arch_register_class_t const *const cls  = reg0->cls;
+	assert(cls == reg1->cls && "Register class mismatch at Perm");
+
+	if (cls == &amd64_reg_classes[CLASS_amd64_gp]) {
+		enc_op_rr(0, 0x87, ENC_W, reg0->encoding, reg1); // xchgq
+	} else if (cls == &amd64_reg_classes[CLASS_amd64_xmm]) {
+		enc_op_rr(0x66, 0x0FEF, ENC_NONE, reg1->encoding, reg0); // pxor
+		enc_op_rr(0x66, 0x0FEF, ENC_NONE, reg0->encoding, reg1);
+		enc_op_rr(0x66, 0x0FEF, ENC_NONE, reg1->encoding, reg0);
+	} else {
+		panic("unexpected register class in be_Perm (%+F)", node);
+	}
+}
+
+static void enc_incsp(ir_node const *const node)
+{
+	int offs = be_get_IncSP_offset(node);
+	if (offs == 0)
+		return;
+
+	unsigned ext;
+	if (offs > 0) {
+		ext = 5; /* sub */
+	} else {
+		ext = 0; /* add */
+		offs = -offs;
+	}
+
+	arch_register_t const *const reg = arch_get_irn_register_out(node, 0);
+	if (is_8bit_val(offs)) {
+		enc_op_rr(0, 0x83, ENC_W, ext, reg);
+		be_emit8(offs);
+	} else {
+		enc_op_rr(0, 0x81, ENC_W, ext, reg);
+		be_emit32(offs);
+	}
+}
+
+static void amd64_register_binary_emitters(void)
+{
+	be_init_emitters();
+
+	amd64_register_spec_binary_emitters();
+
+	/* benode emitter */
+	be_set_emitter(op_be_Copy,           enc_copy);
+	be_set_emitter(op_be_CopyKeep,       enc_copy);
+	be_set_emitter(op_be_IncSP,          enc_incsp);
+	be_set_emitter(op_be_Perm,           enc_perm);
+	be_set_emitter(op_amd64_call,        enc_call);
+	be_set_emitter(op_amd64_cmovcc,      enc_cmovcc);
+	be_set_emitter(op_amd64_cmpxchg,     enc_cmpxchg);
+	be_set_emitter(op_amd64_copyB,       enc_copyB);
+	be_set_emitter(op_amd64_copyB_i,     enc_copyB_i);
+	be_set_emitter(op_amd64_fild,        enc_fild);
+	be_set_emitter(op_amd64_fisttp,      enc_fisttp);
+	be_set_emitter(op_amd64_fld,         enc_fld);
+	be_set_emitter(op_amd64_fst,         enc_fst);
+	be_set_emitter(op_amd64_fstp,        enc_fstp);
+	be_set_emitter(op_amd64_fucomi,      enc_fucomi);
+	be_set_emitter(op_amd64_ijmp,        enc_ijmp);
+	be_set_emitter(op_amd64_imul,        enc_imul);
+	be_set_emitter(op_amd64_jcc,         enc_amd64_jcc);
+	be_set_emitter(op_amd64_jmp,         enc_jump);
+	be_set_emitter(op_amd64_jmp_switch,  enc_jmp_switch);
+	be_set_emitter(op_amd64_lea,         enc_lea);
+	be_set_emitter(op_amd64_mov_gp,      enc_mov_gp);
+	be_set_emitter(op_amd64_mov_imm,     enc_mov_imm);
+	be_set_emitter(op_amd64_mov_store,   enc_mov_store);
+	be_set_emitter(op_amd64_movd,        enc_movd);
+	be_set_emitter(op_amd64_movd_gp_xmm, enc_movd_gp_xmm);
+	be_set_emitter(op_amd64_movd_xmm_gp, enc_movd_xmm_gp);
+	be_set_emitter(op_amd64_movs,        enc_movs);
+	be_set_emitter(op_amd64_movs_store_xmm, enc_movs_store_xmm);
+	be_set_emitter(op_amd64_movs_xmm,    enc_movs_xmm);
+	be_set_emitter(op_amd64_pop_am,      enc_pop_am);
+	be_set_emitter(op_amd64_pop_reg,     enc_pop_reg);
+	be_set_emitter(op_amd64_push_am,     enc_push_am);
+	be_set_emitter(op_amd64_push_reg,    enc_push_reg);
+	be_set_emitter(op_amd64_setcc,       enc_setcc);
+	be_set_emitter(op_amd64_sub_sp,      enc_sub_sp);
+	be_set_emitter(op_amd64_test,        enc_test);
+	be_set_emitter(op_amd64_xor_0,       enc_xor_0);
+	be_set_emitter(op_amd64_xorp_0,      enc_xorp_0);
+}
+
+static void enc_constant(ir_entity const *const entity)
+{
+	ir_initializer_t const *const init = get_entity_initializer(entity);
+	if (get_initializer_kind(init) != IR_INITIALIZER_TARVAL)
+		panic("unsupported initializer for constant %+F", entity);
+
+	ir_tarval *const tv        = get_initializer_tarval_value(init);
+	unsigned   const size      = get_type_size(get_entity_type(entity));
+	unsigned   const tv_size   = get_mode_size_bytes(get_tarval_mode(tv));
+	assert(tv_size <= size);
+	for (unsigned i = 0; i < tv_size; ++i) {
+		be_emit8(get_tarval_sub_bits(tv, i));
+	}
+	for (unsigned i = tv_size; i < size; ++i) {
+		be_emit8(0);
+	}
+}
+
+static void enc_jump_table(ir_node const *const node)
+{
+	amd64_switch_jmp_attr_t const *const attr
+		= get_amd64_switch_jmp_attr_const(node);
+	unsigned long        length;
+	ir_node const **const labels
+		= be_get_jump_table_targets(node, &attr->swtch, &length);
+	for (unsigned long i = 0; i < length; ++i) {
+		ir_node const *const block = be_emit_get_cfop_target(labels[i]);
+		unsigned const fragment_num
+			= PTR_TO_INT(ir_nodehashmap_get(void, &block_fragmentnum, block));
+		if (ir_platform.pic_style != BE_PIC_NONE) {
+			/* entries are relative to the table start */
+			be_emit_reloc_fragment(4, X86_IMM_PCREL, fragment_num, i * 4);
+		} else {
+			be_emit_reloc_fragment(8, AMD64_RELOCATION_ABS64, fragment_num, 0);
+		}
+	}
+	free(labels);
+}
+
+static void enc_pool(void)
+{
+	for (size_t i = 0, n = ARR_LEN(pool); i < n; ++i) {
+		pool_entry_t const *const entry = pool[i];
+
+		uint8_t p2align = 3;
+		if (entry->kind == POOL_CONSTANT) {
+			unsigned const align
+				= get_type_alignment(get_entity_type(entry->entity));
+			p2align = MAX(log2_floor(align), p2align);
+		}
+		unsigned const fragment_num
+			= be_begin_fragment(p2align, (1U << p2align) - 1);
+		assert(fragment_num == entry->fragment_num);
+		(void)fragment_num;
+
+		switch (entry->kind) {
+		case POOL_CONSTANT:
+			enc_constant(entry->entity);
+			break;
+		case POOL_JUMP_TABLE:
+			enc_jump_table(entry->node);
+			break;
+		case POOL_SLOT:
+			be_emit_reloc_entity(8, AMD64_RELOCATION_ABS64, entry->entity, 0);
+			break;
+		}
+		be_finish_fragment();
+	}
+}
+
+/**
+ * Registers the constants and jump tables referenced by the function, so
+ * their pool fragments are known when encoding the references.
+ */
+static void init_pool(ir_node **const blk_sched)
+{
+	obstack_init(&pool_obst);
+	pool                = NEW_ARR_F(pool_entry_t*, 0);
+	pool_data           = pmap_create();
+	pool_slots          = pmap_create();
+	first_pool_fragment = ARR_LEN(blk_sched);
+
+	if (!for_object) {
+		foreach_pmap(amd64_constants, entry) {
+			ir_entity *const entity = (ir_entity*)entry->value;
+			pmap_insert(pool_data, entity,
+			            new_pool_entry(POOL_CONSTANT, entity));
+		}
+	}
+
+	/* object files place jump tables into the data section */
+	for (size_t i = 0, n = ARR_LEN(blk_sched); i < n && !for_object; ++i) {
+		ir_node *const cfop = sched_last(blk_sched[i]);
+		if (!is_amd64_jmp_switch(cfop))
+			continue;
+		amd64_switch_jmp_attr_t const *const attr
+			= get_amd64_switch_jmp_attr_const(cfop);
+		ir_entity    *const entity = (ir_entity*)attr->swtch.table_entity;
+		pool_entry_t *const table  = new_pool_entry(POOL_JUMP_TABLE, entity);
+		table->node = cfop;
+		pmap_insert(pool_data, entity, table);
+	}
+}
+
+static void free_pool(void)
+{
+	pmap_destroy(pool_slots);
+	pmap_destroy(pool_data);
+	DEL_ARR_F(pool);
+	obstack_free(&pool_obst, NULL);
+}
+
+/**
+ * Adds the jump tables of @p function, which defines @p entity, to the object
+ * file.
+ */
+static void add_object_jump_tables(ir_entity const *const entity,
+                                   ir_jit_function_t const *const function,
+                                   ir_node **const blk_sched)
+{
+	uint8_t const be_kind = ir_platform.pic_style != BE_PIC_NONE
+	                      ? X86_IMM_PCREL : AMD64_RELOCATION_ABS64;
+	be_elf_relocation_t const reloc = amd64_elf_target.get_relocation(be_kind);
+	for (size_t i = 0, n = ARR_LEN(blk_sched); i < n; ++i) {
+		ir_node *const cfop = sched_last(blk_sched[i]);
+		if (!is_amd64_jmp_switch(cfop))
+			continue;
+		amd64_switch_jmp_attr_t const *const attr
+			= get_amd64_switch_jmp_attr_const(cfop);
+		unsigned long        length;
+		ir_node const **const labels
+			= be_get_jump_table_targets(cfop, &attr->swtch, &length);
+		unsigned *const targets = XMALLOCN(unsigned, length);
+		for (unsigned long l = 0; l < length; ++l) {
+			ir_node const *const block = be_emit_get_cfop_target(labels[l]);
+			unsigned const fragment_num
+				= PTR_TO_INT(ir_nodehashmap_get(void, &block_fragmentnum, block));
+			targets[l] = be_get_fragment_address(function, fragment_num);
+		}
+		be_elf_add_jump_table(attr->swtch.table_entity, entity, reloc,
+		                      targets, length);
+		free(targets);
+		free(labels);
+	}
+}
+
+static void assign_block_fragment_num(ir_node *const block, unsigned const num)
+{
+	assert(ir_nodehashmap_get(void, &block_fragmentnum, block) == NULL);
+	ir_nodehashmap_insert(&block_fragmentnum, block, INT_TO_PTR(num));
+}
+
+static void gen_binary_block(ir_node *const block)
+{
+	unsigned fragment_num = be_begin_fragment(0, 0);
+	assert(fragment_num
+	       == (unsigned)PTR_TO_INT(ir_nodehashmap_get(void, &block_fragmentnum, block)));
+	(void)fragment_num;
+
+	/* emit the contents of the block */
+	sched_foreach(block, node) {
+		be_emit_node(node);
+	}
+
+	be_finish_fragment();
+}
+
+static ir_jit_function_t *encode_function(ir_jit_segment_t *const segment,
+                                          ir_graph *const irg)
+{
+	amd64_register_binary_emitters();
+
+	ir_node **const blk_sched = be_create_block_schedule(irg, NULL);
+
+	be_jit_begin_function(segment);
+
+	/* we use links to point to target blocks */
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
+
+	be_emit_init_cf_links(blk_sched);
+
+	ir_nodehashmap_init(&block_fragmentnum);
+	size_t n = ARR_LEN(blk_sched);
+	for (size_t i = 0; i < n; ++i) {
+		ir_node *block = blk_sched[i];
+		assign_block_fragment_num(block, (unsigned)i);
+	}
+	init_pool(blk_sched);
+	for (size_t i = 0; i < n; ++i) {
+		ir_node *block = blk_sched[i];
+		gen_binary_block(block);
+	}
+	enc_pool();
+	free_pool();
+
+	ir_jit_function_t *const function = be_jit_finish_function();
+	if (for_object) {
+		ir_entity *const entity = get_irg_entity(irg);
+		be_elf_add_function(entity, function);
+		add_object_jump_tables(entity, function, blk_sched);
+	}
+	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
+	ir_nodehashmap_destroy(&block_fragmentnum);
+	return function;
+}
+
+ir_jit_function_t *amd64_emit_jit(ir_jit_segment_t *const segment,
+                                  ir_graph *const irg)
+{
+	for_object = false;
+	return encode_function(segment, irg);
+}
+
+void amd64_emit_object_function(ir_graph *const irg)
+{
+	for_object = true;
+	encode_function(be_elf_get_segment(), irg);
+}
+
+static void enc_nop_callback(char *buffer, unsigned size)
+{
+	memset(buffer, 0, size);
+	while (size > 0) {
+		switch (size) {
+		case 1: buffer[0] = 0x90; return;
+		case 2:
+			buffer[0] = 0x66;
+			++buffer;
+			--size;
+			continue;
+		case 3:
+		sequence_0f1f:
+			buffer[0] = 0x0F;
+			buffer[1] = 0x1F;
+			return;
+		case 4: buffer[2] = 0x40; goto sequence_0f1f;
+		case 5: buffer[2] = 0x44; goto sequence_0f1f;
+		case 6:
+			buffer[0] = 0x66;
+			++buffer;
+			--size;
+			continue;
+		case 7: buffer[2] = 0x80; goto sequence_0f1f;
+		case 8: buffer[2] = 0x84; goto sequence_0f1f;
+		default:
+			buffer[0] = 0x66;
+			buffer[1] = 0x0F;
+			buffer[2] = 0x1F;
+			buffer[3] = 0x84;
+			buffer += 9;
+			size   -= 9;
+			continue;
+		}
+	}
+}
+
+static unsigned enc_relocation_callback(char *const buffer,
+                                        char const *const address,
+                                        uint8_t const be_kind,
+                                        ir_entity *const entity,
+                                        int32_t const offset)
+{
+	intptr_t addr;
+	if (entity == NULL) {
+		/* offsets of fragment relocations are relative to the relocation */
+		addr = (intptr_t)address + offset;
+	} else {
+		intptr_t const entity_addr = (intptr_t)be_jit_get_entity_addr(entity);
+		if (entity_addr == (intptr_t)-1)
+			panic("Could not resolve address of entity %+F", entity);
+		addr = entity_addr + offset;
+	}
+
+	switch (be_kind) {
+	case AMD64_RELOCATION_ABS64: {
+		uint64_t const value = (uint64_t)addr;
+		memcpy(buffer, &value, 8);
+		return 8;
+	}
+	case X86_IMM_PCREL:
+		addr -= (intptr_t)address;
+		/* FALLTHROUGH */
+	case X86_IMM_ADDR: {
+		int32_t const value = (int32_t)addr;
+		if ((intptr_t)value != addr)
+			panic("Overflow in relocation");
+		memcpy(buffer, &value, 4);
+		return 4;
+	}
+	}
+	panic("unsupported relocation kind %u", (unsigned)be_kind);
+}
+
+void amd64_emit_jit_function(char *const buffer, char const *const address,
+                             ir_jit_function_t *const function)
+{
+	static const be_jit_emit_interface_t jit_emit_interface = {
+		.nops       = enc_nop_callback,
+		.relocation = enc_relocation_callback,
+	};
+	be_jit_emit_memory(buffer, address, function, &jit_emit_interface);
+}
+
+unsigned amd64_get_jit_relocation_size(uint8_t const be_kind)
+{
+	switch (be_kind) {
+	case AMD64_RELOCATION_ABS64: return 8;
+	case X86_IMM_ADDR:
+	case X86_IMM_PCREL:          return 4;
+	}
+	return 0;
+}
+
+/** The ELF relocation type numbers, see the x86-64 psABI. */
+enum {
+	R_X86_64_64       = 1,
+	R_X86_64_PC32     = 2,
+	R_X86_64_PLT32    = 4,
+	R_X86_64_GOTPCREL = 9,
+	R_X86_64_32S      = 11,
+};
+
+static be_elf_relocation_t get_elf_relocation(uint8_t const be_kind)
+{
+	switch (be_kind) {
+	case AMD64_RELOCATION_ABS64:
+		return (be_elf_relocation_t){ R_X86_64_64, 8, false };
+	case X86_IMM_ADDR:
+		return (be_elf_relocation_t){ R_X86_64_32S, 4, false };
+	case X86_IMM_PCREL:
+		return (be_elf_relocation_t){ R_X86_64_PC32, 4, true };
+	case X86_IMM_PLT:
+		return (be_elf_relocation_t){ R_X86_64_PLT32, 4, true };
+	case X86_IMM_GOTPCREL:
+		return (be_elf_relocation_t){ R_X86_64_GOTPCREL, 4, true };
+	}
+	panic("unsupported relocation kind %u", (unsigned)be_kind);
+}
+
+be_elf_target_t const amd64_elf_target = {
+	.machine          = 62, /* EM_X86_64 */
+	.data_relocation  = R_X86_64_64,
+	.function_p2align = 4,
+	.nops             = enc_nop_callback,
+	.get_relocation   = get_elf_relocation,
+};
+
+/** movabs $@p value, %r11 */
+static char *stub_movabs_r11(char *buffer, uint64_t const value)
+{
+	*buffer++ = 0x49;
+	*buffer++ = 0xBB;
+	memcpy(buffer, &value, 8);
+	return buffer + 8;
+}
+
+static char *stub_bytes(char *const buffer, char const *const bytes,
+                        size_t const size)
+{
+	memcpy(buffer, bytes, size);
+	return buffer + size;
+}
+
+/** movdqu between %xmm@p reg and @p reg*16(%rsp) */
+static char *stub_movdqu(char *buffer, uint8_t const opcode,
+                         unsigned const reg)
+{
+	*buffer++ = 0xF3;
+	*buffer++ = 0x0F;
+	*buffer++ = opcode;
+	*buffer++ = 0x44 | reg << 3;
+	*buffer++ = 0x24;
+	*buffer++ = reg * 16;
+	return buffer;
+}
+
+enum {
+	STUB_SIZE        = 16,
+	TRAMPOLINES_SIZE = 192,
+	/** size of the xmm save area, keeps the stack aligned at the call */
+	XMM_SAVE_SIZE    = 8 * 16 + 8,
+};
+
+/*
+ * The stubs pass their record in %r11, which is neither used for arguments
+ * nor preserved across calls.
+ */
+static void emit_jit_trampolines(char *const buffer,
+                                 be_jit_resolve_func const resolve,
+                                 unsigned *const resolve_offset,
+                                 unsigned *const count_offset)
+{
+	char *p = buffer;
+
+	/* resolve trampoline: save the argument registers and %rax, which
+	 * holds the number of vector arguments of variadic calls */
+	*resolve_offset = 0;
+	static char const save[] = {
+		0x55,                   /* push %rbp */
+		0x48, 0x89, 0xE5,       /* mov %rsp, %rbp */
+		0x57, 0x56, 0x52, 0x51, /* push %rdi, %rsi, %rdx, %rcx */
+		0x41, 0x50, 0x41, 0x51, /* push %r8, %r9 */
+		0x50,                   /* push %rax */
+		0x48, 0x81, 0xEC, XMM_SAVE_SIZE, 0, 0, 0, /* sub $size, %rsp */
+	};
+	p = stub_bytes(p, save, sizeof(save));
+	for (unsigned i = 0; i < 8; ++i)
+		p = stub_movdqu(p, 0x7F, i);
+	static char const mov_record[] = { 0x4C, 0x89, 0xDF }; /* mov %r11, %rdi */
+	p = stub_bytes(p, mov_record, sizeof(mov_record));
+	*p++ = 0x48; /* movabs $resolve, %rax */
+	*p++ = 0xB8;
+	uint64_t const resolve_addr = (uint64_t)(uintptr_t)resolve;
+	memcpy(p, &resolve_addr, 8);
+	p += 8;
+	static char const call[] = {
+		0xFF, 0xD0,       /* call *%rax */
+		0x49, 0x89, 0xC3, /* mov %rax, %r11 */
+	};
+	p = stub_bytes(p, call, sizeof(call));
+	for (unsigned i = 0; i < 8; ++i)
+		p = stub_movdqu(p, 0x6F, i);
+	static char const restore[] = {
+		0x48, 0x81, 0xC4, XMM_SAVE_SIZE, 0, 0, 0, /* add $size, %rsp */
+		0x58,                   /* pop %rax */
+		0x41, 0x59, 0x41, 0x58, /* pop %r9, %r8 */
+		0x59, 0x5A, 0x5E, 0x5F, /* pop %rcx, %rdx, %rsi, %rdi */
+		0x5D,                   /* pop %rbp */
+		0x41, 0xFF, 0xE3,       /* jmp *%r11 */
+	};
+	p = stub_bytes(p, restore, sizeof(restore));
+
+	/* count trampoline */
+	*count_offset = p - buffer;
+	static char const count[] = {
+		0x49, 0x83, 0x6B, 16, 0x01, /* subq $1, counter(%r11) */
+		0x0F, 0x84,                 /* jz resolve */
+	};
+	p = stub_bytes(p, count, sizeof(count));
+	int32_t const rel = (int32_t)(buffer + *resolve_offset - (p + 4));
+	memcpy(p, &rel, 4);
+	p += 4;
+	static char const jmp_code[] = { 0x41, 0xFF, 0x63, 8 }; /* jmp *code(%r11) */
+	p = stub_bytes(p, jmp_code, sizeof(jmp_code));
+	assert(p - buffer <= TRAMPOLINES_SIZE);
+}
+
+static void emit_jit_stub(char *const buffer,
+                          be_jit_stub_record_t *const record)
+{
+	char *p = stub_movabs_r11(buffer, (uint64_t)(uintptr_t)record);
+	static char const jmp_entry[] = { 0x41, 0xFF, 0x23 }; /* jmp *(%r11) */
+	p = stub_bytes(p, jmp_entry, sizeof(jmp_entry));
+	memset(p, 0xCC, buffer + STUB_SIZE - p);
+}
+
+be_jit_stub_if_t const amd64_jit_stubs = {
+	.stub_size        = STUB_SIZE,
+	.trampolines_size = TRAMPOLINES_SIZE,
+	.emit_trampolines = emit_jit_trampolines,
+	.emit_stub        = emit_jit_stub,
+};
@@ -0,0 +1,73 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       amd64 binary encoding/emission
+ */
+#ifndef FIRM_BE_AMD64_AMD64_ENCODE_H
+#define FIRM_BE_AMD64_AMD64_ENCODE_H
+
+#include <stdint.h>
+#include "beelf.h"
+#include "firm_types.h"
+#include "bejitrt.h"
+#include "jit.h"
+
+enum {
+	/** 64bit absolute address */
+	AMD64_RELOCATION_ABS64 = 128,
+};
+
+extern be_elf_target_t const amd64_elf_target;
+extern be_jit_stub_if_t const amd64_jit_stubs;
+
+ir_jit_function_t *amd64_emit_jit(ir_jit_segment_t *segment, ir_graph *irg);
+
+/**
+ * Encodes @p irg and adds it to the object file being written.
+ */
+void amd64_emit_object_function(ir_graph *irg);
+
+void amd64_emit_jit_function(char *buffer, char const *address,
+                             ir_jit_function_t *function);
+
+unsigned amd64_get_jit_relocation_size(uint8_t be_kind);
+
+void amd64_enc_simple(unsigned opcode);
+
+void amd64_enc_binop(ir_node const *node, unsigned code);
+
+void amd64_enc_shiftop(ir_node const *node, uint8_t ext);
+
+void amd64_enc_shiftop_mem(ir_node const *node, uint8_t ext);
+
+void amd64_enc_unop(ir_node const *node, uint8_t ext);
+
+void amd64_enc_unop_out(ir_node const *node, unsigned opcode);
+
+void amd64_enc_prefetch(ir_node const *node, uint8_t ext);
+
+void amd64_enc_xmm_binop(ir_node const *node, uint8_t prefix,
+                         unsigned opcode);
+
+void amd64_enc_xmm_scalar(ir_node const *node, unsigned opcode);
+
+void amd64_enc_xmm_packed(ir_node const *node, unsigned opcode);
+
+void amd64_enc_xmm_load(ir_node const *node, uint8_t prefix, unsigned opcode);
+
+void amd64_enc_xmm_store(ir_node const *node, uint8_t prefix,
+                         unsigned opcode);
+
+void amd64_enc_cvt(ir_node const *node, uint8_t prefix, unsigned opcode);
+
+void amd64_enc_fsimple(uint8_t opcode);
+
+void amd64_enc_fbinop(ir_node const *node, unsigned op_fwd, unsigned op_rev);
+
+void amd64_enc_fop_reg(ir_node const *node, uint8_t op0, uint8_t op1);
+
+#endif
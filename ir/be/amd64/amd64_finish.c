@@ -163,6 +163,10 @@ static bool amd64_handle_2addr(ir_node *const node, arch_register_req_t const *c
 {
 	(void)req;
 
+	/* the emitter negates the condition if the true value is in place */
+	if (is_amd64_cmovcc(node))
+		return arch_get_irn_register_in(node, n_amd64_cmovcc_val_true) == out_reg;
+
 	amd64_attr_t const *const attr = get_amd64_attr_const(node);
 	if (attr->op_mode == AMD64_OP_REG_ADDR) {
 		x86_addr_t const *const addr = &get_amd64_addr_attr_const(node)->addr;
@@ -9,12 +9,14 @@
  */
 #include "amd64_optimize.h"
 
+#include "amd64_bearch_t.h"
 #include "amd64_new_nodes.h"
 #include "amd64_transform.h"
 #include "benode.h"
 #include "bepeephole.h"
 #include "besched.h"
 #include "gen_amd64_regalloc_if.h"
+#include "iredges_t.h"
 #include "util.h"
 
 static void peephole_amd64_cmp(ir_node *const node)
@@ -133,9 +135,239 @@ static void peephole_amd64_mov_imm(ir_node *const node)
 	}
 }
 
+/* only optimize up to 16 stack slots below the frame top */
+#define MAXPUSH_OPTIMIZE 16
+
+/**
+ * Returns the offset of the 64bit stack slot accessed by @p node at @p addr
+ * relative to the stack pointer or -1 if it accesses something else.
+ */
+static int get_stack_slot_offset(ir_node const *const node,
+                                 x86_addr_t const *const addr)
+{
+	if (get_amd64_attr_const(node)->size != X86_SIZE_64
+	 || addr->variant != X86_ADDR_BASE
+	 || addr->immediate.kind != X86_IMM_VALUE
+	 || arch_get_irn_register_in(node, addr->base_input)
+	    != &amd64_registers[REG_RSP])
+		return -1;
+	int32_t const offset = addr->immediate.offset;
+	/* storing at half-slots is bad */
+	if (offset < 0 || offset % AMD64_REGISTER_SIZE != 0)
+		return -1;
+	return offset;
+}
+
+/**
+ * Returns the first slot of the window considered for an IncSP of
+ * @p inc_ofs bytes. The window ends at the top of the stack area, where
+ * callee saved registers and stack arguments are stored.
+ */
+static int get_window_base(int const inc_ofs)
+{
+	return MAX(inc_ofs / AMD64_REGISTER_SIZE - MAXPUSH_OPTIMIZE, 0);
+}
+
+/**
+ * Tries to create pushes from IncSP, store combinations.
+ * The stores are replaced by pushes, the IncSP is split into the parts above
+ * and below the pushed slots (possibly into IncSP 0, but not removed).
+ */
+static void peephole_IncSP_store_to_push(ir_node *const node)
+{
+	int const inc_ofs = be_get_IncSP_offset(node);
+	if (inc_ofs < AMD64_REGISTER_SIZE || inc_ofs % AMD64_REGISTER_SIZE != 0)
+		return;
+
+	/* collect the stores directly after the IncSP sorted by their slot */
+	int const base                     = get_window_base(inc_ofs);
+	ir_node  *stores[MAXPUSH_OPTIMIZE] = { NULL };
+	int       maxslot                  = -1;
+	sched_foreach_after(node, store) {
+		if (!is_amd64_mov_store(store))
+			break;
+		amd64_binop_addr_attr_t const *const attr
+			= get_amd64_binop_addr_attr_const(store);
+		x86_addr_t const *const addr = &attr->base.addr;
+		if (attr->base.base.op_mode != AMD64_OP_ADDR_REG
+		 || !is_NoMem(get_irn_n(store, addr->mem_input)))
+			break;
+		int const offset = get_stack_slot_offset(store, addr);
+		if (offset < 0)
+			break;
+		/* ignore those outside the possible window */
+		int const slot = offset / AMD64_REGISTER_SIZE - base;
+		if (slot < 0 || offset >= inc_ofs)
+			continue;
+
+		/* storing into the same slot twice is bad (and shouldn't happen...) */
+		if (stores[slot] != NULL)
+			break;
+		stores[slot] = store;
+		maxslot      = MAX(maxslot, slot);
+	}
+
+	if (maxslot < 0)
+		return;
+
+	/* the pushes fill the slots down from the highest one */
+	int i = maxslot;
+	while (i >= 0 && stores[i] != NULL)
+		--i;
+
+	ir_node *const block      = get_nodes_block(node);
+	ir_node       *curr_sp    = node;
+	ir_node       *sched_pos  = node;
+	ir_node       *first_push = NULL;
+	for (int slot = maxslot; slot > i; --slot) {
+		ir_node                       *const store = stores[slot];
+		amd64_binop_addr_attr_t const *const attr
+			= get_amd64_binop_addr_attr_const(store);
+		dbg_info *const dbgi = get_irn_dbg_info(store);
+		ir_node  *const mem  = get_irn_n(store, attr->base.addr.mem_input);
+		ir_node  *const val  = get_irn_n(store, attr->u.reg_input);
+		ir_node  *const push
+			= new_bd_amd64_push_reg(dbgi, block, curr_sp, mem, val, X86_SIZE_64);
+		if (first_push == NULL)
+			first_push = push;
+		sched_add_after(sched_pos, push);
+		sched_pos = push;
+
+		curr_sp = be_new_Proj_reg(push, pn_amd64_push_reg_stack,
+		                          &amd64_registers[REG_RSP]);
+		be_peephole_exchange(store, be_new_Proj(push, pn_amd64_push_reg_M));
+	}
+
+	/* allocate the slots below the pushed ones */
+	int const below = (base + i + 1) * AMD64_REGISTER_SIZE;
+	ir_node  *last  = curr_sp;
+	if (below > 0) {
+		last = amd64_new_IncSP(block, curr_sp, below,
+		                       be_get_IncSP_no_align(node));
+		sched_add_after(sched_pos, last);
+	}
+
+	edges_reroute_except(node, last, first_push);
+	int const above = inc_ofs - (base + maxslot + 1) * AMD64_REGISTER_SIZE;
+	be_set_IncSP_offset(node, above);
+}
+
+/**
+ * Tries to create pops from load, IncSP combinations.
+ * The loads are replaced by pops, the IncSP is split into the parts below
+ * and above the popped slots (possibly into IncSP 0, but not removed).
+ */
+static void peephole_load_IncSP_to_pop(ir_node *const node)
+{
+	int inc_ofs = -be_get_IncSP_offset(node);
+	if (inc_ofs < AMD64_REGISTER_SIZE || inc_ofs % AMD64_REGISTER_SIZE != 0)
+		return;
+
+	/* collect the loads directly before the IncSP sorted by their slot */
+	int const base                    = get_window_base(inc_ofs);
+	ir_node  *loads[MAXPUSH_OPTIMIZE] = { NULL };
+	unsigned  regmask                 = 0;
+	unsigned  copymask                = ~0u;
+	int       maxslot                 = -1;
+	sched_foreach_reverse_before(node, load) {
+		if (be_is_Copy(load)) {
+			arch_register_t const *const dreg = arch_get_irn_register(load);
+			if (dreg->cls != &amd64_reg_classes[CLASS_amd64_gp]) {
+				/* not a GP copy, ignore */
+				continue;
+			}
+			arch_register_t const *const sreg
+				= arch_get_irn_register(be_get_Copy_op(load));
+			unsigned const copyregs = (1u << dreg->index) | (1u << sreg->index);
+			if (regmask & copymask & copyregs)
+				break;
+			/* we can skip copies if none of our future pops overwrites their
+			 * registers */
+			regmask  |= copyregs;
+			copymask &= ~copyregs;
+			continue;
+		}
+		if (!is_amd64_mov_gp(load)
+		 || get_amd64_attr_const(load)->op_mode != AMD64_OP_ADDR)
+			break;
+
+		x86_addr_t const *const addr = &get_amd64_addr_attr_const(load)->addr;
+		int const offset = get_stack_slot_offset(load, addr);
+		if (offset < 0)
+			break;
+		/* ignore those outside the possible window */
+		int const slot = offset / AMD64_REGISTER_SIZE - base;
+		if (slot < 0 || offset >= inc_ofs)
+			continue;
+
+		/* loading from the same slot twice is bad (and shouldn't happen...) */
+		if (loads[slot] != NULL)
+			break;
+
+		arch_register_t const *const dreg
+			= arch_get_irn_register_out(load, pn_amd64_mov_gp_res);
+		if (regmask & (1u << dreg->index)) {
+			/* this register is already used */
+			break;
+		}
+		regmask |= 1u << dreg->index;
+
+		loads[slot] = load;
+		maxslot     = MAX(maxslot, slot);
+	}
+
+	if (maxslot < 0)
+		return;
+
+	/* the pops have to free the slots up to the highest one */
+	int i = maxslot;
+	while (i >= 0 && loads[i] != NULL)
+		--i;
+
+	int const ofs = inc_ofs - (base + maxslot + 1) * AMD64_REGISTER_SIZE;
+	inc_ofs = (base + i + 1) * AMD64_REGISTER_SIZE;
+
+	/* create a new IncSP if needed */
+	ir_node *const block   = get_nodes_block(node);
+	ir_node       *pred_sp = be_get_IncSP_pred(node);
+	if (inc_ofs > 0) {
+		pred_sp = amd64_new_IncSP(block, pred_sp, -inc_ofs,
+		                          be_get_IncSP_no_align(node));
+		sched_add_before(node, pred_sp);
+	}
+
+	while (++i <= maxslot) {
+		ir_node                 *const load = loads[i];
+		dbg_info                *const dbgi = get_irn_dbg_info(load);
+		amd64_addr_attr_t const *const attr = get_amd64_addr_attr_const(load);
+		ir_node                 *const mem  = get_irn_n(load, attr->addr.mem_input);
+		arch_register_t   const *const reg
+			= arch_get_irn_register_out(load, pn_amd64_mov_gp_res);
+		ir_node *const pop = new_bd_amd64_pop_reg(dbgi, block, pred_sp, mem,
+		                                          X86_SIZE_64);
+		arch_set_irn_register_out(pop, pn_amd64_pop_reg_res, reg);
+		sched_add_before(node, pop);
+
+		pred_sp = be_new_Proj_reg(pop, pn_amd64_pop_reg_stack,
+		                          &amd64_registers[REG_RSP]);
+		be_peephole_exchange(load, pop);
+	}
+
+	be_set_IncSP_offset(node, -ofs);
+	be_set_IncSP_pred(node, pred_sp);
+}
+
 static void peephole_be_IncSP(ir_node *const node)
 {
-	be_peephole_IncSP_IncSP(node);
+	/* first optimize incsp->incsp combinations */
+	if (be_peephole_IncSP_IncSP(node))
+		return;
+
+	/* transform IncSP->store combinations to push where possible */
+	peephole_IncSP_store_to_push(node);
+
+	/* transform load->IncSP combinations to pop where possible */
+	peephole_load_IncSP_to_pop(node);
 }
 
 void amd64_peephole_optimization(ir_graph *const irg)
@@ -9,22 +9,22 @@ $mode_x87   = "x86_mode_E";
 	gp => {
 		mode => $mode_gp,
 		registers => [
-			{ name => "rax", dwarf =>  0 },
-			{ name => "rcx", dwarf =>  2 },
-			{ name => "rdx", dwarf =>  1 },
-			{ name => "rsi", dwarf =>  4 },
-			{ name => "rdi", dwarf =>  5 },
-			{ name => "rbx", dwarf =>  3 },
-			{ name => "rbp", dwarf =>  6 },
-			{ name => "rsp", dwarf =>  7 },
-			{ name => "r8",  dwarf =>  8 },
-			{ name => "r9",  dwarf =>  9 },
-			{ name => "r10", dwarf => 10 },
-			{ name => "r11", dwarf => 11 },
-			{ name => "r12", dwarf => 12 },
-			{ name => "r13", dwarf => 13 },
-			{ name => "r14", dwarf => 14 },
-			{ name => "r15", dwarf => 15 },
+			{ name => "rax", encoding =>  0, dwarf =>  0 },
+			{ name => "rcx", encoding =>  1, dwarf =>  2 },
+			{ name => "rdx", encoding =>  2, dwarf =>  1 },
+			{ name => "rsi", encoding =>  6, dwarf =>  4 },
+			{ name => "rdi", encoding =>  7, dwarf =>  5 },
+			{ name => "rbx", encoding =>  3, dwarf =>  3 },
+			{ name => "rbp", encoding =>  5, dwarf =>  6 },
+			{ name => "rsp", encoding =>  4, dwarf =>  7 },
+			{ name => "r8",  encoding =>  8, dwarf =>  8 },
+			{ name => "r9",  encoding =>  9, dwarf =>  9 },
+			{ name => "r10", encoding => 10, dwarf => 10 },
+			{ name => "r11", encoding => 11, dwarf => 11 },
+			{ name => "r12", encoding => 12, dwarf => 12 },
+			{ name => "r13", encoding => 13, dwarf => 13 },
+			{ name => "r14", encoding => 14, dwarf => 14 },
+			{ name => "r15", encoding => 15, dwarf => 15 },
 		]
 	},
 	flags => {
@@ -131,6 +131,17 @@ my $binop_commutative = {
 	emit      => "{name}%M %AM",
 };
 
+my $binop_mem = {
+	irn_flags => [ "modify_flags" ],
+	state     => "exc_pinned",
+	in_reqs   => "...",
+	out_reqs  => [ "none", "flags", "mem" ],
+	outs      => [ "dummy", "flags", "M" ],
+	attr_type => "amd64_binop_addr_attr_t",
+	attr      => "const amd64_binop_addr_attr_t *attr_init",
+	emit      => "{name}%M %AM",
+};
+
 my $cmpop = {
 	irn_flags => [ "modify_flags", "rematerializable" ],
 	state     => "exc_pinned",
@@ -201,6 +212,18 @@ my $unop = {
 	emit      => "{name}%M %AM",
 };
 
+my $unop_mem = {
+	irn_flags => [ "modify_flags" ],
+	state     => "exc_pinned",
+	in_reqs   => "...",
+	out_reqs  => [ "none", "flags", "mem" ],
+	outs      => [ "dummy", "flags", "M" ],
+	attr_type => "amd64_addr_attr_t",
+	attr      => "x86_insn_size_t size, x86_addr_t addr",
+	fixed     => "amd64_op_mode_t op_mode = AMD64_OP_ADDR;\n",
+	emit      => "{name}%M %AM",
+};
+
 my $unop_out = {
 	irn_flags => [ "modify_flags", "rematerializable" ],
 	in_reqs   => "...",
@@ -301,6 +324,19 @@ my $x87store = {
 	attr      => "const amd64_binop_addr_attr_t *attr_init",
 };
 
+my $prefetchop = {
+	op_flags  => [ "uses_memory" ],
+	state     => "exc_pinned",
+	in_reqs   => "...",
+	out_reqs  => [ "mem" ],
+	outs      => [ "M" ],
+	attr_type => "amd64_addr_attr_t",
+	attr      => "x86_addr_t addr",
+	fixed     => "amd64_op_mode_t op_mode = AMD64_OP_ADDR;\n"
+	            ."x86_insn_size_t size    = X86_SIZE_8;\n",
+	emit      => "{name} %A",
+};
+
 %nodes = (
 push_am => {
 	op_flags  => [ "uses_memory" ],
@@ -325,6 +361,17 @@ push_reg => {
 	emit      => "push%M %^S2",
 },
 
+pop_reg => {
+	state     => "exc_pinned",
+	in_reqs   => [ "rsp",   "mem" ],
+	ins       => [ "stack", "mem" ],
+	out_reqs  => [ "gp",  "rsp:I", "mem" ],
+	outs      => [ "res", "stack", "M"   ],
+	fixed     => "amd64_op_mode_t op_mode = AMD64_OP_NONE;\n",
+	attr      => "x86_insn_size_t size",
+	emit      => "pop%M %D0",
+},
+
 pop_am => {
 	op_flags  => [ "uses_memory" ],
 	state     => "exc_pinned",
@@ -358,57 +405,161 @@ leave => {
 	fixed     => "amd64_op_mode_t op_mode = AMD64_OP_NONE;\n"
 	            ."x86_insn_size_t size    = X86_SIZE_64;\n",
 	emit      => "leave",
+	encode    => "amd64_enc_simple(0xC9)",
+},
+
+add => {
+	template => $binop_commutative,
+	encode   => "amd64_enc_binop(node, 0)",
 },
 
-add => { template => $binop_commutative },
+add_mem => {
+	template => $binop_mem,
+	name     => "add",
+	encode   => "amd64_enc_binop(node, 0)",
+},
+
+and => {
+	template => $binop_commutative,
+	encode   => "amd64_enc_binop(node, 4)",
+},
 
-and => { template => $binop_commutative },
+and_mem => {
+	template => $binop_mem,
+	name     => "and",
+	encode   => "amd64_enc_binop(node, 4)",
+},
 
 cltd => {
 	template => $sextop,
 	fixed    => "amd64_op_mode_t op_mode = AMD64_OP_NONE;\n"
 	           ."x86_insn_size_t size    = X86_SIZE_32;\n",
+	encode   => "amd64_enc_simple(0x99)",
 },
 
 cqto => {
 	template => $sextop,
 	fixed    => "amd64_op_mode_t op_mode = AMD64_OP_NONE;\n"
 	           ."x86_insn_size_t size    = X86_SIZE_64;\n",
+	encode   => "amd64_enc_simple(0x4899)",
 },
 
-div => { template => $divop },
+div => {
+	template => $divop,
+	encode   => "amd64_enc_unop(node, 6)",
+},
 
-idiv => { template => $divop },
+idiv => {
+	template => $divop,
+	encode   => "amd64_enc_unop(node, 7)",
+},
 
 imul => { template => $binop_commutative },
 
 imul_1op => {
 	template => $mulop,
 	name     => "imul",
+	encode   => "amd64_enc_unop(node, 5)",
 },
 
-mul => { template => $mulop },
+mul => {
+	template => $mulop,
+	encode   => "amd64_enc_unop(node, 4)",
+},
 
-or => { template => $binop_commutative },
+or => {
+	template => $binop_commutative,
+	encode   => "amd64_enc_binop(node, 1)",
+},
 
-shl => { template => $shiftop },
+or_mem => {
+	template => $binop_mem,
+	name     => "or",
+	encode   => "amd64_enc_binop(node, 1)",
+},
 
-shr => { template => $shiftop },
+shl => {
+	template => $shiftop,
+	encode   => "amd64_enc_shiftop(node, 4)",
+},
+
+shl_mem => {
+	template => $binop_mem,
+	name     => "shl",
+	encode   => "amd64_enc_shiftop_mem(node, 4)",
+},
 
-sar => { template => $shiftop },
+shr => {
+	template => $shiftop,
+	encode   => "amd64_enc_shiftop(node, 5)",
+},
+
+shr_mem => {
+	template => $binop_mem,
+	name     => "shr",
+	encode   => "amd64_enc_shiftop_mem(node, 5)",
+},
+
+sar => {
+	template => $shiftop,
+	encode   => "amd64_enc_shiftop(node, 7)",
+},
+
+sar_mem => {
+	template => $binop_mem,
+	name     => "sar",
+	encode   => "amd64_enc_shiftop_mem(node, 7)",
+},
 
 sub => {
 	template  => $binop,
 	irn_flags => [ "modify_flags", "rematerializable" ],
+	encode    => "amd64_enc_binop(node, 5)",
 },
 
-sbb => { template => $binop },
+sub_mem => {
+	template => $binop_mem,
+	name     => "sub",
+	encode   => "amd64_enc_binop(node, 5)",
+},
+
+sbb => {
+	template => $binop,
+	encode   => "amd64_enc_binop(node, 3)",
+},
+
+neg => {
+	template => $unop,
+	encode   => "amd64_enc_unop(node, 3)",
+},
+
+neg_mem => {
+	template => $unop_mem,
+	name     => "neg",
+	encode   => "amd64_enc_unop(node, 3)",
+},
+
+not => {
+	template => $unop,
+	encode   => "amd64_enc_unop(node, 2)",
+},
 
-neg => { template => $unop },
+not_mem => {
+	template => $unop_mem,
+	name     => "not",
+	encode   => "amd64_enc_unop(node, 2)",
+},
 
-not => { template => $unop },
+xor => {
+	template => $binop_commutative,
+	encode   => "amd64_enc_binop(node, 6)",
+},
 
-xor => { template => $binop_commutative },
+xor_mem => {
+	template => $binop_mem,
+	name     => "xor",
+	encode   => "amd64_enc_binop(node, 6)",
+},
 
 xor_0 => {
 	op_flags  => [ "constlike" ],
@@ -469,7 +620,10 @@ jmp => {
 	            ."x86_insn_size_t size    = X86_SIZE_64;\n",
 },
 
-cmp => { template => $cmpop },
+cmp => {
+	template => $cmpop,
+	encode   => "amd64_enc_binop(node, 7)",
+},
 
 test => { template => $cmpop },
 
@@ -484,6 +638,17 @@ cmpxchg => {
 	emit      => "lock cmpxchg%M %AM",
 },
 
+# The result is either of the inputs, the emitter negates the condition if it
+# has to move val_false.
+cmovcc => {
+	in_reqs   => [ "gp", "gp", "flags" ],
+	out_reqs  => [ "in_r0 in_r1" ],
+	ins       => [ "val_false", "val_true", "flags" ],
+	outs      => [ "res" ],
+	attr_type => "amd64_cc_attr_t",
+	attr      => "x86_insn_size_t size, x86_condition_code_t cc",
+},
+
 # TODO Setcc can also operate on memory
 setcc => {
 	irn_flags => [  ],
@@ -531,6 +696,26 @@ mov_store => {
 	emit      => "mov%M %AM",
 },
 
+prefetcht0 => {
+	template => $prefetchop,
+	encode   => "amd64_enc_prefetch(node, 1)",
+},
+
+prefetcht1 => {
+	template => $prefetchop,
+	encode   => "amd64_enc_prefetch(node, 2)",
+},
+
+prefetcht2 => {
+	template => $prefetchop,
+	encode   => "amd64_enc_prefetch(node, 3)",
+},
+
+prefetchnta => {
+	template => $prefetchop,
+	encode   => "amd64_enc_prefetch(node, 0)",
+},
+
 jmp_switch => {
 	op_flags  => [ "cfopcode", "forking" ],
 	state     => "pinned",
@@ -560,19 +745,30 @@ ret => {
 	fixed    => "amd64_op_mode_t op_mode = AMD64_OP_NONE;\n"
 	           ."x86_insn_size_t size    = X86_SIZE_64;\n",
 	emit     => "ret",
+	encode   => "amd64_enc_simple(0xC3)",
 },
 
-bsf => { template => $unop_out },
+bsf => {
+	template => $unop_out,
+	encode   => "amd64_enc_unop_out(node, 0x0FBC)",
+},
 
-bsr => { template => $unop_out },
+bsr => {
+	template => $unop_out,
+	encode   => "amd64_enc_unop_out(node, 0x0FBD)",
+},
 
 # SSE
 
-adds => { template => $binopx_commutative },
+adds => {
+	template => $binopx_commutative,
+	encode   => "amd64_enc_xmm_scalar(node, 0x0F58)",
+},
 
 divs => {
 	template => $binopx,
 	emit     => "divs%MX %AM",
+	encode   => "amd64_enc_xmm_scalar(node, 0x0F5E)",
 },
 
 movs_xmm => {
@@ -581,7 +777,10 @@ movs_xmm => {
 	emit     => "movs%MX %AM, %D0",
 },
 
-muls => { template => $binopx_commutative },
+muls => {
+	template => $binopx_commutative,
+	encode   => "amd64_enc_xmm_scalar(node, 0x0F59)",
+},
 
 movs_store_xmm => {
 	op_flags  => [ "uses_memory" ],
@@ -597,6 +796,7 @@ movs_store_xmm => {
 subs => {
 	template => $binopx,
 	emit     => "subs%MX %AM",
+	encode   => "amd64_enc_xmm_scalar(node, 0x0F5C)",
 },
 
 ucomis => {
@@ -608,6 +808,7 @@ ucomis => {
 	attr_type => "amd64_binop_addr_attr_t",
 	attr      => "const amd64_binop_addr_attr_t *attr_init",
 	emit      => "ucomis%MX %AM",
+	encode    => "amd64_enc_xmm_packed(node, 0x0F2E)",
 },
 
 xorp_0 => {
@@ -620,7 +821,10 @@ xorp_0 => {
 	emit      => "xorp%MX %^D0, %^D0",
 },
 
-xorp => { template => $binopx_commutative },
+xorp => {
+	template => $binopx_commutative,
+	encode   => "amd64_enc_xmm_packed(node, 0x0F57)",
+},
 
 movd_xmm_gp => {
 	state     => "exc_pinned",
@@ -646,21 +850,37 @@ movd_gp_xmm => {
 
 # Conversion operations
 
-cvtss2sd => { template => $cvtop2x },
+cvtss2sd => {
+	template => $cvtop2x,
+	encode   => "amd64_enc_xmm_load(node, 0xF3, 0x0F5A)",
+},
 
 cvtsd2ss => {
 	template => $cvtop2x,
 	attr     => "amd64_op_mode_t op_mode, x86_addr_t addr",
 	fixed    => "x86_insn_size_t size = X86_SIZE_64;\n",
+	encode   => "amd64_enc_xmm_load(node, 0xF2, 0x0F5A)",
 },
 
-cvttsd2si => { template => $cvtopx2i },
+cvttsd2si => {
+	template => $cvtopx2i,
+	encode   => "amd64_enc_cvt(node, 0xF2, 0x0F2C)",
+},
 
-cvttss2si => { template => $cvtopx2i },
+cvttss2si => {
+	template => $cvtopx2i,
+	encode   => "amd64_enc_cvt(node, 0xF3, 0x0F2C)",
+},
 
-cvtsi2ss => { template => $cvtop2x },
+cvtsi2ss => {
+	template => $cvtop2x,
+	encode   => "amd64_enc_cvt(node, 0xF3, 0x0F2A)",
+},
 
-cvtsi2sd => { template => $cvtop2x },
+cvtsi2sd => {
+	template => $cvtop2x,
+	encode   => "amd64_enc_cvt(node, 0xF2, 0x0F2A)",
+},
 
 movd => {
 	template => $movopx,
@@ -670,11 +890,13 @@ movd => {
 movdqa => {
 	template => $movopx,
 	fixed    => "x86_insn_size_t size = X86_SIZE_128;\n",
+	encode   => "amd64_enc_xmm_load(node, 0x66, 0x0F6F)",
 },
 
 movdqu => {
 	template => $movopx,
 	fixed    => "x86_insn_size_t size = X86_SIZE_128;\n",
+	encode   => "amd64_enc_xmm_load(node, 0xF3, 0x0F6F)",
 },
 
 movdqu_store => {
@@ -686,6 +908,7 @@ movdqu_store => {
 	attr_type => "amd64_binop_addr_attr_t",
 	attr      => "const amd64_binop_addr_attr_t *attr_init",
 	emit      => "movdqu %^S0, %A",
+	encode    => "amd64_enc_xmm_store(node, 0xF3, 0x0F7F)",
 },
 
 copyB => {
@@ -732,15 +955,30 @@ l_haddpd => {
 	mode      => $mode_xmm,
 },
 
-punpckldq => { template => $binopx },
+punpckldq => {
+	template => $binopx,
+	encode   => "amd64_enc_xmm_binop(node, 0x66, 0x0F62)",
+},
 
-subpd => { template => $binopx },
+subpd => {
+	template => $binopx,
+	encode   => "amd64_enc_xmm_binop(node, 0x66, 0x0F5C)",
+},
 
-haddpd => { template => $binopx },
+haddpd => {
+	template => $binopx,
+	encode   => "amd64_enc_xmm_binop(node, 0x66, 0x0F7C)",
+},
 
-fldz => { template => $x87const },
+fldz => {
+	template => $x87const,
+	encode   => "amd64_enc_fsimple(0xEE)",
+},
 
-fld1 => { template => $x87const },
+fld1 => {
+	template => $x87const,
+	encode   => "amd64_enc_fsimple(0xE8)",
+},
 
 fld => {
 	irn_flags => [ "rematerializable" ],
@@ -784,24 +1022,31 @@ fstp => {
 fadd => {
 	template => $x87binop,
 	emit     => "fadd%FP %AF",
+	encode   => "amd64_enc_fbinop(node, 0, 0)",
 },
 
 fdiv => {
 	template => $x87binop,
 	emit     => "fdiv%FR%FP %AF",
+	encode   => "amd64_enc_fbinop(node, 6, 7)",
 },
 
 fmul => {
 	template => $x87binop,
 	emit     => "fmul%FP %AF",
+	encode   => "amd64_enc_fbinop(node, 1, 1)",
 },
 
 fsub => {
 	template => $x87binop,
 	emit     => "fsub%FR%FP %AF",
+	encode   => "amd64_enc_fbinop(node, 4, 5)",
 },
 
-fchs => { template => $x87unop },
+fchs => {
+	template => $x87unop,
+	encode   => "amd64_enc_fsimple(0xE0)",
+},
 
 fucomi => {
 	irn_flags => [ "rematerializable" ],
@@ -822,6 +1067,7 @@ fdup => {
 	attr        => "const arch_register_t *reg",
 	init        => "attr->x87.reg = reg;",
 	emit        => "fld %F0",
+	encode      => "amd64_enc_fop_reg(node, 0xD9, 0xC0)",
 },
 
 fxch => {
@@ -832,6 +1078,7 @@ fxch => {
 	attr        => "const arch_register_t *reg",
 	init        => "attr->x87.reg = reg;",
 	emit        => "fxch %F0",
+	encode      => "amd64_enc_fop_reg(node, 0xD9, 0xC8)",
 },
 
 fpop => {
@@ -842,6 +1089,7 @@ fpop => {
 	attr        => "const arch_register_t *reg",
 	init        => "attr->x87.reg = reg;",
 	emit        => "fstp %F0",
+	encode      => "amd64_enc_fop_reg(node, 0xDD, 0xD8)",
 },
 
 );
@@ -2136,6 +2136,73 @@ static ir_node *gen_Cond(ir_node *const node)
 	return new_bd_amd64_jcc(dbgi, block, flags, cc);
 }
 
+/**
+ * Creates a setcc, which is zero extended to produce 0 or 1.
+ */
+static ir_node *create_setcc(dbg_info *const dbgi, ir_node *const block,
+                             ir_node *const flags,
+                             x86_condition_code_t const cc)
+{
+	ir_node *const setcc = new_bd_amd64_setcc(dbgi, block, flags, cc);
+
+	ir_node   *const movzbl_in[] = { setcc };
+	x86_addr_t const movzbl_addr = {
+		.base_input = 0,
+		.variant    = X86_ADDR_REG,
+	};
+	ir_node *const movzbl
+		= new_bd_amd64_mov_gp(dbgi, block, ARRAY_SIZE(movzbl_in), movzbl_in,
+		                      reg_reqs, X86_SIZE_8, AMD64_OP_REG, movzbl_addr);
+	return be_new_Proj(movzbl, pn_amd64_mov_gp_res);
+}
+
+/**
+ * Transforms a Mux into a setcc if it selects between 0 and 1 and into
+ * conditional moves otherwise.
+ */
+static ir_node *gen_Mux(ir_node *const node)
+{
+	ir_node  *const sel       = get_Mux_sel(node);
+	ir_node        *mux_true  = get_Mux_true(node);
+	ir_node        *mux_false = get_Mux_false(node);
+	ir_mode  *const mode      = get_irn_mode(node);
+	dbg_info *const dbgi      = get_irn_dbg_info(node);
+	ir_node  *const new_block = be_transform_nodes_block(node);
+	assert(mode_needs_gp_reg(mode) && get_mode_size_bits(mode) <= 64);
+	if (get_irn_mode(get_Cmp_left(sel)) == x86_mode_E)
+		panic("cannot transform %+F with x87 compare", node);
+
+	x86_condition_code_t cc;
+	ir_node *const flags = get_flags_node(sel, &cc);
+
+	if (is_irn_null(mux_true) && is_irn_one(mux_false)) {
+		ir_node *const tmp = mux_true;
+		mux_true  = mux_false;
+		mux_false = tmp;
+		cc        = x86_negate_condition_code(cc);
+	}
+	if (is_irn_null(mux_false) && is_irn_one(mux_true)
+	 && !(cc & x86_cc_float_parity_cases))
+		return create_setcc(dbgi, new_block, flags, cc);
+
+	ir_node        *const new_false = be_transform_node(mux_false);
+	ir_node        *const new_true  = be_transform_node(mux_true);
+	x86_insn_size_t const size      = get_mode_size_bits(mode) > 32
+	                                ? X86_SIZE_64 : X86_SIZE_32;
+	x86_condition_code_t const flags_cc
+		= cc & ~(x86_cc_float_parity_cases | x86_cc_additional_float_cases);
+	ir_node *res = new_bd_amd64_cmovcc(dbgi, new_block, new_false, new_true,
+	                                   flags, size, flags_cc);
+	if (cc & x86_cc_float_parity_cases) {
+		/* an unordered float comparison sets the parity flag, which makes the
+		 * negated conditions true and all others false */
+		ir_node *const unordered = cc & x86_cc_negated ? new_true : new_false;
+		res = new_bd_amd64_cmovcc(dbgi, new_block, res, unordered, flags, size,
+		                          x86_cc_parity);
+	}
+	return res;
+}
+
 static ir_node *gen_ASM(ir_node *const node)
 {
 	return x86_match_ASM(node, &amd64_asm_constraints);
@@ -2592,8 +2659,284 @@ static ir_node *gen_Conv(ir_node *const node)
 	return be_new_Proj(conv, pn_res);
 }
 
+static const unsigned pn_amd64_mem = 2;
+
+/**
+ * Checks whether the memory @p mem of a Store depends on @p load other than
+ * through the memory Proj of the Load. Folding the Load into the Store would
+ * create a memory loop then.
+ */
+static bool mem_depends_on_load(ir_node *const block, ir_node *const load,
+                                ir_node *const mem)
+{
+	if (is_Sync(mem)) {
+		foreach_irn_in(mem, i, pred) {
+			if (mem_depends_on_load(block, load, pred))
+				return true;
+		}
+		return false;
+	}
+	if (is_Proj(mem) && get_Proj_pred(mem) == load)
+		return false;
+	return get_nodes_block(mem) == block
+	    && heights_reachable_in_block(heights, mem, load);
+}
+
+/**
+ * Returns the Load producing @p op, if the Store with memory @p mem to @p ptr
+ * writes back to the address the Load read from and both can be merged into
+ * a read-modify-write operation, NULL otherwise.
+ */
+static ir_node *use_dest_am(ir_node *const block, ir_node *const op,
+                            ir_node *const mem, ir_node *const ptr,
+                            ir_node *const other)
+{
+	if (!is_Proj(op) || get_irn_n_edges(op) != 1)
+		return NULL;
+	ir_node *const load = get_Proj_pred(op);
+	if (!is_Load(load) || get_nodes_block(load) != block
+	 || get_Load_ptr(load) != ptr || be_is_transformed(load))
+		return NULL;
+	/* the other operand must not depend on the Load */
+	if (other != NULL && input_depends_on_load(load, other))
+		return NULL;
+	if (mem_depends_on_load(block, load, mem))
+		return NULL;
+	return load;
+}
+
+/**
+ * Adds the address and memory inputs of a read-modify-write operation, which
+ * replaces @p load and the Store with memory @p mem.
+ */
+static void match_dest_am(ir_node *const load, ir_node *const mem,
+                          int *const arity, ir_node **const in,
+                          x86_addr_t *const addr)
+{
+	perform_address_matching_flags(get_Load_ptr(load), arity, in, addr,
+	                               x86_create_am_double_use);
+
+	ir_node *const load_mem = be_transform_node(get_Load_mem(load));
+	ir_node       *new_mem;
+	if (is_Proj(mem) && get_Proj_pred(mem) == load) {
+		new_mem = load_mem;
+	} else {
+		int       n_syncs = is_Sync(mem) ? get_Sync_n_preds(mem) : 1;
+		ir_node **syncs   = ALLOCAN(ir_node*, n_syncs + 1);
+		int       n       = 0;
+		if (is_Sync(mem)) {
+			foreach_irn_in(mem, i, pred) {
+				/* avoid memory loop */
+				if (is_Proj(pred) && get_Proj_pred(pred) == load)
+					continue;
+				syncs[n++] = be_transform_node(pred);
+			}
+		} else {
+			syncs[n++] = be_transform_node(mem);
+		}
+		syncs[n++] = load_mem;
+		ir_node *const new_block = be_transform_nodes_block(load);
+		new_mem = be_make_Sync(new_block, n, syncs);
+	}
+	int const mem_input = (*arity)++;
+	in[mem_input]   = new_mem;
+	addr->mem_input = mem_input;
+}
+
+/**
+ * Attaches the memory Proj of @p load to the read-modify-write operation
+ * @p new_node, which replaces the Load and @p store.
+ */
+static ir_node *finish_dest_am(ir_node *const new_node, ir_node *const load,
+                               ir_node *const store)
+{
+	set_irn_pinned(new_node, get_irn_pinned(store) || get_irn_pinned(load));
+
+	/* The Proj M of the Load may have further users, which must see the
+	 * memory of the new node as well. */
+	be_set_transformed_node(load, new_node);
+	ir_node *const load_mem = get_Proj_for_pn(load, pn_Load_M);
+	if (load_mem != NULL) {
+		ir_node *const new_load_mem = be_transform_node(load_mem);
+		set_Proj_pred(new_load_mem, new_node);
+	}
+	return be_new_Proj(new_node, pn_amd64_mem);
+}
+
+static ir_node *dest_am_binop(ir_node *const store, ir_node *const node,
+                              ir_node *op1, ir_node *op2,
+                              construct_binop_func const func,
+                              match_flags_t const flags)
+{
+	ir_node *const block = get_nodes_block(node);
+	ir_node *const mem   = get_Store_mem(store);
+	ir_node *const ptr   = get_Store_ptr(store);
+	ir_node       *load  = use_dest_am(block, op1, mem, ptr, op2);
+	if (load == NULL) {
+		if (!(flags & match_commutative))
+			return NULL;
+		ir_node *const tmp = op1;
+		op1  = op2;
+		op2  = tmp;
+		load = use_dest_am(block, op1, mem, ptr, op2);
+		if (load == NULL)
+			return NULL;
+	}
+
+	amd64_binop_addr_attr_t attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.base.base.size = x86_size_from_mode(get_irn_mode(node));
+
+	ir_node *in[4];
+	int      arity = 0;
+	if ((flags & match_immediate)
+	 && match_immediate_32(&attr.u.immediate, op2, false)) {
+		attr.base.base.op_mode = AMD64_OP_ADDR_IMM;
+	} else {
+		/* only the lower bits of the operand are stored */
+		op2 = be_skip_downconv(op2, true);
+		attr.base.base.op_mode = AMD64_OP_ADDR_REG;
+		int const reg_input = arity++;
+		in[reg_input]    = be_transform_node(op2);
+		attr.u.reg_input = reg_input;
+	}
+	match_dest_am(load, mem, &arity, in, &attr.base.addr);
+	assert((size_t)arity <= ARRAY_SIZE(in));
+
+	dbg_info *const dbgi      = get_irn_dbg_info(node);
+	ir_node  *const new_block = be_transform_node(block);
+	ir_node  *const new_node
+		= func(dbgi, new_block, arity, in, gp_am_reqs[arity - 1], &attr);
+	return finish_dest_am(new_node, load, store);
+}
+
+static ir_node *dest_am_shift(ir_node *const store, ir_node *const node,
+                              ir_node *const op1, ir_node *const op2,
+                              construct_binop_func const func)
+{
+	/* there is no shift by %cl with an address as destination here */
+	if (!is_Const(op2))
+		return NULL;
+	ir_mode *const mode = get_irn_mode(node);
+	if (get_mode_modulo_shift(mode) != 32 && get_mode_size_bits(mode) != 64)
+		return NULL;
+
+	ir_node *const block = get_nodes_block(node);
+	ir_node *const mem   = get_Store_mem(store);
+	ir_node *const ptr   = get_Store_ptr(store);
+	ir_node *const load  = use_dest_am(block, op1, mem, ptr, NULL);
+	if (load == NULL)
+		return NULL;
+
+	amd64_binop_addr_attr_t attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.base.base.op_mode  = AMD64_OP_ADDR_IMM;
+	attr.base.base.size     = x86_size_from_mode(mode);
+	attr.u.immediate.kind   = X86_IMM_VALUE;
+	attr.u.immediate.offset = (uint8_t)get_Const_long(op2);
+
+	ir_node *in[3];
+	int      arity = 0;
+	match_dest_am(load, mem, &arity, in, &attr.base.addr);
+	assert((size_t)arity <= ARRAY_SIZE(in));
+
+	dbg_info *const dbgi      = get_irn_dbg_info(node);
+	ir_node  *const new_block = be_transform_node(block);
+	ir_node  *const new_node
+		= func(dbgi, new_block, arity, in, gp_am_reqs[arity - 1], &attr);
+	return finish_dest_am(new_node, load, store);
+}
+
+typedef ir_node *(*construct_unop_mem_func)(dbg_info *dbgi, ir_node *block, int arity, ir_node *const *in, arch_register_req_t const **in_reqs, x86_insn_size_t size, x86_addr_t addr);
+
+static ir_node *dest_am_unop(ir_node *const store, ir_node *const node,
+                             ir_node *const op,
+                             construct_unop_mem_func const func)
+{
+	ir_node *const block = get_nodes_block(node);
+	ir_node *const mem   = get_Store_mem(store);
+	ir_node *const ptr   = get_Store_ptr(store);
+	ir_node *const load  = use_dest_am(block, op, mem, ptr, NULL);
+	if (load == NULL)
+		return NULL;
+
+	x86_addr_t addr;
+	memset(&addr, 0, sizeof(addr));
+	ir_node *in[3];
+	int      arity = 0;
+	match_dest_am(load, mem, &arity, in, &addr);
+	assert((size_t)arity <= ARRAY_SIZE(in));
+
+	dbg_info       *const dbgi      = get_irn_dbg_info(node);
+	ir_node        *const new_block = be_transform_node(block);
+	x86_insn_size_t const size      = x86_size_from_mode(get_irn_mode(node));
+	ir_node        *const new_node
+		= func(dbgi, new_block, arity, in, gp_am_reqs[arity - 1], size, addr);
+	return finish_dest_am(new_node, load, store);
+}
+
+/**
+ * Tries to turn a Store of an operation on a value loaded from the same
+ * address into a read-modify-write operation with the address as destination.
+ */
+static ir_node *try_create_dest_am(ir_node *const node)
+{
+	ir_node *const val  = get_Store_value(node);
+	ir_mode *const mode = get_irn_mode(val);
+	if (!mode_needs_gp_reg(mode))
+		return NULL;
+
+	/* the Store must be the only user of the value */
+	if (get_irn_n_edges(val) > 1)
+		return NULL;
+	if (get_nodes_block(val) != get_nodes_block(node))
+		return NULL;
+
+	switch (get_irn_opcode(val)) {
+	case iro_Add:
+		return dest_am_binop(node, val, get_Add_left(val), get_Add_right(val),
+		                     new_bd_amd64_add_mem,
+		                     match_commutative | match_immediate);
+	case iro_And:
+		return dest_am_binop(node, val, get_And_left(val), get_And_right(val),
+		                     new_bd_amd64_and_mem,
+		                     match_commutative | match_immediate);
+	case iro_Eor:
+		return dest_am_binop(node, val, get_Eor_left(val), get_Eor_right(val),
+		                     new_bd_amd64_xor_mem,
+		                     match_commutative | match_immediate);
+	case iro_Or:
+		return dest_am_binop(node, val, get_Or_left(val), get_Or_right(val),
+		                     new_bd_amd64_or_mem,
+		                     match_commutative | match_immediate);
+	case iro_Sub:
+		return dest_am_binop(node, val, get_Sub_left(val), get_Sub_right(val),
+		                     new_bd_amd64_sub_mem, match_immediate);
+	case iro_Shl:
+		return dest_am_shift(node, val, get_Shl_left(val), get_Shl_right(val),
+		                     new_bd_amd64_shl_mem);
+	case iro_Shr:
+		return dest_am_shift(node, val, get_Shr_left(val), get_Shr_right(val),
+		                     new_bd_amd64_shr_mem);
+	case iro_Shrs:
+		return dest_am_shift(node, val, get_Shrs_left(val),
+		                     get_Shrs_right(val), new_bd_amd64_sar_mem);
+	case iro_Minus:
+		return dest_am_unop(node, val, get_Minus_op(val),
+		                    new_bd_amd64_neg_mem);
+	case iro_Not:
+		return dest_am_unop(node, val, get_Not_op(val), new_bd_amd64_not_mem);
+	default:
+		return NULL;
+	}
+}
+
 static ir_node *gen_Store(ir_node *const node)
 {
+	ir_node *const dest_am = try_create_dest_am(node);
+	if (dest_am != NULL)
+		return dest_am;
+
 	dbg_info *const dbgi  = get_irn_dbg_info(node);
 	ir_node  *const block = be_transform_nodes_block(node);
 	ir_node  *const val   = get_Store_value(node);
@@ -2654,6 +2997,7 @@ ir_node *amd64_new_spill(ir_node *const value, ir_node *const after)
 				.immediate.kind = X86_IMM_FRAMEENT,
 				.variant        = X86_ADDR_BASE,
 				.base_input     = 1,
+				.mem_input      = 2,
 			},
 		},
 		.u.reg_input = 0,
@@ -2767,8 +3111,6 @@ static ir_node *gen_Unknown(ir_node *const node)
 	}
 }
 
-static const unsigned pn_amd64_mem = 2;
-
 static ir_node *gen_Proj_Load(ir_node *const node)
 {
 	ir_node  *const load     = get_Proj_pred(node);
@@ -2952,22 +3294,11 @@ static ir_node *gen_ffs(ir_node *const node)
 	                                       new_bd_amd64_bsf, pn_amd64_bsf_res);
 	ir_node  *const bsf     = skip_Proj(bsf_res);
 
-	/* seteq temp */
-	dbg_info *const dbgi    = get_irn_dbg_info(bsf);
-	ir_node  *const block   = get_nodes_block(bsf);
-	ir_node  *const flags   = be_new_Proj(bsf, pn_amd64_bsf_flags);
-	ir_node  *const setcc   = new_bd_amd64_setcc(dbgi, block, flags, x86_cc_equal);
-
-	/* movzbl temp, temp */
-	ir_node  *const movzbl_in[] = { setcc };
-	x86_addr_t movzbl_addr = {
-		.base_input = 0,
-		.variant    = X86_ADDR_REG,
-	};
-	ir_node *const movzbl
-		= new_bd_amd64_mov_gp(dbgi, block, ARRAY_SIZE(movzbl_in), movzbl_in,
-		                      reg_reqs, X86_SIZE_8, AMD64_OP_REG, movzbl_addr);
-	ir_node *const movzbl_res = be_new_Proj(movzbl, pn_amd64_mov_gp_res);
+	/* seteq temp; movzbl temp, temp */
+	dbg_info *const dbgi       = get_irn_dbg_info(bsf);
+	ir_node  *const block      = get_nodes_block(bsf);
+	ir_node  *const flags      = be_new_Proj(bsf, pn_amd64_bsf_flags);
+	ir_node  *const movzbl_res = create_setcc(dbgi, block, flags, x86_cc_equal);
 
 	/* neg temp */
 	x86_insn_size_t size    = get_amd64_attr_const(bsf)->size;
@@ -3135,6 +3466,40 @@ static ir_node *gen_va_start(ir_node *const node)
 	return amd64_initialize_va_list(dbgi, block, current_cconv, mem, ap, fp);
 }
 
+typedef ir_node *(*create_prefetch_func)(dbg_info *dbgi, ir_node *block,
+                                         int arity, ir_node *const *in,
+                                         arch_register_req_t const **in_reqs,
+                                         x86_addr_t addr);
+
+static ir_node *gen_prefetch(ir_node *const node)
+{
+	size_t const n_params = get_Builtin_n_params(node);
+	long   const locality = n_params > 2
+		? get_Const_long(get_Builtin_param(node, 2)) : 3;
+
+	int        arity = 0;
+	ir_node   *in[3];
+	x86_addr_t addr;
+	memset(&addr, 0, sizeof(addr));
+	perform_address_matching(get_Builtin_param(node, 0), &arity, in, &addr);
+	arch_register_req_t const **const reqs = gp_am_reqs[arity];
+	in[arity++] = be_transform_node(get_Builtin_mem(node));
+
+	/* the write hint is ignored, SSE has no prefetch for writing */
+	create_prefetch_func cons;
+	switch (locality) {
+	case 0:  cons = &new_bd_amd64_prefetchnta; break;
+	case 1:  cons = &new_bd_amd64_prefetcht2;  break;
+	case 2:  cons = &new_bd_amd64_prefetcht1;  break;
+	default: cons = &new_bd_amd64_prefetcht0;  break;
+	}
+	dbg_info *const dbgi     = get_irn_dbg_info(node);
+	ir_node  *const block    = be_transform_nodes_block(node);
+	ir_node  *const new_node = cons(dbgi, block, arity, in, reqs, addr);
+	set_irn_pinned(new_node, get_irn_pinned(node));
+	return new_node;
+}
+
 static ir_node *gen_Builtin(ir_node *const node)
 {
 	ir_builtin_kind const kind = get_Builtin_kind(node);
@@ -3151,6 +3516,8 @@ static ir_node *gen_Builtin(ir_node *const node)
 		return gen_saturating_increment(node);
 	case ir_bk_va_start:
 		return gen_va_start(node);
+	case ir_bk_prefetch:
+		return gen_prefetch(node);
 	default:
 		break;
 	}
@@ -3180,6 +3547,7 @@ static ir_node *gen_Proj_Builtin(ir_node *const proj)
 	case ir_bk_saturating_increment:
 		return be_new_Proj(new_node, pn_amd64_sbb_res);
 	case ir_bk_va_start:
+	case ir_bk_prefetch:
 		assert(get_Proj_num(proj) == pn_Builtin_M);
 		return new_node;
 	default:
@@ -3262,6 +3630,7 @@ static void amd64_register_transformers(void)
 	be_set_transform_function(op_Mod,               gen_Mod);
 	be_set_transform_function(op_Mul,               gen_Mul);
 	be_set_transform_function(op_Mulh,              gen_Mulh);
+	be_set_transform_function(op_Mux,               gen_Mux);
 	be_set_transform_function(op_Not,               gen_Not);
 	be_set_transform_function(op_Or,                gen_Or);
 	be_set_transform_function(op_Phi,               gen_Phi);
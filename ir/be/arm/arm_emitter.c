@@ -617,7 +617,7 @@ void arm_emit_function(ir_graph *irg)
 	arm_register_emitters();
 
 	/* create the block schedule */
-	ir_node **blk_sched = be_create_block_schedule(irg);
+	ir_node **blk_sched = be_create_block_schedule(irg, NULL);
 
 	ir_entity            *const entity = get_irg_entity(irg);
 	parameter_dbg_info_t *const infos  = construct_parameter_infos(irg);
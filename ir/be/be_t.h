@@ -41,6 +41,9 @@ struct be_options_t {
 	bool do_verify;            /**< backend verify option */
 	char ilp_solver[128];      /**< the ilp solver name */
 	bool verbose_asm;          /**< dump verbose assembler */
+	bool split_cold;           /**< move cold blocks into a separate section */
+	bool order_functions;      /**< order functions by call affinity */
+	bool emit_object;          /**< write an object file instead of assembler */
 };
 extern be_options_t be_options;
 
@@ -54,6 +57,7 @@ struct be_main_env_t {
 	ir_type    *pic_trampolines_type; /**< Class type containing all trampolines */
 	pmap       *ent_pic_symbol_map;
 	ir_type    *pic_symbols_type;
+	bool        has_profile;          /**< execfreqs come from profile data */
 };
 
 void be_set_constraint_support(asm_constraint_flags_t flags, char const *constraints);
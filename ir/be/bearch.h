@@ -292,7 +292,26 @@ struct arch_isa_if_t {
 
 	ir_jit_function_t* (*jit_compile)(ir_jit_segment_t *segment, ir_graph *irg);
 
-	void (*emit_function)(char *buffer, ir_jit_function_t *function);
+	void (*emit_function)(char *buffer, char const *address,
+	                      ir_jit_function_t *function);
+
+	/**
+	 * Returns the size of jit relocation kind @p be_kind in the code, 0 if
+	 * the target does not use it.
+	 */
+	unsigned (*jit_relocation_size)(uint8_t be_kind);
+
+	/**
+	 * Describes the target to the ELF object file writer, NULL if the
+	 * target cannot write object files.
+	 */
+	struct be_elf_target_t const *elf_target;
+
+	/**
+	 * Creates the stubs of the lazily compiling jit runtime, NULL if the
+	 * target does not support it.
+	 */
+	struct be_jit_stub_if_t const *jit_stubs;
 
 	/**
 	 * lowers current program for target. See the documentation for
@@ -18,9 +18,15 @@
  * to change as many edges to fallthroughs as possible, this is done by setting
  * a next and prev pointers on blocks. The greedy algorithm sorts the edges by
  * execution frequencies and tries to transform them to fallthroughs in this order
+ *
+ * Finally cold blocks are moved to the end of the schedule: Blocks which
+ * never reach a return (error paths ending in noreturn calls), blocks only
+ * reachable through such blocks and, with profile data, blocks which are
+ * (nearly) never executed. Emitters may put them into a separate section.
  */
 #include "beblocksched.h"
 
+#include "be_t.h"
 #include "bearch.h"
 #include "beirg.h"
 #include "bemodule.h"
@@ -36,6 +42,9 @@
 
 DEBUG_ONLY(static firm_dbg_module_t *dbg = NULL;)
 
+/** Blocks executed less often relative to the start block are cold. */
+#define COLD_FREQ_FACTOR 1e-4
+
 static bool blocks_removed;
 
 /**
@@ -142,6 +151,7 @@ struct blocksched_entry_t {
 	ir_node            *block;
 	blocksched_entry_t *next;
 	blocksched_entry_t *prev;
+	bool                cold;
 };
 
 typedef struct edge_t edge_t;
@@ -532,7 +542,88 @@ static ir_node **create_blocksched_array(blocksched_env_t *const env)
 	return block_list;
 }
 
-ir_node **be_create_block_schedule(ir_graph *irg)
+/**
+ * Checks whether a block is cold because of its successors (all of them are
+ * cold or it has none), its predecessors (all of them are cold) or its
+ * profiled execution frequency.
+ */
+static bool is_cold_block(ir_node const *block, double start_freq,
+                          bool has_profile)
+{
+	if (has_profile && get_block_execfreq(block) <= start_freq * COLD_FREQ_FACTOR)
+		return true;
+
+	bool all_succs_cold = true;
+	foreach_block_succ(block, edge) {
+		ir_node const *const succ = get_edge_src_irn(edge);
+		if (succ == get_irg_end_block(get_irn_irg(block))
+		    || !get_blocksched_entry(succ)->cold) {
+			all_succs_cold = false;
+			break;
+		}
+	}
+	if (all_succs_cold)
+		return true;
+
+	for (int i = 0, arity = get_Block_n_cfgpreds(block); i < arity; ++i) {
+		ir_node const *const pred = get_Block_cfgpred_block(block, i);
+		if (pred != NULL && !get_blocksched_entry(pred)->cold)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Moves the cold blocks to the end of the block schedule.
+ *
+ * @return the number of hot blocks
+ */
+static size_t move_cold_blocks(blocksched_env_t const *const env,
+                               ir_node **const block_list)
+{
+	size_t const count = ARR_LEN(block_list);
+	if (!be_options.split_cold)
+		return count;
+
+	ir_graph const *const irg         = env->irg;
+	ir_node  const *const start_block = get_irg_start_block(irg);
+	double          const start_freq  = get_block_execfreq(start_block);
+	bool            const has_profile = be_get_irg_main_env(irg)->has_profile
+	                                    && start_freq > 0.0;
+
+	/* iterate until the cold blocks are stable, every round adds at least
+	 * one block */
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t i = count; i-- > 0;) {
+			ir_node            *const block = block_list[i];
+			blocksched_entry_t *const entry = get_blocksched_entry(block);
+			if (entry->cold || block == start_block)
+				continue;
+			if (is_cold_block(block, start_freq, has_profile)) {
+				entry->cold = true;
+				changed     = true;
+			}
+		}
+	}
+
+	ir_node **const cold  = ALLOCAN(ir_node*, count);
+	size_t          n_hot = 0;
+	size_t          n_cold = 0;
+	for (size_t i = 0; i < count; ++i) {
+		ir_node *const block = block_list[i];
+		if (get_blocksched_entry(block)->cold) {
+			DB((dbg, LEVEL_1, "Cold block %+F\n", block));
+			cold[n_cold++] = block;
+		} else {
+			block_list[n_hot++] = block;
+		}
+	}
+	MEMCPY(block_list + n_hot, cold, n_cold);
+	return n_hot;
+}
+
+ir_node **be_create_block_schedule(ir_graph *irg, size_t *n_hot)
 {
 	blocksched_env_t env = {
 		.irg        = irg,
@@ -552,6 +643,9 @@ ir_node **be_create_block_schedule(ir_graph *irg)
 	coalesce_blocks(&env);
 
 	ir_node **const block_list = create_blocksched_array(&env);
+	size_t    const hot        = move_cold_blocks(&env, block_list);
+	if (n_hot != NULL)
+		*n_hot = hot;
 	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
 
 	DEL_ARR_F(env.edges);
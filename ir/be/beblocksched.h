@@ -12,8 +12,17 @@
 #ifndef FIRM_BE_BEBLOCKSCHED_H
 #define FIRM_BE_BEBLOCKSCHED_H
 
+#include <stddef.h>
+
 #include "firm_types.h"
 
-ir_node **be_create_block_schedule(ir_graph *irg);
+/**
+ * Computes the order in which the blocks of @p irg are emitted. Cold blocks
+ * are placed at the end of the schedule.
+ *
+ * @param n_hot  if not NULL, receives the number of blocks before the first
+ *               cold block
+ */
+ir_node **be_create_block_schedule(ir_graph *irg, size_t *n_hot);
 
 #endif
@@ -523,6 +523,14 @@ void be_dwarf_function_end(void)
 	}
 }
 
+void be_dwarf_function_cold_end(void)
+{
+	if (debug_level < LEVEL_FRAMEINFO)
+		return;
+	be_emit_cstring("\t.cfi_endproc\n");
+	be_emit_write_line();
+}
+
 static void emit_base_type_abbrev(void)
 {
 	begin_abbrev(abbrev_base_type, DW_TAG_base_type, DW_CHILDREN_no);
@@ -40,6 +40,9 @@ void be_dwarf_function_begin(void);
 /** debug for a function end */
 void be_dwarf_function_end(void);
 
+/** end the call frame information of the cold part of a function */
+void be_dwarf_function_cold_end(void);
+
 /** dump a variable in the global type */
 void be_dwarf_variable(const ir_entity *ent);
 
@@ -0,0 +1,1039 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Writes ELF relocatable object files.
+ *
+ * Only 64bit ELF with RELA relocations is supported. The sections follow the
+ * choice of the assembler output (see begnuas.c), but neither debug
+ * information nor call frame information is written.
+ */
+#include "beelf.h"
+
+#include "array.h"
+#include "begnuas.h"
+#include "bejit.h"
+#include "entity_t.h"
+#include "irnode_t.h"
+#include "obst.h"
+#include "panic.h"
+#include "pmap.h"
+#include "target_t.h"
+#include "tv_t.h"
+#include "util.h"
+#include <assert.h>
+#include <string.h>
+
+/** ELF constants, see the System V ABI. */
+enum {
+	ET_REL        = 1,
+	EV_CURRENT    = 1,
+	ELFCLASS64    = 2,
+	ELFDATA2LSB   = 1,
+	ELFDATA2MSB   = 2,
+	EHDR_SIZE     = 64,
+	SHDR_SIZE     = 64,
+	SYM_SIZE      = 24,
+	RELA_SIZE     = 24,
+
+	SHT_NULL      = 0,
+	SHT_PROGBITS  = 1,
+	SHT_SYMTAB    = 2,
+	SHT_STRTAB    = 3,
+	SHT_RELA      = 4,
+	SHT_NOBITS    = 8,
+
+	SHF_WRITE     = 0x01,
+	SHF_ALLOC     = 0x02,
+	SHF_EXECINSTR = 0x04,
+	SHF_MERGE     = 0x10,
+	SHF_STRINGS   = 0x20,
+	SHF_INFO_LINK = 0x40,
+
+	SHN_UNDEF     = 0,
+	SHN_ABS       = 0xFFF1,
+	SHN_COMMON    = 0xFFF2,
+
+	STB_LOCAL     = 0,
+	STB_GLOBAL    = 1,
+	STB_WEAK      = 2,
+
+	STT_NOTYPE    = 0,
+	STT_OBJECT    = 1,
+	STT_FUNC      = 2,
+	STT_SECTION   = 3,
+	STT_FILE      = 4,
+
+	STV_DEFAULT   = 0,
+	STV_HIDDEN    = 2,
+	STV_PROTECTED = 3,
+};
+
+typedef struct elf_section_info_t {
+	char const *name;
+	uint32_t    type;
+	uint32_t    flags;
+	uint32_t    entsize;
+} elf_section_info_t;
+
+static elf_section_info_t const section_infos[] = {
+	[GAS_SECTION_TEXT]         = { ".text",              SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,           0 },
+	[GAS_SECTION_DATA]         = { ".data",              SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_RODATA]       = { ".rodata",            SHT_PROGBITS, SHF_ALLOC,                           0 },
+	[GAS_SECTION_REL_RO_LOCAL] = { ".data.rel.ro.local", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_REL_RO]       = { ".data.rel.ro",       SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_BSS]          = { ".bss",               SHT_NOBITS,   SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_CONSTRUCTORS] = { ".ctors",             SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_DESTRUCTORS]  = { ".dtors",             SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_JCR]          = { ".jcr",               SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,               0 },
+	[GAS_SECTION_CSTRING]      = { ".rodata.str1.1",     SHT_PROGBITS, SHF_ALLOC | SHF_MERGE | SHF_STRINGS, 1 },
+	[GAS_SECTION_LITERAL4]     = { ".rodata.cst4",       SHT_PROGBITS, SHF_ALLOC | SHF_MERGE,               4 },
+	[GAS_SECTION_LITERAL8]     = { ".rodata.cst8",       SHT_PROGBITS, SHF_ALLOC | SHF_MERGE,               8 },
+	[GAS_SECTION_LITERAL16]    = { ".rodata.cst16",      SHT_PROGBITS, SHF_ALLOC | SHF_MERGE,              16 },
+};
+
+typedef struct elf_section_t elf_section_t;
+
+typedef struct elf_relocation_t {
+	uint64_t            offset;  /**< position in the section */
+	be_elf_relocation_t kind;
+	ir_entity const    *entity;  /**< referenced entity or NULL */
+	elf_section_t      *section; /**< referenced section if entity is NULL */
+	int64_t             addend;
+} elf_relocation_t;
+
+struct elf_section_t {
+	elf_section_info_t const *info;
+	uint64_t                  alignment;
+	uint64_t                  size;
+	char                     *data;        /**< contents unless SHT_NOBITS */
+	elf_relocation_t         *relocations;
+	unsigned                  index;       /**< section header index */
+	unsigned                  rela_index;  /**< header index of relocations */
+	unsigned                  symbol;      /**< symbol index of the section */
+	uint32_t                  name;
+	uint32_t                  rela_name;
+	uint64_t                  file_offset;
+	uint64_t                  rela_file_offset;
+};
+
+typedef struct elf_symbol_t {
+	ir_entity const *entity;
+	elf_section_t   *section;  /**< defining section, NULL if undefined */
+	bool             common;
+	bool             named;    /**< private entities get no symbol */
+	bool             merged;   /**< referenced into a mergeable section */
+	uint8_t          binding;
+	uint8_t          type;
+	uint8_t          other;
+	uint64_t         value;
+	uint64_t         size;
+	unsigned         index;
+	uint32_t         name;
+} elf_symbol_t;
+
+static FILE                  *output;
+static char const            *cup_name;
+static be_elf_target_t const *target;
+static ir_jit_segment_t      *segment;
+static struct obstack         obst;
+static elf_section_t         *sections[GAS_SECTION_LITERAL16 + 1];
+static elf_section_t        **section_order;
+static pmap                  *symbols;     /**< entity -> elf_symbol_t */
+static elf_symbol_t         **symbol_order;
+static char                  *strtab;
+static char                  *shstrtab;
+static uint64_t               file_pos;
+
+/* state of the relocation callback */
+static elf_section_t *reloc_section;
+static char          *reloc_buffer;
+static uint64_t       reloc_buffer_offset;
+
+static uint32_t add_string(char **const table, char const *const string)
+{
+	size_t const pos = ARR_LEN(*table);
+	size_t const len = strlen(string) + 1;
+	ARR_EXTEND(char, *table, len);
+	memcpy(*table + pos, string, len);
+	return pos;
+}
+
+static elf_section_t *get_section(be_gas_section_t const section)
+{
+	if (section & GAS_SECTION_FLAG_TLS)
+		panic("thread local storage not supported in ELF object files");
+	be_gas_section_t const base = section & GAS_SECTION_TYPE_MASK;
+	if ((size_t)base >= ARRAY_SIZE(section_infos)
+	 || section_infos[base].name == NULL)
+		panic("section %u not supported in ELF object files", (unsigned)base);
+
+	elf_section_t *res = sections[base];
+	if (res == NULL) {
+		res = OALLOCZ(&obst, elf_section_t);
+		res->info        = &section_infos[base];
+		res->alignment   = 1;
+		res->data        = NEW_ARR_F(char, 0);
+		res->relocations = NEW_ARR_F(elf_relocation_t, 0);
+		sections[base]   = res;
+		ARR_APP1(elf_section_t*, section_order, res);
+	}
+	return res;
+}
+
+/** Reserves @p size bytes aligned to @p alignment and returns their offset. */
+static uint64_t reserve(elf_section_t *const section, uint64_t const alignment,
+                        uint64_t const size)
+{
+	uint64_t const offset = round_up2(section->size, alignment);
+	section->alignment = MAX(section->alignment, alignment);
+	section->size      = offset + size;
+	if (section->info->type != SHT_NOBITS) {
+		size_t const old_len = ARR_LEN(section->data);
+		ARR_RESIZE(char, section->data, section->size);
+		memset(section->data + old_len, 0, section->size - old_len);
+	}
+	return offset;
+}
+
+static void add_relocation(elf_section_t *const section, uint64_t const offset,
+                           be_elf_relocation_t const kind,
+                           ir_entity const *const entity,
+                           elf_section_t *const dest, int64_t const addend)
+{
+	elf_relocation_t const relocation = {
+		.offset  = offset,
+		.kind    = kind,
+		.entity  = entity,
+		.section = dest,
+		.addend  = addend,
+	};
+	ARR_APP1(elf_relocation_t, section->relocations, relocation);
+}
+
+static void put_value(char *const buffer, uint64_t const value,
+                      unsigned const size)
+{
+	bool const big_endian = ir_target_big_endian();
+	for (unsigned i = 0; i < size; ++i) {
+		buffer[big_endian ? size - 1 - i : i] = (char)(value >> (8 * i));
+	}
+}
+
+static void put_tarval(char *const buffer, ir_tarval *const tv,
+                       unsigned const size)
+{
+	unsigned const n          = MIN(size, get_mode_size_bytes(get_tarval_mode(tv)));
+	bool     const big_endian = ir_target_big_endian();
+	for (unsigned i = 0; i < n; ++i) {
+		buffer[big_endian ? n - 1 - i : i] = get_tarval_sub_bits(tv, i);
+	}
+}
+
+static elf_symbol_t *get_symbol(ir_entity const *const entity)
+{
+	elf_symbol_t *symbol = pmap_get(elf_symbol_t, symbols, entity);
+	if (symbol == NULL) {
+		symbol = OALLOCZ(&obst, elf_symbol_t);
+		symbol->entity = entity;
+		pmap_insert(symbols, entity, symbol);
+	}
+	return symbol;
+}
+
+static void define_symbol(ir_entity const *const entity,
+                          elf_section_t *const section, uint64_t const value,
+                          uint64_t const size)
+{
+	elf_symbol_t *const symbol = get_symbol(entity);
+	if (symbol->section != NULL || symbol->common)
+		panic("entity %+F defined twice", entity);
+	symbol->section = section;
+	symbol->value   = value;
+	symbol->size    = size;
+	symbol->type    = is_method_entity(entity) ? STT_FUNC : STT_OBJECT;
+}
+
+void be_elf_begin(FILE *const file, char const *const name,
+                  be_elf_target_t const *const elf_target)
+{
+	output   = file;
+	cup_name = name;
+	target   = elf_target;
+	segment  = be_new_jit_segment();
+	obstack_init(&obst);
+	memset(sections, 0, sizeof(sections));
+	section_order = NEW_ARR_F(elf_section_t*, 0);
+	symbols       = pmap_create();
+
+	/* the text section always comes first */
+	get_section(GAS_SECTION_TEXT);
+}
+
+ir_jit_segment_t *be_elf_get_segment(void)
+{
+	return segment;
+}
+
+static unsigned elf_relocation_callback(char *const buffer,
+                                        char const *const address,
+                                        uint8_t const be_kind,
+                                        ir_entity *const entity,
+                                        int32_t const offset)
+{
+	(void)address;
+	be_elf_relocation_t const reloc = target->get_relocation(be_kind);
+	uint64_t const position = reloc_buffer_offset + (buffer - reloc_buffer);
+	if (entity != NULL) {
+		add_relocation(reloc_section, position, reloc, entity, NULL,
+		               offset);
+	} else if (reloc.pc_relative) {
+		/* offsets of fragment relocations are relative to the relocation */
+		put_value(buffer, (uint64_t)(int64_t)offset, reloc.size);
+		return reloc.size;
+	} else {
+		add_relocation(reloc_section, position, reloc, NULL,
+		               reloc_section, (int64_t)position + offset);
+	}
+	memset(buffer, 0, reloc.size);
+	return reloc.size;
+}
+
+void be_elf_add_function(ir_entity *const entity,
+                         ir_jit_function_t *const function)
+{
+	elf_section_t *const text = get_section(be_gas_get_entity_section(entity)
+	                                        & ~GAS_SECTION_FLAG_COMDAT);
+	uint64_t const old_size = text->size;
+	uint64_t const size     = be_get_function_size(function);
+	uint64_t const offset
+		= reserve(text, 1U << target->function_p2align, size);
+	if (offset > old_size)
+		target->nops(text->data + old_size, offset - old_size);
+
+	reloc_section       = text;
+	reloc_buffer        = text->data + offset;
+	reloc_buffer_offset = offset;
+	be_jit_emit_interface_t const emitter = {
+		.nops       = target->nops,
+		.relocation = elf_relocation_callback,
+	};
+	be_jit_emit_memory(reloc_buffer, reloc_buffer, function, &emitter);
+
+	define_symbol(entity, text, offset, size);
+}
+
+void be_elf_add_jump_table(ir_entity const *const table,
+                           ir_entity const *const function,
+                           be_elf_relocation_t const reloc,
+                           unsigned const *const targets,
+                           size_t const n_targets)
+{
+	elf_symbol_t const *const code = get_symbol(function);
+	assert(code->section != NULL);
+	elf_section_t *const rodata = get_section(GAS_SECTION_RODATA);
+	uint64_t const size   = (uint64_t)reloc.size * n_targets;
+	uint64_t const offset = reserve(rodata, reloc.size, size);
+	for (size_t i = 0; i < n_targets; ++i) {
+		uint64_t const entry  = offset + i * reloc.size;
+		int64_t        addend = code->value + targets[i];
+		if (reloc.pc_relative)
+			addend += entry - offset;
+		add_relocation(rodata, entry, reloc, NULL, code->section, addend);
+	}
+	define_symbol(table, rodata, offset, size);
+}
+
+/**
+ * Evaluates the initializer expression @p node to @p value plus the address
+ * of @p entity if it is not NULL.
+ */
+static void eval_expression(ir_node const *const node,
+                            ir_entity const **const entity,
+                            uint64_t *const value)
+{
+	switch (get_irn_opcode(node)) {
+	case iro_Conv:
+		eval_expression(get_Conv_op(node), entity, value);
+		return;
+
+	case iro_Const: {
+		ir_tarval *const tv    = get_Const_tarval(node);
+		unsigned   const bytes = get_mode_size_bytes(get_tarval_mode(tv));
+		*entity = NULL;
+		*value  = 0;
+		for (unsigned i = 0; i < MIN(bytes, 8U); ++i) {
+			*value |= (uint64_t)get_tarval_sub_bits(tv, i) << (8 * i);
+		}
+		return;
+	}
+
+	case iro_Address:
+		*entity = get_Address_entity(node);
+		*value  = 0;
+		if (get_entity_kind(*entity) == IR_ENTITY_LABEL)
+			panic("label addresses not supported in ELF object files");
+		return;
+
+	case iro_Offset:
+		*entity = NULL;
+		*value  = get_entity_offset(get_Offset_entity(node));
+		return;
+
+	case iro_Align:
+		*entity = NULL;
+		*value  = get_type_alignment(get_Align_type(node));
+		return;
+
+	case iro_Size:
+		*entity = NULL;
+		*value  = get_type_size(get_Size_type(node));
+		return;
+
+	case iro_Unknown:
+		*entity = NULL;
+		*value  = 0;
+		return;
+
+	case iro_Add:
+	case iro_Sub:
+	case iro_Mul: {
+		ir_entity const *left_entity;
+		ir_entity const *right_entity;
+		uint64_t         left;
+		uint64_t         right;
+		eval_expression(get_binop_left(node),  &left_entity,  &left);
+		eval_expression(get_binop_right(node), &right_entity, &right);
+		if (is_Add(node)) {
+			if (left_entity != NULL && right_entity != NULL)
+				break;
+			*entity = left_entity != NULL ? left_entity : right_entity;
+			*value  = left + right;
+		} else if (is_Sub(node)) {
+			if (right_entity != NULL && right_entity != left_entity)
+				break;
+			*entity = right_entity != NULL ? NULL : left_entity;
+			*value  = left - right;
+		} else {
+			if (left_entity != NULL || right_entity != NULL)
+				break;
+			*entity = NULL;
+			*value  = left * right;
+		}
+		return;
+	}
+
+	default:
+		break;
+	}
+	panic("unsupported initializer expression %+F", node);
+}
+
+static void write_expression(elf_section_t *const section,
+                             uint64_t const offset, ir_node const *const node,
+                             ir_type *const type)
+{
+	char     *const buffer = section->data + offset;
+	unsigned  const size   = get_type_size(type);
+	if (is_Const(node)) {
+		put_tarval(buffer, get_Const_tarval(node), size);
+		return;
+	}
+
+	ir_entity const *entity;
+	uint64_t         value;
+	eval_expression(node, &entity, &value);
+	if (entity == NULL) {
+		put_value(buffer, value, MIN(size, 8U));
+		return;
+	}
+	if (size != ir_target_pointer_size())
+		panic("address of %+F does not fit into %u bytes", entity, size);
+	be_elf_relocation_t const kind = {
+		.type = target->data_relocation,
+		.size = size,
+	};
+	add_relocation(section, offset, kind, entity, NULL, (int64_t)value);
+}
+
+static void write_bitfield(char *const buffer, unsigned const offset_bits,
+                           unsigned const bitfield_size,
+                           ir_initializer_t const *const initializer,
+                           ir_type *const type)
+{
+	ir_tarval *tv;
+	switch (get_initializer_kind(initializer)) {
+	case IR_INITIALIZER_NULL:
+		return;
+	case IR_INITIALIZER_TARVAL:
+		tv = get_initializer_tarval_value(initializer);
+		break;
+	case IR_INITIALIZER_CONST: {
+		ir_node *const node = get_initializer_const_value(initializer);
+		if (!is_Const(node))
+			panic("bitfield initializer not a Const node");
+		tv = get_Const_tarval(node);
+		break;
+	}
+	default:
+		panic("bitfield initializer is compound");
+	}
+
+	unsigned const value_len  = get_type_size(type);
+	bool     const big_endian = ir_target_big_endian();
+	for (unsigned bit = 0; bit < bitfield_size; ++bit) {
+		unsigned const src = bit;
+		unsigned const dst = bit + offset_bits;
+		if (!((get_tarval_sub_bits(tv, src / 8) >> (src % 8)) & 1))
+			continue;
+		unsigned const byte = big_endian ? value_len - dst / 8 - 1 : dst / 8;
+		buffer[byte] |= 1 << (dst % 8);
+	}
+}
+
+static void write_initializer(elf_section_t *const section,
+                              uint64_t const offset,
+                              ir_initializer_t const *const initializer,
+                              ir_type *const type)
+{
+	switch (get_initializer_kind(initializer)) {
+	case IR_INITIALIZER_NULL:
+		return;
+
+	case IR_INITIALIZER_TARVAL:
+		put_tarval(section->data + offset,
+		           get_initializer_tarval_value(initializer),
+		           get_type_size(type));
+		return;
+
+	case IR_INITIALIZER_CONST:
+		write_expression(section, offset,
+		                 get_initializer_const_value(initializer), type);
+		return;
+
+	case IR_INITIALIZER_COMPOUND:
+		if (is_Array_type(type)) {
+			ir_type *const element_type = get_array_element_type(type);
+			unsigned const alignment    = get_type_alignment(element_type);
+			unsigned const skip
+				= round_up2(get_type_size(element_type), alignment);
+			for (size_t i = 0, n = get_initializer_compound_n_entries(initializer);
+			     i < n; ++i) {
+				ir_initializer_t const *const sub_initializer
+					= get_initializer_compound_value(initializer, i);
+				write_initializer(section, offset + i * skip, sub_initializer,
+				                  element_type);
+			}
+		} else {
+			assert(is_compound_type(type));
+			for (size_t i = 0, n = get_compound_n_members(type); i < n; ++i) {
+				ir_entity *const member = get_compound_member(type, i);
+				uint64_t   const member_offset
+					= offset + get_entity_offset(member);
+
+				assert(i < get_initializer_compound_n_entries(initializer));
+				ir_initializer_t const *const sub_initializer
+					= get_initializer_compound_value(initializer, i);
+
+				ir_type *const subtype       = get_entity_type(member);
+				unsigned const bitfield_size = get_entity_bitfield_size(member);
+				if (bitfield_size > 0) {
+					write_bitfield(section->data + member_offset,
+					               get_entity_bitfield_offset(member),
+					               bitfield_size, sub_initializer, subtype);
+					continue;
+				}
+				write_initializer(section, member_offset, sub_initializer,
+				                  subtype);
+			}
+		}
+		return;
+	}
+	panic("invalid initializer");
+}
+
+static void add_global(ir_entity const *const entity)
+{
+	ir_entity_kind const kind = get_entity_kind(entity);
+	if (kind == IR_ENTITY_LABEL || kind == IR_ENTITY_METHOD
+	 || kind == IR_ENTITY_ALIAS)
+		return;
+
+	be_gas_section_t const section_kind = be_gas_get_entity_section(entity);
+	ir_visibility    const visibility   = get_entity_visibility(entity);
+	ir_linkage       const linkage      = get_entity_linkage(entity);
+	bool             const zero_initializer
+		= be_gas_entity_is_zero_initialized(entity);
+	unsigned long          size         = be_gas_get_entity_size(entity);
+	unsigned         const alignment
+		= MAX(be_gas_get_entity_alignment(entity), 1U);
+	if (!is_po2_or_zero(alignment))
+		panic("alignment not a power of 2");
+	if (size == 0)
+		size = 1;
+
+	/* see emit_global() in begnuas.c for the choice of common symbols */
+	if ((linkage & IR_LINKAGE_MERGE || zero_initializer)
+	 && !(section_kind & GAS_SECTION_FLAG_TLS)) {
+		switch (visibility) {
+		case ir_visibility_external:
+		case ir_visibility_external_private:
+		case ir_visibility_external_protected:
+			if (linkage & IR_LINKAGE_MERGE) {
+				elf_symbol_t *const symbol = get_symbol(entity);
+				symbol->common = true;
+				symbol->type   = STT_OBJECT;
+				symbol->value  = alignment;
+				symbol->size   = size;
+				return;
+			}
+			break;
+		case ir_visibility_local:
+		case ir_visibility_private:
+			if (!(linkage & IR_LINKAGE_CONSTANT)) {
+				elf_section_t *const bss    = get_section(GAS_SECTION_BSS);
+				uint64_t       const offset = reserve(bss, alignment, size);
+				define_symbol(entity, bss, offset, size);
+				return;
+			}
+			break;
+		}
+	}
+
+	if (!entity_has_definition(entity))
+		return;
+
+	elf_section_t *const section
+		= get_section(section_kind & ~GAS_SECTION_FLAG_COMDAT);
+	uint64_t const offset = reserve(section, alignment, size);
+	if (section->info->type != SHT_NOBITS && !zero_initializer) {
+		write_initializer(section, offset, get_entity_initializer(entity),
+		                  get_entity_type(entity));
+	}
+	define_symbol(entity, section, offset, get_type_size(get_entity_type(entity)));
+}
+
+static void add_globals(ir_type *const type)
+{
+	for (size_t i = 0, n = get_compound_n_members(type); i < n; ++i) {
+		ir_entity *const entity = get_compound_member(type, i);
+		if (!(get_entity_linkage(entity) & IR_LINKAGE_NO_CODEGEN))
+			add_global(entity);
+	}
+}
+
+static void add_aliases(ir_type *const type)
+{
+	for (size_t i = 0, n = get_compound_n_members(type); i < n; ++i) {
+		ir_entity *const entity = get_compound_member(type, i);
+		if (!is_alias_entity(entity)
+		 || get_entity_linkage(entity) & IR_LINKAGE_NO_CODEGEN)
+			continue;
+		elf_symbol_t const *const aliased
+			= pmap_get(elf_symbol_t, symbols, get_entity_alias(entity));
+		if (aliased == NULL || aliased->section == NULL)
+			panic("alias %+F of undefined entity", entity);
+		define_symbol(entity, aliased->section, aliased->value, aliased->size);
+		get_symbol(entity)->type = aliased->type;
+	}
+}
+
+/**
+ * Determines binding and visibility of the symbols and turns references to
+ * private entities into references to their section.
+ */
+static void finish_symbols(void)
+{
+	foreach_pmap(symbols, entry) {
+		elf_symbol_t    *const symbol = (elf_symbol_t*)entry->value;
+		ir_entity const *const entity = symbol->entity;
+		ir_linkage       const linkage = get_entity_linkage(entity);
+		symbol->named = true;
+		switch (get_entity_visibility(entity)) {
+		case ir_visibility_private:
+		case ir_visibility_local:
+			if (symbol->section == NULL)
+				panic("local entity %+F is not defined", entity);
+			if (get_entity_visibility(entity) == ir_visibility_private)
+				symbol->named = false;
+			symbol->binding = STB_LOCAL;
+			break;
+		case ir_visibility_external_private:
+			symbol->other = STV_HIDDEN;
+			goto external;
+		case ir_visibility_external_protected:
+			symbol->other = STV_PROTECTED;
+			goto external;
+		case ir_visibility_external:
+external:
+			/* mergeable functions have no comdat groups here, so let the
+			 * linker pick one of the definitions */
+			symbol->binding = linkage & IR_LINKAGE_WEAK
+			               || (linkage & IR_LINKAGE_MERGE && !symbol->common)
+			                ? STB_WEAK : STB_GLOBAL;
+			break;
+		}
+		if (get_id_str(get_entity_ld_ident(entity))[0] == '\0')
+			symbol->named = false;
+	}
+
+	for (size_t s = 0, n = ARR_LEN(section_order); s < n; ++s) {
+		elf_section_t *const section = section_order[s];
+		size_t               n_kept  = 0;
+		for (size_t r = 0, n_relocs = ARR_LEN(section->relocations);
+		     r < n_relocs; ++r) {
+			elf_relocation_t *const relocation = &section->relocations[r];
+			section->relocations[n_kept++] = *relocation;
+			if (relocation->entity == NULL)
+				continue;
+			elf_symbol_t *const symbol = get_symbol(relocation->entity);
+			if (symbol->section == NULL && !symbol->common) {
+				/* referenced but undefined */
+				ir_entity const *const entity = relocation->entity;
+				ir_visibility    const vis    = get_entity_visibility(entity);
+				if (vis == ir_visibility_local || vis == ir_visibility_private)
+					panic("local entity %+F is not defined", entity);
+				symbol->named   = true;
+				symbol->binding = get_entity_linkage(entity) & IR_LINKAGE_WEAK
+				                ? STB_WEAK : STB_GLOBAL;
+			} else if (symbol->binding == STB_LOCAL
+			        && symbol->section == section
+			        && relocation->kind.pc_relative) {
+				/* resolve references within the section right away */
+				int64_t const value = symbol->value + relocation->addend
+				                    - relocation->offset;
+				put_value(section->data + relocation->offset, value,
+				          relocation->kind.size);
+				--n_kept;
+			} else if (!symbol->named && relocation->addend != 0
+			        && symbol->section->info->flags & SHF_MERGE) {
+				/* like the assembler, keep the symbol, as the linker can
+				 * only map addends to the start of merged entries */
+				symbol->merged = true;
+			} else if (!symbol->named) {
+				elf_relocation_t *const kept
+					= &section->relocations[n_kept - 1];
+				kept->entity  = NULL;
+				kept->section = symbol->section;
+				kept->addend += symbol->value;
+			}
+		}
+		ARR_SHRINKLEN(section->relocations, n_kept);
+	}
+
+	foreach_pmap(symbols, entry) {
+		elf_symbol_t *const symbol = (elf_symbol_t*)entry->value;
+		if (symbol->merged)
+			symbol->named = true;
+	}
+}
+
+static uint32_t add_symbol_name(ir_entity const *const entity)
+{
+	char const *const name = get_id_str(get_entity_ld_ident(entity));
+	if (get_entity_visibility(entity) != ir_visibility_private)
+		return add_string(&strtab, name);
+
+	/* use the same names as the assembler output */
+	uint32_t const res = add_string(&strtab, be_gas_get_private_prefix());
+	ARR_SHRINKLEN(strtab, ARR_LEN(strtab) - 1);
+	add_string(&strtab, name);
+	return res;
+}
+
+static int cmp_symbol(void const *const a, void const *const b)
+{
+	elf_symbol_t const *const s0 = *(elf_symbol_t const**)a;
+	elf_symbol_t const *const s1 = *(elf_symbol_t const**)b;
+	/* locals first, otherwise keep the order of definition */
+	bool const global0 = s0->binding != STB_LOCAL;
+	bool const global1 = s1->binding != STB_LOCAL;
+	if (global0 != global1)
+		return global0 - global1;
+	return s0->index < s1->index ? -1 : s0->index > s1->index;
+}
+
+/**
+ * Assigns section header indices, symbol table indices and names.
+ *
+ * @return  the index of the first global symbol
+ */
+static unsigned layout_symbols(void)
+{
+	shstrtab = NEW_ARR_F(char, 0);
+	strtab   = NEW_ARR_F(char, 0);
+	add_string(&shstrtab, "");
+	add_string(&strtab, "");
+
+	/* null symbol, file symbol and the section symbols come first */
+	unsigned next_symbol = 2;
+	unsigned next_index  = 1;
+	for (size_t s = 0, n = ARR_LEN(section_order); s < n; ++s) {
+		elf_section_t *const section = section_order[s];
+		section->index  = next_index++;
+		section->symbol = next_symbol++;
+		section->name   = add_string(&shstrtab, section->info->name);
+	}
+
+	symbol_order = NEW_ARR_F(elf_symbol_t*, 0);
+	unsigned n_symbols = 0;
+	foreach_pmap(symbols, entry) {
+		elf_symbol_t *const symbol = (elf_symbol_t*)entry->value;
+		if (!symbol->named)
+			continue;
+		/* pmap iteration order is arbitrary, sort by entity number */
+		symbol->index = get_entity_nr(symbol->entity);
+		ARR_APP1(elf_symbol_t*, symbol_order, symbol);
+		++n_symbols;
+	}
+	QSORT_ARR(symbol_order, cmp_symbol);
+
+	unsigned first_global = next_symbol + n_symbols;
+	for (size_t i = 0; i < n_symbols; ++i) {
+		elf_symbol_t *const symbol = symbol_order[i];
+		if (symbol->binding != STB_LOCAL && first_global > next_symbol)
+			first_global = next_symbol;
+		symbol->index = next_symbol++;
+		symbol->name  = add_symbol_name(symbol->entity);
+	}
+	return first_global;
+}
+
+static void write_u8(uint8_t const value)
+{
+	fputc(value, output);
+	++file_pos;
+}
+
+static void write_u(uint64_t const value, unsigned const size)
+{
+	char buffer[8];
+	put_value(buffer, value, size);
+	fwrite(buffer, 1, size, output);
+	file_pos += size;
+}
+
+static void write_bytes(char const *const data, size_t const size)
+{
+	fwrite(data, 1, size, output);
+	file_pos += size;
+}
+
+/** Pads the output with zeros up to file offset @p offset. */
+static void write_padding(uint64_t const offset)
+{
+	assert(file_pos <= offset);
+	while (file_pos < offset)
+		write_u8(0);
+}
+
+static void write_section_header(uint32_t const name, uint32_t const type,
+                                 uint64_t const flags, uint64_t const offset,
+                                 uint64_t const size, uint32_t const link,
+                                 uint32_t const info, uint64_t const alignment,
+                                 uint64_t const entsize)
+{
+	write_u(name,      4);
+	write_u(type,      4);
+	write_u(flags,     8);
+	write_u(0,         8); /* address */
+	write_u(offset,    8);
+	write_u(size,      8);
+	write_u(link,      4);
+	write_u(info,      4);
+	write_u(alignment, 8);
+	write_u(entsize,   8);
+}
+
+static void write_symbol(uint32_t const name, uint8_t const info,
+                         uint8_t const other, uint16_t const shndx,
+                         uint64_t const value, uint64_t const size)
+{
+	write_u(name,  4);
+	write_u8(info);
+	write_u8(other);
+	write_u(shndx, 2);
+	write_u(value, 8);
+	write_u(size,  8);
+}
+
+static uint8_t symbol_info(uint8_t const binding, uint8_t const type)
+{
+	return binding << 4 | type;
+}
+
+static void write_object(void)
+{
+	unsigned const first_global = layout_symbols();
+	uint32_t const file_name    = add_string(&strtab, cup_name);
+
+	/* the relocation sections follow the content sections */
+	size_t   const n_sections = ARR_LEN(section_order);
+	unsigned       next_index = n_sections + 1;
+	uint64_t       pos        = EHDR_SIZE;
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t *const section = section_order[s];
+		pos = round_up2(pos, section->alignment);
+		section->file_offset = pos;
+		if (section->info->type != SHT_NOBITS)
+			pos += section->size;
+	}
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t *const section = section_order[s];
+		size_t const n_relocations = ARR_LEN(section->relocations);
+		if (n_relocations == 0)
+			continue;
+		char *const name = XMALLOCN(char, strlen(section->info->name) + 6);
+		strcpy(name, ".rela");
+		strcat(name, section->info->name);
+		section->rela_index       = next_index++;
+		section->rela_name        = add_string(&shstrtab, name);
+		section->rela_file_offset = pos = round_up2(pos, 8);
+		pos += n_relocations * RELA_SIZE;
+		free(name);
+	}
+	++next_index; /* .note.GNU-stack */
+	unsigned const symtab_index   = next_index++;
+	unsigned const strtab_index   = next_index++;
+	unsigned const shstrtab_index = next_index++;
+	uint32_t const note_name      = add_string(&shstrtab, ".note.GNU-stack");
+	uint32_t const symtab_name    = add_string(&shstrtab, ".symtab");
+	uint32_t const strtab_name    = add_string(&shstrtab, ".strtab");
+	uint32_t const shstrtab_name  = add_string(&shstrtab, ".shstrtab");
+	unsigned const n_symbols      = 2 + n_sections + ARR_LEN(symbol_order);
+	uint64_t const symtab_offset  = round_up2(pos, 8);
+	uint64_t const strtab_offset  = symtab_offset + n_symbols * SYM_SIZE;
+	uint64_t const shstrtab_offset = strtab_offset + ARR_LEN(strtab);
+	uint64_t const shoff
+		= round_up2(shstrtab_offset + ARR_LEN(shstrtab), 8);
+
+	/* ELF header */
+	file_pos = 0;
+	write_bytes("\177ELF", 4);
+	write_u8(ELFCLASS64);
+	write_u8(ir_target_big_endian() ? ELFDATA2MSB : ELFDATA2LSB);
+	write_u8(EV_CURRENT);
+	for (unsigned i = 7; i < 16; ++i)
+		write_u8(0);
+	write_u(ET_REL,          2);
+	write_u(target->machine, 2);
+	write_u(EV_CURRENT,      4);
+	write_u(0,               8); /* entry */
+	write_u(0,               8); /* program headers */
+	write_u(shoff,           8);
+	write_u(0,               4); /* flags */
+	write_u(EHDR_SIZE,       2);
+	write_u(0,               2);
+	write_u(0,               2);
+	write_u(SHDR_SIZE,       2);
+	write_u(next_index,      2);
+	write_u(shstrtab_index,  2);
+
+	/* section contents */
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t const *const section = section_order[s];
+		write_padding(section->file_offset);
+		if (section->info->type != SHT_NOBITS)
+			write_bytes(section->data, section->size);
+	}
+
+	/* relocations */
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t const *const section = section_order[s];
+		if (section->rela_index == 0)
+			continue;
+		write_padding(section->rela_file_offset);
+		for (size_t r = 0, n = ARR_LEN(section->relocations); r < n; ++r) {
+			elf_relocation_t const *const relocation
+				= &section->relocations[r];
+			uint64_t const symbol = relocation->entity != NULL
+				? get_symbol(relocation->entity)->index
+				: relocation->section->symbol;
+			write_u(relocation->offset, 8);
+			write_u(symbol << 32 | relocation->kind.type, 8);
+			write_u((uint64_t)relocation->addend, 8);
+		}
+	}
+
+	/* symbol table */
+	write_padding(symtab_offset);
+	write_symbol(0, 0, 0, SHN_UNDEF, 0, 0);
+	write_symbol(file_name, symbol_info(STB_LOCAL, STT_FILE), STV_DEFAULT,
+	             SHN_ABS, 0, 0);
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t const *const section = section_order[s];
+		write_symbol(0, symbol_info(STB_LOCAL, STT_SECTION), STV_DEFAULT,
+		             section->index, 0, 0);
+	}
+	for (size_t i = 0, n = ARR_LEN(symbol_order); i < n; ++i) {
+		elf_symbol_t const *const symbol = symbol_order[i];
+		uint16_t const shndx = symbol->common ? SHN_COMMON
+		                     : symbol->section != NULL ? symbol->section->index
+		                     : SHN_UNDEF;
+		uint8_t  const type  = shndx == SHN_UNDEF ? STT_NOTYPE : symbol->type;
+		write_symbol(symbol->name, symbol_info(symbol->binding, type),
+		             symbol->other, shndx, symbol->value, symbol->size);
+	}
+	write_bytes(strtab, ARR_LEN(strtab));
+	write_bytes(shstrtab, ARR_LEN(shstrtab));
+
+	/* section headers */
+	write_padding(shoff);
+	write_section_header(0, SHT_NULL, 0, 0, 0, 0, 0, 0, 0);
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t      const *const section = section_order[s];
+		elf_section_info_t const *const info    = section->info;
+		write_section_header(section->name, info->type, info->flags,
+		                     section->file_offset, section->size, 0, 0,
+		                     section->alignment, info->entsize);
+	}
+	for (size_t s = 0; s < n_sections; ++s) {
+		elf_section_t const *const section = section_order[s];
+		if (section->rela_index == 0)
+			continue;
+		size_t const n_relocations = ARR_LEN(section->relocations);
+		write_section_header(section->rela_name, SHT_RELA, SHF_INFO_LINK,
+		                     section->rela_file_offset,
+		                     n_relocations * RELA_SIZE, symtab_index,
+		                     section->index, 8, RELA_SIZE);
+	}
+	write_section_header(note_name, SHT_PROGBITS, 0, symtab_offset, 0, 0, 0,
+	                     1, 0);
+	write_section_header(symtab_name, SHT_SYMTAB, 0, symtab_offset,
+	                     n_symbols * SYM_SIZE, strtab_index, first_global, 8,
+	                     SYM_SIZE);
+	write_section_header(strtab_name, SHT_STRTAB, 0, strtab_offset,
+	                     ARR_LEN(strtab), 0, 0, 1, 0);
+	write_section_header(shstrtab_name, SHT_STRTAB, 0, shstrtab_offset,
+	                     ARR_LEN(shstrtab), 0, 0, 1, 0);
+}
+
+void be_elf_end(void)
+{
+	if (get_irp_n_asms() > 0)
+		panic("global assembler not supported in ELF object files");
+
+	add_globals(get_glob_type());
+	add_globals(get_tls_type());
+	add_globals(get_segment_type(IR_SEGMENT_CONSTRUCTORS));
+	add_globals(get_segment_type(IR_SEGMENT_DESTRUCTORS));
+	add_globals(get_segment_type(IR_SEGMENT_JCR));
+	add_aliases(get_glob_type());
+	finish_symbols();
+	write_object();
+
+	for (size_t s = 0, n = ARR_LEN(section_order); s < n; ++s) {
+		DEL_ARR_F(section_order[s]->data);
+		DEL_ARR_F(section_order[s]->relocations);
+	}
+	DEL_ARR_F(section_order);
+	DEL_ARR_F(symbol_order);
+	DEL_ARR_F(strtab);
+	DEL_ARR_F(shstrtab);
+	pmap_destroy(symbols);
+	obstack_free(&obst, NULL);
+	be_destroy_jit_segment(segment);
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Writes ELF relocatable object files.
+ *
+ * Functions are encoded into ir_jit_function_t by the target's binary
+ * emitter and handed to the writer, which lays them out in the text section
+ * and turns their relocations into ELF relocations. Global variables are
+ * written from their initializers.
+ */
+#ifndef FIRM_BE_BEELF_H
+#define FIRM_BE_BEELF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "firm_types.h"
+#include "jit.h"
+
+/** ELF relocation corresponding to a backend relocation kind. */
+typedef struct be_elf_relocation_t {
+	uint32_t type;        /**< ELF relocation type */
+	uint8_t  size;        /**< size of the relocated field in bytes */
+	bool     pc_relative; /**< the field is relative to its own address */
+} be_elf_relocation_t;
+
+/** Describes the target machine to the ELF writer. */
+typedef struct be_elf_target_t {
+	uint16_t machine;          /**< ELF machine number */
+	uint32_t data_relocation;  /**< relocation for pointers in data */
+	uint8_t  function_p2align; /**< alignment of function starts */
+
+	/** create @p size bytes of NOP instructions for alignment */
+	void (*nops)(char *buffer, unsigned size);
+
+	/** Returns the ELF relocation for backend relocation kind @p be_kind. */
+	be_elf_relocation_t (*get_relocation)(uint8_t be_kind);
+} be_elf_target_t;
+
+/**
+ * Starts writing an ELF object file for the compilation unit @p cup_name
+ * into @p output.
+ */
+void be_elf_begin(FILE *output, char const *cup_name,
+                  be_elf_target_t const *target);
+
+/**
+ * Returns the segment functions of the object file are encoded into.
+ */
+ir_jit_segment_t *be_elf_get_segment(void);
+
+/**
+ * Places the encoded @p function as definition of @p entity into the text
+ * section.
+ */
+void be_elf_add_function(ir_entity *entity, ir_jit_function_t *function);
+
+/**
+ * Places the jump table @p table of the function @p function into the
+ * read-only data section. Entry i holds the address of offset @p targets[i]
+ * in the function, relative to the table start if @p reloc is PC relative.
+ */
+void be_elf_add_jump_table(ir_entity const *table, ir_entity const *function,
+                           be_elf_relocation_t reloc,
+                           unsigned const *targets, size_t n_targets);
+
+/**
+ * Adds the global variables, writes the object file and frees the writer's
+ * resources.
+ */
+void be_elf_end(void);
+
+#endif
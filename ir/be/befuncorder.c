@@ -0,0 +1,271 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Ordering of the emitted functions by call affinity.
+ *
+ * Implements call-chain clustering (C3): Functions are visited in order of
+ * decreasing invocation frequency and each is appended to the cluster of its
+ * most frequent caller, as long as the cluster stays small enough to share a
+ * page. The clusters are then emitted in order of decreasing density, so hot
+ * callers and callees end up close to each other.
+ *
+ * Invocation frequencies are propagated top-down through the callgraph: Each
+ * call contributes the frequency of its caller scaled by the execution
+ * frequency of its block, which comes from profile data if available.
+ */
+#include "befuncorder.h"
+
+#include "array.h"
+#include "bemodule.h"
+#include "callgraph.h"
+#include "cgana.h"
+#include "debug.h"
+#include "entity_t.h"
+#include "execfreq.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irnode_t.h"
+#include "irprog_t.h"
+#include "pmap.h"
+#include "util.h"
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** Estimated size of a function part sharing a page (in bytes). */
+#define MAX_CLUSTER_SIZE  4096
+/** Estimated number of bytes per IR node. */
+#define BYTES_PER_NODE    4
+/** Clusters are not merged if this reduces the density of the caller cluster
+ * to less than 1/x. */
+#define MAX_DENSITY_DROP  8
+
+typedef struct cluster_t cluster_t;
+
+typedef struct func_info_t {
+	ir_graph  *irg;
+	size_t     index;       /**< the original position in the irp */
+	double     freq;        /**< the estimated invocation frequency */
+	unsigned   size;        /**< the estimated code size */
+	ir_graph  *hot_caller;  /**< the caller with the most frequent calls */
+	double     hot_weight;  /**< the call frequency from hot_caller */
+	cluster_t *cluster;
+} func_info_t;
+
+struct cluster_t {
+	func_info_t **funcs;    /**< the functions in emission order */
+	double        freq;
+	unsigned      size;
+};
+
+static pmap *infos;
+
+static func_info_t *get_func_info(ir_graph const *irg)
+{
+	return pmap_get(func_info_t, infos, irg);
+}
+
+static void count_node(ir_node *node, void *data)
+{
+	unsigned *count = (unsigned*)data;
+	if (!is_Proj(node) && !is_Block(node))
+		++*count;
+}
+
+static unsigned estimate_size(ir_graph *irg)
+{
+	unsigned count = 0;
+	irg_walk_graph(irg, count_node, NULL, &count);
+	return MAX(count, 1u) * BYTES_PER_NODE;
+}
+
+/**
+ * Returns the summed execution frequencies of the calls in @p calls.
+ */
+static double get_call_freq(ir_node *const *calls)
+{
+	double freq = 0.0;
+	for (size_t i = 0, n = ARR_LEN(calls); i < n; ++i) {
+		freq += get_block_execfreq(get_nodes_block(calls[i]));
+	}
+	return freq;
+}
+
+static void collect_irg(ir_graph *irg, void *data)
+{
+	ir_graph ***order = (ir_graph***)data;
+	ARR_APP1(ir_graph*, *order, irg);
+}
+
+/**
+ * Computes the invocation frequencies and the hottest caller of each
+ * function. Callers are handled before their callees, except in recursions.
+ */
+static void compute_frequencies(ir_graph **order)
+{
+	for (size_t i = ARR_LEN(order); i-- > 0;) {
+		ir_graph    *irg  = order[i];
+		func_info_t *info = get_func_info(irg);
+		ir_entity   *ent  = get_irg_entity(irg);
+		/* roots and externally visible functions may be called from outside */
+		if (get_irg_n_callers(irg) == 0 || entity_is_externally_visible(ent))
+			info->freq += 1.0;
+
+		for (size_t c = 0, n = get_irg_n_callees(irg); c < n; ++c) {
+			cg_callee_entry const *entry  = irg->callees[c];
+			func_info_t           *callee = get_func_info(entry->irg);
+			if (callee == NULL || callee == info)
+				continue;
+			double weight = info->freq * get_call_freq(entry->call_list);
+			callee->freq += weight;
+			if (weight > callee->hot_weight) {
+				callee->hot_weight = weight;
+				callee->hot_caller = irg;
+			}
+		}
+	}
+}
+
+static int cmp_func_freq(void const *a, void const *b)
+{
+	func_info_t const *const f0 = *(func_info_t const**)a;
+	func_info_t const *const f1 = *(func_info_t const**)b;
+	if (f0->freq != f1->freq)
+		return f0->freq < f1->freq ? 1 : -1;
+	return f0->index < f1->index ? -1 : f0->index > f1->index;
+}
+
+static double get_density(cluster_t const *cluster)
+{
+	return cluster->freq / cluster->size;
+}
+
+static int cmp_cluster_density(void const *a, void const *b)
+{
+	cluster_t const *const c0 = *(cluster_t const**)a;
+	cluster_t const *const c1 = *(cluster_t const**)b;
+	double const d0 = get_density(c0);
+	double const d1 = get_density(c1);
+	if (d0 != d1)
+		return d0 < d1 ? 1 : -1;
+	size_t const i0 = c0->funcs[0]->index;
+	size_t const i1 = c1->funcs[0]->index;
+	return i0 < i1 ? -1 : i0 > i1;
+}
+
+/**
+ * Appends the functions of @p src to @p dst.
+ */
+static void merge_clusters(cluster_t *dst, cluster_t *src)
+{
+	for (size_t i = 0, n = ARR_LEN(src->funcs); i < n; ++i) {
+		func_info_t *func = src->funcs[i];
+		func->cluster = dst;
+		ARR_APP1(func_info_t*, dst->funcs, func);
+	}
+	dst->freq += src->freq;
+	dst->size += src->size;
+	DEL_ARR_F(src->funcs);
+	src->funcs = NULL;
+}
+
+void be_order_functions(void)
+{
+	size_t n_irgs = get_irp_n_irgs();
+	if (n_irgs < 2)
+		return;
+
+	ir_entity **free_methods;
+	cgana(&free_methods);
+	free(free_methods);
+	compute_callgraph();
+
+	infos = pmap_create();
+	func_info_t *funcs    = XMALLOCNZ(func_info_t, n_irgs);
+	cluster_t   *clusters = XMALLOCNZ(cluster_t, n_irgs);
+	for (size_t i = 0; i < n_irgs; ++i) {
+		ir_graph    *irg  = get_irp_irg(i);
+		func_info_t *info = &funcs[i];
+		info->irg     = irg;
+		info->index   = i;
+		info->size    = estimate_size(irg);
+		info->cluster = &clusters[i];
+		clusters[i].funcs = NEW_ARR_F(func_info_t*, 1);
+		clusters[i].funcs[0] = info;
+		clusters[i].size     = info->size;
+		pmap_insert(infos, irg, info);
+	}
+
+	ir_graph **order = NEW_ARR_F(ir_graph*, 0);
+	callgraph_walk(NULL, collect_irg, &order);
+	compute_frequencies(order);
+	DEL_ARR_F(order);
+	free_callgraph();
+	free_irp_callee_info();
+
+	for (size_t i = 0; i < n_irgs; ++i) {
+		clusters[i].freq = funcs[i].freq;
+	}
+
+	/* append each function to the cluster of its hottest caller */
+	func_info_t **sorted = XMALLOCN(func_info_t*, n_irgs);
+	for (size_t i = 0; i < n_irgs; ++i) {
+		sorted[i] = &funcs[i];
+	}
+	QSORT(sorted, n_irgs, cmp_func_freq);
+	for (size_t i = 0; i < n_irgs; ++i) {
+		func_info_t *func = sorted[i];
+		if (func->hot_caller == NULL)
+			continue;
+		cluster_t *cluster        = func->cluster;
+		cluster_t *caller_cluster = get_func_info(func->hot_caller)->cluster;
+		if (cluster == caller_cluster)
+			continue;
+		if (caller_cluster->size + cluster->size > MAX_CLUSTER_SIZE)
+			continue;
+		double const merged_density = (caller_cluster->freq + cluster->freq)
+		                            / (caller_cluster->size + cluster->size);
+		if (merged_density * MAX_DENSITY_DROP < get_density(caller_cluster))
+			continue;
+		DB((dbg, LEVEL_2, "append %+F to cluster of %+F\n", func->irg,
+		    func->hot_caller));
+		merge_clusters(caller_cluster, cluster);
+	}
+
+	/* emit the densest clusters first */
+	cluster_t **cluster_order = XMALLOCN(cluster_t*, n_irgs);
+	size_t      n_clusters    = 0;
+	for (size_t i = 0; i < n_irgs; ++i) {
+		if (clusters[i].funcs != NULL)
+			cluster_order[n_clusters++] = &clusters[i];
+	}
+	QSORT(cluster_order, n_clusters, cmp_cluster_density);
+
+	size_t pos = 0;
+	for (size_t c = 0; c < n_clusters; ++c) {
+		cluster_t *cluster = cluster_order[c];
+		DB((dbg, LEVEL_1, "cluster (density %g):\n", get_density(cluster)));
+		for (size_t i = 0, n = ARR_LEN(cluster->funcs); i < n; ++i) {
+			ir_graph *irg = cluster->funcs[i]->irg;
+			DB((dbg, LEVEL_1, "\t%+F (freq %g)\n", irg, cluster->funcs[i]->freq));
+			set_irp_irg(pos++, irg);
+		}
+		DEL_ARR_F(cluster->funcs);
+	}
+	assert(pos == n_irgs);
+
+	free(cluster_order);
+	free(sorted);
+	free(clusters);
+	free(funcs);
+	pmap_destroy(infos);
+}
+
+BE_REGISTER_MODULE_CONSTRUCTOR(be_init_funcorder)
+void be_init_funcorder(void)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.be.funcorder");
+}
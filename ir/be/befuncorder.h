@@ -0,0 +1,19 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Ordering of the emitted functions by call affinity.
+ */
+#ifndef FIRM_BE_BEFUNCORDER_H
+#define FIRM_BE_BEFUNCORDER_H
+
+/**
+ * Reorders the graphs of the irp, so frequently calling functions are
+ * emitted next to their callees.
+ */
+void be_order_functions(void);
+
+#endif
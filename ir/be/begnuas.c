@@ -20,6 +20,7 @@
 #include "dbginfo.h"
 #include "entity_t.h"
 #include "execfreq.h"
+#include "hashptr.h"
 #include "iredges_t.h"
 #include "irnode_t.h"
 #include "irtools.h"
@@ -37,7 +38,12 @@ char                   be_gas_elf_type_char = '@';
 
 static be_gas_section_t current_section = (be_gas_section_t) -1;
 static pmap            *block_numbers;
+/** Maps constants to an equal constant emitted instead of them. */
+static pmap            *merged_constants;
 static unsigned         next_block_nr;
+/** section and entity of the function (part) being emitted */
+static be_gas_section_t function_section;
+static ir_entity const *function_entity;
 
 static bool is_macho(void)
 {
@@ -73,12 +79,16 @@ static void emit_section_macho(be_gas_section_t const section)
 
 	static const macho_sectioninfo_t macho_sectioninfos[] = {
 		[GAS_SECTION_TEXT]            = { "__TEXT,__text",            "regular,pure_instructions" },
+		[GAS_SECTION_TEXT_UNLIKELY]   = { "__TEXT,__text_cold",       "regular,pure_instructions" },
 		[GAS_SECTION_DATA]            = { "__DATA,__data",            NULL },
 		[GAS_SECTION_RODATA]          = { "__TEXT,__const",           NULL },
 		[GAS_SECTION_REL_RO]          = { "__DATA,__const",           NULL },
 		[GAS_SECTION_REL_RO_LOCAL]    = { "__DATA,__const",           NULL },
 		[GAS_SECTION_BSS]             = { "__DATA,__bss",             NULL },
 		[GAS_SECTION_CSTRING]         = { "__TEXT,__cstring",         "cstring_literals" },
+		[GAS_SECTION_LITERAL4]        = { "__TEXT,__literal4",        "4byte_literals" },
+		[GAS_SECTION_LITERAL8]        = { "__TEXT,__literal8",        "8byte_literals" },
+		[GAS_SECTION_LITERAL16]       = { "__TEXT,__literal16",       "16byte_literals" },
 		[GAS_SECTION_PIC_TRAMPOLINES] = { "__IMPORT,__jump_table",    "symbol_stubs,self_modifying_code+pure_instructions,5" },
 		[GAS_SECTION_PIC_SYMBOLS]     = { "__IMPORT,__pointers",      "non_lazy_symbol_pointers" },
 		[GAS_SECTION_DEBUG_INFO]      = { "__DWARF,__debug_info",     "regular,debug" },
@@ -89,6 +99,7 @@ static void emit_section_macho(be_gas_section_t const section)
 	};
 	static const macho_sectioninfo_t macho_sectioninfos_coalesce[] = {
 		[GAS_SECTION_TEXT]    = { "__TEXT,__textcoal_nt", "coalesced,pure_instructions" },
+		[GAS_SECTION_TEXT_UNLIKELY] = { "__TEXT,__textcoal_nt", "coalesced,pure_instructions" },
 		[GAS_SECTION_DATA]    = { "__DATA,__datacoal_nt", "coalesced" },
 		[GAS_SECTION_BSS]     = { "__DATA,__datacoal_nt", "coalesced" },
 		[GAS_SECTION_RODATA]  = { "__TEXT,__const_coal",  "coalesced" },
@@ -120,23 +131,29 @@ typedef struct {
 	const char *name;
 	const char *type;
 	const char *flags;
+	unsigned    entsize; /**< entry size of mergeable sections */
 } elf_sectioninfo_t;
 
 static const elf_sectioninfo_t elf_sectioninfos[] = {
-	[GAS_SECTION_TEXT]           = { "text",              "progbits", "ax" },
-	[GAS_SECTION_DATA]           = { "data",              "progbits", "aw" },
-	[GAS_SECTION_RODATA]         = { "rodata",            "progbits", "a"  },
-	[GAS_SECTION_REL_RO_LOCAL]   = { "data.rel.ro.local", "progbits", "aw" },
-	[GAS_SECTION_REL_RO]         = { "data.rel.ro",       "progbits", "aw" },
-	[GAS_SECTION_BSS]            = { "bss",               "nobits",   "aw" },
-	[GAS_SECTION_CONSTRUCTORS]   = { "ctors",             "progbits", "aw" },
-	[GAS_SECTION_DESTRUCTORS]    = { "dtors",             "progbits", "aw" },
-	[GAS_SECTION_JCR]            = { "jcr",               "progbits", "aw" },
-	[GAS_SECTION_DEBUG_INFO]     = { "debug_info",        "progbits", ""   },
-	[GAS_SECTION_DEBUG_ABBREV]   = { "debug_abbrev",      "progbits", ""   },
-	[GAS_SECTION_DEBUG_LINE]     = { "debug_line",        "progbits", ""   },
-	[GAS_SECTION_DEBUG_PUBNAMES] = { "debug_pubnames",    "progbits", ""   },
-	[GAS_SECTION_DEBUG_FRAME]    = { "debug_frame",       "progbits", ""   },
+	[GAS_SECTION_TEXT]           = { "text",              "progbits", "ax",  0 },
+	[GAS_SECTION_TEXT_UNLIKELY]  = { "text.unlikely",     "progbits", "ax",  0 },
+	[GAS_SECTION_DATA]           = { "data",              "progbits", "aw",  0 },
+	[GAS_SECTION_RODATA]         = { "rodata",            "progbits", "a",   0 },
+	[GAS_SECTION_REL_RO_LOCAL]   = { "data.rel.ro.local", "progbits", "aw",  0 },
+	[GAS_SECTION_REL_RO]         = { "data.rel.ro",       "progbits", "aw",  0 },
+	[GAS_SECTION_BSS]            = { "bss",               "nobits",   "aw",  0 },
+	[GAS_SECTION_CONSTRUCTORS]   = { "ctors",             "progbits", "aw",  0 },
+	[GAS_SECTION_DESTRUCTORS]    = { "dtors",             "progbits", "aw",  0 },
+	[GAS_SECTION_JCR]            = { "jcr",               "progbits", "aw",  0 },
+	[GAS_SECTION_CSTRING]        = { "rodata.str1.1",     "progbits", "aMS", 1 },
+	[GAS_SECTION_LITERAL4]       = { "rodata.cst4",       "progbits", "aM",  4 },
+	[GAS_SECTION_LITERAL8]       = { "rodata.cst8",       "progbits", "aM",  8 },
+	[GAS_SECTION_LITERAL16]      = { "rodata.cst16",      "progbits", "aM", 16 },
+	[GAS_SECTION_DEBUG_INFO]     = { "debug_info",        "progbits", "",    0 },
+	[GAS_SECTION_DEBUG_ABBREV]   = { "debug_abbrev",      "progbits", "",    0 },
+	[GAS_SECTION_DEBUG_LINE]     = { "debug_line",        "progbits", "",    0 },
+	[GAS_SECTION_DEBUG_PUBNAMES] = { "debug_pubnames",    "progbits", "",    0 },
+	[GAS_SECTION_DEBUG_FRAME]    = { "debug_frame",       "progbits", "",    0 },
 };
 
 static void emit_section_sparc(be_gas_section_t section,
@@ -237,8 +254,11 @@ static void emit_section_elf_coff(be_gas_section_t const section, ir_entity cons
 		be_emit_char('G');
 
 	/* section type */
-	if (ir_platform.object_format != OBJECT_FORMAT_PE_COFF)
+	if (ir_platform.object_format != OBJECT_FORMAT_PE_COFF) {
 		be_emit_irprintf("\",%c%s", be_gas_elf_type_char, info->type);
+		if (info->entsize != 0)
+			be_emit_irprintf(",%u", info->entsize);
+	}
 
 	if (flags & GAS_SECTION_FLAG_COMDAT) {
 		be_emit_char(',');
@@ -394,6 +414,9 @@ static bool is_comdat(const ir_entity *entity)
 		&& (linkage & IR_LINKAGE_GARBAGE_COLLECT);
 }
 
+static unsigned long compute_entity_size(ir_entity const *entity);
+static unsigned get_effective_entity_alignment(const ir_entity *entity);
+
 typedef enum reloc_class_t {
 	NO_RELOCATIONS,
 	ONLY_LOCAL_RELOCATIONS,
@@ -451,17 +474,52 @@ static reloc_class_t classify_initializer_relocs(
 	panic("invalid initializer");
 }
 
+static bool supports_mergeable_sections(void)
+{
+	return is_macho()
+	    || (ir_platform.object_format == OBJECT_FORMAT_ELF
+	        && be_gas_elf_variant != ELF_VARIANT_SPARC);
+}
+
+/**
+ * Returns the section for a constant whose contents the linker may merge with
+ * equal constants from other object files, or GAS_SECTION_RODATA if it cannot
+ * be merged.
+ */
+static be_gas_section_t determine_mergeable_section(ir_entity const *entity)
+{
+	if (!(get_entity_linkage(entity) & IR_LINKAGE_NO_IDENTITY)
+	 || get_entity_owner(entity) != get_segment_type(IR_SEGMENT_GLOBAL)
+	 || is_comdat(entity) || !supports_mergeable_sections())
+		return GAS_SECTION_RODATA;
+
+	unsigned const alignment = get_effective_entity_alignment(entity);
+	if (entity_is_string_const(entity, true))
+		return alignment <= 1 ? GAS_SECTION_CSTRING : GAS_SECTION_RODATA;
+
+	ir_initializer_t const *const init = get_entity_initializer(entity);
+	if (init == NULL || classify_initializer_relocs(init) != NO_RELOCATIONS)
+		return GAS_SECTION_RODATA;
+	unsigned long const size = compute_entity_size(entity);
+	if (alignment > size)
+		return GAS_SECTION_RODATA;
+	switch (size) {
+	case  4: return GAS_SECTION_LITERAL4;
+	case  8: return GAS_SECTION_LITERAL8;
+	case 16: return GAS_SECTION_LITERAL16;
+	default: return GAS_SECTION_RODATA;
+	}
+}
+
 static be_gas_section_t determine_basic_section(const ir_entity *entity)
 {
 	if (is_method_entity(entity) || is_alias_entity(entity))
 		return GAS_SECTION_TEXT;
 
 	if (get_entity_linkage(entity) & IR_LINKAGE_CONSTANT) {
-		/* mach-o is the only one with a cstring section */
-		if (is_macho()
-		    && get_entity_linkage(entity) & IR_LINKAGE_NO_IDENTITY
-		    && entity_is_string_const(entity, true))
-			return GAS_SECTION_CSTRING;
+		be_gas_section_t const mergeable = determine_mergeable_section(entity);
+		if (mergeable != GAS_SECTION_RODATA)
+			return mergeable;
 
 		if (ir_platform.pic_style != BE_PIC_NONE) {
 			ir_initializer_t const *const init = get_entity_initializer(entity);
@@ -516,6 +574,26 @@ static be_gas_section_t determine_section(be_main_env_t const *const main_env, i
 	panic("couldn't determine section for %+F", entity);
 }
 
+be_gas_section_t be_gas_get_entity_section(ir_entity const *const entity)
+{
+	return determine_section(NULL, entity);
+}
+
+unsigned long be_gas_get_entity_size(ir_entity const *const entity)
+{
+	return compute_entity_size(entity);
+}
+
+unsigned be_gas_get_entity_alignment(ir_entity const *const entity)
+{
+	return get_effective_entity_alignment(entity);
+}
+
+bool be_gas_entity_is_zero_initialized(ir_entity const *const entity)
+{
+	return entity_is_zero_initialized(entity);
+}
+
 static void emit_symbol_directive(const char *directive,
                                   const ir_entity *entity)
 {
@@ -599,6 +677,8 @@ void be_gas_emit_function_prolog(const ir_entity *entity, unsigned po2alignment,
 
 	be_gas_section_t const section = determine_section(NULL, entity);
 	emit_section(section, entity);
+	function_section = section;
+	function_entity  = entity;
 
 	/* write the begin line (makes the life easier for scripts parsing the
 	 * assembler) */
@@ -671,6 +751,50 @@ void be_gas_emit_function_epilog(ir_entity const *const entity)
 	next_block_nr -= next_block_nr % 100;
 }
 
+static void emit_cold_label(ir_entity const *const entity)
+{
+	be_gas_emit_entity(entity);
+	be_emit_cstring(".cold");
+}
+
+void be_gas_emit_cold_function_prolog(ir_entity const *const entity)
+{
+	be_gas_section_t const section = GAS_SECTION_TEXT_UNLIKELY
+		| (function_section & GAS_SECTION_FLAG_COMDAT);
+	emit_section(section, entity);
+	function_section = section;
+	function_entity  = entity;
+
+	if (ir_platform.object_format == OBJECT_FORMAT_ELF) {
+		be_emit_cstring("\t.type\t");
+		emit_cold_label(entity);
+		be_emit_irprintf(", %cfunction\n", be_gas_elf_type_char);
+		be_emit_write_line();
+	}
+	emit_cold_label(entity);
+	be_emit_cstring(":\n");
+	be_emit_write_line();
+
+	be_dwarf_function_begin();
+}
+
+void be_gas_emit_cold_function_epilog(ir_entity const *const entity)
+{
+	be_dwarf_function_cold_end();
+
+	if (ir_platform.object_format == OBJECT_FORMAT_ELF) {
+		be_emit_cstring("\t.size\t");
+		emit_cold_label(entity);
+		be_emit_cstring(", .-");
+		emit_cold_label(entity);
+		be_emit_char('\n');
+		be_emit_write_line();
+	}
+
+	be_emit_char('\n');
+	be_emit_write_line();
+}
+
 /**
  * Output parts of a tarval.
  *
@@ -1264,19 +1388,25 @@ static void emit_indirect_symbol(const ir_entity *entity,
 	}
 }
 
-static void emit_alias(const ir_entity *entity)
+static void emit_set(ir_entity const *const entity,
+                     ir_entity const *const target)
 {
-	if (ir_platform.object_format != OBJECT_FORMAT_ELF)
-		panic("alias entities only supported for ELF");
-
 	be_emit_cstring("\t.set ");
 	be_gas_emit_entity(entity);
 	be_emit_char(',');
-	be_gas_emit_entity(get_entity_alias(entity));
+	be_gas_emit_entity(target);
 	be_emit_char('\n');
 	be_emit_write_line();
 }
 
+static void emit_alias(const ir_entity *entity)
+{
+	if (ir_platform.object_format != OBJECT_FORMAT_ELF)
+		panic("alias entities only supported for ELF");
+
+	emit_set(entity, get_entity_alias(entity));
+}
+
 char const *be_gas_get_private_prefix(void)
 {
 	return is_macho() ? "L" : ".L";
@@ -1411,6 +1541,14 @@ static void emit_global(be_main_env_t const *const main_env,
 		return;
 	}
 
+	/* constants equal to an already emitted one just get a second name */
+	ir_entity const *const equal = pmap_get(ir_entity const, merged_constants,
+	                                        entity);
+	if (equal != NULL) {
+		emit_set(entity, equal);
+		return;
+	}
+
 	be_dwarf_variable(entity);
 
 	ir_visibility const visibility       = get_entity_visibility(entity);
@@ -1517,9 +1655,159 @@ static void be_gas_emit_globals(ir_type *const gt, be_main_env_t const *const ma
 	}
 }
 
+static bool is_mergeable_constant(ir_entity const *const entity)
+{
+	ir_linkage const linkage = get_entity_linkage(entity);
+	return get_entity_kind(entity) == IR_ENTITY_NORMAL
+	    && (linkage & IR_LINKAGE_CONSTANT)
+	    && (linkage & IR_LINKAGE_NO_IDENTITY)
+	    && !(linkage & IR_LINKAGE_NO_CODEGEN)
+	    && !entity_is_externally_visible(entity)
+	    && get_entity_initializer(entity) != NULL;
+}
+
+static unsigned hash_initializer(ir_initializer_t const *const init)
+{
+	switch (get_initializer_kind(init)) {
+	case IR_INITIALIZER_NULL:
+		return 0;
+	case IR_INITIALIZER_TARVAL:
+		return hash_ptr(get_initializer_tarval_value(init));
+	case IR_INITIALIZER_CONST:
+		return hash_ptr(get_initializer_const_value(init));
+	case IR_INITIALIZER_COMPOUND: {
+		size_t   const n    = get_initializer_compound_n_entries(init);
+		unsigned       hash = (unsigned)n;
+		for (size_t i = 0; i < n; ++i) {
+			ir_initializer_t const *const sub
+				= get_initializer_compound_value(init, i);
+			hash = hash_combine(hash, hash_initializer(sub));
+		}
+		return hash;
+	}
+	}
+	panic("invalid initializer");
+}
+
+static bool initializers_equal(ir_initializer_t const *const a,
+                               ir_initializer_t const *const b)
+{
+	ir_initializer_kind_t const kind = get_initializer_kind(a);
+	if (get_initializer_kind(b) != kind)
+		return false;
+	switch (kind) {
+	case IR_INITIALIZER_NULL:
+		return true;
+	case IR_INITIALIZER_TARVAL:
+		return get_initializer_tarval_value(a) == get_initializer_tarval_value(b);
+	case IR_INITIALIZER_CONST:
+		return get_initializer_const_value(a) == get_initializer_const_value(b);
+	case IR_INITIALIZER_COMPOUND: {
+		size_t const n = get_initializer_compound_n_entries(a);
+		if (get_initializer_compound_n_entries(b) != n)
+			return false;
+		for (size_t i = 0; i < n; ++i) {
+			if (!initializers_equal(get_initializer_compound_value(a, i),
+			                        get_initializer_compound_value(b, i)))
+				return false;
+		}
+		return true;
+	}
+	}
+	panic("invalid initializer");
+}
+
+/**
+ * Checks whether initializers for @p a and @p b are emitted the same way.
+ */
+static bool types_equal(ir_type const *const a, ir_type const *const b)
+{
+	if (a == b)
+		return true;
+	if (get_type_size(a) != get_type_size(b))
+		return false;
+	if (is_Primitive_type(a) && is_Primitive_type(b))
+		return get_type_mode(a) == get_type_mode(b);
+	if (is_Array_type(a) && is_Array_type(b))
+		return types_equal(get_array_element_type(a), get_array_element_type(b));
+	return false;
+}
+
+/** Checks whether @p b can be emitted as another name for @p a. */
+static bool constants_equal(ir_entity const *const a, ir_entity const *const b)
+{
+	if (!types_equal(get_entity_type(a), get_entity_type(b)))
+		return false;
+	return compute_entity_size(a) == compute_entity_size(b)
+	    && get_effective_entity_alignment(a) >= get_effective_entity_alignment(b)
+	    && determine_basic_section(a) == determine_basic_section(b)
+	    && initializers_equal(get_entity_initializer(a),
+	                          get_entity_initializer(b));
+}
+
+typedef struct constant_t {
+	ir_entity *entity;
+	unsigned   hash;
+	size_t     index;
+} constant_t;
+
+static int cmp_constant(void const *const a, void const *const b)
+{
+	constant_t const *const c0 = (constant_t const*)a;
+	constant_t const *const c1 = (constant_t const*)b;
+	if (c0->hash != c1->hash)
+		return c0->hash < c1->hash ? -1 : 1;
+	return c0->index < c1->index ? -1 : c0->index > c1->index;
+}
+
+/**
+ * Finds local constants with equal contents. Only the first one of them is
+ * emitted, the others become additional names for it.
+ */
+static void merge_constants(void)
+{
+	merged_constants = pmap_create();
+	if (ir_platform.object_format != OBJECT_FORMAT_ELF)
+		return;
+
+	ir_type    *const glob      = get_glob_type();
+	size_t      const n_members = get_compound_n_members(glob);
+	constant_t *const constants = XMALLOCN(constant_t, n_members);
+	size_t            n         = 0;
+	for (size_t i = 0; i < n_members; ++i) {
+		ir_entity *const entity = get_compound_member(glob, i);
+		if (!is_mergeable_constant(entity))
+			continue;
+		unsigned hash = hash_initializer(get_entity_initializer(entity));
+		hash = hash_combine(hash, (unsigned)compute_entity_size(entity));
+		constants[n++] = (constant_t){ entity, hash, i };
+	}
+	QSORT(constants, n, cmp_constant);
+
+	for (size_t i = 0; i < n;) {
+		size_t end = i + 1;
+		while (end < n && constants[end].hash == constants[i].hash)
+			++end;
+		for (size_t c = i + 1; c < end; ++c) {
+			ir_entity *const entity = constants[c].entity;
+			for (size_t l = i; l < c; ++l) {
+				ir_entity *const leader = constants[l].entity;
+				if (pmap_contains(merged_constants, leader)
+				 || !constants_equal(leader, entity))
+					continue;
+				pmap_insert(merged_constants, entity, leader);
+				break;
+			}
+		}
+		i = end;
+	}
+	free(constants);
+}
+
 /* Generate all entities. */
 static void emit_global_decls(be_main_env_t const *const main_env)
 {
+	merge_constants();
 	be_gas_emit_globals(get_glob_type(), main_env);
 	be_gas_emit_globals(get_tls_type(), main_env);
 	be_gas_emit_globals(get_segment_type(IR_SEGMENT_CONSTRUCTORS), main_env);
@@ -1539,9 +1827,13 @@ static void emit_global_decls(be_main_env_t const *const main_env)
 		be_emit_cstring("\t.subsections_via_symbols\n");
 		be_emit_write_line();
 	}
+
+	pmap_destroy(merged_constants);
 }
 
-void be_emit_jump_table(ir_node const *const node, be_switch_attr_t const *const swtch, ir_mode *const entry_mode, emit_target_func const emit_target)
+ir_node const **be_get_jump_table_targets(ir_node const *const node,
+                                          be_switch_attr_t const *const swtch,
+                                          unsigned long *const length)
 {
 	/* go over all proj's and collect their jump targets */
 	unsigned        n_outs  = arch_get_irn_n_outs(node);
@@ -1557,7 +1849,7 @@ void be_emit_jump_table(ir_node const *const node, be_switch_attr_t const *const
 	/* go over table to determine max value (note that we normalized the
 	 * ranges so that the minimum is 0) */
 	size_t        n_entries = ir_switch_table_get_n_entries(table);
-	unsigned long length    = 0;
+	unsigned long highest   = 0;
 	for (size_t e = 0; e < n_entries; ++e) {
 		const ir_switch_table_entry *entry
 			= ir_switch_table_get_entry_const(table, e);
@@ -1567,18 +1859,18 @@ void be_emit_jump_table(ir_node const *const node, be_switch_attr_t const *const
 		if (!tarval_is_long(max))
 			panic("switch case overflow (%+F)", node);
 		unsigned long const val = (unsigned long)get_tarval_long(max);
-		length = MAX(length, val);
+		highest = MAX(highest, val);
 	}
 
 	/* the 16000 isn't a real limit of the architecture. But should protect us
 	 * from seamingly endless compiler runs */
-	if (length > 16000) {
+	if (highest > 16000) {
 		/* switch lowerer should have broken this monster to pieces... */
 		panic("too large switch encountered (%+F)", node);
 	}
-	++length;
+	*length = highest + 1;
 
-	const ir_node **labels = XMALLOCNZ(const ir_node*, length);
+	const ir_node **labels = XMALLOCNZ(const ir_node*, *length);
 	for (size_t e = 0; e < n_entries; ++e) {
 		const ir_switch_table_entry *entry
 			= ir_switch_table_get_entry_const(table, e);
@@ -1601,6 +1893,21 @@ void be_emit_jump_table(ir_node const *const node, be_switch_attr_t const *const
 		}
 	}
 
+	/* unmentioned values jump to the default target */
+	for (unsigned long i = 0; i < *length; ++i) {
+		if (labels[i] == NULL)
+			labels[i] = targets[0];
+	}
+
+	free(targets);
+	return labels;
+}
+
+void be_emit_jump_table(ir_node const *const node, be_switch_attr_t const *const swtch, ir_mode *const entry_mode, emit_target_func const emit_target)
+{
+	unsigned long        length;
+	ir_node const **const labels = be_get_jump_table_targets(node, swtch, &length);
+
 	/* emit table */
 	unsigned         const pointer_size = get_mode_size_bytes(entry_mode);
 	ir_entity const *const entity       = swtch->table_entity;
@@ -1613,20 +1920,16 @@ void be_emit_jump_table(ir_node const *const node, be_switch_attr_t const *const
 	}
 
 	for (unsigned long i = 0; i < length; ++i) {
-		ir_node const *target = labels[i];
-		if (target == NULL)
-			target = targets[0];
 		emit_size_type(pointer_size);
-		emit_target(entity, target);
+		emit_target(entity, labels[i]);
 		be_emit_char('\n');
 		be_emit_write_line();
 	}
 
 	if (entity && !is_macho())
-		be_gas_emit_switch_section(GAS_SECTION_TEXT);
+		emit_section(function_section, function_entity);
 
 	free(labels);
-	free(targets);
 }
 
 static void emit_global_asms(void)
@@ -19,6 +19,7 @@
 
 typedef enum {
 	GAS_SECTION_TEXT,            /**< text section - program code */
+	GAS_SECTION_TEXT_UNLIKELY,   /**< rarely executed program code */
 	GAS_SECTION_DATA,            /**< data section - arbitrary data */
 	GAS_SECTION_RODATA,          /**< read only data no relocations */
 	GAS_SECTION_REL_RO,          /**< read only data containing relocations */
@@ -28,6 +29,9 @@ typedef enum {
 	GAS_SECTION_DESTRUCTORS,     /**< dtors section */
 	GAS_SECTION_JCR,             /**< java class registry */
 	GAS_SECTION_CSTRING,         /**< section for constant strings */
+	GAS_SECTION_LITERAL4,        /**< mergeable 4 byte constants */
+	GAS_SECTION_LITERAL8,        /**< mergeable 8 byte constants */
+	GAS_SECTION_LITERAL16,       /**< mergeable 16 byte constants */
 	GAS_SECTION_PIC_TRAMPOLINES, /**< trampolines for pic codes */
 	GAS_SECTION_PIC_SYMBOLS,     /**< contains resolved pic symbols */
 	GAS_SECTION_DEBUG_INFO,      /**< dwarf debug info */
@@ -63,6 +67,27 @@ extern char                 be_gas_elf_type_char;
  */
 void be_gas_emit_switch_section(be_gas_section_t section);
 
+/**
+ * Returns the section the definition of @p entity is placed in.
+ */
+be_gas_section_t be_gas_get_entity_section(ir_entity const *entity);
+
+/**
+ * Returns the size of @p entity, which may be larger than the size of its
+ * type for initialized flexible arrays.
+ */
+unsigned long be_gas_get_entity_size(ir_entity const *entity);
+
+/**
+ * Returns the alignment of @p entity.
+ */
+unsigned be_gas_get_entity_alignment(ir_entity const *entity);
+
+/**
+ * Returns whether @p entity is initialized with zeros only.
+ */
+bool be_gas_entity_is_zero_initialized(ir_entity const *entity);
+
 /**
  * emit assembler instructions necessary before starting function code
  */
@@ -72,6 +97,15 @@ void be_gas_emit_function_prolog(const ir_entity *entity,
 
 void be_gas_emit_function_epilog(const ir_entity *entity);
 
+/**
+ * Start the cold part of a function after be_gas_emit_function_epilog():
+ * Switches to the section for rarely executed code and emits a local label
+ * with its own call frame information.
+ */
+void be_gas_emit_cold_function_prolog(const ir_entity *entity);
+
+void be_gas_emit_cold_function_epilog(const ir_entity *entity);
+
 char const *be_gas_get_private_prefix(void);
 
 /**
@@ -122,6 +156,13 @@ void be_gas_end_compilation_unit(const be_main_env_t *env);
  */
 const char *be_gas_insn_label_prefix(void);
 
+/**
+ * Returns the jump targets of the switch @p node indexed by the switch value.
+ * Values without a case get the default target. The array has @p length
+ * entries and must be freed by the caller.
+ */
+ir_node const **be_get_jump_table_targets(ir_node const *node, be_switch_attr_t const *swtch, unsigned long *length);
+
 typedef void (*emit_target_func)(ir_entity const *table, ir_node const *proj_x);
 
 /**
@@ -17,10 +17,12 @@
 #include "bitfiddle.h"
 #include "compiler.h"
 #include "entity_t.h"
+#include "list.h"
 #include "obst.h"
 #include "panic.h"
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 typedef enum reloc_dest_kind_t {
 	RELOC_DEST_CODE_FRAGMENT,
@@ -32,6 +34,10 @@ typedef struct relocation_t {
 	ENUMBF(reloc_dest_kind_t) dest_kind : 8;
 	uint16_t                  offset;
 	int32_t                   dest_offset;
+	uint8_t                   size;            /**< bytes in the code */
+	uint8_t                   short_opcode;    /**< short form of a jump */
+	uint8_t                   long_opcode_len; /**< 0 if not a jump */
+	bool                      relaxed;         /**< emit the short form */
 	union dest {
 		uint16_t   fragment_num;
 		ir_entity *entity;
@@ -47,10 +53,17 @@ typedef struct fragment_info_t {
 	relocation_t relocations[];
 } fragment_info_t;
 
+/**
+ * The obstacks only hold the function currently being built or read, finished
+ * functions are copied into a single allocation each.
+ */
 struct ir_jit_segment_t {
-	struct obstack code_obst;
-	struct obstack fragment_info_obst;
-	struct obstack fragment_info_arr_obst;
+	struct obstack   code_obst;
+	struct obstack   fragment_info_obst;
+	struct obstack   fragment_info_arr_obst;
+	struct list_head functions;  /**< functions not freed yet */
+	be_jit_heap_t   *heap;       /**< executable memory, created on demand */
+	bool             huge_pages;
 };
 
 struct ir_jit_function_t {
@@ -58,11 +71,15 @@ struct ir_jit_function_t {
 	unsigned          n_fragments;
 	char const       *code;
 	fragment_info_t **fragment_infos;
+	ir_jit_segment_t *segment;
+	struct list_head  list;      /**< list of the functions of the segment */
+	be_jit_block_t    installed; /**< executable memory of the function */
 };
 
-struct obstack        *code_obst;
-static struct obstack *fragment_info_obst;
-static struct obstack *fragment_info_arr_obst;
+struct obstack          *code_obst;
+static struct obstack   *fragment_info_obst;
+static struct obstack   *fragment_info_arr_obst;
+static ir_jit_segment_t *current_segment;
 
 ir_jit_segment_t *be_new_jit_segment(void)
 {
@@ -70,17 +87,93 @@ ir_jit_segment_t *be_new_jit_segment(void)
 	obstack_init(&segment->code_obst);
 	obstack_init(&segment->fragment_info_obst);
 	obstack_init(&segment->fragment_info_arr_obst);
+	INIT_LIST_HEAD(&segment->functions);
 	return segment;
 }
 
 void be_destroy_jit_segment(ir_jit_segment_t *segment)
 {
+	list_for_each_entry_safe(ir_jit_function_t, function, next,
+	                         &segment->functions, list) {
+		free(function);
+	}
+	if (segment->heap != NULL)
+		be_free_jit_heap(segment->heap);
 	obstack_free(&segment->code_obst, NULL);
 	obstack_free(&segment->fragment_info_obst, NULL);
 	obstack_free(&segment->fragment_info_arr_obst, NULL);
 	free(segment);
 }
 
+/** Releases the memory of the function built or read last in @p segment. */
+static void clear_obstacks(ir_jit_segment_t *const segment)
+{
+	obstack_free(&segment->code_obst, NULL);
+	obstack_free(&segment->fragment_info_obst, NULL);
+	obstack_free(&segment->fragment_info_arr_obst, NULL);
+	obstack_init(&segment->code_obst);
+	obstack_init(&segment->fragment_info_obst);
+	obstack_init(&segment->fragment_info_arr_obst);
+}
+
+static size_t get_fragment_info_size(fragment_info_t const *const fragment)
+{
+	return sizeof(*fragment) + fragment->n_relocations * sizeof(relocation_t);
+}
+
+/**
+ * Copies a function from the obstacks of @p segment into a single allocation,
+ * which is released by be_jit_free_function() or with the segment.
+ */
+static ir_jit_function_t *new_jit_function(ir_jit_segment_t *const segment,
+                                           unsigned const size,
+                                           unsigned const n_fragments,
+                                           fragment_info_t **const fragment_infos,
+                                           char const *const code,
+                                           unsigned const code_size)
+{
+	size_t alloc_size = sizeof(ir_jit_function_t)
+	                  + n_fragments * sizeof(fragment_info_t*);
+	for (unsigned i = 0; i < n_fragments; ++i)
+		alloc_size += get_fragment_info_size(fragment_infos[i]);
+	alloc_size += code_size;
+
+	ir_jit_function_t *const res = (ir_jit_function_t*)xmalloc(alloc_size);
+	memset(res, 0, sizeof(*res));
+	char *data = (char*)(res + 1);
+	res->fragment_infos = (fragment_info_t**)data;
+	data += n_fragments * sizeof(fragment_info_t*);
+	for (unsigned i = 0; i < n_fragments; ++i) {
+		size_t const fragment_size = get_fragment_info_size(fragment_infos[i]);
+		memcpy(data, fragment_infos[i], fragment_size);
+		res->fragment_infos[i] = (fragment_info_t*)data;
+		data += fragment_size;
+	}
+	memcpy(data, code, code_size);
+	res->code        = data;
+	res->size        = size;
+	res->n_fragments = n_fragments;
+	res->segment     = segment;
+	list_add_tail(&res->list, &segment->functions);
+
+	clear_obstacks(segment);
+	return res;
+}
+
+void be_jit_segment_use_huge_pages(ir_jit_segment_t *const segment,
+                                   int const enable)
+{
+	assert(segment->heap == NULL);
+	segment->huge_pages = enable;
+}
+
+be_jit_heap_t *be_jit_get_segment_heap(ir_jit_segment_t *const segment)
+{
+	if (segment->heap == NULL)
+		segment->heap = be_new_jit_heap(segment->huge_pages);
+	return segment->heap;
+}
+
 void be_jit_set_entity_addr(ir_entity *entity, void const *address)
 {
 	assert(is_global_entity(entity));
@@ -101,62 +194,133 @@ void be_jit_begin_function(ir_jit_segment_t *const segment)
 	code_obst              = &segment->code_obst;
 	fragment_info_obst     = &segment->fragment_info_obst;
 	fragment_info_arr_obst = &segment->fragment_info_arr_obst;
+	current_segment        = segment;
 }
 
-static void layout_fragments(ir_jit_function_t *const function,
-                             unsigned const code_size)
+/** Returns the bytes saved by emitting @p relocation as short jump. */
+static unsigned get_relax_savings(relocation_t const *const relocation)
 {
-	unsigned          const n_fragments    = function->n_fragments;
-	fragment_info_t **const fragment_infos = function->fragment_infos;
+	/* the short form has a one byte opcode and displacement */
+	return relocation->relaxed ? relocation->long_opcode_len + 4 - 2 : 0;
+}
 
-	unsigned address      = 0;
-#ifndef NDEBUG
-	unsigned orig_address = 0;
-#endif
+/** Returns the size of @p fragment with its relaxed jumps. */
+static unsigned get_fragment_size(fragment_info_t const *const fragment)
+{
+	unsigned size = fragment->len;
+	for (unsigned r = 0, n = fragment->n_relocations; r < n; ++r)
+		size -= get_relax_savings(&fragment->relocations[r]);
+	return size;
+}
+
+static unsigned place_fragments(unsigned const n_fragments,
+                                fragment_info_t **const fragment_infos)
+{
+	unsigned address = 0;
 	for (unsigned i = 0; i < n_fragments; ++i) {
 		fragment_info_t *const fragment = fragment_infos[i];
-		assert(fragment->address == ~0u);
-		assert(fragment->len != ~0u);
-
-		unsigned const align   = 1 << fragment->p2align;
-		unsigned const aligned = round_up2(address, align);
+		unsigned         const align    = 1 << fragment->p2align;
+		unsigned         const aligned  = round_up2(address, align);
 		if (aligned - address <= fragment->max_skip)
 			address = aligned;
 
 		fragment->address = address;
+		address          += get_fragment_size(fragment);
+	}
+	return address;
+}
 
-		address      += fragment->len;
+/**
+ * Returns the displacement of the relaxed jump @p relocation, whose 8bit
+ * displacement is at @p address.
+ */
+static int32_t get_short_displacement(fragment_info_t *const *const fragment_infos,
+                                      relocation_t const *const relocation,
+                                      unsigned const address)
+{
+	assert(relocation->dest_kind == RELOC_DEST_CODE_FRAGMENT);
+	assert(relocation->dest_offset == -4);
+	fragment_info_t const *const dest
+		= fragment_infos[relocation->dest.fragment_num];
+	return (int32_t)dest->address - (int32_t)(address + 1);
+}
+
+/**
+ * Switches relaxed jumps, whose destination is out of reach of an 8bit
+ * displacement, back to the long form. Returns true if any jump changed.
+ */
+static bool widen_jumps(unsigned const n_fragments,
+                        fragment_info_t **const fragment_infos)
+{
+	bool changed = false;
+	for (unsigned i = 0; i < n_fragments; ++i) {
+		fragment_info_t *const fragment = fragment_infos[i];
+		unsigned               saved    = 0;
+		for (unsigned r = 0, n = fragment->n_relocations; r < n; ++r) {
+			relocation_t *const relocation = &fragment->relocations[r];
+			if (relocation->relaxed) {
+				unsigned const address = fragment->address + relocation->offset
+				                       - saved - relocation->long_opcode_len + 1;
+				int32_t  const displacement
+					= get_short_displacement(fragment_infos, relocation, address);
+				if (displacement < -128 || displacement > 127) {
+					relocation->relaxed = false;
+					changed             = true;
+				}
+			}
+			saved += get_relax_savings(relocation);
+		}
+	}
+	return changed;
+}
+
+/**
+ * Assigns the addresses of the fragments. Jumps start in the short form and
+ * are widened until all displacements fit, so the jumps only grow and the
+ * iteration terminates.
+ */
+static unsigned layout_fragments(unsigned const n_fragments,
+                                 fragment_info_t **const fragment_infos,
+                                 unsigned const code_size)
+{
 #ifndef NDEBUG
-		orig_address += fragment->len;
-#endif
+	unsigned orig_size = 0;
+	for (unsigned i = 0; i < n_fragments; ++i) {
+		assert(fragment_infos[i]->len != ~0u);
+		orig_size += fragment_infos[i]->len;
 	}
-	function->size = address;
-	assert(code_size == orig_address);
+	assert(code_size == orig_size);
+#endif
 	(void)code_size;
+
+	unsigned size;
+	do {
+		size = place_fragments(n_fragments, fragment_infos);
+	} while (widen_jumps(n_fragments, fragment_infos));
+	return size;
 }
 
 ir_jit_function_t *be_jit_finish_function(void)
 {
 	struct obstack *obst = fragment_info_arr_obst;
 
-	size_t   const size        = obstack_object_size(obst);
-	unsigned const n_fragments = size / sizeof(fragment_info_t*);
-	assert(size % sizeof(fragment_info_t*) == 0);
+	size_t   const arr_size    = obstack_object_size(obst);
+	unsigned const n_fragments = arr_size / sizeof(fragment_info_t*);
+	assert(arr_size % sizeof(fragment_info_t*) == 0);
 	fragment_info_t **const fragment_infos = obstack_finish(obst);
 
-	unsigned const code_size = obstack_object_size(code_obst);
-
-	ir_jit_function_t *const res = OALLOCZ(obst, ir_jit_function_t);
-	res->n_fragments    = n_fragments;
-	res->fragment_infos = fragment_infos;
-	res->code           = obstack_finish(code_obst);
-
-	layout_fragments(res, code_size);
+	unsigned   const code_size = obstack_object_size(code_obst);
+	char const      *code      = obstack_finish(code_obst);
+	unsigned   const size      = layout_fragments(n_fragments, fragment_infos,
+	                                              code_size);
+	ir_jit_function_t *const res = new_jit_function(current_segment, size,
+		n_fragments, fragment_infos, code, code_size);
 
 #ifndef NDEBUG
 	code_obst              = NULL;
 	fragment_info_obst     = NULL;
 	fragment_info_arr_obst = NULL;
+	current_segment        = NULL;
 #endif
 
 	return res;
@@ -167,6 +331,189 @@ unsigned be_get_function_size(ir_jit_function_t const *const function)
 	return function->size;
 }
 
+unsigned be_get_fragment_address(ir_jit_function_t const *const function,
+                                 unsigned const fragment_num)
+{
+	assert(fragment_num < function->n_fragments);
+	return function->fragment_infos[fragment_num]->address;
+}
+
+void const *be_jit_install_function(ir_jit_function_t *const function)
+{
+	assert(function->installed.address == NULL);
+	be_jit_heap_t  *const heap  = be_jit_get_segment_heap(function->segment);
+	be_jit_block_t *const block = &function->installed;
+	*block = be_jit_heap_alloc(heap, function->size);
+	be_jit_heap_begin_write(block);
+	be_jit_emit_function(block->writable, block->address, function);
+	be_jit_heap_finish_write(block);
+	return block->address;
+}
+
+void be_jit_free_function(ir_jit_function_t *const function)
+{
+	if (function->installed.address != NULL)
+		be_jit_heap_free(&function->installed);
+	list_del(&function->list);
+	free(function);
+}
+
+static void write_bytes(FILE *const out, void const *const data,
+                        size_t const size)
+{
+	fwrite(data, 1, size, out);
+}
+
+static bool read_bytes(FILE *const in, void *const data, size_t const size)
+{
+	return fread(data, 1, size, in) == size;
+}
+
+void be_jit_write_function(FILE *const out,
+                           ir_jit_function_t const *const function,
+                           be_jit_write_entity_func const write_entity,
+                           void *const data)
+{
+	unsigned code_size = 0;
+	for (unsigned i = 0; i < function->n_fragments; ++i)
+		code_size += function->fragment_infos[i]->len;
+
+	write_bytes(out, &function->size, sizeof(function->size));
+	write_bytes(out, &function->n_fragments, sizeof(function->n_fragments));
+	write_bytes(out, &code_size, sizeof(code_size));
+	write_bytes(out, function->code, code_size);
+	for (unsigned i = 0; i < function->n_fragments; ++i) {
+		fragment_info_t const *const fragment = function->fragment_infos[i];
+		write_bytes(out, fragment, sizeof(*fragment));
+		for (unsigned r = 0; r < fragment->n_relocations; ++r) {
+			relocation_t const *const relocation = &fragment->relocations[r];
+			write_bytes(out, relocation, sizeof(*relocation));
+			if (relocation->dest_kind == RELOC_DEST_ENTITY)
+				write_entity(out, relocation->dest.entity, data);
+		}
+	}
+}
+
+/** Returns the number of bytes left in @p in, -1 if unknown. */
+static long get_remaining_size(FILE *const in)
+{
+	long const pos = ftell(in);
+	if (pos < 0 || fseek(in, 0, SEEK_END) != 0)
+		return -1;
+	long const end = ftell(in);
+	if (fseek(in, pos, SEEK_SET) != 0 || end < pos)
+		return -1;
+	return end - pos;
+}
+
+/**
+ * Checks the relocations of @p fragment against its code and resets the jumps
+ * to their short form for the layout. Returns false if they are malformed.
+ */
+static bool check_relocations(fragment_info_t *const fragment,
+                              unsigned const n_fragments,
+                              be_jit_relocation_size_func const relocation_size)
+{
+	unsigned last_end = 0;
+	for (unsigned r = 0; r < fragment->n_relocations; ++r) {
+		relocation_t *const relocation = &fragment->relocations[r];
+		unsigned      const offset     = relocation->offset;
+		if (relocation->size == 0
+		 || relocation->size != relocation_size(relocation->be_kind)
+		 || offset < last_end || offset + relocation->size > fragment->len)
+			return false;
+
+		switch (relocation->dest_kind) {
+		case RELOC_DEST_CODE_FRAGMENT:
+			if (relocation->dest.fragment_num >= n_fragments)
+				return false;
+			break;
+		case RELOC_DEST_ENTITY:
+			break;
+		default:
+			return false;
+		}
+
+		unsigned const opcode_len = relocation->long_opcode_len;
+		if (opcode_len != 0
+		 && (relocation->dest_kind != RELOC_DEST_CODE_FRAGMENT
+		  || relocation->size != 4 || relocation->dest_offset != -4
+		  || opcode_len > offset - last_end))
+			return false;
+		relocation->relaxed = opcode_len != 0;
+		last_end = offset + relocation->size;
+	}
+	return true;
+}
+
+ir_jit_function_t *be_jit_read_function(FILE *const in,
+                                        ir_jit_segment_t *const segment,
+                                        be_jit_relocation_size_func const relocation_size,
+                                        be_jit_read_entity_func const read_entity,
+                                        void *const data)
+{
+	unsigned size;
+	unsigned n_fragments;
+	unsigned code_size;
+	if (!read_bytes(in, &size, sizeof(size))
+	 || !read_bytes(in, &n_fragments, sizeof(n_fragments))
+	 || !read_bytes(in, &code_size, sizeof(code_size)))
+		return NULL;
+	/* the input bounds the allocations below */
+	long const remaining = get_remaining_size(in);
+	if (remaining < 0 || code_size > (unsigned long)remaining
+	 || n_fragments > (unsigned long)remaining / sizeof(fragment_info_t))
+		return NULL;
+
+	char *const code = obstack_alloc(&segment->code_obst, code_size);
+	if (!read_bytes(in, code, code_size))
+		goto error;
+
+	fragment_info_t **const fragment_infos = OALLOCN(
+		&segment->fragment_info_arr_obst, fragment_info_t*, n_fragments);
+	unsigned fragments_size = 0;
+	for (unsigned i = 0; i < n_fragments; ++i) {
+		fragment_info_t header;
+		if (!read_bytes(in, &header, sizeof(header)))
+			goto error;
+		if (header.len > code_size - fragments_size
+		 || header.n_relocations > header.len
+		 || header.p2align >= 16)
+			goto error;
+		fragments_size += header.len;
+		/* the layout is computed again below */
+		header.address = ~0u;
+
+		fragment_info_t *const fragment = obstack_alloc(
+			&segment->fragment_info_obst,
+			sizeof(*fragment) + header.n_relocations * sizeof(relocation_t));
+		*fragment = header;
+		for (unsigned r = 0; r < header.n_relocations; ++r) {
+			relocation_t *const relocation = &fragment->relocations[r];
+			if (!read_bytes(in, relocation, sizeof(*relocation)))
+				goto error;
+			if (relocation->dest_kind == RELOC_DEST_ENTITY) {
+				relocation->dest.entity = read_entity(in, data);
+				if (relocation->dest.entity == NULL)
+					goto error;
+			}
+		}
+		if (!check_relocations(fragment, n_fragments, relocation_size))
+			goto error;
+		fragment_infos[i] = fragment;
+	}
+	if (fragments_size != code_size
+	 || layout_fragments(n_fragments, fragment_infos, code_size) != size)
+		goto error;
+
+	return new_jit_function(segment, size, n_fragments, fragment_infos, code,
+	                        code_size);
+
+error:
+	clear_obstacks(segment);
+	return NULL;
+}
+
 unsigned be_begin_fragment(uint8_t const p2align, uint8_t const max_skip)
 {
 	assert(obstack_object_size(fragment_info_obst) == 0);
@@ -223,11 +570,30 @@ void be_emit_reloc_fragment(unsigned const len, uint8_t const be_kind,
 		.be_kind           = be_kind,
 		.dest_kind         = RELOC_DEST_CODE_FRAGMENT,
 		.dest_offset       = offset,
+		.size              = len,
 		.dest.fragment_num = fragment_num,
 	};
 	be_emit_relocation(len, &relocation);
 }
 
+void be_emit_reloc_jump(uint8_t const be_kind, unsigned const fragment_num,
+                        uint8_t const short_opcode,
+                        unsigned const long_opcode_len)
+{
+	assert(long_opcode_len > 0);
+	relocation_t relocation = {
+		.be_kind           = be_kind,
+		.dest_kind         = RELOC_DEST_CODE_FRAGMENT,
+		.dest_offset       = -4,
+		.size              = 4,
+		.short_opcode      = short_opcode,
+		.long_opcode_len   = long_opcode_len,
+		.relaxed           = true,
+		.dest.fragment_num = fragment_num,
+	};
+	be_emit_relocation(4, &relocation);
+}
+
 void be_emit_reloc_entity(unsigned const len, uint8_t be_kind,
                           ir_entity *const entity, int32_t const offset)
 {
@@ -235,6 +601,7 @@ void be_emit_reloc_entity(unsigned const len, uint8_t be_kind,
 		.be_kind     = be_kind,
 		.dest_kind   = RELOC_DEST_ENTITY,
 		.dest_offset = offset,
+		.size        = len,
 		.dest.entity = entity,
 	};
 	be_emit_relocation(len, &relocation);
@@ -256,16 +623,18 @@ static unsigned emit_relocation(ir_jit_function_t const *const function,
                                 relocation_t const *const relocation,
                                 unsigned const relocation_address,
                                 char *const relocation_abs,
+                                char const *const relocation_run,
                                 emit_relocation_func const emit)
 {
 	switch (relocation->dest_kind) {
 	case RELOC_DEST_CODE_FRAGMENT: {
 		int32_t const dest = resolve_relocation_code(function, relocation,
 		                                             relocation_address);
-		return emit(relocation_abs, relocation->be_kind, NULL, dest);
+		return emit(relocation_abs, relocation_run, relocation->be_kind, NULL,
+		            dest);
 	}
 	case RELOC_DEST_ENTITY:
-		return emit(relocation_abs, relocation->be_kind,
+		return emit(relocation_abs, relocation_run, relocation->be_kind,
 		            relocation->dest.entity, relocation->dest_offset);
 	}
 	panic("Invalid relocation");
@@ -290,10 +659,13 @@ static void emit_fragment_as_asm(ir_jit_function_t const *const function,
 	for (unsigned r = 0, n = fragment->n_relocations; r < n; ++r) {
 		relocation_t const *const relocation = &fragment->relocations[r];
 		unsigned            const offset     = relocation->offset;
+		/* the assembler relaxes jumps itself */
+		assert(!relocation->relaxed);
 		emit_bytes_as_asm(b, fragment_code + offset);
 		unsigned const reloc_address = fragment_address + offset;
 		unsigned const reloc_size
-			= emit_relocation(function, relocation, reloc_address, NULL, emit);
+			= emit_relocation(function, relocation, reloc_address, NULL, NULL,
+			                  emit);
 		b = fragment_code + relocation->offset + reloc_size;
 	}
 	char const *const end = fragment_code + fragment->len;
@@ -324,6 +696,7 @@ void be_jit_emit_as_asm(ir_jit_function_t *const function,
 static void emit_fragment(ir_jit_function_t const *const function,
 						  fragment_info_t const *const fragment,
                           char const *const fragment_code, char *const buffer,
+                          char const *const address,
                           emit_relocation_func const emit)
 {
 	unsigned        const fragment_address = fragment->address;
@@ -338,9 +711,22 @@ static void emit_fragment(ir_jit_function_t const *const function,
 		memcpy(d, b, len);
 		d += len;
 		b += len;
-		unsigned const reloc_address = fragment_address + offset;
+		if (relocation->relaxed) {
+			/* replace the long opcode by the short form */
+			d -= relocation->long_opcode_len;
+			*d++ = relocation->short_opcode;
+			unsigned const reloc_address = fragment_address + (d - buffer);
+			*d++ = (char)get_short_displacement(function->fragment_infos,
+			                                    relocation, reloc_address);
+			b += 4;
+			last_offset = offset + 4;
+			continue;
+		}
+		unsigned const reloc_address = fragment_address + (d - buffer);
 		unsigned const reloc_size
-			= emit_relocation(function, relocation, reloc_address, d, emit);
+			= emit_relocation(function, relocation, reloc_address, d,
+			                  address + (d - buffer), emit);
+		assert(reloc_size == relocation->size);
 		d += reloc_size;
 		b += reloc_size;
 		last_offset = offset + reloc_size;
@@ -350,7 +736,8 @@ static void emit_fragment(ir_jit_function_t const *const function,
 	memcpy(d, b, end-b);
 }
 
-void be_jit_emit_memory(char *const buffer, ir_jit_function_t *const function,
+void be_jit_emit_memory(char *const buffer, char const *const run_address,
+                        ir_jit_function_t *const function,
                         be_jit_emit_interface_t const *const emitter)
 {
 	/* Copy fragments and resolve relocations. */
@@ -360,15 +747,15 @@ void be_jit_emit_memory(char *const buffer, ir_jit_function_t *const function,
 	for (size_t i = 0, n = function->n_fragments; i < n; ++i) {
 		fragment_info_t const *const fragment  = function->fragment_infos[i];
 		unsigned               const address   = fragment->address;
-		unsigned               const nop_bytes = last_address - address;
+		unsigned               const nop_bytes = address - last_address;
 		assert(address >= last_address);
 		if (nop_bytes > 0)
 			emitter->nops(buffer + last_address, nop_bytes);
 
 		emit_fragment(function, fragment, code+orig_address, buffer+address,
-		              emitter->relocation);
+		              run_address+address, emitter->relocation);
 
 		orig_address += fragment->len;
-		last_address = address + fragment->len;
+		last_address = address + get_fragment_size(fragment);
 	}
 }
@@ -13,13 +13,20 @@
 #define FIRM_BE_BEEMITTER_BINARY_H
 
 #include <stdint.h>
+#include <stdio.h>
 
+#include "bejitheap.h"
 #include "firm_types.h"
 #include "jit.h"
 #include "obst.h"
 
-typedef unsigned (*emit_relocation_func) (char *buffer, uint8_t be_kind,
-                                          ir_entity *entity, int32_t offset);
+/**
+ * Emits a relocation to @p buffer, whose code runs at @p address. Both are
+ * NULL when emitting assembly.
+ */
+typedef unsigned (*emit_relocation_func) (char *buffer, char const *address,
+                                          uint8_t be_kind, ir_entity *entity,
+                                          int32_t offset);
 
 typedef struct be_jit_emit_interface_t {
 	/** create @p size of NOP instructions for alignment */
@@ -30,11 +37,62 @@ typedef struct be_jit_emit_interface_t {
 	emit_relocation_func relocation;
 } be_jit_emit_interface_t;
 
-void be_jit_emit_memory(char *buffer, ir_jit_function_t *function,
+/**
+ * Emits @p function to @p buffer with relocations resolved for running the
+ * code at @p run_address.
+ */
+void be_jit_emit_memory(char *buffer, char const *run_address,
+                        ir_jit_function_t *function,
                         be_jit_emit_interface_t const *emitter);
 
+/**
+ * Like be_emit_function() but the code runs at @p address instead of
+ * @p buffer.
+ */
+void be_jit_emit_function(char *buffer, char const *address,
+                          ir_jit_function_t *function);
+
 void be_jit_emit_as_asm(ir_jit_function_t *function, emit_relocation_func emit);
 
+/** Returns the offset of fragment @p fragment_num in the laid out code. */
+unsigned be_get_fragment_address(ir_jit_function_t const *function,
+                                 unsigned fragment_num);
+
+/** Writes a reference to @p entity for be_jit_write_function(). */
+typedef void (*be_jit_write_entity_func)(FILE *out, ir_entity *entity,
+                                         void *data);
+
+/**
+ * Reads an entity reference written by a be_jit_write_entity_func, returns
+ * NULL if the entity is unknown.
+ */
+typedef ir_entity *(*be_jit_read_entity_func)(FILE *in, void *data);
+
+/**
+ * Writes @p function with its unresolved relocations to @p out. The format
+ * depends on the host and the target.
+ */
+void be_jit_write_function(FILE *out, ir_jit_function_t const *function,
+                           be_jit_write_entity_func write_entity, void *data);
+
+/**
+ * Returns the size of the field of relocation kind @p be_kind in the code,
+ * 0 if the target does not use the kind.
+ */
+typedef unsigned (*be_jit_relocation_size_func)(uint8_t be_kind);
+
+/**
+ * Reads a function written by be_jit_write_function() into @p segment.
+ * Returns NULL if the input is malformed or an entity could not be resolved.
+ */
+ir_jit_function_t *be_jit_read_function(FILE *in, ir_jit_segment_t *segment,
+                                        be_jit_relocation_size_func relocation_size,
+                                        be_jit_read_entity_func read_entity,
+                                        void *data);
+
+/** Returns the executable memory of @p segment. */
+be_jit_heap_t *be_jit_get_segment_heap(ir_jit_segment_t *segment);
+
 void be_jit_begin_function(ir_jit_segment_t *segment);
 ir_jit_function_t *be_jit_finish_function(void);
 
@@ -67,4 +125,13 @@ void be_emit_reloc_fragment(unsigned len, uint8_t be_kind,
 void be_emit_reloc_entity(unsigned len, uint8_t be_kind, ir_entity *entity,
                           int32_t offset);
 
+/**
+ * Emits the 32bit displacement of a jump to fragment @p fragment_num, which
+ * follows a @p long_opcode_len bytes long opcode. The layout replaces the
+ * jump by @p short_opcode with an 8bit displacement if the destination is in
+ * reach.
+ */
+void be_emit_reloc_jump(uint8_t be_kind, unsigned fragment_num,
+                        uint8_t short_opcode, unsigned long_opcode_len);
+
 #endif
@@ -0,0 +1,342 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Persistent cache of jit compiled functions.
+ *
+ * Each cache entry is a file named after a hash of the target fingerprint and
+ * the structural form of the graph. The entry contains both texts, so a hash
+ * collision is detected when loading, followed by the function with its
+ * unresolved relocations. Relocations against entities referenced by the
+ * graph use the position of the entity in the structural form, other
+ * entities are looked up by their linker name.
+ */
+#include "bejit.h"
+
+#include <string.h>
+
+#include "array.h"
+#include "be_t.h"
+#include "firm_common.h"
+#include "irio_t.h"
+#include "irprog.h"
+#include "irtools.h"
+#include "lc_opts.h"
+#include "platform_t.h"
+#include "pmap.h"
+#include "target_t.h"
+#include "util.h"
+#include "xmalloc.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define CACHE_MAGIC   "FIRMJIT"
+#define CACHE_VERSION 3
+
+struct ir_jit_cache_t {
+	char  *directory;
+	char  *fingerprint;
+	size_t fingerprint_size;
+};
+
+typedef enum entity_ref_kind_t {
+	ENTITY_REF_GRAPH,  /**< index into the entities of the structural form */
+	ENTITY_REF_GLOBAL, /**< linker name of a global entity */
+} entity_ref_kind_t;
+
+typedef struct entity_refs_t {
+	ir_entity **entities; /**< entities in order of the structural form */
+	pmap       *indices;  /**< maps entity to its index + 1 */
+	bool        valid;    /**< all entities could be referenced */
+} entity_refs_t;
+
+/** Returns the contents of @p file and its size in @p size. */
+static char *read_contents(FILE *const file, size_t *const size)
+{
+	long const length = ftell(file);
+	if (length < 0 || fseek(file, 0, SEEK_SET) != 0)
+		return NULL;
+	char *const contents = XMALLOCN(char, length + 1);
+	if (fread(contents, 1, length, file) != (size_t)length) {
+		free(contents);
+		return NULL;
+	}
+	contents[length] = '\0';
+	*size            = length;
+	return contents;
+}
+
+/**
+ * Describes everything besides the graph which influences the generated
+ * code: the library version, the target and all backend options.
+ */
+static char *create_fingerprint(size_t *const size)
+{
+	FILE *const file = tmpfile();
+	if (file == NULL)
+		return NULL;
+	fprintf(file, "libfirm %u.%u.%u %s\n", ir_get_version_major(),
+	        ir_get_version_minor(), ir_get_version_micro(),
+	        ir_get_version_revision());
+	fprintf(file, "%s %u %d %d %d %d %c\n", ir_target.isa->name,
+	        ir_target.isa->pointer_size, (int)ir_platform.object_format,
+	        (int)ir_platform.pic_style, (int)ir_platform.amd64_x64abi,
+	        (int)ir_platform.is_darwin, ir_platform.user_label_prefix);
+	lc_opt_entry_t *const be_grp = lc_opt_get_grp(firm_opt_get_root(), "be");
+	lc_opt_print_help_for_entry(be_grp, '-', file);
+	char *const fingerprint = read_contents(file, size);
+	fclose(file);
+	return fingerprint;
+}
+
+ir_jit_cache_t *be_new_jit_cache(char const *const directory)
+{
+	/* entries cannot be checked without the relocation sizes */
+	if (ir_target.isa->jit_relocation_size == NULL)
+		return NULL;
+
+	size_t      fingerprint_size;
+	char *const fingerprint = create_fingerprint(&fingerprint_size);
+	if (fingerprint == NULL)
+		return NULL;
+
+	ir_jit_cache_t *const cache = XMALLOCZ(ir_jit_cache_t);
+	cache->directory        = xstrdup(directory);
+	cache->fingerprint      = fingerprint;
+	cache->fingerprint_size = fingerprint_size;
+	return cache;
+}
+
+void be_destroy_jit_cache(ir_jit_cache_t *const cache)
+{
+	free(cache->directory);
+	free(cache->fingerprint);
+	free(cache);
+}
+
+/** 64bit FNV-1a, the entries are checked completely anyway */
+static uint64_t hash_bytes(uint64_t hash, char const *const data,
+                           size_t const size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+static void write_size(FILE *const out, size_t const size)
+{
+	uint64_t const value = size;
+	fwrite(&value, sizeof(value), 1, out);
+}
+
+static void write_blob(FILE *const out, char const *const data,
+                       size_t const size)
+{
+	write_size(out, size);
+	fwrite(data, 1, size, out);
+}
+
+/** Checks that the next blob in @p in equals @p data. */
+static bool check_blob(FILE *const in, char const *const data,
+                       size_t const size)
+{
+	uint64_t value;
+	if (fread(&value, sizeof(value), 1, in) != 1 || value != size)
+		return false;
+	char buffer[4096];
+	for (size_t done = 0; done < size;) {
+		size_t const chunk = MIN(size - done, sizeof(buffer));
+		if (fread(buffer, 1, chunk, in) != chunk
+		 || memcmp(buffer, data + done, chunk) != 0)
+			return false;
+		done += chunk;
+	}
+	return true;
+}
+
+static void write_header(FILE *const out)
+{
+	uint32_t const byte_order = 0x01020304;
+	uint32_t const version    = CACHE_VERSION;
+	fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), out);
+	fwrite(&byte_order, sizeof(byte_order), 1, out);
+	fwrite(&version, sizeof(version), 1, out);
+}
+
+static bool check_header(FILE *const in)
+{
+	char     magic[sizeof(CACHE_MAGIC)];
+	uint32_t byte_order;
+	uint32_t version;
+	return fread(magic, 1, sizeof(magic), in) == sizeof(magic)
+	    && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+	    && fread(&byte_order, sizeof(byte_order), 1, in) == 1
+	    && byte_order == 0x01020304
+	    && fread(&version, sizeof(version), 1, in) == 1
+	    && version == CACHE_VERSION;
+}
+
+static void write_entity(FILE *const out, ir_entity *const entity,
+                         void *const data)
+{
+	entity_refs_t *const refs  = (entity_refs_t*)data;
+	void          *const index = pmap_get(void, refs->indices, entity);
+	if (index != NULL) {
+		uint8_t  const kind  = ENTITY_REF_GRAPH;
+		uint32_t const value = PTR_TO_INT(index) - 1;
+		fwrite(&kind, sizeof(kind), 1, out);
+		fwrite(&value, sizeof(value), 1, out);
+		return;
+	}
+
+	/* entities created by the backend, like library functions for
+	 * intrinsics, can be found by their name */
+	if (get_entity_visibility(entity) == ir_visibility_private
+	 || ir_get_global(get_entity_ld_ident(entity)) != entity)
+		refs->valid = false;
+	uint8_t const kind = ENTITY_REF_GLOBAL;
+	fwrite(&kind, sizeof(kind), 1, out);
+	char const *const name = get_entity_ld_name(entity);
+	write_blob(out, name, strlen(name));
+}
+
+static ir_entity *read_entity(FILE *const in, void *const data)
+{
+	entity_refs_t const *const refs = (entity_refs_t const*)data;
+	uint8_t kind;
+	if (fread(&kind, sizeof(kind), 1, in) != 1)
+		return NULL;
+	switch ((entity_ref_kind_t)kind) {
+	case ENTITY_REF_GRAPH: {
+		uint32_t index;
+		if (fread(&index, sizeof(index), 1, in) != 1
+		 || index >= ARR_LEN(refs->entities))
+			return NULL;
+		return refs->entities[index];
+	}
+	case ENTITY_REF_GLOBAL: {
+		uint64_t size;
+		char     name[1024];
+		if (fread(&size, sizeof(size), 1, in) != 1 || size >= sizeof(name)
+		 || fread(name, 1, size, in) != size)
+			return NULL;
+		return ir_get_global(new_id_from_chars(name, size));
+	}
+	}
+	return NULL;
+}
+
+static ir_jit_function_t *load_entry(ir_jit_cache_t const *const cache,
+                                     char const *const path,
+                                     ir_jit_segment_t *const segment,
+                                     char const *const structure,
+                                     size_t const structure_size,
+                                     entity_refs_t *const refs)
+{
+	FILE *const in = fopen(path, "rb");
+	if (in == NULL)
+		return NULL;
+	ir_jit_function_t *res = NULL;
+	if (check_header(in)
+	 && check_blob(in, cache->fingerprint, cache->fingerprint_size)
+	 && check_blob(in, structure, structure_size))
+		res = be_jit_read_function(in, segment,
+		                           ir_target.isa->jit_relocation_size,
+		                           read_entity, refs);
+	fclose(in);
+	return res;
+}
+
+static void store_entry(ir_jit_cache_t const *const cache,
+                        char const *const path,
+                        ir_jit_function_t const *const function,
+                        char const *const structure,
+                        size_t const structure_size,
+                        entity_refs_t *const refs)
+{
+	/* write to a temporary file first, so concurrent users of the cache
+	 * never see partial entries */
+#ifdef _WIN32
+	unsigned long const pid = GetCurrentProcessId();
+#else
+	unsigned long const pid = (unsigned long)getpid();
+#endif
+	char temp_path[1024];
+	int const length = snprintf(temp_path, sizeof(temp_path), "%s.%lu.tmp",
+	                            path, pid);
+	if (length < 0 || (size_t)length >= sizeof(temp_path))
+		return;
+	FILE *const out = fopen(temp_path, "wb");
+	if (out == NULL)
+		return;
+	write_header(out);
+	write_blob(out, cache->fingerprint, cache->fingerprint_size);
+	write_blob(out, structure, structure_size);
+	be_jit_write_function(out, function, write_entity, refs);
+	bool const ok = !ferror(out);
+	if (fclose(out) != 0 || !ok || !refs->valid
+	 || rename(temp_path, path) != 0)
+		remove(temp_path);
+}
+
+ir_jit_function_t *be_jit_compile_cached(ir_jit_cache_t *const cache,
+                                         ir_jit_segment_t *const segment,
+                                         ir_graph *const irg)
+{
+	if (cache == NULL)
+		return be_jit_compile(segment, irg);
+
+	FILE *const file = tmpfile();
+	if (file == NULL)
+		return be_jit_compile(segment, irg);
+	entity_refs_t refs = {
+		.entities = NEW_ARR_F(ir_entity*, 0),
+		.indices  = pmap_create(),
+		.valid    = true,
+	};
+	ir_export_irg_structure(file, irg, &refs.entities);
+	size_t      structure_size;
+	char *const structure = read_contents(file, &structure_size);
+	fclose(file);
+
+	char path[1000];
+	int  length = -1;
+	if (structure != NULL) {
+		uint64_t hash = UINT64_C(14695981039346656037);
+		hash   = hash_bytes(hash, cache->fingerprint, cache->fingerprint_size);
+		hash   = hash_bytes(hash, structure, structure_size);
+		length = snprintf(path, sizeof(path), "%s/%016llx.jit",
+		                  cache->directory, (unsigned long long)hash);
+	}
+
+	ir_jit_function_t *res;
+	if (length >= 0 && (size_t)length < sizeof(path)) {
+		for (size_t i = 0, n = ARR_LEN(refs.entities); i < n; ++i)
+			pmap_insert(refs.indices, refs.entities[i], INT_TO_PTR(i + 1));
+		res = load_entry(cache, path, segment, structure, structure_size,
+		                 &refs);
+		if (res == NULL) {
+			res = be_jit_compile(segment, irg);
+			if (res != NULL)
+				store_entry(cache, path, res, structure, structure_size,
+				            &refs);
+		}
+	} else {
+		res = be_jit_compile(segment, irg);
+	}
+
+	free(structure);
+	pmap_destroy(refs.indices);
+	DEL_ARR_F(refs.entities);
+	return res;
+}
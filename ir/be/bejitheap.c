@@ -0,0 +1,344 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Executable memory for jit compiled code.
+ */
+/* anonymous mappings, madvise() and memfd_create() are not part of POSIX */
+#define _GNU_SOURCE
+
+#include "bejitheap.h"
+
+#include <string.h>
+
+#include "array.h"
+#include "panic.h"
+#include "xmalloc.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+enum {
+	BLOCK_ALIGNMENT = 64,        /**< alignment of blocks, a cache line */
+	REGION_SIZE     = 1 << 20,   /**< minimum size of a region */
+	HUGE_PAGE_SIZE  = 2 << 20,   /**< size of a huge page */
+};
+
+typedef struct free_range_t {
+	size_t offset;
+	size_t size;
+} free_range_t;
+
+struct be_jit_region_t {
+	be_jit_region_t *next;
+	char            *base;
+	char            *writable; /**< writable view of the region or base */
+	size_t           size;
+	size_t           page_size;
+	bool             huge_pages;
+	free_range_t    *free; /**< free ranges sorted by offset */
+};
+
+struct be_jit_heap_t {
+	be_jit_region_t *regions;
+	size_t           page_size;
+	bool             huge_pages;
+};
+
+static size_t round_up_size(size_t const size, size_t const alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t get_page_size(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+#ifndef _WIN32
+/**
+ * Maps @p size bytes with protection @p prot, aligned to a huge page with
+ * @p huge_pages.
+ */
+static char *map_anonymous(size_t const size, bool const huge_pages,
+                           int const prot)
+{
+	size_t const map_size = huge_pages ? size + HUGE_PAGE_SIZE : size;
+	char  *const mapped   = mmap(NULL, map_size, prot,
+	                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapped == MAP_FAILED)
+		return NULL;
+	if (!huge_pages)
+		return mapped;
+
+	/* trim the mapping to a huge page aligned region */
+	char *const base = (char*)round_up_size((size_t)mapped, HUGE_PAGE_SIZE);
+	if (base != mapped)
+		munmap(mapped, base - mapped);
+	char *const end = mapped + map_size;
+	if (base + size != end)
+		munmap(base + size, end - (base + size));
+	return base;
+}
+#endif
+
+#if !defined(_WIN32) && defined(MFD_CLOEXEC)
+/**
+ * Maps the same memory twice, executable and writable, so writing a block
+ * never changes the protection of code other threads may be running.
+ * Returns false if the system does not allow this.
+ */
+static bool map_double(be_jit_region_t *const region)
+{
+	size_t const size = region->size;
+	int    const fd   = memfd_create("firm-jit", MFD_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	char *base     = NULL;
+	char *writable = MAP_FAILED;
+	if (ftruncate(fd, size) != 0)
+		goto out;
+	/* reserve an aligned range, then put the executable view there */
+	base = map_anonymous(size, region->huge_pages, PROT_NONE);
+	if (base == NULL)
+		goto out;
+	if (mmap(base, size, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, fd, 0)
+	    == MAP_FAILED)
+		goto out;
+	writable = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+out:
+	close(fd);
+	if (writable == MAP_FAILED) {
+		if (base != NULL)
+			munmap(base, size);
+		return false;
+	}
+	region->base     = base;
+	region->writable = writable;
+	return true;
+}
+#endif
+
+static void map_region(be_jit_region_t *const region)
+{
+	size_t const size       = region->size;
+	bool   const huge_pages = region->huge_pages;
+#ifdef _WIN32
+	(void)huge_pages; /* large pages need special privileges on windows */
+	region->base = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+	                            PAGE_EXECUTE_READ);
+	if (region->base == NULL)
+		panic("could not allocate memory for jit code");
+#else
+#ifdef MFD_CLOEXEC
+	if (!map_double(region))
+#endif
+	{
+		region->base = map_anonymous(size, huge_pages, PROT_READ | PROT_EXEC);
+		if (region->base == NULL)
+			panic("could not allocate memory for jit code");
+	}
+#ifdef MADV_HUGEPAGE
+	/* only a hint, the region works without huge pages as well */
+	if (huge_pages)
+		madvise(region->base, size, MADV_HUGEPAGE);
+#endif
+#endif
+	if (region->writable == NULL)
+		region->writable = region->base;
+}
+
+static void unmap_region(be_jit_region_t const *const region)
+{
+#ifdef _WIN32
+	VirtualFree(region->base, 0, MEM_RELEASE);
+#else
+	if (region->writable != region->base)
+		munmap(region->writable, region->size);
+	munmap(region->base, region->size);
+#endif
+}
+
+static void protect(char *const start, size_t const size, bool const writable)
+{
+#ifdef _WIN32
+	DWORD old;
+	if (!VirtualProtect(start, size,
+	                    writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old))
+		panic("could not change protection of jit code");
+#else
+	if (mprotect(start, size,
+	             writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC))
+		panic("could not change protection of jit code");
+#endif
+}
+
+be_jit_heap_t *be_new_jit_heap(bool const huge_pages)
+{
+	be_jit_heap_t *const heap = XMALLOCZ(be_jit_heap_t);
+	heap->page_size  = get_page_size();
+	heap->huge_pages = huge_pages;
+	return heap;
+}
+
+void be_free_jit_heap(be_jit_heap_t *const heap)
+{
+	for (be_jit_region_t *region = heap->regions, *next; region != NULL;
+	     region = next) {
+		next = region->next;
+		unmap_region(region);
+		DEL_ARR_F(region->free);
+		free(region);
+	}
+	free(heap);
+}
+
+static be_jit_region_t *new_region(be_jit_heap_t *const heap,
+                                   size_t const min_size)
+{
+	bool   const huge_pages  = heap->huge_pages;
+	size_t const granularity = huge_pages ? HUGE_PAGE_SIZE : heap->page_size;
+	size_t       size        = round_up_size(min_size, granularity);
+	if (size < REGION_SIZE)
+		size = round_up_size(REGION_SIZE, granularity);
+
+	be_jit_region_t *const region = XMALLOCZ(be_jit_region_t);
+	region->size       = size;
+	region->page_size  = heap->page_size;
+	region->huge_pages = huge_pages;
+	map_region(region);
+	region->free       = NEW_ARR_F(free_range_t, 1);
+	region->free[0]    = (free_range_t){ 0, size };
+	region->next       = heap->regions;
+	heap->regions      = region;
+	return region;
+}
+
+be_jit_block_t be_jit_heap_alloc(be_jit_heap_t *const heap, size_t size)
+{
+	size = round_up_size(size > 0 ? size : 1, BLOCK_ALIGNMENT);
+	for (be_jit_region_t *region = heap->regions;; region = region->next) {
+		if (region == NULL)
+			region = new_region(heap, size);
+
+		free_range_t *const free = region->free;
+		for (size_t i = 0, n = ARR_LEN(free); i < n; ++i) {
+			free_range_t *const range = &free[i];
+			if (range->size < size)
+				continue;
+
+			be_jit_block_t const block = {
+				.address  = region->base + range->offset,
+				.writable = region->writable + range->offset,
+				.size     = size,
+				.region   = region,
+			};
+			range->offset += size;
+			range->size   -= size;
+			if (range->size == 0) {
+				memmove(range, range + 1, (n - i - 1) * sizeof(*range));
+				ARR_SHRINKLEN(free, n - 1);
+			}
+			return block;
+		}
+	}
+}
+
+void be_jit_heap_free(be_jit_block_t const *const block)
+{
+	be_jit_region_t *const region = block->region;
+	size_t           const offset = block->address - region->base;
+	size_t           const size   = block->size;
+
+	size_t const n = ARR_LEN(region->free);
+	size_t       i = 0;
+	while (i < n && region->free[i].offset < offset)
+		++i;
+
+	free_range_t *const prev = i > 0 ? &region->free[i - 1] : NULL;
+	free_range_t *const next = i < n ? &region->free[i]     : NULL;
+	bool const merge_prev = prev != NULL && prev->offset + prev->size == offset;
+	bool const merge_next = next != NULL && offset + size == next->offset;
+	if (merge_prev && merge_next) {
+		prev->size += size + next->size;
+		memmove(next, next + 1, (n - i - 1) * sizeof(*next));
+		ARR_SHRINKLEN(region->free, n - 1);
+	} else if (merge_prev) {
+		prev->size += size;
+	} else if (merge_next) {
+		next->offset  = offset;
+		next->size   += size;
+	} else {
+		free_range_t const range = { offset, size };
+		ARR_APP1(free_range_t, region->free, range);
+		free_range_t *const free = region->free;
+		memmove(&free[i + 1], &free[i], (n - i) * sizeof(*free));
+		free[i] = range;
+	}
+}
+
+/**
+ * Returns the pages whose protection changes for writing @p block without a
+ * writable view. Huge page regions change as a whole so the huge pages are
+ * not split.
+ */
+static void get_write_range(be_jit_block_t const *const block,
+                            char **const start, size_t *const size)
+{
+	be_jit_region_t const *const region = block->region;
+	if (region->huge_pages) {
+		*start = region->base;
+		*size  = region->size;
+		return;
+	}
+	size_t const page_size = region->page_size;
+	size_t const begin     = (size_t)block->address & ~(page_size - 1);
+	size_t const end       = round_up_size((size_t)block->address + block->size,
+	                                       page_size);
+	*start = (char*)begin;
+	*size  = end - begin;
+}
+
+void be_jit_heap_begin_write(be_jit_block_t const *const block)
+{
+	if (block->writable != block->address)
+		return;
+	char  *start;
+	size_t size;
+	get_write_range(block, &start, &size);
+	protect(start, size, true);
+}
+
+void be_jit_heap_finish_write(be_jit_block_t const *const block)
+{
+	if (block->writable == block->address) {
+		char  *start;
+		size_t size;
+		get_write_range(block, &start, &size);
+		protect(start, size, false);
+	}
+#ifdef _WIN32
+	FlushInstructionCache(GetCurrentProcess(), block->address, block->size);
+#elif defined(__GNUC__)
+	__builtin___clear_cache(block->address, block->address + block->size);
+#endif
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Executable memory for jit compiled code.
+ *
+ * The heap hands out blocks of large regions. Where the system allows it the
+ * memory of a region is mapped twice, executable and writable, so code can
+ * be written while other threads run code of the same region. Otherwise the
+ * executable pages are only made writable while a block gets written. Freed
+ * blocks are merged with their free neighbours and reused by later
+ * allocations.
+ */
+#ifndef FIRM_BE_BEJITHEAP_H
+#define FIRM_BE_BEJITHEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct be_jit_heap_t   be_jit_heap_t;
+typedef struct be_jit_region_t be_jit_region_t;
+
+/** Executable memory allocated from a heap. */
+typedef struct be_jit_block_t {
+	char            *address;  /**< address the code runs at */
+	char            *writable; /**< address the code is written to */
+	size_t           size;
+	be_jit_region_t *region;
+} be_jit_block_t;
+
+/**
+ * Creates a heap. With @p huge_pages regions are aligned to huge pages and
+ * the operating system is asked to back them with huge pages.
+ */
+be_jit_heap_t *be_new_jit_heap(bool huge_pages);
+
+/**
+ * Frees the heap and all memory allocated from it.
+ */
+void be_free_jit_heap(be_jit_heap_t *heap);
+
+/**
+ * Allocates a block of at least @p size bytes. The block is aligned to a
+ * cache line.
+ */
+be_jit_block_t be_jit_heap_alloc(be_jit_heap_t *heap, size_t size);
+
+/**
+ * Returns @p block to its heap for reuse.
+ */
+void be_jit_heap_free(be_jit_block_t const *block);
+
+/**
+ * Prepares writing @p block through its writable address. Without a separate
+ * writable view this changes the protection of the pages of @p block, or of
+ * its whole region with huge pages, so code on them must not execute until
+ * be_jit_heap_finish_write() is called.
+ */
+void be_jit_heap_begin_write(be_jit_block_t const *block);
+
+/**
+ * Makes @p block executable again after it was written.
+ */
+void be_jit_heap_finish_write(be_jit_block_t const *block);
+
+#endif
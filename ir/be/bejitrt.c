@@ -0,0 +1,182 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Lazily compiling jit runtime with tiered recompilation.
+ *
+ * Every function gets a stub, which jumps to the entry stored in the
+ * function's record. The entry starts out as the resolve trampoline, which
+ * compiles the function and continues in the new code. With tiered
+ * compilation the entry then becomes the count trampoline, which enters the
+ * resolve trampoline again once the function got hot. Finally the entry is
+ * the optimized code itself.
+ */
+#include "bejitrt.h"
+
+#include "bejit.h"
+#include "irgraph_t.h"
+#include "irprog_t.h"
+#include "jit.h"
+#include "panic.h"
+#include "pmap.h"
+#include "target_t.h"
+#include "xmalloc.h"
+
+/** size of the blocks new stubs are placed in */
+#define STUB_BLOCK_SIZE 1024
+
+typedef struct jit_function_t {
+	be_jit_stub_record_t record; /**< must be the first member */
+	ir_jit_runtime_t    *runtime;
+	ir_graph            *irg;
+	unsigned             tier;
+} jit_function_t;
+
+struct ir_jit_runtime_t {
+	be_jit_stub_if_t const *stubs;
+	ir_jit_optimize_func    baseline;
+	ir_jit_optimize_func    optimized;
+	unsigned                hot_threshold;
+	void const             *resolve_entry;
+	void const             *count_entry;
+	ir_jit_segment_t       *segment;    /**< holds all code of the runtime */
+	be_jit_block_t          stub_block; /**< block receiving new stubs */
+	size_t                  stub_block_used;
+	pmap                   *functions;  /**< entity -> jit_function_t */
+};
+
+/**
+ * Compiles a copy of the graph of @p function after applying @p optimize and
+ * returns the executable code.
+ */
+static void const *compile(jit_function_t const *const function,
+                           ir_jit_optimize_func const optimize)
+{
+	ir_graph  *const irg    = function->irg;
+	ir_entity *const entity = get_irg_entity(irg);
+	ir_graph  *const copy   = create_irg_copy(irg);
+	set_irg_entity(copy, entity);
+	copy->constraints       = irg->constraints;
+	copy->callee_info_state = irg->callee_info_state;
+	copy->mem_disambig_opt  = irg->mem_disambig_opt;
+	add_irp_irg(copy);
+	if (optimize != NULL)
+		optimize(copy);
+
+	ir_jit_segment_t  *const segment = function->runtime->segment;
+	ir_jit_function_t *const jitted  = be_jit_compile(segment, copy);
+	if (jitted == NULL)
+		panic("could not jit compile %+F", entity);
+	void const *const code = be_jit_install_function(jitted);
+
+	free_ir_graph(copy);
+	/* freeing the copy unset the graph of the entity */
+	set_entity_irg(entity, irg);
+	return code;
+}
+
+static void const *resolve(be_jit_stub_record_t *const record)
+{
+	jit_function_t   *const function = (jit_function_t*)record;
+	ir_jit_runtime_t *const runtime  = function->runtime;
+	if (function->tier == 0) {
+		record->code = compile(function, runtime->baseline);
+		if (runtime->optimized != NULL && runtime->hot_threshold > 0) {
+			record->counter = runtime->hot_threshold;
+			record->entry   = runtime->count_entry;
+		} else {
+			record->entry   = record->code;
+		}
+	} else {
+		/* the baseline code may still be running, so it is kept until the
+		 * runtime gets destroyed */
+		record->code  = compile(function, runtime->optimized);
+		record->entry = record->code;
+	}
+	++function->tier;
+	return record->code;
+}
+
+ir_jit_runtime_t *be_new_jit_runtime(ir_jit_optimize_func const baseline,
+                                     ir_jit_optimize_func const optimized,
+                                     unsigned const hot_threshold)
+{
+	be_jit_stub_if_t const *const stubs = ir_target.isa->jit_stubs;
+	if (stubs == NULL)
+		return NULL;
+
+	ir_jit_runtime_t *const runtime = XMALLOCZ(ir_jit_runtime_t);
+	runtime->stubs         = stubs;
+	runtime->baseline      = baseline;
+	runtime->optimized     = optimized;
+	runtime->hot_threshold = hot_threshold;
+	runtime->segment       = be_new_jit_segment();
+	runtime->functions     = pmap_create();
+
+	be_jit_heap_t *const heap = be_jit_get_segment_heap(runtime->segment);
+	be_jit_block_t const block
+		= be_jit_heap_alloc(heap, stubs->trampolines_size);
+	char *const trampolines = block.address;
+	unsigned resolve_offset;
+	unsigned count_offset;
+	be_jit_heap_begin_write(&block);
+	stubs->emit_trampolines(block.writable, resolve, &resolve_offset,
+	                        &count_offset);
+	be_jit_heap_finish_write(&block);
+	runtime->resolve_entry = trampolines + resolve_offset;
+	runtime->count_entry   = trampolines + count_offset;
+	return runtime;
+}
+
+void be_destroy_jit_runtime(ir_jit_runtime_t *const runtime)
+{
+	foreach_pmap(runtime->functions, entry) {
+		free(entry->value);
+	}
+	pmap_destroy(runtime->functions);
+	be_destroy_jit_segment(runtime->segment);
+	free(runtime);
+}
+
+void const *be_jit_runtime_add(ir_jit_runtime_t *const runtime,
+                               ir_graph *const irg)
+{
+	ir_entity *const entity = get_irg_entity(irg);
+	if (pmap_contains(runtime->functions, entity))
+		panic("%+F added twice to jit runtime", entity);
+
+	jit_function_t *const function = XMALLOCZ(jit_function_t);
+	function->record.entry = runtime->resolve_entry;
+	function->runtime      = runtime;
+	function->irg          = irg;
+	pmap_insert(runtime->functions, entity, function);
+
+	size_t          const stub_size = runtime->stubs->stub_size;
+	be_jit_block_t *const block     = &runtime->stub_block;
+	if (block->address == NULL
+	 || runtime->stub_block_used + stub_size > block->size) {
+		be_jit_heap_t *const heap = be_jit_get_segment_heap(runtime->segment);
+		*block = be_jit_heap_alloc(heap, STUB_BLOCK_SIZE);
+		runtime->stub_block_used = 0;
+	}
+	char *const stub = block->address + runtime->stub_block_used;
+	be_jit_heap_begin_write(block);
+	runtime->stubs->emit_stub(block->writable + runtime->stub_block_used,
+	                          &function->record);
+	be_jit_heap_finish_write(block);
+	runtime->stub_block_used += stub_size;
+
+	be_jit_set_entity_addr(entity, stub);
+	return stub;
+}
+
+unsigned be_jit_runtime_get_tier(ir_jit_runtime_t const *const runtime,
+                                 ir_entity const *const entity)
+{
+	jit_function_t const *const function
+		= pmap_get(jit_function_t const, runtime->functions, entity);
+	return function != NULL ? function->tier : 0;
+}
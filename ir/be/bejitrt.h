@@ -0,0 +1,56 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief       Target interface for the lazily compiling jit runtime.
+ */
+#ifndef FIRM_BE_BEJITRT_H
+#define FIRM_BE_BEJITRT_H
+
+#include <stdint.h>
+
+/**
+ * Per function data read by the stubs and trampolines. The target code
+ * accesses the fields at their offsets, so keep the layout in sync.
+ */
+typedef struct be_jit_stub_record_t {
+	void const *entry;   /**< where the stub continues */
+	void const *code;    /**< the currently compiled code of the function */
+	int64_t     counter; /**< calls left until the function gets recompiled */
+} be_jit_stub_record_t;
+
+/**
+ * Compiles the function of @p record if necessary and returns the address
+ * the call continues at.
+ */
+typedef void const *(*be_jit_resolve_func)(be_jit_stub_record_t *record);
+
+typedef struct be_jit_stub_if_t {
+	unsigned stub_size;        /**< size of a stub in bytes */
+	unsigned trampolines_size; /**< size of the trampolines in bytes */
+
+	/**
+	 * Writes the trampolines shared by all stubs into @p buffer. The code
+	 * must be position independent, it may run at another address.
+	 *
+	 * The resolve trampoline preserves the argument registers, calls
+	 * @p resolve with the record of the stub and continues at the returned
+	 * address. The count trampoline decrements the counter of the record,
+	 * enters the resolve trampoline if it reaches zero and continues at the
+	 * code of the record otherwise.
+	 */
+	void (*emit_trampolines)(char *buffer, be_jit_resolve_func resolve,
+	                         unsigned *resolve_offset, unsigned *count_offset);
+
+	/**
+	 * Writes a stub into @p buffer, which continues at the entry of
+	 * @p record and makes @p record available to the trampolines. The code
+	 * must be position independent like the trampolines.
+	 */
+	void (*emit_stub)(char *buffer, be_jit_stub_record_t *record);
+} be_jit_stub_if_t;
+
+#endif
@@ -13,7 +13,9 @@
 #include "beasm.h"
 #include "bechordal_t.h"
 #include "bediagnostic.h"
+#include "beelf.h"
 #include "beemitter.h"
+#include "befuncorder.h"
 #include "begnuas.h"
 #include "beifg.h"
 #include "beirg.h"
@@ -46,6 +48,7 @@
 #include "lc_opts.h"
 #include "lc_opts_enum.h"
 #include "obst.h"
+#include "platform_t.h"
 #include "statev.h"
 #include "target_t.h"
 #include "util.h"
@@ -64,6 +67,9 @@ be_options_t be_options = {
 	.do_verify            = true,
 	.ilp_solver           = "",
 	.verbose_asm          = true,
+	.split_cold           = true,
+	.order_functions      = true,
+	.emit_object          = false,
 };
 
 /* possible dumping options */
@@ -91,6 +97,9 @@ static const lc_opt_table_entry_t be_main_options[] = {
 	LC_OPT_ENT_BOOL     ("profilegenerate", "instrument the code for execution count profiling", &be_options.opt_profile_generate),
 	LC_OPT_ENT_BOOL     ("profileuse",      "use existing profile data",                         &be_options.opt_profile_use),
 	LC_OPT_ENT_BOOL     ("verboseasm", "enable verbose assembler output",                        &be_options.verbose_asm),
+	LC_OPT_ENT_BOOL     ("splitcold",  "move rarely executed blocks into a separate section",   &be_options.split_cold),
+	LC_OPT_ENT_BOOL     ("orderfuncs", "place frequently calling functions next to each other", &be_options.order_functions),
+	LC_OPT_ENT_BOOL     ("object",     "write an ELF relocatable object instead of assembler",  &be_options.emit_object),
 
 	LC_OPT_ENT_STR("ilp.solver", "the ilp solver name", &be_options.ilp_solver),
 	LC_OPT_LAST
@@ -296,6 +305,7 @@ static ir_graph *be_prepare_profile(const char *const cup_name)
 			ir_create_execfreqs_from_profile();
 			ir_profile_free();
 			have_profile = true;
+			env.has_profile = true;
 		}
 	}
 
@@ -382,7 +392,18 @@ void be_begin(FILE *file_handle, const char *cup_name)
 	if (prof_init_irg != NULL)
 		initialize_birg(&birgs[num_birgs++], prof_init_irg, &env);
 
-	be_gas_begin_compilation_unit(&env);
+	if (be_options.order_functions)
+		be_order_functions();
+
+	if (be_options.emit_object) {
+		be_elf_target_t const *const elf_target = ir_target.isa->elf_target;
+		if (elf_target == NULL
+		 || ir_platform.object_format != OBJECT_FORMAT_ELF)
+			panic("target does not support writing object files");
+		be_elf_begin(file_handle, cup_name, elf_target);
+	} else {
+		be_gas_begin_compilation_unit(&env);
+	}
 }
 
 void firm_be_finish(void)
@@ -551,7 +572,11 @@ void be_step_last(ir_graph *irg)
 
 void be_finish(void)
 {
-	be_gas_end_compilation_unit(&env);
+	if (be_options.emit_object) {
+		be_elf_end();
+	} else {
+		be_gas_end_compilation_unit(&env);
+	}
 
 	if (be_options.timing) {
 		ir_timer_stop(bemain_timer);
@@ -605,5 +630,11 @@ ir_jit_function_t *be_jit_compile(ir_jit_segment_t *const segment,
 
 void be_emit_function(char *const buffer, ir_jit_function_t *const function)
 {
-	ir_target.isa->emit_function(buffer, function);
+	ir_target.isa->emit_function(buffer, buffer, function);
+}
+
+void be_jit_emit_function(char *const buffer, char const *const address,
+                          ir_jit_function_t *const function)
+{
+	ir_target.isa->emit_function(buffer, address, function);
 }
@@ -19,6 +19,7 @@
 #include "irgwalk.h"
 #include "irprintf.h"
 #include "irtools.h"
+#include "target_t.h"
 #include "util.h"
 #include <stdlib.h>
 
@@ -34,6 +35,8 @@ typedef struct irn_cost_pair {
 
 typedef struct flag_and_cost {
 	bool          no_root;
+	bool          has_path;
+	unsigned      path;    /**< cycles until the result is available */
 	irn_cost_pair costs[];
 } flag_and_cost;
 
@@ -101,7 +104,8 @@ static unsigned normal_tree_cost(ir_node *irn)
 		ir_node *block = get_nodes_block(irn);
 
 		fc = OALLOCF(&obst, flag_and_cost, costs, arity);
-		fc->no_root = false;
+		fc->no_root  = false;
+		fc->has_path = false;
 		irn_cost_pair *costs = fc->costs;
 
 		foreach_irn_in(irn, i, pred) {
@@ -207,6 +211,33 @@ static ir_node **sched_node(ir_node **sched, ir_node *irn)
 	return sched;
 }
 
+/**
+ * Returns the estimated number of cycles until the result of @p irn is
+ * available, if its operands in the same block are computed right before.
+ */
+static unsigned get_critical_path(const ir_node *irn)
+{
+	irn = skip_Proj_const(irn);
+	if (arch_is_irn_not_scheduled(irn))
+		return 0;
+	flag_and_cost *fc = get_irn_flag_and_cost(irn);
+	if (fc->has_path)
+		return fc->path;
+
+	unsigned path = 0;
+	if (!is_Phi(irn)) {
+		ir_node *block = get_nodes_block(irn);
+		foreach_irn_in(irn, i, pred) {
+			if (get_nodes_block(pred) == block)
+				path = MAX(path, get_critical_path(pred));
+		}
+	}
+	path += ir_target.isa->get_op_estimated_cost(irn);
+	fc->has_path = true;
+	fc->path     = path;
+	return path;
+}
+
 static int root_cmp(const void *a, const void *b)
 {
 	const irn_cost_pair *const a1 = (const irn_cost_pair*)a;
@@ -219,8 +250,13 @@ static int root_cmp(const void *a, const void *b)
 	} else {
 		ret = (int)b1->cost - (int)a1->cost;
 		if (ret == 0) {
+			/* start long latency computations first */
+			ret = (int)get_critical_path(b1->irn)
+			    - (int)get_critical_path(a1->irn);
 			/* place live-out nodes later */
-			ret = (count_result(a1->irn) != 0) - (count_result(b1->irn) != 0);
+			if (ret == 0)
+				ret = (count_result(a1->irn) != 0)
+				    - (count_result(b1->irn) != 0);
 			/* compare node idx */
 			if (ret == 0)
 				ret = get_irn_idx(a1->irn) - get_irn_idx(b1->irn);
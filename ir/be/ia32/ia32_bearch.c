@@ -1347,6 +1347,9 @@ static void ia32_init(void)
 	ir_target.fast_unaligned_memaccess = true;
 	ir_target.allow_ifconv             = ia32_is_mux_allowed;
 	ir_target.float_int_overflow       = ir_overflow_indefinite;
+	ir_target.data_cache_size          = 32 * 1024;
+	if (ia32_cg_config.use_sse_prefetch || ia32_cg_config.use_3dnow_prefetch)
+		ir_target.prefetch_distance = 256;
 	ir_platform_set_va_list_type_pointer();
 
 	if (!ia32_cg_config.use_sse2 && !ia32_cg_config.use_softfloat) {
@@ -1664,6 +1667,7 @@ arch_isa_if_t const ia32_isa_if = {
 	.generate_code         = ia32_generate_code,
 	.jit_compile           = ia32_jit_compile,
 	.emit_function         = ia32_emit_jit_function,
+	.jit_relocation_size   = ia32_get_jit_relocation_size,
 	.lower_for_target      = ia32_lower_for_target,
 	.additional_reg_names  = ia32_additional_reg_names,
 	.get_op_estimated_cost = ia32_get_op_estimated_cost,
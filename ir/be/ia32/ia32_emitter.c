@@ -1376,22 +1376,61 @@ static parameter_dbg_info_t *construct_parameter_infos(ir_graph *irg)
 	return infos;
 }
 
+/**
+ * Emits the initial call frame information of a function (part).
+ */
+static void ia32_emit_callframe(void)
+{
+	if (omit_fp) {
+		be_dwarf_callframe_register(&ia32_registers[REG_ESP]);
+	} else {
+		/* well not entirely correct here, we should emit this after the
+		 * "movl esp, ebp" */
+		be_dwarf_callframe_register(&ia32_registers[REG_EBP]);
+		/* TODO: do not hardcode the following */
+		be_dwarf_callframe_offset(8);
+		be_dwarf_callframe_spilloffset(&ia32_registers[REG_EBP], -8);
+	}
+}
+
+/**
+ * Emits the blocks of a function followed by the function epilog. Cold
+ * blocks are emitted into a separate section after the epilog.
+ */
 static void emit_function_text(ir_graph *const irg, exc_entry **const exc_list)
 {
 	ia32_register_emitters();
 
-	ir_node  **const blk_sched = be_create_block_schedule(irg);
+	size_t           n_hot;
+	ir_node  **const blk_sched = be_create_block_schedule(irg, &n_hot);
+	size_t     const n_blocks  = ARR_LEN(blk_sched);
 
 	/* we use links to point to target blocks */
 	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
 	irg_block_walk_graph(irg, ia32_gen_labels, NULL, exc_list);
 
 	be_emit_init_cf_links(blk_sched);
+	/* there is no fallthrough into the cold part */
+	if (n_hot < n_blocks)
+		set_irn_link(blk_sched[n_hot], NULL);
 
-	for (size_t i = 0, n = ARR_LEN(blk_sched); i < n; ++i) {
+	for (size_t i = 0; i < n_hot; ++i) {
 		ir_node *const block = blk_sched[i];
 		ia32_gen_block(block);
 	}
+
+	ir_entity *const entity = get_irg_entity(irg);
+	be_gas_emit_function_epilog(entity);
+
+	if (n_hot < n_blocks) {
+		be_gas_emit_cold_function_prolog(entity);
+		ia32_emit_callframe();
+		for (size_t i = n_hot; i < n_blocks; ++i) {
+			ir_node *const block = blk_sched[i];
+			ia32_gen_block(block);
+		}
+		be_gas_emit_cold_function_epilog(entity);
+	}
 	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
 }
 
@@ -1412,11 +1451,13 @@ static const lc_opt_table_entry_t ia32_emitter_options[] = {
 };
 
 static unsigned emit_jit_entity_relocation_asm(char *const buffer,
+                                               char const *const address,
                                                uint8_t const be_kind,
                                                ir_entity *const entity,
                                                int32_t const offset)
 {
 	(void)buffer;
+	(void)address;
 	assert(buffer == NULL);
 	if (be_kind == IA32_RELOCATION_RELJUMP) {
 		be_emit_irprintf("\t.long %"PRId32"\n", offset);
@@ -1454,15 +1495,8 @@ void ia32_emit_function(ir_graph *const irg)
 	if (omit_fp) {
 		ir_type *frame_type = get_irg_frame_type(irg);
 		frame_type_size = get_type_size(frame_type);
-		be_dwarf_callframe_register(&ia32_registers[REG_ESP]);
-	} else {
-		/* well not entirely correct here, we should emit this after the
-		 * "movl esp, ebp" */
-		be_dwarf_callframe_register(&ia32_registers[REG_EBP]);
-		/* TODO: do not hardcode the following */
-		be_dwarf_callframe_offset(8);
-		be_dwarf_callframe_spilloffset(&ia32_registers[REG_EBP], -8);
 	}
+	ia32_emit_callframe();
 
 	get_unique_label(pic_base_label, sizeof(pic_base_label), "PIC_BASE");
 	x86_pic_base_label = pic_base_label;
@@ -1474,12 +1508,11 @@ void ia32_emit_function(ir_graph *const irg)
 		ir_jit_function_t *const function = ia32_emit_jit(segment, irg);
 		be_jit_emit_as_asm(function, emit_jit_entity_relocation_asm);
 		be_destroy_jit_segment(segment);
+		be_gas_emit_function_epilog(entity);
 	} else {
 		emit_function_text(irg, &exc_list);
 	}
 
-	be_gas_emit_function_epilog(entity);
-
 	/* Sort the exception table using the exception label id's.
 	   Those are ascending with ascending addresses. */
 	QSORT_ARR(exc_list, cmp_exc_entry);
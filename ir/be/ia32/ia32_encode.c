@@ -1359,7 +1359,7 @@ ir_jit_function_t *ia32_emit_jit(ir_jit_segment_t *const segment,
 {
 	ia32_register_binary_emitters();
 
-	ir_node **const blk_sched = be_create_block_schedule(irg);
+	ir_node **const blk_sched = be_create_block_schedule(irg, NULL);
 
 	be_jit_begin_function(segment);
 
@@ -1422,6 +1422,7 @@ static void enc_nop_callback(char *buffer, unsigned size)
 }
 
 static unsigned enc_relocation_callback(char *const buffer,
+                                        char const *const address,
                                         uint8_t const be_kind,
                                         ir_entity *const entity,
                                         int32_t const offset)
@@ -1436,7 +1437,7 @@ static unsigned enc_relocation_callback(char *const buffer,
 			panic("Could not resolve address of entity %+F", entity);
 		intptr_t addr = entity_addr + offset;
 		if (be_kind == X86_IMM_PCREL)
-			addr -= (intptr_t)buffer;
+			addr -= (intptr_t)address;
 		value = (uint32_t)addr;
 		if ((intptr_t)value != addr)
 			panic("Overflow in relocation");
@@ -1446,11 +1447,23 @@ static unsigned enc_relocation_callback(char *const buffer,
 	return 4;
 }
 
-void ia32_emit_jit_function(char *buffer, ir_jit_function_t *const function)
+unsigned ia32_get_jit_relocation_size(uint8_t const be_kind)
+{
+	switch (be_kind) {
+	case IA32_RELOCATION_RELJUMP:
+	case X86_IMM_ADDR:
+	case X86_IMM_PCREL:
+		return 4;
+	}
+	return 0;
+}
+
+void ia32_emit_jit_function(char *const buffer, char const *const address,
+                            ir_jit_function_t *const function)
 {
 	static const be_jit_emit_interface_t jit_emit_interface = {
 		.nops       = enc_nop_callback,
 		.relocation = enc_relocation_callback,
 	};
-	be_jit_emit_memory(buffer, function, &jit_emit_interface);
+	be_jit_emit_memory(buffer, address, function, &jit_emit_interface);
 }
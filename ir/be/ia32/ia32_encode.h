@@ -21,7 +21,10 @@ enum {
 
 ir_jit_function_t *ia32_emit_jit(ir_jit_segment_t *segment, ir_graph *irg);
 
-void ia32_emit_jit_function(char *buffer, ir_jit_function_t *function);
+void ia32_emit_jit_function(char *buffer, char const *address,
+                            ir_jit_function_t *function);
+
+unsigned ia32_get_jit_relocation_size(uint8_t be_kind);
 
 void ia32_enc_simple(uint8_t opcode);
 
@@ -253,7 +253,7 @@ void riscv_emit_function(ir_graph *const irg)
 	ir_entity *const entity = get_irg_entity(irg);
 	be_gas_emit_function_prolog(entity, 16, NULL);
 
-	ir_node **const blk_sched = be_create_block_schedule(irg);
+	ir_node **const blk_sched = be_create_block_schedule(irg, NULL);
 	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
 	be_emit_init_cf_links(blk_sched);
 
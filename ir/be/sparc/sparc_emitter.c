@@ -1295,7 +1295,7 @@ void sparc_emit_function(ir_graph *irg)
 	sparc_register_emitters();
 
 	/* create the block schedule. For now, we don't need it earlier. */
-	ir_node **block_schedule = be_create_block_schedule(irg);
+	ir_node **block_schedule = be_create_block_schedule(irg, NULL);
 
 	sparc_emit_func_prolog(irg);
 	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
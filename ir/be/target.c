@@ -144,6 +144,18 @@ int ir_target_fast_unaligned_memaccess(void)
 	return ir_target.fast_unaligned_memaccess;
 }
 
+unsigned ir_target_prefetch_distance(void)
+{
+	assert(ir_target.isa_initialized);
+	return ir_target.prefetch_distance;
+}
+
+unsigned ir_target_data_cache_size(void)
+{
+	assert(ir_target.isa_initialized);
+	return ir_target.data_cache_size;
+}
+
 int ir_target_supports_pic(void)
 {
 	return ir_target.isa->pic_supported;
@@ -21,6 +21,8 @@ typedef struct target_info_t {
 	char const            *experimental;
 	arch_allow_ifconv_func allow_ifconv;
 	ir_mode               *mode_float_arithmetic;
+	unsigned               prefetch_distance; /**< bytes to prefetch ahead */
+	unsigned               data_cache_size;   /**< size of the L1 data cache */
 	bool isa_initialized          : 1;
 	bool fast_unaligned_memaccess : 1;
 	ENUMBF(float_int_conversion_overflow_style_t) float_int_overflow : 2;
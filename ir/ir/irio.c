@@ -344,13 +344,126 @@ void write_symbol(write_env_t *env, const char *symbol)
 	fputc(' ', env->file);
 }
 
+static void write_list_begin(write_env_t *env)
+{
+	fputs("[", env->file);
+}
+
+static void write_list_end(write_env_t *env)
+{
+	fputs("] ", env->file);
+}
+
+static void write_type_structure(write_env_t *env, ir_type *type);
+
+static void write_entity_structure(write_env_t *env, ir_entity *entity)
+{
+	void *const number = pmap_get(void, env->entity_numbers, entity);
+	if (number != NULL) {
+		write_long(env, PTR_TO_INT(number) - 1);
+		return;
+	}
+	ARR_APP1(ir_entity*, env->entities, entity);
+	pmap_insert(env->entity_numbers, entity,
+	            INT_TO_PTR(ARR_LEN(env->entities)));
+
+	ir_visibility const visibility = get_entity_visibility(entity);
+	write_symbol(env, "entity");
+	write_unsigned(env, get_entity_kind(entity));
+	if (visibility == ir_visibility_private || !entity_has_ld_ident(entity)) {
+		write_symbol(env, "anonymous");
+	} else {
+		write_ident(env, get_entity_ld_ident(entity));
+	}
+	write_visibility(env, visibility);
+	write_unsigned(env, get_entity_linkage(entity));
+	write_volatility(env, get_entity_volatility(entity));
+	write_type_structure(env, get_entity_type(entity));
+	switch (get_entity_kind(entity)) {
+	case IR_ENTITY_COMPOUND_MEMBER:
+		write_int(env, get_entity_offset(entity));
+		write_unsigned(env, get_entity_bitfield_offset(entity));
+		write_unsigned(env, get_entity_bitfield_size(entity));
+		break;
+	case IR_ENTITY_PARAMETER:
+		write_int(env, get_entity_offset(entity));
+		write_size_t(env, get_entity_parameter_number(entity));
+		break;
+	case IR_ENTITY_METHOD:
+		write_unsigned(env, get_entity_additional_properties(entity));
+		break;
+	case IR_ENTITY_NORMAL:
+		write_unsigned(env, get_entity_alignment(entity));
+		break;
+	case IR_ENTITY_ALIAS:
+	case IR_ENTITY_LABEL:
+	case IR_ENTITY_SPILLSLOT:
+	case IR_ENTITY_UNKNOWN:
+		break;
+	}
+}
+
+/**
+ * Writes the layout of @p type. Pointers and compound types are not
+ * followed, so recursive types terminate.
+ */
+static void write_type_structure(write_env_t *env, ir_type *type)
+{
+	tp_opcode const opcode = get_type_opcode(type);
+	write_symbol(env, get_type_opcode_name(opcode));
+	switch (opcode) {
+	case tpo_code:
+	case tpo_unknown:
+		return;
+	case tpo_primitive:
+	case tpo_pointer:
+		write_mode_ref(env, get_type_mode(type));
+		break;
+	case tpo_array:
+		write_unsigned(env, get_array_size(type));
+		write_type_structure(env, get_array_element_type(type));
+		break;
+	case tpo_method:
+		write_unsigned(env, get_method_calling_convention(type));
+		write_unsigned(env, get_method_additional_properties(type));
+		write_int(env, is_method_variadic(type));
+		write_list_begin(env);
+		for (size_t i = 0, n = get_method_n_params(type); i < n; ++i)
+			write_type_structure(env, get_method_param_type(type, i));
+		write_list_end(env);
+		write_list_begin(env);
+		for (size_t i = 0, n = get_method_n_ress(type); i < n; ++i)
+			write_type_structure(env, get_method_res_type(type, i));
+		write_list_end(env);
+		break;
+	case tpo_class:
+	case tpo_segment:
+	case tpo_struct:
+	case tpo_union:
+		write_ident(env, get_compound_ident(type));
+		break;
+	case tpo_uninitialized:
+		panic("invalid type %+F", type);
+	}
+	write_unsigned(env, get_type_size(type));
+	write_unsigned(env, get_type_alignment(type));
+}
+
 void write_entity_ref(write_env_t *env, ir_entity *entity)
 {
+	if (env->structural) {
+		write_entity_structure(env, entity);
+		return;
+	}
 	write_long(env, get_entity_nr(entity));
 }
 
 void write_type_ref(write_env_t *env, ir_type *type)
 {
+	if (env->structural) {
+		write_type_structure(env, type);
+		return;
+	}
 	switch (get_type_opcode(type)) {
 	case tpo_unknown:
 		write_symbol(env, "unknown");
@@ -448,16 +561,6 @@ void write_loop(write_env_t *env, bool loop)
 	write_symbol(env, loop ? "loop" : "noloop");
 }
 
-static void write_list_begin(write_env_t *env)
-{
-	fputs("[", env->file);
-}
-
-static void write_list_end(write_env_t *env)
-{
-	fputs("] ", env->file);
-}
-
 static void write_scope_begin(write_env_t *env)
 {
 	fputs("{\n", env->file);
@@ -468,8 +571,22 @@ static void write_scope_end(write_env_t *env)
 	fputs("}\n\n", env->file);
 }
 
+/** Returns the number of @p node in the structural form. */
+static long get_structural_nr(write_env_t *env, const ir_node *node)
+{
+	unsigned const idx = get_irn_idx(node);
+	assert(idx < env->n_node_indices);
+	if (env->node_numbers[idx] == 0)
+		env->node_numbers[idx] = ++env->last_node_number;
+	return env->node_numbers[idx];
+}
+
 void write_node_ref(write_env_t *env, const ir_node *node)
 {
+	if (env->structural) {
+		write_long(env, get_structural_nr(env, node));
+		return;
+	}
 	write_long(env, get_irn_node_nr(node));
 }
 
@@ -802,7 +919,7 @@ void write_pred_refs(write_env_t *env, const ir_node *node, int from)
 
 void write_node_nr(write_env_t *env, const ir_node *node)
 {
-	write_long(env, get_irn_node_nr(node));
+	write_node_ref(env, node);
 }
 
 static void write_ASM(write_env_t *env, const ir_node *node)
@@ -1103,6 +1220,36 @@ void ir_export_file(FILE *file)
 	deq_free(&env->write_queue);
 }
 
+void ir_export_irg_structure(FILE *file, ir_graph *irg, ir_entity ***entities)
+{
+	write_env_t my_env;
+	write_env_t *env = &my_env;
+
+	memset(env, 0, sizeof(*env));
+	env->file           = file;
+	env->structural     = true;
+	env->n_node_indices = get_irg_last_idx(irg);
+	env->node_numbers   = XMALLOCNZ(long, env->n_node_indices);
+	env->entity_numbers = pmap_create();
+	env->entities       = *entities;
+	deq_init(&env->write_queue);
+
+	writers_init();
+
+	/* the frame layout is not visible in the nodes */
+	ir_type *const frame = get_irg_frame_type(irg);
+	write_list_begin(env);
+	for (size_t i = 0, n = get_compound_n_members(frame); i < n; ++i)
+		write_entity_ref(env, get_compound_member(frame, i));
+	write_list_end(env);
+	write_irg(env, irg);
+
+	deq_free(&env->write_queue);
+	pmap_destroy(env->entity_numbers);
+	free(env->node_numbers);
+	*entities = env->entities;
+}
+
 
 
 static void read_c(read_env_t *env)
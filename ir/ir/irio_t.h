@@ -6,6 +6,7 @@
 #include "irnode_t.h"
 #include "obst.h"
 #include "pdeq.h"
+#include "pmap.h"
 #include "set.h"
 #include "type_t.h"
 #include "typerep.h"
@@ -43,8 +44,25 @@ typedef struct write_env_t {
 	FILE *file;
 	deq_t write_queue;
 	deq_t entity_queue;
+	/* structural form, see ir_export_irg_structure() */
+	bool        structural;
+	long       *node_numbers;   /**< maps node index to number, 0 if none */
+	unsigned    n_node_indices;
+	long        last_node_number;
+	pmap       *entity_numbers; /**< maps entity to its index + 1 */
+	ir_entity **entities;
 } write_env_t;
 
+/**
+ * Writes @p irg to @p file in a form which only depends on the structure of
+ * the graph: Nodes are numbered in the order they are written, entities are
+ * described by their linker name, kind and layout and types by their layout.
+ * Private entities are described without their name. Entities are written
+ * completely at their first reference only and the entities are appended to
+ * the flexible array @p entities in that order.
+ */
+void ir_export_irg_structure(FILE *file, ir_graph *irg, ir_entity ***entities);
+
 void write_align(write_env_t *env, ir_align align);
 void write_builtin_kind(write_env_t *env, ir_builtin_kind kind);
 void write_cond_jmp_predicate(write_env_t *env, cond_jmp_predicate pred);
@@ -478,6 +478,11 @@ static void irp_associate_blocks(block_assoc_t *env)
 	}
 }
 
+bool ir_profile_has_data(void)
+{
+	return profile != NULL;
+}
+
 void ir_profile_free(void)
 {
 	if (profile) {
@@ -32,6 +32,11 @@ ir_graph *ir_profile_instrument(const char *filename);
  */
 bool ir_profile_read(const char *filename);
 
+/**
+ * Returns true if profile data has been read and not freed yet.
+ */
+bool ir_profile_has_data(void);
+
 /**
  * Frees the profile info
  */
@@ -7,8 +7,15 @@
  * @file
  * @brief   Lowering of Switches if necessary or advantageous.
  * @author  Moritz Kroll
+ *
+ * The cases of a Switch are grouped into clusters: Dense ranges of cases
+ * become jump tables, small sets of cases with few targets become bit tests
+ * and all other cases are compared one by one. The clusters are selected by
+ * a binary decision tree, which is balanced by the execution frequencies of
+ * the targets if they are known.
  */
 #include "array.h"
+#include "execfreq.h"
 #include "ircons.h"
 #include "irgopt.h"
 #include "irgwalk.h"
@@ -18,8 +25,17 @@
 #include "lowering.h"
 #include "panic.h"
 #include "util.h"
+#include <float.h>
+#include <limits.h>
 #include <stdbool.h>
 
+/** Minimum percentage of the values in a jump table range that are cases. */
+#define MIN_TABLE_DENSITY     40
+/** Maximum number of different targets of a bit test cluster. */
+#define MAX_BIT_TEST_TARGETS  3
+/** Up to this number of single cases are tested in order of their weight. */
+#define MAX_LINEAR_CASES      3
+
 typedef struct walk_env_t {
 	ir_nodeset_t  processed;
 	ir_mode      *selector_mode;
@@ -29,19 +45,38 @@ typedef struct walk_env_t {
 } walk_env_t;
 
 typedef struct target_t {
-	ir_node *block;     /**< block that is targetted */
-	uint16_t n_entries; /**< number of table entries targetting this block */
-	uint16_t i;
+	ir_node  *block;     /**< block that is targetted */
+	unsigned  n_entries; /**< number of table entries targetting this block */
+	unsigned  pn;        /**< Proj number in a new Switch, 0 if none yet */
+	ir_node **preds;     /**< the new control flow predecessors of block */
 } target_t;
 
+typedef enum cluster_kind_t {
+	CLUSTER_RANGE,    /**< a single case (range) */
+	CLUSTER_TABLE,    /**< a jump table */
+	CLUSTER_BIT_TEST, /**< bit tests for a few targets */
+} cluster_kind_t;
+
+typedef struct case_cluster_t {
+	cluster_kind_t kind;
+	ir_tarval     *min;       /**< the smallest case value */
+	ir_tarval     *max;       /**< the largest case value */
+	size_t         first;     /**< the first table entry of the cluster */
+	size_t         n_entries; /**< the number of table entries */
+	double         weight;    /**< the execution weight of the cluster */
+} case_cluster_t;
+
 typedef struct switch_info_t {
 	ir_node     *switchn;
 	ir_tarval   *switch_min;
 	ir_tarval   *switch_max;
+	ir_node     *selector;    /**< the normalized selector */
 	ir_node     *default_block;
 	unsigned     num_cases;
 	target_t    *targets;
-	ir_node    **defusers;    /**< the Projs pointing to the default case */
+	unsigned     n_targets;
+	double      *weights;     /**< the weights of the table entries */
+	ir_node    **defusers;    /**< the control flow to the default case */
 } switch_info_t;
 
 /**
@@ -104,9 +139,13 @@ static void analyse_switch1(switch_info_t *info)
 		target_t *target = &targets[entry->pn];
 		++target->n_entries;
 	}
+	for (unsigned pn = 0; pn < n_outs; ++pn) {
+		targets[pn].preds = NEW_ARR_F(ir_node*, 0);
+	}
 
 	info->default_block = targets[pn_Switch_default].block;
 	info->targets       = targets;
+	info->n_targets     = n_outs;
 }
 
 static int compare_entries(const void *a, const void *b)
@@ -163,65 +202,10 @@ static void normalize_table(ir_node *switchn, ir_mode *new_mode,
 	}
 }
 
-static void create_out_of_bounds_check(switch_info_t *info)
-{
-	/* should already be normalized to zero */
-	assert(tarval_is_null(info->switch_min));
-
-	/* create out-of-bounds check */
-	ir_node  *switchn    = info->switchn;
-	ir_graph *irg        = get_irn_irg(switchn);
-	dbg_info *dbgi       = get_irn_dbg_info(switchn);
-	ir_node  *selector   = get_Switch_selector(switchn);
-	ir_node  *block      = get_nodes_block(switchn);
-	ir_node  *max_const  = new_r_Const(irg, info->switch_max);
-	ir_node  *cmp        = new_rd_Cmp(dbgi, block, selector, max_const,
-	                                  ir_relation_less_equal);
-	ir_node  *oob_cond   = new_rd_Cond(dbgi, block, cmp);
-	ir_node  *proj_true  = new_r_Proj(oob_cond, mode_X, pn_Cond_true);
-	ir_node  *proj_false = new_r_Proj(oob_cond, mode_X, pn_Cond_false);
-
-	ir_node **default_preds = NEW_ARR_F(ir_node*, 0);
-	ARR_APP1(ir_node*, default_preds, proj_false);
-
-	/* create new block containing the switch */
-	ir_node *in[]      = { proj_true };
-	ir_node *new_block = new_r_Block(irg, ARRAY_SIZE(in), in);
-	set_nodes_block(switchn, new_block);
-
-	/* adjust projs */
-	ir_node *default_block = NULL;
-	foreach_irn_out_r(switchn, i, proj) {
-		unsigned pn = get_Proj_num(proj);
-		if (pn == pn_Switch_default) {
-			assert(default_block == NULL);
-			default_block = get_irn_out(proj, 0);
-			ARR_APP1(ir_node*, default_preds, proj);
-		}
-		set_nodes_block(proj, new_block);
-	}
-
-	/* adapt default block */
-	size_t n_default_preds = ARR_LEN(default_preds);
-	if (n_default_preds > 1) {
-		/* create new intermediate blocks so we don't have critical edges */
-		for (size_t p = 0; p < n_default_preds; ++p) {
-			ir_node *pred        = default_preds[p];
-			ir_node *bin[]       = { pred };
-			ir_node *split_block = new_r_Block(irg, ARRAY_SIZE(bin), bin);
-
-			default_preds[p] = new_r_Jmp(split_block);
-		}
-	}
-	set_irn_in(default_block, n_default_preds, default_preds);
-
-	DEL_ARR_F(default_preds);
-}
-
 /**
- * normalize switch to work on an unsigned input with the first case at 0
+ * normalize the selector to an unsigned value with the first case at 0
  */
-static bool normalize_switch(switch_info_t *info, ir_mode *selector_mode)
+static void normalize_selector(switch_info_t *info)
 {
 	ir_node   *switchn  = info->switchn;
 	ir_node   *block    = get_nodes_block(switchn);
@@ -232,7 +216,6 @@ static bool normalize_switch(switch_info_t *info, ir_mode *selector_mode)
 		mode             = find_unsigned_mode(mode);
 		selector         = new_r_Conv(block, selector, mode);
 		min              = tarval_convert_to(min, mode);
-		info->switch_min = min;
 		info->switch_max = tarval_convert_to(info->switch_max, mode);
 	}
 
@@ -245,129 +228,545 @@ static bool normalize_switch(switch_info_t *info, ir_mode *selector_mode)
 		selector = new_rd_Sub(dbgi, block, selector, min_const);
 
 		info->switch_max = tarval_sub(info->switch_max, min);
-		info->switch_min = get_mode_null(mode);
 		delta            = min;
 	}
+	info->switch_min = get_mode_null(mode);
+	info->selector   = selector;
 
-	/* if we have a selector_mode set, then the we will have a switch node,
-	 * we have to construct an out-of-bounds check then and after that convert
-	 * the switch/selector to the backends desired switch mode */
-	if (selector_mode != NULL) {
-		set_Switch_selector(switchn, selector);
-		create_out_of_bounds_check(info);
+	normalize_table(switchn, mode, delta);
+}
 
-		selector = new_r_Conv(block, selector, selector_mode);
-		mode     = selector_mode;
-		info->switch_min = tarval_convert_to(info->switch_min, mode);
-		info->switch_max = tarval_convert_to(info->switch_max, mode);
-		if (delta != NULL)
-			delta = tarval_convert_to(delta, mode);
-		set_Switch_selector(switchn, selector);
+/**
+ * Returns the number of values in [min, max] or 0 if it is too large to be
+ * represented.
+ */
+static uint64_t get_range_size(ir_tarval *min, ir_tarval *max)
+{
+	ir_tarval *diff = tarval_sub(max, min);
+	if (!tarval_is_long(diff))
+		return 0;
+	long size = get_tarval_long(diff);
+	if (size < 0 || size >= LONG_MAX)
+		return 0;
+	return (uint64_t)size + 1;
+}
+
+/**
+ * Checks whether the table entries [first, last] should form a jump table.
+ *
+ * @param n_values  the number of case values of the entries
+ */
+static bool is_table_cluster(walk_env_t const *env,
+                             ir_switch_table const *table, size_t first,
+                             size_t last, uint64_t n_values, bool *too_sparse)
+{
+	ir_switch_table_entry const *entry0
+		= ir_switch_table_get_entry_const(table, first);
+	ir_switch_table_entry const *entry1
+		= ir_switch_table_get_entry_const(table, last);
+	uint64_t range = get_range_size(entry0->min, entry1->max);
+	if (range == 0 || range < n_values || range - n_values >= env->spare_size) {
+		/* the spare grows with every further entry */
+		*too_sparse = true;
+		return false;
 	}
+	return last - first + 1 > env->small_switch
+	    && n_values * 100 >= range * MIN_TABLE_DENSITY;
+}
 
-	normalize_table(switchn, mode, delta);
-	return true;
+static case_cluster_t make_cluster(switch_info_t const *info,
+                                   cluster_kind_t kind, size_t first,
+                                   size_t last)
+{
+	ir_switch_table const *table = get_Switch_table(info->switchn);
+	case_cluster_t cluster = {
+		.kind      = kind,
+		.min       = ir_switch_table_get_entry_const(table, first)->min,
+		.max       = ir_switch_table_get_entry_const(table, last)->max,
+		.first     = first,
+		.n_entries = last - first + 1,
+		.weight    = 0.0,
+	};
+	for (size_t e = first; e <= last; ++e) {
+		cluster.weight += info->weights[e];
+	}
+	return cluster;
 }
 
 /**
- * Create an if (selector == caseval) Cond node (and handle the special case
- * of ranged cases)
+ * Partitions the (sorted) table entries into the minimal number of jump
+ * table and single case clusters.
  */
-static ir_node *create_case_cond(const ir_switch_table_entry *entry,
-                                 dbg_info *dbgi, ir_node *block,
-                                 ir_node *selector)
+static case_cluster_t *find_table_clusters(walk_env_t const *env,
+                                           switch_info_t const *info)
 {
-	ir_graph *irg      = get_irn_irg(block);
-	ir_node  *minconst = new_r_Const(irg, entry->min);
+	ir_switch_table const *table     = get_Switch_table(info->switchn);
+	size_t                 n_entries = ir_switch_table_get_n_entries(table);
 
-	ir_node  *cmp;
-	if (entry->min == entry->max) {
-		cmp = new_rd_Cmp(dbgi, block, selector, minconst, ir_relation_equal);
-	} else {
-		ir_tarval *adjusted_max = tarval_sub(entry->max, entry->min);
-		ir_node   *sub          = new_rd_Sub(dbgi, block, selector, minconst);
-		ir_node   *maxconst     = new_r_Const(irg, adjusted_max);
-		cmp = new_rd_Cmp(dbgi, block, sub, maxconst, ir_relation_less_equal);
+	/* n_values[i]: number of case values in the entries before i */
+	uint64_t *n_values = XMALLOCN(uint64_t, n_entries + 1);
+	n_values[0] = 0;
+	for (size_t e = 0; e < n_entries; ++e) {
+		ir_switch_table_entry const *entry
+			= ir_switch_table_get_entry_const(table, e);
+		uint64_t size = get_range_size(entry->min, entry->max);
+		if (size == 0)
+			size = UINT64_MAX / 4;
+		n_values[e + 1] = n_values[e] + size;
+	}
+
+	/* n_clusters[j]: the minimal number of clusters for the entries before j,
+	 * begin[j]: the first entry of the last of these clusters */
+	size_t *n_clusters = XMALLOCN(size_t, n_entries + 1);
+	size_t *begin      = XMALLOCN(size_t, n_entries + 1);
+	n_clusters[0] = 0;
+	for (size_t j = 1; j <= n_entries; ++j) {
+		n_clusters[j] = n_clusters[j - 1] + 1;
+		begin[j]      = j - 1;
+		for (size_t i = j - 1; i-- > 0;) {
+			bool too_sparse = false;
+			if (is_table_cluster(env, table, i, j - 1, n_values[j] - n_values[i],
+			                     &too_sparse)) {
+				if (n_clusters[i] + 1 < n_clusters[j]) {
+					n_clusters[j] = n_clusters[i] + 1;
+					begin[j]      = i;
+				}
+			} else if (too_sparse) {
+				break;
+			}
+		}
+	}
+
+	case_cluster_t *clusters = NEW_ARR_F(case_cluster_t, n_clusters[n_entries]);
+	for (size_t j = n_entries, c = ARR_LEN(clusters); j > 0; j = begin[j]) {
+		size_t         first = begin[j];
+		cluster_kind_t kind  = first + 1 < j ? CLUSTER_TABLE : CLUSTER_RANGE;
+		clusters[--c] = make_cluster(info, kind, first, j - 1);
 	}
-	return new_rd_Cond(dbgi, block, cmp);
+
+	free(begin);
+	free(n_clusters);
+	free(n_values);
+	return clusters;
+}
+
+/**
+ * Returns the mode used for bit tests.
+ */
+static ir_mode *get_bit_test_mode(void)
+{
+	return find_unsigned_mode(get_reference_offset_mode(mode_P));
 }
 
-static void connect_to_target(target_t *target, ir_node *cf)
+/**
+ * Checks whether enough cases for few enough targets are in the entries
+ * [first, last] so that bit tests are cheaper than comparisons.
+ */
+static bool is_bit_test_cluster(switch_info_t const *info, size_t first,
+                                size_t last)
 {
-	ir_node *block     = target->block;
-	unsigned n_entries = target->n_entries;
-	if (get_Block_n_cfgpreds(block) != (int)n_entries) {
-		ir_node **new_in = ALLOCAN(ir_node*, n_entries);
-		ir_graph *irg    = get_irn_irg(block);
-		ir_node  *dummy  = new_r_Dummy(irg, mode_X);
-		for (unsigned i = 0; i < n_entries; ++i) {
-			new_in[i] = dummy;
+	ir_switch_table const *table = get_Switch_table(info->switchn);
+	ir_switch_table_entry const *entry0
+		= ir_switch_table_get_entry_const(table, first);
+	ir_switch_table_entry const *entry1
+		= ir_switch_table_get_entry_const(table, last);
+	uint64_t range = get_range_size(entry0->min, entry1->max);
+	if (range == 0 || range >= get_mode_size_bits(get_bit_test_mode()))
+		return false;
+
+	unsigned pns[MAX_BIT_TEST_TARGETS];
+	unsigned n_pns = 0;
+	for (size_t e = first; e <= last; ++e) {
+		unsigned pn = ir_switch_table_get_pn(table, e);
+		bool     found = false;
+		for (unsigned i = 0; i < n_pns; ++i) {
+			if (pns[i] == pn)
+				found = true;
+		}
+		if (!found) {
+			if (n_pns == MAX_BIT_TEST_TARGETS)
+				return false;
+			pns[n_pns++] = pn;
 		}
-		set_irn_in(block, n_entries, new_in);
-		assert(target->i == 0);
 	}
-	assert(target->i < n_entries);
-	set_Block_cfgpred(target->block, target->i++, cf);
+
+	size_t n_cases = last - first + 1;
+	return (n_pns == 1 && n_cases >= 3) || (n_pns == 2 && n_cases >= 5)
+	    || (n_pns == 3 && n_cases >= 6);
 }
 
 /**
- * Creates an if cascade realizing binary search.
+ * Merges runs of single case clusters into bit test clusters.
  */
-static void create_if_cascade(switch_info_t *info, ir_node *block,
-                              ir_switch_table_entry *curcases,
-                              unsigned numcases)
+static void find_bit_test_clusters(switch_info_t const *info,
+                                   case_cluster_t **clusters)
 {
-	ir_graph      *irg      = get_irn_irg(block);
-	const ir_node *switchn  = info->switchn;
-	dbg_info      *dbgi     = get_irn_dbg_info(switchn);
-	ir_node       *selector = get_Switch_selector(switchn);
+	case_cluster_t *old   = *clusters;
+	case_cluster_t *res   = NEW_ARR_F(case_cluster_t, 0);
+	size_t          n_old = ARR_LEN(old);
+	for (size_t c = 0; c < n_old;) {
+		/* find the largest bit test cluster starting here */
+		size_t end = c;
+		for (size_t d = c + 1; d < n_old && old[d].kind == CLUSTER_RANGE; ++d) {
+			if (old[c].kind == CLUSTER_RANGE
+			    && is_bit_test_cluster(info, old[c].first, old[d].first))
+				end = d;
+		}
+		if (end > c) {
+			ARR_APP1(case_cluster_t, res, make_cluster(info, CLUSTER_BIT_TEST,
+			         old[c].first, old[end].first));
+			c = end + 1;
+		} else {
+			ARR_APP1(case_cluster_t, res, old[c]);
+			++c;
+		}
+	}
+	DEL_ARR_F(old);
+	*clusters = res;
+}
+
+static void add_target_pred(switch_info_t *info, unsigned pn, ir_node *cf)
+{
+	ARR_APP1(ir_node*, info->targets[pn].preds, cf);
+}
 
-	if (numcases == 0) {
+/**
+ * Creates a comparison testing whether the selector is in [min, max] given
+ * that it is known to be in [lo, hi].
+ *
+ * @return the Cmp or NULL if the test is always true
+ */
+static ir_node *create_range_cmp(switch_info_t const *info, ir_node *block,
+                                 ir_tarval *min, ir_tarval *max,
+                                 ir_tarval *lo, ir_tarval *hi)
+{
+	ir_graph *irg       = get_irn_irg(block);
+	dbg_info *dbgi      = get_irn_dbg_info(info->switchn);
+	ir_node  *selector  = info->selector;
+	bool      min_known = tarval_cmp(lo, min) != ir_relation_less;
+	bool      max_known = tarval_cmp(hi, max) != ir_relation_greater;
+
+	if (min_known && max_known)
+		return NULL;
+	if (min == max)
+		return new_rd_Cmp(dbgi, block, selector, new_r_Const(irg, min),
+		                  ir_relation_equal);
+	if (min_known)
+		return new_rd_Cmp(dbgi, block, selector, new_r_Const(irg, max),
+		                  ir_relation_less_equal);
+	if (max_known)
+		return new_rd_Cmp(dbgi, block, selector, new_r_Const(irg, min),
+		                  ir_relation_greater_equal);
+
+	/* the selector is unsigned, so values below min wrap around */
+	ir_tarval *adjusted_max = tarval_sub(max, min);
+	ir_node   *sub          = new_rd_Sub(dbgi, block, selector,
+	                                     new_r_Const(irg, min));
+	return new_rd_Cmp(dbgi, block, sub, new_r_Const(irg, adjusted_max),
+	                  ir_relation_less_equal);
+}
+
+/**
+ * Creates the test of a single case.
+ *
+ * @return the control flow if the case does not match or NULL if it always
+ *         matches
+ */
+static ir_node *create_case_test(switch_info_t *info, ir_node *block,
+                                 case_cluster_t const *cluster,
+                                 ir_tarval *lo, ir_tarval *hi)
+{
+	ir_switch_table const *table = get_Switch_table(info->switchn);
+	unsigned pn  = ir_switch_table_get_pn(table, cluster->first);
+	ir_node *cmp = create_range_cmp(info, block, cluster->min, cluster->max,
+	                                lo, hi);
+	if (cmp == NULL) {
+		add_target_pred(info, pn, new_r_Jmp(block));
+		return NULL;
+	}
+	dbg_info *dbgi = get_irn_dbg_info(info->switchn);
+	ir_node  *cond = new_rd_Cond(dbgi, block, cmp);
+	add_target_pred(info, pn, new_r_Proj(cond, mode_X, pn_Cond_true));
+	return new_r_Proj(cond, mode_X, pn_Cond_false);
+}
+
+/**
+ * Subtracts the smallest value of a cluster from the selector and checks
+ * that the result is inside the cluster range if this is not known yet.
+ *
+ * @param block  the block to insert the check into, updated to the block
+ *               in which the selector is inside the range
+ */
+static ir_node *create_cluster_index(switch_info_t *info, ir_node **block,
+                                     case_cluster_t const *cluster,
+                                     ir_tarval *lo, ir_tarval *hi)
+{
+	ir_graph *irg   = get_irn_irg(*block);
+	dbg_info *dbgi  = get_irn_dbg_info(info->switchn);
+	ir_node  *index = info->selector;
+	if (!tarval_is_null(cluster->min))
+		index = new_rd_Sub(dbgi, *block, index,
+		                   new_r_Const(irg, cluster->min));
+
+	if (tarval_cmp(lo, cluster->min) == ir_relation_less
+	    || tarval_cmp(hi, cluster->max) == ir_relation_greater) {
+		ir_tarval *max  = tarval_sub(cluster->max, cluster->min);
+		ir_node   *cmp  = new_rd_Cmp(dbgi, *block, index, new_r_Const(irg, max),
+		                             ir_relation_less_equal);
+		ir_node   *cond = new_rd_Cond(dbgi, *block, cmp);
+		ir_node   *in[] = { new_r_Proj(cond, mode_X, pn_Cond_true) };
+		ARR_APP1(ir_node*, info->defusers,
+		         new_r_Proj(cond, mode_X, pn_Cond_false));
+		*block = new_r_Block(irg, ARRAY_SIZE(in), in);
+	}
+	return index;
+}
+
+/**
+ * Creates a jump table for a cluster.
+ */
+static void create_table(walk_env_t *env, switch_info_t *info,
+                         ir_node *block, case_cluster_t const *cluster,
+                         ir_tarval *lo, ir_tarval *hi)
+{
+	ir_mode  *selector_mode = env->selector_mode;
+	ir_graph *irg   = get_irn_irg(block);
+	dbg_info *dbgi  = get_irn_dbg_info(info->switchn);
+	ir_node  *index = create_cluster_index(info, &block, cluster, lo, hi);
+	ir_mode  *mode  = get_irn_mode(index);
+	if (selector_mode != NULL && selector_mode != mode) {
+		index = new_r_Conv(block, index, selector_mode);
+		mode  = selector_mode;
+	}
+
+	ir_switch_table const *old_table = get_Switch_table(info->switchn);
+	ir_switch_table       *table     = ir_new_switch_table(irg,
+	                                                       cluster->n_entries);
+	unsigned               n_outs    = 1;
+	for (size_t i = 0; i < cluster->n_entries; ++i) {
+		ir_switch_table_entry const *entry
+			= ir_switch_table_get_entry_const(old_table, cluster->first + i);
+		target_t *target = &info->targets[entry->pn];
+		if (target->pn == 0)
+			target->pn = n_outs++;
+		ir_tarval *min = tarval_sub(entry->min, cluster->min);
+		ir_tarval *max = tarval_sub(entry->max, cluster->min);
+		ir_switch_table_set(table, i, tarval_convert_to(min, mode),
+		                    tarval_convert_to(max, mode), target->pn);
+	}
+
+	ir_node *switchn = new_rd_Switch(dbgi, block, index, n_outs, table);
+	/* the new Switch has no out edges, do not lower it again */
+	ir_nodeset_insert(&env->processed, switchn);
+	ARR_APP1(ir_node*, info->defusers,
+	         new_r_Proj(switchn, mode_X, pn_Switch_default));
+	for (size_t i = 0; i < cluster->n_entries; ++i) {
+		unsigned  pn     = ir_switch_table_get_pn(old_table, cluster->first + i);
+		target_t *target = &info->targets[pn];
+		if (target->pn == 0)
+			continue;
+		add_target_pred(info, pn, new_r_Proj(switchn, mode_X, target->pn));
+		target->pn = 0;
+	}
+}
+
+/**
+ * Creates bit tests for a cluster: For each target, a bit mask of the case
+ * values is tested against (1 << index).
+ */
+static void create_bit_tests(switch_info_t *info, ir_node *block,
+                             case_cluster_t const *cluster,
+                             ir_tarval *lo, ir_tarval *hi)
+{
+	ir_graph *irg   = get_irn_irg(block);
+	dbg_info *dbgi  = get_irn_dbg_info(info->switchn);
+	ir_node  *index = create_cluster_index(info, &block, cluster, lo, hi);
+	ir_mode  *mode  = get_bit_test_mode();
+	ir_node  *one   = new_r_Const(irg, get_mode_one(mode));
+	ir_node  *bit   = new_rd_Shl(dbgi, block, one, index);
+
+	/* collect the masks of the targets */
+	ir_switch_table const *table = get_Switch_table(info->switchn);
+	unsigned pns[MAX_BIT_TEST_TARGETS];
+	uint64_t masks[MAX_BIT_TEST_TARGETS];
+	double   weights[MAX_BIT_TEST_TARGETS];
+	unsigned n_pns = 0;
+	for (size_t e = cluster->first; e < cluster->first + cluster->n_entries;
+	     ++e) {
+		ir_switch_table_entry const *entry
+			= ir_switch_table_get_entry_const(table, e);
+		unsigned t = 0;
+		while (t < n_pns && pns[t] != entry->pn)
+			++t;
+		if (t == n_pns) {
+			assert(n_pns < MAX_BIT_TEST_TARGETS);
+			pns[t]     = entry->pn;
+			masks[t]   = 0;
+			weights[t] = 0.0;
+			++n_pns;
+		}
+		long from = get_tarval_long(tarval_sub(entry->min, cluster->min));
+		long to   = get_tarval_long(tarval_sub(entry->max, cluster->min));
+		for (long v = from; v <= to; ++v) {
+			masks[t] |= (uint64_t)1 << v;
+		}
+		weights[t] += info->weights[e];
+	}
+
+	/* test the most frequent targets first */
+	for (unsigned i = 0; i < n_pns; ++i) {
+		unsigned best = i;
+		for (unsigned j = i + 1; j < n_pns; ++j) {
+			if (weights[j] > weights[best])
+				best = j;
+		}
+		unsigned pn   = pns[best];
+		uint64_t mask = masks[best];
+		pns[best]     = pns[i];
+		masks[best]   = masks[i];
+		weights[best] = weights[i];
+
+		ir_tarval *mask_tv = new_tarval_from_long((long)mask, mode);
+		ir_node   *and     = new_rd_And(dbgi, block, bit,
+		                                new_r_Const(irg, mask_tv));
+		ir_node   *cmp     = new_rd_Cmp(dbgi, block, and,
+		                                new_r_Const(irg, get_mode_null(mode)),
+		                                ir_relation_less_greater);
+		ir_node   *cond    = new_rd_Cond(dbgi, block, cmp);
+		ir_node   *proj_f  = new_r_Proj(cond, mode_X, pn_Cond_false);
+		add_target_pred(info, pn, new_r_Proj(cond, mode_X, pn_Cond_true));
+		if (i + 1 < n_pns) {
+			ir_node *in[] = { proj_f };
+			block = new_r_Block(irg, ARRAY_SIZE(in), in);
+		} else {
+			ARR_APP1(ir_node*, info->defusers, proj_f);
+		}
+	}
+}
+
+/**
+ * Tests a few single cases in the order of their weights.
+ */
+static void create_case_chain(switch_info_t *info, ir_node *block,
+                              case_cluster_t *clusters, size_t n_clusters,
+                              ir_tarval *lo, ir_tarval *hi)
+{
+	ir_graph *irg = get_irn_irg(block);
+	for (size_t i = 0; i < n_clusters; ++i) {
+		size_t best = i;
+		for (size_t j = i + 1; j < n_clusters; ++j) {
+			if (clusters[j].weight > clusters[best].weight)
+				best = j;
+		}
+		case_cluster_t cluster = clusters[best];
+		clusters[best] = clusters[i];
+		clusters[i]    = cluster;
+
+		ir_node *next = create_case_test(info, block, &cluster, lo, hi);
+		if (next == NULL)
+			return;
+		if (i + 1 < n_clusters) {
+			ir_node *in[] = { next };
+			block = new_r_Block(irg, ARRAY_SIZE(in), in);
+		} else {
+			ARR_APP1(ir_node*, info->defusers, next);
+		}
+	}
+}
+
+/**
+ * Creates a binary decision tree selecting the clusters. The selector is
+ * known to be in [lo, hi] in @p block.
+ */
+static void create_decision_tree(walk_env_t *env, switch_info_t *info,
+                                 ir_node *block, case_cluster_t *clusters,
+                                 size_t n_clusters, ir_tarval *lo,
+                                 ir_tarval *hi)
+{
+	if (n_clusters == 0) {
 		/* zero cases: "goto default;" */
 		ARR_APP1(ir_node*, info->defusers, new_r_Jmp(block));
-	} else if (numcases == 1) {
-		/*only one case: "if (sel == val) goto target else goto default;"*/
-		const ir_switch_table_entry *entry = &curcases[0];
-		ir_node *cond      = create_case_cond(entry, dbgi, block, selector);
-		ir_node *trueproj  = new_r_Proj(cond, mode_X, pn_Cond_true);
-		ir_node *falseproj = new_r_Proj(cond, mode_X, pn_Cond_false);
-
-		connect_to_target(&info->targets[entry->pn], trueproj);
-		ARR_APP1(ir_node*, info->defusers, falseproj);
-	} else if (numcases == 2) {
-		/* only two cases: "if (sel == val[0]) goto target[0];" */
-		const ir_switch_table_entry *entry0 = &curcases[0];
-		const ir_switch_table_entry *entry1 = &curcases[1];
-		ir_node *cond      = create_case_cond(entry0, dbgi, block, selector);
-		ir_node *trueproj  = new_r_Proj(cond, mode_X, pn_Cond_true);
-		ir_node *falseproj = new_r_Proj(cond, mode_X, pn_Cond_false);
-		connect_to_target(&info->targets[entry0->pn], trueproj);
-
-		ir_node *in[]    = { falseproj };
-		ir_node *neblock = new_r_Block(irg, ARRAY_SIZE(in), in);
-
-		/* second part: "else if (sel == val[1]) goto target[1] else goto default;" */
-		ir_node *cond1      = create_case_cond(entry1, dbgi, neblock, selector);
-		ir_node *trueproj1  = new_r_Proj(cond1, mode_X, pn_Cond_true);
-		ir_node *falseproj1 = new_r_Proj(cond1, mode_X, pn_Cond_false);
-		connect_to_target(&info->targets[entry1->pn], trueproj1);
-		ARR_APP1(ir_node*, info->defusers, falseproj1);
-	} else {
-		/* recursive case: split cases in the middle */
-		unsigned midcase = numcases / 2;
-		const ir_switch_table_entry *entry = &curcases[midcase];
-		ir_node *val = new_r_Const(irg, entry->min);
-		ir_node *cmp = new_rd_Cmp(dbgi, block, selector, val, ir_relation_less);
-		ir_node *cond = new_rd_Cond(dbgi, block, cmp);
+		return;
+	}
+
+	bool only_ranges = true;
+	for (size_t c = 0; c < n_clusters; ++c) {
+		if (clusters[c].kind != CLUSTER_RANGE)
+			only_ranges = false;
+	}
+	if (only_ranges && n_clusters <= MAX_LINEAR_CASES) {
+		create_case_chain(info, block, clusters, n_clusters, lo, hi);
+		return;
+	}
+	if (n_clusters == 1) {
+		if (clusters[0].kind == CLUSTER_TABLE) {
+			create_table(env, info, block, &clusters[0], lo, hi);
+		} else {
+			create_bit_tests(info, block, &clusters[0], lo, hi);
+		}
+		return;
+	}
+
+	/* split where the weights of both halves are balanced best */
+	double total = 0.0;
+	for (size_t c = 0; c < n_clusters; ++c) {
+		total += clusters[c].weight;
+	}
+	size_t mid       = 1;
+	double left      = 0.0;
+	double best_diff = DBL_MAX;
+	for (size_t c = 1; c < n_clusters; ++c) {
+		left += clusters[c - 1].weight;
+		double diff = total - 2 * left;
+		if (diff < 0)
+			diff = -diff;
+		if (diff < best_diff) {
+			best_diff = diff;
+			mid       = c;
+		}
+	}
 
-		ir_node *ltin[]  = { new_r_Proj(cond, mode_X, pn_Cond_true) };
-		ir_node *ltblock = new_r_Block(irg, ARRAY_SIZE(ltin), ltin);
+	ir_graph  *irg   = get_irn_irg(block);
+	dbg_info  *dbgi  = get_irn_dbg_info(info->switchn);
+	ir_tarval *pivot = clusters[mid].min;
+	ir_node   *val   = new_r_Const(irg, pivot);
+	ir_node   *cmp   = new_rd_Cmp(dbgi, block, info->selector, val,
+	                              ir_relation_less);
+	ir_node   *cond  = new_rd_Cond(dbgi, block, cmp);
+
+	ir_node *ltin[]  = { new_r_Proj(cond, mode_X, pn_Cond_true) };
+	ir_node *ltblock = new_r_Block(irg, ARRAY_SIZE(ltin), ltin);
+
+	ir_node *gein[]  = { new_r_Proj(cond, mode_X, pn_Cond_false) };
+	ir_node *geblock = new_r_Block(irg, ARRAY_SIZE(gein), gein);
+
+	ir_tarval *lt_hi = tarval_sub(pivot, get_mode_one(get_tarval_mode(pivot)));
+	create_decision_tree(env, info, ltblock, clusters, mid, lo, lt_hi);
+	create_decision_tree(env, info, geblock, clusters + mid, n_clusters - mid,
+	                     pivot, hi);
+}
 
-		ir_node *gein[]  = { new_r_Proj(cond, mode_X, pn_Cond_false) };
-		ir_node *geblock = new_r_Block(irg, ARRAY_SIZE(gein), gein);
+/**
+ * Computes the weights of the table entries from the execution frequencies
+ * of their targets. Without frequencies, all entries are equally likely.
+ */
+static void compute_weights(switch_info_t *info)
+{
+	ir_switch_table const *table     = get_Switch_table(info->switchn);
+	size_t                 n_entries = ir_switch_table_get_n_entries(table);
+	bool                   have_freq = false;
+	for (unsigned pn = 0; pn < info->n_targets; ++pn) {
+		ir_node const *block = info->targets[pn].block;
+		if (block != NULL && get_block_execfreq(block) > 0.0)
+			have_freq = true;
+	}
 
-		create_if_cascade(info, ltblock, curcases, midcase);
-		create_if_cascade(info, geblock, curcases + midcase, numcases - midcase);
+	info->weights = XMALLOCN(double, n_entries);
+	for (size_t e = 0; e < n_entries; ++e) {
+		target_t const *target
+			= &info->targets[ir_switch_table_get_pn(table, e)];
+		info->weights[e] = have_freq
+			? get_block_execfreq(target->block) / target->n_entries : 1.0;
 	}
 }
 
@@ -396,43 +795,45 @@ static void find_switch_nodes(ir_node *block, void *ctx)
 
 	switch_info_t info;
 	analyse_switch0(&info, switchn);
-
-	/*
-	 * Here we have: num_cases and [switch_min, switch_max] interval.
-	 * We do an if-cascade if there are too many spare numbers.
-	 */
-	ir_mode   *selector_mode = get_irn_mode(get_Switch_selector(switchn));
-	ir_tarval *spare = tarval_sub(info.switch_max, info.switch_min);
-	ir_mode   *mode  = find_unsigned_mode(selector_mode);
-	spare = tarval_convert_to(spare, mode);
-	ir_tarval *num_cases_minus_one
-		= new_tarval_from_long(info.num_cases-1, mode);
-	spare = tarval_sub(spare, num_cases_minus_one);
-	ir_tarval *spare_size = new_tarval_from_long(env->spare_size, mode);
-	bool lower_switch = info.num_cases <= env->small_switch
-		|| (tarval_cmp(spare, spare_size) & ir_relation_greater_equal);
-
-	if (!lower_switch) {
-		/* we won't decompose the switch. But we must add an out-of-bounds
-		 * check */
-		env->changed |= normalize_switch(&info, env->selector_mode);
-		return;
-	}
-
-	normalize_table(switchn, selector_mode, NULL);
 	analyse_switch1(&info);
-
-	/* Now create the if cascade */
-	env->changed  = true;
 	info.defusers = NEW_ARR_F(ir_node*, 0);
 	block         = get_nodes_block(switchn);
-	ir_switch_table *table = get_Switch_table(switchn);
-	create_if_cascade(&info, block, table->entries, table->n_entries);
 
-	/* Connect new default case users */
+	if (info.num_cases == 0) {
+		ARR_APP1(ir_node*, info.defusers, new_r_Jmp(block));
+		info.weights = NULL;
+	} else {
+		normalize_selector(&info);
+		compute_weights(&info);
+
+		case_cluster_t *clusters = find_table_clusters(env, &info);
+		find_bit_test_clusters(&info, &clusters);
+
+		ir_mode *mode = get_irn_mode(info.selector);
+		create_decision_tree(env, &info, block, clusters, ARR_LEN(clusters),
+		                     get_mode_null(mode), get_mode_max(mode));
+		DEL_ARR_F(clusters);
+	}
+	env->changed = true;
+
+	/* Connect the targets to the new control flow */
+	ir_graph *irg = get_irn_irg(block);
+	for (unsigned pn = 0; pn < info.n_targets; ++pn) {
+		target_t *target = &info.targets[pn];
+		if (pn == pn_Switch_default || target->block == NULL) {
+			/* handled below */
+		} else if (ARR_LEN(target->preds) == 0) {
+			ir_node *bad = new_r_Bad(irg, mode_X);
+			set_irn_in(target->block, 1, &bad);
+		} else {
+			set_irn_in(target->block, ARR_LEN(target->preds), target->preds);
+		}
+		DEL_ARR_F(target->preds);
+	}
 	set_irn_in(info.default_block, ARR_LEN(info.defusers), info.defusers);
 
 	DEL_ARR_F(info.defusers);
+	free(info.weights);
 	free(info.targets);
 }
 
@@ -0,0 +1,488 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Dead argument and return value elimination.
+ *
+ * Rewrites the method types of functions which cannot be called from
+ * outside of the compilation unit:
+ *  - parameters which are not used (or only passed to the same parameter of
+ *    a recursive call) are removed,
+ *  - results which are ignored by all callers are removed,
+ *  - pointer parameters which are only used to load a scalar are replaced
+ *    by the loaded value. The load is moved into the callers, so the
+ *    function must not write memory and must load the value on all paths.
+ * All call sites are adapted accordingly.
+ */
+#include "array.h"
+#include "cgana.h"
+#include "debug.h"
+#include "entity_t.h"
+#include "ircons.h"
+#include "irdom.h"
+#include "irgmod.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irnode_t.h"
+#include "iroptimize.h"
+#include "irouts_t.h"
+#include "irprog_t.h"
+#include "obst.h"
+#include "type_t.h"
+#include "util.h"
+#include "xmalloc.h"
+#include <stdbool.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+#define DROPPED ((size_t)-1)
+
+/** Information about a function whose signature may be changed. */
+typedef struct arg_info_t {
+	ir_type  *mtp;           /**< the old method type */
+	bool      fixed;         /**< set if the signature must not change */
+	bool      changed;       /**< set if the signature changes */
+	size_t    n_params;
+	size_t    n_ress;
+	bool     *param_used;    /**< parameter is used by the function */
+	bool     *res_used;      /**< result is used by a caller */
+	ir_type **by_value;      /**< type of the value loaded from a parameter
+	                              which can be passed by value or NULL */
+	size_t   *param_map;     /**< new parameter positions */
+	size_t   *res_map;       /**< new result positions */
+} arg_info_t;
+
+static struct obstack obst;
+
+static arg_info_t *get_arg_info(ir_entity const *entity)
+{
+	return (arg_info_t*)get_entity_link(entity);
+}
+
+/**
+ * Returns the info of the function called by @p call or NULL.
+ */
+static arg_info_t *get_callee_info(ir_node const *call)
+{
+	ir_entity *callee = get_Call_callee(call);
+	if (callee == NULL || get_entity_irg(callee) == NULL)
+		return NULL;
+	return get_arg_info(callee);
+}
+
+/**
+ * Walker: checks the call sites and marks the used results.
+ */
+static void analyze_call_sites(ir_node *node, void *env)
+{
+	(void)env;
+	if (is_Call(node)) {
+		arg_info_t *info = get_callee_info(node);
+		if (info != NULL && (get_Call_n_params(node) != info->n_params
+		                     || is_method_variadic(get_Call_type(node))))
+			info->fixed = true;
+	} else if (is_Proj(node)) {
+		ir_node *pred = get_Proj_pred(node);
+		if (!is_Proj(pred) || get_Proj_num(pred) != pn_Call_T_result)
+			return;
+		ir_node *call = get_Proj_pred(pred);
+		if (!is_Call(call))
+			return;
+		arg_info_t *info = get_callee_info(call);
+		unsigned    pn   = get_Proj_num(node);
+		if (info == NULL || pn >= info->n_ress)
+			return;
+		info->res_used[pn] = true;
+	}
+}
+
+/**
+ * Walker: checks whether a graph may write memory.
+ */
+static void check_writes(ir_node *node, void *env)
+{
+	bool *writes = (bool*)env;
+	switch (get_irn_opcode(node)) {
+	case iro_Call: {
+		ir_entity *callee = get_Call_callee(node);
+		mtp_additional_properties props
+			= get_method_additional_properties(get_Call_type(node));
+		if (callee != NULL)
+			props |= get_entity_additional_properties(callee);
+		if (!(props & (mtp_property_no_write | mtp_property_pure)))
+			*writes = true;
+		break;
+	}
+	case iro_ASM:
+	case iro_Builtin:
+	case iro_CopyB:
+	case iro_Free:
+	case iro_Store:
+		*writes = true;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Checks whether a pointer parameter can be passed by value and returns the
+ * type of the loaded value.
+ */
+static ir_type *get_by_value_type(ir_node *arg)
+{
+	ir_graph *irg         = get_irn_irg(arg);
+	ir_node  *start_block = get_irg_start_block(irg);
+	ir_type  *type        = NULL;
+	bool      postdom     = false;
+	foreach_irn_out_r(arg, i, succ) {
+		if (!is_Load(succ) || get_Load_ptr(succ) != arg
+		    || get_Load_volatility(succ) == volatility_is_volatile
+		    || ir_throws_exception(succ))
+			return NULL;
+		ir_type *load_type = get_Load_type(succ);
+		if (type == NULL) {
+			type = load_type;
+		} else if (load_type != type) {
+			return NULL;
+		}
+		if (get_Load_mode(succ) != get_type_mode(type))
+			return NULL;
+		if (block_postdominates(get_nodes_block(succ), start_block))
+			postdom = true;
+	}
+	/* moving the load into the caller must not introduce a fault */
+	return postdom ? type : NULL;
+}
+
+/**
+ * Analyzes how a function uses its parameters.
+ */
+static void analyze_params(ir_graph *irg, arg_info_t *info)
+{
+	ir_entity *entity = get_irg_entity(irg);
+	/* parameters living in the frame are addressed by their number */
+	ir_type *frame = get_irg_frame_type(irg);
+	for (size_t i = 0, n = get_compound_n_members(frame); i < n; ++i) {
+		if (is_parameter_entity(get_compound_member(frame, i))) {
+			info->fixed = true;
+			return;
+		}
+	}
+
+	assure_irg_properties(irg, IR_GRAPH_PROPERTY_CONSISTENT_OUTS
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_POSTDOMINANCE);
+	bool writes = false;
+	irg_walk_graph(irg, NULL, check_writes, &writes);
+
+	ir_node *args = get_irg_args(irg);
+	foreach_irn_out_r(args, i, arg) {
+		unsigned pn = get_Proj_num(arg);
+		if (pn >= info->n_params)
+			continue;
+		foreach_irn_out_r(arg, j, succ) {
+			/* passing the parameter to itself is no use */
+			if (is_Call(succ) && get_Call_callee(succ) == entity
+			    && get_Call_ptr(succ) != arg) {
+				bool other_pos = false;
+				for (size_t p = 0, n = get_Call_n_params(succ); p < n; ++p) {
+					if (get_Call_param(succ, p) == arg && p != pn)
+						other_pos = true;
+				}
+				if (!other_pos)
+					continue;
+			}
+			info->param_used[pn] = true;
+		}
+		if (!writes && info->param_used[pn]
+		    && mode_is_reference(get_irn_mode(arg))
+		    && !is_aggregate_type(get_method_param_type(info->mtp, pn)))
+			info->by_value[pn] = get_by_value_type(arg);
+	}
+}
+
+/**
+ * Creates the info for a function.
+ */
+static arg_info_t *create_arg_info(ir_entity *entity)
+{
+	ir_type    *mtp  = get_entity_type(entity);
+	arg_info_t *info = OALLOCZ(&obst, arg_info_t);
+	info->mtp        = mtp;
+	info->n_params   = get_method_n_params(mtp);
+	info->n_ress     = get_method_n_ress(mtp);
+	info->param_used = OALLOCNZ(&obst, bool, info->n_params);
+	info->res_used   = OALLOCNZ(&obst, bool, info->n_ress);
+	info->by_value   = OALLOCNZ(&obst, ir_type*, info->n_params);
+	info->param_map  = OALLOCN(&obst, size_t, info->n_params);
+	info->res_map    = OALLOCN(&obst, size_t, info->n_ress);
+	info->fixed      = is_method_variadic(mtp)
+		|| (get_entity_additional_properties(entity) & mtp_property_naked);
+	set_entity_link(entity, info);
+	return info;
+}
+
+/**
+ * Computes the new signature of a function.
+ */
+static void create_new_type(ir_entity *entity, arg_info_t *info)
+{
+	ir_type *mtp      = info->mtp;
+	size_t   n_params = 0;
+	for (size_t i = 0; i < info->n_params; ++i) {
+		ir_type *type = get_method_param_type(mtp, i);
+		if (info->param_used[i] || is_aggregate_type(type)) {
+			info->param_map[i] = n_params++;
+		} else {
+			info->param_map[i] = DROPPED;
+			info->changed      = true;
+		}
+		if (info->by_value[i] != NULL)
+			info->changed = true;
+	}
+	size_t n_ress = 0;
+	for (size_t i = 0; i < info->n_ress; ++i) {
+		ir_type *type = get_method_res_type(mtp, i);
+		if (info->res_used[i] || is_aggregate_type(type)) {
+			info->res_map[i] = n_ress++;
+		} else {
+			info->res_map[i] = DROPPED;
+			info->changed    = true;
+		}
+	}
+	if (!info->changed)
+		return;
+
+	ir_type *new_mtp = new_type_method(n_params, n_ress, false,
+	                                   get_method_calling_convention(mtp),
+	                                   get_method_additional_properties(mtp));
+	for (size_t i = 0; i < info->n_params; ++i) {
+		size_t new_pos = info->param_map[i];
+		if (new_pos == DROPPED)
+			continue;
+		ir_type *type = info->by_value[i] != NULL
+		              ? info->by_value[i] : get_method_param_type(mtp, i);
+		set_method_param_type(new_mtp, new_pos, type);
+	}
+	for (size_t i = 0; i < info->n_ress; ++i) {
+		size_t new_pos = info->res_map[i];
+		if (new_pos != DROPPED)
+			set_method_res_type(new_mtp, new_pos, get_method_res_type(mtp, i));
+	}
+	DB((dbg, LEVEL_1, "%+F: %zu -> %zu params, %zu -> %zu results\n", entity,
+	    info->n_params, n_params, info->n_ress, n_ress));
+
+	set_entity_type(entity, new_mtp);
+	/* cached parameter analysis results are no longer valid */
+	if (entity->attr.mtd_attr.param_access != NULL) {
+		DEL_ARR_F(entity->attr.mtd_attr.param_access);
+		entity->attr.mtd_attr.param_access = NULL;
+	}
+	if (entity->attr.mtd_attr.param_weight != NULL) {
+		DEL_ARR_F(entity->attr.mtd_attr.param_weight);
+		entity->attr.mtd_attr.param_weight = NULL;
+	}
+}
+
+typedef struct rewrite_env_t {
+	ir_node **calls;     /**< calls of changed functions */
+	ir_node **res_projs; /**< result Projs of these calls */
+	ir_node **arg_projs; /**< parameter Projs of a changed function */
+} rewrite_env_t;
+
+/**
+ * Walker: collects the nodes to rewrite.
+ */
+static void collect_rewrites(ir_node *node, void *data)
+{
+	rewrite_env_t *env = (rewrite_env_t*)data;
+	if (is_Call(node)) {
+		arg_info_t *info = get_callee_info(node);
+		if (info != NULL && info->changed)
+			ARR_APP1(ir_node*, env->calls, node);
+	} else if (is_Proj(node)) {
+		ir_node *pred = get_Proj_pred(node);
+		if (pred == get_irg_args(get_irn_irg(node))) {
+			ARR_APP1(ir_node*, env->arg_projs, node);
+		} else if (is_Proj(pred) && get_Proj_num(pred) == pn_Call_T_result
+		           && is_Call(get_Proj_pred(pred))) {
+			arg_info_t *info = get_callee_info(get_Proj_pred(pred));
+			if (info != NULL && info->changed)
+				ARR_APP1(ir_node*, env->res_projs, node);
+		}
+	}
+}
+
+/**
+ * Rewrites a call of a changed function.
+ */
+static void rewrite_call(ir_node *call)
+{
+	arg_info_t *info  = get_callee_info(call);
+	ir_node    *block = get_nodes_block(call);
+	dbg_info   *dbgi  = get_irn_dbg_info(call);
+	ir_node    *mem   = get_Call_mem(call);
+	ir_node   **in    = ALLOCAN(ir_node*, info->n_params);
+	int         n_in  = 0;
+	for (size_t i = 0; i < info->n_params; ++i) {
+		if (info->param_map[i] == DROPPED)
+			continue;
+		ir_node *param = get_Call_param(call, i);
+		ir_type *type  = info->by_value[i];
+		if (type != NULL) {
+			ir_node *load = new_rd_Load(dbgi, block, mem, param,
+			                            get_type_mode(type), type, cons_none);
+			mem   = new_r_Proj(load, mode_M, pn_Load_M);
+			param = new_r_Proj(load, get_type_mode(type), pn_Load_res);
+		}
+		in[n_in++] = param;
+	}
+	ir_entity *callee   = get_Call_callee(call);
+	ir_node   *new_call = new_rd_Call(dbgi, block, mem, get_Call_ptr(call),
+	                                  n_in, in, get_entity_type(callee));
+	ir_set_throws_exception(new_call, ir_throws_exception(call));
+	exchange(call, new_call);
+}
+
+/**
+ * Rewrites the parameters and Returns of a changed function.
+ */
+static void rewrite_function(ir_graph *irg, arg_info_t *info,
+                             ir_node **arg_projs)
+{
+	/* remove dropped parameters and renumber the others first, so the new
+	 * value Projs do not collide with old ones */
+	for (size_t i = 0, n = ARR_LEN(arg_projs); i < n; ++i) {
+		ir_node *proj    = arg_projs[i];
+		unsigned pn      = get_Proj_num(proj);
+		size_t   new_pos = info->param_map[pn];
+		if (new_pos == DROPPED) {
+			exchange(proj, new_r_Bad(irg, get_irn_mode(proj)));
+		} else if (info->by_value[pn] == NULL) {
+			set_Proj_num(proj, new_pos);
+		}
+	}
+	ir_node *args = get_irg_args(irg);
+	for (size_t i = 0, n = ARR_LEN(arg_projs); i < n; ++i) {
+		ir_node *proj = arg_projs[i];
+		if (!is_Proj(proj) || get_Proj_pred(proj) != args)
+			continue;
+		unsigned pn   = get_Proj_num(proj);
+		ir_type *type = info->by_value[pn];
+		if (type == NULL || info->param_map[pn] == DROPPED)
+			continue;
+		ir_node *value = new_r_Proj(args, get_type_mode(type),
+		                            info->param_map[pn]);
+		foreach_irn_out_r(proj, j, load) {
+			ir_node *tuple_in[pn_Load_max + 1];
+			for (size_t k = 0; k < ARRAY_SIZE(tuple_in); ++k)
+				tuple_in[k] = new_r_Bad(irg, mode_ANY);
+			tuple_in[pn_Load_M]   = get_Load_mem(load);
+			tuple_in[pn_Load_res] = value;
+			turn_into_tuple(load, ARRAY_SIZE(tuple_in), tuple_in);
+		}
+	}
+
+	ir_node *end_block = get_irg_end_block(irg);
+	foreach_irn_in(end_block, i, ret) {
+		if (!is_Return(ret))
+			continue;
+		ir_node **in   = ALLOCAN(ir_node*, info->n_ress);
+		int       n_in = 0;
+		for (size_t r = 0; r < info->n_ress; ++r) {
+			if (info->res_map[r] != DROPPED)
+				in[n_in++] = get_Return_res(ret, r);
+		}
+		ir_node *new_ret = new_rd_Return(get_irn_dbg_info(ret),
+		                                 get_nodes_block(ret),
+		                                 get_Return_mem(ret), n_in, in);
+		exchange(ret, new_ret);
+	}
+}
+
+/**
+ * Rewrites the calls of changed functions in a graph and the graph itself
+ * if its signature changed.
+ */
+static void rewrite_irg(ir_graph *irg)
+{
+	arg_info_t   *info = get_arg_info(get_irg_entity(irg));
+	bool          own  = info != NULL && info->changed;
+	rewrite_env_t env  = {
+		.calls     = NEW_ARR_F(ir_node*, 0),
+		.res_projs = NEW_ARR_F(ir_node*, 0),
+		.arg_projs = NEW_ARR_F(ir_node*, 0),
+	};
+	if (own)
+		assure_irg_outs(irg);
+	irg_walk_graph(irg, NULL, collect_rewrites, &env);
+
+	bool changed = own;
+	for (size_t i = 0, n = ARR_LEN(env.res_projs); i < n; ++i) {
+		ir_node    *proj = env.res_projs[i];
+		ir_node    *call = get_Proj_pred(get_Proj_pred(proj));
+		arg_info_t *callee_info = get_callee_info(call);
+		set_Proj_num(proj, callee_info->res_map[get_Proj_num(proj)]);
+	}
+	for (size_t i = 0, n = ARR_LEN(env.calls); i < n; ++i) {
+		rewrite_call(env.calls[i]);
+		changed = true;
+	}
+	if (own)
+		rewrite_function(irg, info, env.arg_projs);
+
+	DEL_ARR_F(env.arg_projs);
+	DEL_ARR_F(env.res_projs);
+	DEL_ARR_F(env.calls);
+
+	if (changed) {
+		set_irg_callee_info_state(irg, irg_callee_info_inconsistent);
+		confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_NONE);
+	}
+}
+
+void dead_argument_elimination(void)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.deadargs");
+
+	/* cgana uses the entity links, so run it before creating the infos */
+	ir_entity **free_methods;
+	size_t      n_free = cgana(&free_methods);
+
+	obstack_init(&obst);
+	foreach_irp_irg(i, irg) {
+		create_arg_info(get_irg_entity(irg));
+	}
+	/* the signature of free methods is fixed */
+	for (size_t i = 0; i < n_free; ++i) {
+		ir_entity *entity = free_methods[i];
+		if (get_entity_irg(entity) != NULL)
+			get_arg_info(entity)->fixed = true;
+	}
+	free(free_methods);
+
+	foreach_irp_irg(i, irg) {
+		irg_walk_graph(irg, NULL, analyze_call_sites, NULL);
+	}
+	foreach_irp_irg(i, irg) {
+		ir_entity  *entity = get_irg_entity(irg);
+		arg_info_t *info   = get_arg_info(entity);
+		if (info->fixed)
+			continue;
+		analyze_params(irg, info);
+		if (!info->fixed)
+			create_new_type(entity, info);
+	}
+	foreach_irp_irg(i, irg) {
+		rewrite_irg(irg);
+	}
+	set_irp_callee_info_state(irg_callee_info_inconsistent);
+
+	foreach_irp_irg(i, irg) {
+		set_entity_link(get_irg_entity(irg), NULL);
+	}
+	obstack_free(&obst, NULL);
+}
@@ -0,0 +1,218 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Speculative devirtualization of indirect calls.
+ *
+ * Uses the callee sets computed by cgana(). Calls with exactly one possible
+ * callee are turned into direct calls. If a callee set contains a dominant
+ * target besides other (possibly unknown) callees, the call is guarded by a
+ * comparison of the call address with the target, which is then called
+ * directly:
+ *
+ *   if (ptr == &target) res = target(args); else res = ptr(args);
+ *
+ * The direct call becomes a candidate for inlining.
+ */
+#include "array.h"
+#include "cgana.h"
+#include "debug.h"
+#include "entity_t.h"
+#include "ircons.h"
+#include "iredges_t.h"
+#include "irgmod.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irnode_t.h"
+#include "iroptimize.h"
+#include "irprog_t.h"
+#include "util.h"
+#include "xmalloc.h"
+#include <stdbool.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/**
+ * Determines the dominant callee of an indirect call.
+ *
+ * @param call         the Call node
+ * @param speculative  set if other callees are possible
+ * @return the dominant callee or NULL if there is none
+ */
+static ir_entity *get_dominant_callee(ir_node const *call, bool *speculative)
+{
+	if (!cg_call_has_callees(call))
+		return NULL;
+
+	ir_entity *known       = NULL;
+	size_t     n_known     = 0;
+	bool       has_unknown = false;
+	for (size_t i = 0, n = cg_get_call_n_callees(call); i < n; ++i) {
+		ir_entity *callee = cg_get_call_callee(call, i);
+		if (is_unknown_entity(callee)) {
+			has_unknown = true;
+		} else {
+			known = callee;
+			++n_known;
+		}
+	}
+	if (n_known == 1) {
+		*speculative = has_unknown;
+		return known;
+	}
+	if (n_known == 0)
+		return NULL;
+
+	/* Several implementations are possible: The class hierarchy tells us the
+	 * implementation of the static type, guess that it is the dominant one. */
+	ir_node *ptr = get_Call_ptr(call);
+	if (!is_Member(ptr))
+		return NULL;
+	ir_entity *method = get_Member_entity(ptr);
+	if (!is_method_entity(method) || get_entity_irg(method) == NULL)
+		return NULL;
+	*speculative = true;
+	return method;
+}
+
+/**
+ * Walker: collects indirect calls.
+ */
+static void collect_indirect_calls(ir_node *node, void *env)
+{
+	ir_node ***calls = (ir_node***)env;
+	if (is_Call(node) && !is_Address(get_Call_ptr(node)))
+		ARR_APP1(ir_node*, *calls, node);
+}
+
+/**
+ * Replaces the users of @p proj by a Phi of @p proj and @p direct_proj in
+ * @p block.
+ */
+static void merge_proj(ir_node *block, ir_node *direct_proj, ir_node *proj)
+{
+	ir_node *in[] = { direct_proj, proj };
+	ir_node *phi  = new_r_Phi(block, ARRAY_SIZE(in), in, get_irn_mode(proj));
+	edges_reroute_except(proj, phi, phi);
+}
+
+/**
+ * Guards an indirect call by a comparison with @p target and calls the
+ * target directly if the comparison succeeds.
+ */
+static void guard_call(ir_node *call, ir_entity *target)
+{
+	ir_graph *irg      = get_irn_irg(call);
+	dbg_info *dbgi     = get_irn_dbg_info(call);
+	ir_node  *ptr      = get_Call_ptr(call);
+	ir_node  *lower_bl = part_block_edges(call);
+	ir_node  *upper_bl = get_nodes_block(call);
+
+	ir_node *addr    = new_r_Address(irg, target);
+	ir_node *cmp     = new_rd_Cmp(dbgi, upper_bl, ptr, addr, ir_relation_equal);
+	ir_node *cond    = new_rd_Cond(dbgi, upper_bl, cmp);
+	ir_node *proj_t  = new_r_Proj(cond, mode_X, pn_Cond_true);
+	ir_node *proj_f  = new_r_Proj(cond, mode_X, pn_Cond_false);
+	ir_node *block_t = new_r_Block(irg, 1, &proj_t);
+	ir_node *block_f = new_r_Block(irg, 1, &proj_f);
+
+	/* the direct call */
+	size_t    n_params = get_Call_n_params(call);
+	ir_node **in       = ALLOCAN(ir_node*, n_params);
+	for (size_t i = 0; i < n_params; ++i)
+		in[i] = get_Call_param(call, i);
+	ir_node *direct = new_rd_Call(dbgi, block_t, get_Call_mem(call), addr,
+	                              n_params, in, get_Call_type(call));
+	cg_set_call_callee_arr(direct, 1, &target);
+
+	/* the original call becomes the fallback */
+	set_nodes_block(call, block_f);
+
+	ir_node *jmps[] = { new_r_Jmp(block_t), new_r_Jmp(block_f) };
+	set_irn_in(lower_bl, ARRAY_SIZE(jmps), jmps);
+
+	/* merge the results */
+	foreach_out_edge_safe(call, edge) {
+		ir_node *proj = get_edge_src_irn(edge);
+		if (!is_Proj(proj))
+			continue;
+		set_nodes_block(proj, block_f);
+		unsigned pn = get_Proj_num(proj);
+		if (pn == pn_Call_M) {
+			ir_node *direct_mem = new_r_Proj(direct, mode_M, pn_Call_M);
+			merge_proj(lower_bl, direct_mem, proj);
+		} else if (pn == pn_Call_T_result) {
+			ir_node *direct_res = new_r_Proj(direct, mode_T, pn_Call_T_result);
+			foreach_out_edge_safe(proj, res_edge) {
+				ir_node *res = get_edge_src_irn(res_edge);
+				if (!is_Proj(res))
+					continue;
+				set_nodes_block(res, block_f);
+				ir_node *direct_val = new_r_Proj(direct_res, get_irn_mode(res),
+				                                 get_Proj_num(res));
+				merge_proj(lower_bl, direct_val, res);
+			}
+		}
+	}
+}
+
+/**
+ * Devirtualizes the indirect calls of a graph.
+ */
+static void devirtualize_irg(ir_graph *irg)
+{
+	ir_node **calls = NEW_ARR_F(ir_node*, 0);
+	irg_walk_graph(irg, NULL, collect_indirect_calls, &calls);
+
+	bool changed   = false;
+	bool has_edges = false;
+	for (size_t i = 0, n = ARR_LEN(calls); i < n; ++i) {
+		ir_node   *call        = calls[i];
+		bool       speculative = false;
+		ir_entity *target      = get_dominant_callee(call, &speculative);
+		if (target == NULL)
+			continue;
+
+		if (!speculative) {
+			DB((dbg, LEVEL_1, "%+F: only callee is %+F\n", call, target));
+			set_Call_ptr(call, new_r_Address(irg, target));
+		} else {
+			/* we cannot split calls with exception control flow */
+			if (ir_throws_exception(call))
+				continue;
+			/* edges stay consistent once activated */
+			if (!has_edges) {
+				assure_edges(irg);
+				has_edges = true;
+			}
+			DB((dbg, LEVEL_1, "%+F: speculating on %+F\n", call, target));
+			guard_call(call, target);
+		}
+		changed = true;
+	}
+	DEL_ARR_F(calls);
+
+	if (changed) {
+		set_irg_callee_info_state(irg, irg_callee_info_inconsistent);
+		confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_NONE);
+	} else {
+		confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_ALL);
+	}
+}
+
+void opt_devirtualize_calls(void)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.devirtualize");
+
+	ir_entity **free_methods;
+	cgana(&free_methods);
+	free(free_methods);
+
+	foreach_irp_irg(i, irg) {
+		devirtualize_irg(irg);
+	}
+	set_irp_callee_info_state(irg_callee_info_inconsistent);
+}
@@ -0,0 +1,307 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Escape analysis and heap to stack promotion.
+ *
+ * Finds allocations with a constant size (calls of malloc-like functions and
+ * Alloc nodes) outside of loops whose address does not escape the function
+ * and replaces them by frame entities. Deallocations of such objects are
+ * removed. If all accesses select members of one compound type of the
+ * allocated size, the frame entity gets that type, so scalar replacement
+ * can handle it afterwards.
+ */
+#include "array.h"
+#include "debug.h"
+#include "ircons.h"
+#include "irgmod.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irloop.h"
+#include "irnode_t.h"
+#include "iroptimize.h"
+#include "irouts_t.h"
+#include "target.h"
+#include "tv.h"
+#include "typerep.h"
+#include "util.h"
+#include <stdbool.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** An allocation which may be promoted to the stack. */
+typedef struct allocation_t {
+	ir_node  *node;  /**< the Call or Alloc node */
+	ir_node  *ptr;   /**< the pointer to the allocated object */
+	unsigned  size;  /**< the size of the object */
+	ir_node **frees; /**< deallocations of the object */
+	ir_type  *type;  /**< compound type selected by all accesses or NULL */
+} allocation_t;
+
+typedef struct escape_env_t {
+	unsigned                 max_size;
+	check_alloc_entity_func  is_free;
+	allocation_t            *allocs;
+} escape_env_t;
+
+/**
+ * Checks whether a call may allocate memory like malloc.
+ */
+static bool is_malloc_call(ir_node const *call)
+{
+	ir_entity *callee = get_Call_callee(call);
+	return callee != NULL
+	    && (get_entity_additional_properties(callee) & mtp_property_malloc);
+}
+
+/**
+ * Returns the constant size of an allocation or 0.
+ */
+static unsigned get_const_size(ir_node const *size, unsigned max_size)
+{
+	if (!is_Const(size))
+		return 0;
+	ir_tarval *tv = get_Const_tarval(size);
+	if (!tarval_is_long(tv))
+		return 0;
+	long value = get_tarval_long(tv);
+	if (value <= 0 || (unsigned long)value > max_size)
+		return 0;
+	return (unsigned)value;
+}
+
+/**
+ * Returns the pointer result of a call or NULL.
+ */
+static ir_node *get_call_result(ir_node *call)
+{
+	foreach_irn_out_r(call, i, proj) {
+		if (!is_Proj(proj) || get_Proj_num(proj) != pn_Call_T_result)
+			continue;
+		foreach_irn_out_r(proj, j, res) {
+			if (get_Proj_num(res) == 0)
+				return res;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Checks whether a (derived) pointer to an allocated object escapes.
+ * Collects the deallocations of the object in @p alloc.
+ */
+static bool escapes(ir_node *ptr, allocation_t *alloc, escape_env_t *env)
+{
+	bool is_base = ptr == alloc->ptr;
+	foreach_irn_out_r(ptr, i, succ) {
+		switch (get_irn_opcode(succ)) {
+		case iro_Load:
+			if (get_Load_ptr(succ) != ptr)
+				return true;
+			break;
+		case iro_Store:
+			if (get_Store_value(succ) == ptr)
+				return true;
+			break;
+		case iro_CopyB:
+		case iro_Cmp:
+			break;
+		case iro_Member: {
+			ir_type *owner = get_entity_owner(get_Member_entity(succ));
+			if (!is_base) {
+				/* nested member */
+			} else if (alloc->type == NULL) {
+				alloc->type = owner;
+			} else if (alloc->type != owner) {
+				alloc->type = get_unknown_type();
+			}
+			if (escapes(succ, alloc, env))
+				return true;
+			break;
+		}
+		case iro_Sel:
+		case iro_Add:
+		case iro_Sub:
+		case iro_Confirm:
+			if (!mode_is_reference(get_irn_mode(succ)))
+				return true;
+			if (is_base)
+				alloc->type = get_unknown_type();
+			if (escapes(succ, alloc, env))
+				return true;
+			break;
+		case iro_Free:
+			if (!is_base || !is_Alloc(alloc->node))
+				return true;
+			ARR_APP1(ir_node*, alloc->frees, succ);
+			break;
+		case iro_Call: {
+			ir_entity *callee = get_Call_callee(succ);
+			if (!is_base || !is_Call(alloc->node) || env->is_free == NULL
+			    || callee == NULL || !env->is_free(callee)
+			    || get_Call_n_params(succ) != 1 || get_Call_ptr(succ) == ptr
+			    || ir_throws_exception(succ))
+				return true;
+			ARR_APP1(ir_node*, alloc->frees, succ);
+			break;
+		}
+		default:
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Walker: collects allocations with a constant size outside of loops.
+ */
+static void collect_allocations(ir_node *node, void *data)
+{
+	escape_env_t *env = (escape_env_t*)data;
+	ir_node      *size;
+	ir_node      *ptr;
+	if (is_Alloc(node)) {
+		/* the frame is not aligned beyond the biggest alignment */
+		if (get_Alloc_alignment(node) > ir_target_biggest_alignment())
+			return;
+		size = get_Alloc_size(node);
+		ptr  = NULL;
+		foreach_irn_out_r(node, i, proj) {
+			if (get_Proj_num(proj) == pn_Alloc_res)
+				ptr = proj;
+		}
+	} else if (is_Call(node) && is_malloc_call(node)
+	           && get_Call_n_params(node) == 1 && !ir_throws_exception(node)) {
+		size = get_Call_param(node, 0);
+		ptr  = get_call_result(node);
+	} else {
+		return;
+	}
+	if (ptr == NULL)
+		return;
+	unsigned const_size = get_const_size(size, env->max_size);
+	if (const_size == 0)
+		return;
+	/* every execution needs a separate object */
+	if (get_loop_depth(get_irn_loop(get_nodes_block(node))) > 0)
+		return;
+
+	allocation_t alloc = {
+		.node  = node,
+		.ptr   = ptr,
+		.size  = const_size,
+		.frees = NEW_ARR_F(ir_node*, 0),
+		.type  = NULL,
+	};
+	if (escapes(ptr, &alloc, env)) {
+		DEL_ARR_F(alloc.frees);
+		return;
+	}
+	ARR_APP1(allocation_t, env->allocs, alloc);
+}
+
+/**
+ * Returns the type of the frame entity for an allocation.
+ */
+static ir_type *get_frame_type(allocation_t const *alloc)
+{
+	ir_type *type = alloc->type;
+	if (type != NULL && is_compound_type(type)
+	    && get_type_size(type) == alloc->size)
+		return type;
+
+	ir_type *byte  = get_type_for_mode(mode_Bu);
+	ir_type *array = new_type_array(byte, alloc->size);
+	set_type_alignment(array, ir_target_biggest_alignment());
+	return array;
+}
+
+/**
+ * Returns the alignment of the frame entity for an allocation, which is at
+ * least the alignment the Alloc asked for.
+ */
+static unsigned get_frame_alignment(allocation_t const *alloc, ir_type *type)
+{
+	unsigned alignment = get_type_alignment(type);
+	if (is_Alloc(alloc->node))
+		alignment = MAX(alignment, get_Alloc_alignment(alloc->node));
+	return alignment;
+}
+
+/**
+ * Replaces an allocation by a frame entity.
+ */
+static void promote_allocation(ir_graph *irg, allocation_t const *alloc)
+{
+	ir_node   *node   = alloc->node;
+	ir_type   *type   = get_frame_type(alloc);
+	ir_entity *entity = new_entity(get_irg_frame_type(irg),
+	                               id_unique("heap2stack"), type);
+	set_entity_alignment(entity, get_frame_alignment(alloc, type));
+	ir_node   *start  = get_irg_start_block(irg);
+	ir_node   *addr   = new_r_Member(start, get_irg_frame(irg), entity);
+	ir_node   *bad    = new_r_Bad(irg, mode_X);
+	DB((dbg, LEVEL_1, "%+F: promoted to %+F\n", node, entity));
+
+	if (is_Alloc(node)) {
+		ir_node *in[] = {
+			[pn_Alloc_M]   = get_Alloc_mem(node),
+			[pn_Alloc_res] = addr,
+		};
+		turn_into_tuple(node, ARRAY_SIZE(in), in);
+	} else {
+		ir_node *block   = get_nodes_block(node);
+		ir_node *results = new_r_Tuple(block, 1, &addr);
+		ir_node *in[] = {
+			[pn_Call_M]         = get_Call_mem(node),
+			[pn_Call_T_result]  = results,
+			[pn_Call_X_regular] = bad,
+			[pn_Call_X_except]  = bad,
+		};
+		turn_into_tuple(node, ARRAY_SIZE(in), in);
+	}
+
+	for (size_t i = 0, n = ARR_LEN(alloc->frees); i < n; ++i) {
+		ir_node *free_node = alloc->frees[i];
+		if (is_Free(free_node)) {
+			exchange(free_node, get_Free_mem(free_node));
+		} else {
+			ir_node *in[] = {
+				[pn_Call_M]         = get_Call_mem(free_node),
+				[pn_Call_T_result]  = new_r_Bad(irg, mode_T),
+				[pn_Call_X_regular] = bad,
+				[pn_Call_X_except]  = bad,
+			};
+			turn_into_tuple(free_node, ARRAY_SIZE(in), in);
+		}
+	}
+}
+
+void escape_analysis(ir_graph *irg, unsigned max_size,
+                     check_alloc_entity_func is_free)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.escape_ana");
+
+	assure_irg_properties(irg, IR_GRAPH_PROPERTY_CONSISTENT_OUTS
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_LOOPINFO);
+
+	escape_env_t env = {
+		.max_size = max_size,
+		.is_free  = is_free,
+		.allocs   = NEW_ARR_F(allocation_t, 0),
+	};
+	irg_walk_graph(irg, NULL, collect_allocations, &env);
+
+	size_t n_allocs = ARR_LEN(env.allocs);
+	for (size_t i = 0; i < n_allocs; ++i) {
+		promote_allocation(irg, &env.allocs[i]);
+		DEL_ARR_F(env.allocs[i].frees);
+	}
+	DEL_ARR_F(env.allocs);
+
+	confirm_irg_properties(irg, n_allocs > 0
+		? IR_GRAPH_PROPERTIES_CONTROL_FLOW : IR_GRAPH_PROPERTIES_ALL);
+}
@@ -0,0 +1,535 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Identical function folding.
+ *
+ * Every function gets a structural hash computed over a canonical numbering
+ * of its nodes: The graph walker visits the nodes in an order which only
+ * depends on the graph structure, so two structurally identical graphs number
+ * their nodes the same way. Functions with equal hashes are compared node by
+ * node and each duplicate is folded into the first function of its class:
+ *
+ * - If the duplicate does not need a unique address (IR_LINKAGE_NO_IDENTITY),
+ *   all its references are redirected and it is removed or, if it is visible
+ *   outside the compilation unit, replaced by an alias.
+ * - Otherwise direct calls are redirected and its body is replaced by a thunk
+ *   calling the remaining function.
+ */
+#include "array.h"
+#include "cgana.h"
+#include "debug.h"
+#include "entity_t.h"
+#include "hashptr.h"
+#include "ircons.h"
+#include "irgmod.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irnode_t.h"
+#include "irop_t.h"
+#include "iroptimize.h"
+#include "irprog_t.h"
+#include "pmap.h"
+#include "tv_t.h"
+#include "type_t.h"
+#include "util.h"
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** Marker hash for references of a function to itself. */
+#define SELF_HASH  0x5e1fu
+
+typedef struct func_info_t func_info_t;
+struct func_info_t {
+	ir_graph    *irg;
+	ir_entity   *ent;
+	ir_node    **nodes;   /**< the nodes in canonical order */
+	unsigned     hash;
+	func_info_t *leader;  /**< the function this one is folded into */
+};
+
+/** Maps the entities of folded functions to their info. */
+static pmap *folded;
+
+static void number_node(ir_node *node, void *data)
+{
+	ir_node ***nodes = (ir_node***)data;
+	set_irn_link(node, INT_TO_PTR(ARR_LEN(*nodes)));
+	ARR_APP1(ir_node*, *nodes, node);
+}
+
+static unsigned get_node_number(ir_node const *node)
+{
+	return (unsigned)PTR_TO_INT(get_irn_link(node));
+}
+
+static bool is_frame_entity(ir_graph *irg, ir_entity const *ent)
+{
+	return get_entity_owner(ent) == get_irg_frame_type(irg);
+}
+
+/*
+ * Modes, entities and tarvals are hashed by content rather than by address,
+ * so the hash of a graph does not change between runs.
+ */
+
+static unsigned hash_mode(ir_mode const *mode)
+{
+	return hash_combine(hash_str(get_mode_name(mode)),
+	                    get_mode_size_bits(mode));
+}
+
+static unsigned hash_entity(ir_graph *irg, ir_entity *ent)
+{
+	if (ent == get_irg_entity(irg))
+		return SELF_HASH;
+	if (is_frame_entity(irg, ent))
+		return (unsigned)get_compound_member_index(get_entity_owner(ent), ent);
+	return hash_str(get_id_str(get_entity_ld_ident(ent)));
+}
+
+static unsigned hash_tarval(ir_tarval const *tv)
+{
+	return hash_combine(hash_mode(tv->mode),
+	                    hash_data(tv->value, tv->length));
+}
+
+static unsigned hash_attrs(ir_graph *irg, ir_node *node)
+{
+	switch (get_irn_opcode(node)) {
+	case iro_Address:
+	case iro_Offset:
+	case iro_Member:
+		return hash_entity(irg, get_irn_entity_attr(node));
+	case iro_Const:
+		return hash_tarval(get_Const_tarval(node));
+	case iro_Proj:
+		return get_Proj_num(node);
+	case iro_Cmp:
+		return get_Cmp_relation(node);
+	default:
+		return 0;
+	}
+}
+
+static unsigned hash_graph(ir_graph *irg, ir_node *const *nodes)
+{
+	unsigned hash = (unsigned)ARR_LEN(nodes);
+	for (size_t i = 0, n = ARR_LEN(nodes); i < n; ++i) {
+		ir_node *node = nodes[i];
+		hash = hash_combine(hash, get_irn_opcode(node));
+		hash = hash_combine(hash, hash_mode(get_irn_mode(node)));
+		hash = hash_combine(hash, hash_attrs(irg, node));
+		if (!is_Block(node))
+			hash = hash_combine(hash, get_node_number(get_nodes_block(node)));
+		foreach_irn_in(node, p, pred) {
+			hash = hash_combine(hash, get_node_number(pred));
+		}
+	}
+	return hash;
+}
+
+/**
+ * Numbers the nodes of @p irg canonically and returns them in order. The
+ * numbers are stored in the link fields.
+ */
+static ir_node **number_nodes(ir_graph *irg)
+{
+	ir_node **nodes = NEW_ARR_F(ir_node*, 0);
+	irg_walk_graph(irg, number_node, NULL, &nodes);
+	return nodes;
+}
+
+unsigned irg_structural_hash(ir_graph *irg)
+{
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
+	ir_node **nodes = number_nodes(irg);
+	unsigned  hash  = hash_graph(irg, nodes);
+	DEL_ARR_F(nodes);
+	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
+	return hash;
+}
+
+static bool entities_equal(func_info_t const *a, ir_entity *ea,
+                           func_info_t const *b, ir_entity *eb)
+{
+	bool const self_a = ea == a->ent;
+	bool const self_b = eb == b->ent;
+	if (self_a || self_b)
+		return self_a && self_b;
+
+	bool const frame_a = is_frame_entity(a->irg, ea);
+	bool const frame_b = is_frame_entity(b->irg, eb);
+	if (frame_a || frame_b) {
+		if (!frame_a || !frame_b)
+			return false;
+		if (get_compound_member_index(get_entity_owner(ea), ea)
+		    != get_compound_member_index(get_entity_owner(eb), eb))
+			return false;
+		if (get_entity_type(ea) != get_entity_type(eb)
+		 || get_entity_offset(ea) != get_entity_offset(eb)
+		 || is_parameter_entity(ea) != is_parameter_entity(eb))
+			return false;
+		return !is_parameter_entity(ea)
+		    || get_entity_parameter_number(ea) == get_entity_parameter_number(eb);
+	}
+	return ea == eb;
+}
+
+static bool switch_tables_equal(ir_switch_table const *ta,
+                                ir_switch_table const *tb)
+{
+	size_t const n = ir_switch_table_get_n_entries(ta);
+	if (ir_switch_table_get_n_entries(tb) != n)
+		return false;
+	for (size_t i = 0; i < n; ++i) {
+		if (ir_switch_table_get_min(ta, i) != ir_switch_table_get_min(tb, i)
+		 || ir_switch_table_get_max(ta, i) != ir_switch_table_get_max(tb, i)
+		 || ir_switch_table_get_pn(ta, i)  != ir_switch_table_get_pn(tb, i))
+			return false;
+	}
+	return true;
+}
+
+static bool node_attrs_equal(func_info_t const *a, ir_node *na,
+                             func_info_t const *b, ir_node *nb)
+{
+	switch (get_irn_opcode(na)) {
+	case iro_Block:
+		/* labels are specific to their function */
+		return get_Block_entity(na) == NULL && get_Block_entity(nb) == NULL;
+	case iro_Address:
+	case iro_Offset:
+	case iro_Member:
+		return entities_equal(a, get_irn_entity_attr(na),
+		                      b, get_irn_entity_attr(nb));
+	case iro_Switch:
+		return get_Switch_n_outs(na) == get_Switch_n_outs(nb)
+		    && switch_tables_equal(get_Switch_table(na), get_Switch_table(nb));
+	case iro_Cond:
+		return get_Cond_jmp_pred(na) == get_Cond_jmp_pred(nb);
+	case iro_Phi:
+		return get_Phi_loop(na) == get_Phi_loop(nb);
+	case iro_Dummy:
+	case iro_Unknown:
+		return true;
+	default:
+		return na->op->ops.attrs_equal(na, nb);
+	}
+}
+
+static bool method_types_equal(ir_type const *ta, ir_type const *tb)
+{
+	if (ta == tb)
+		return true;
+	size_t const n_params = get_method_n_params(ta);
+	size_t const n_ress   = get_method_n_ress(ta);
+	if (get_method_n_params(tb) != n_params || get_method_n_ress(tb) != n_ress
+	 || is_method_variadic(ta) != is_method_variadic(tb)
+	 || get_method_calling_convention(ta) != get_method_calling_convention(tb)
+	 || get_method_additional_properties(ta)
+	    != get_method_additional_properties(tb))
+		return false;
+	for (size_t i = 0; i < n_params; ++i) {
+		if (get_method_param_type(ta, i) != get_method_param_type(tb, i))
+			return false;
+	}
+	for (size_t i = 0; i < n_ress; ++i) {
+		if (get_method_res_type(ta, i) != get_method_res_type(tb, i))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Checks whether the graphs of @p a and @p b compute the same function.
+ */
+static bool functions_equal(func_info_t const *a, func_info_t const *b)
+{
+	size_t const n = ARR_LEN(a->nodes);
+	if (a->hash != b->hash || ARR_LEN(b->nodes) != n)
+		return false;
+	if (!method_types_equal(get_entity_type(a->ent), get_entity_type(b->ent))
+	 || get_entity_additional_properties(a->ent)
+	    != get_entity_additional_properties(b->ent))
+		return false;
+	ir_type *frame_a = get_irg_frame_type(a->irg);
+	ir_type *frame_b = get_irg_frame_type(b->irg);
+	if (get_type_size(frame_a) != get_type_size(frame_b)
+	 || get_compound_n_members(frame_a) != get_compound_n_members(frame_b))
+		return false;
+
+	for (size_t i = 0; i < n; ++i) {
+		ir_node *na = a->nodes[i];
+		ir_node *nb = b->nodes[i];
+		if (get_irn_op(na) != get_irn_op(nb)
+		 || get_irn_mode(na) != get_irn_mode(nb)
+		 || get_irn_arity(na) != get_irn_arity(nb)
+		 || get_irn_pinned(na) != get_irn_pinned(nb))
+			return false;
+		if (!is_Block(na) && get_node_number(get_nodes_block(na))
+		                     != get_node_number(get_nodes_block(nb)))
+			return false;
+		foreach_irn_in(na, p, pred) {
+			if (get_node_number(pred) != get_node_number(get_irn_n(nb, p)))
+				return false;
+		}
+		if (!node_attrs_equal(a, na, b, nb))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Checks whether the function of @p irg may take part in folding. Weak
+ * functions may be replaced at link time and thunks cannot forward variadic
+ * or compound arguments.
+ */
+static bool is_candidate(ir_graph *irg)
+{
+	ir_entity *ent = get_irg_entity(irg);
+	if (get_entity_linkage(ent) & (IR_LINKAGE_WEAK | IR_LINKAGE_NO_CODEGEN))
+		return false;
+	ir_type *mtp = get_entity_type(ent);
+	if (is_method_variadic(mtp))
+		return false;
+	for (size_t i = 0, n = get_method_n_params(mtp); i < n; ++i) {
+		if (get_type_mode(get_method_param_type(mtp, i)) == NULL)
+			return false;
+	}
+	for (size_t i = 0, n = get_method_n_ress(mtp); i < n; ++i) {
+		if (get_type_mode(get_method_res_type(mtp, i)) == NULL)
+			return false;
+	}
+	return true;
+}
+
+static bool needs_identity(ir_entity const *ent)
+{
+	return !(get_entity_linkage(ent) & IR_LINKAGE_NO_IDENTITY);
+}
+
+/**
+ * Returns the function @p ent is folded into or NULL.
+ */
+static ir_entity *get_fold_target(ir_entity *ent)
+{
+	func_info_t *info = pmap_get(func_info_t, folded, ent);
+	return info != NULL ? info->leader->ent : NULL;
+}
+
+static void redirect_node(ir_node *node, void *env)
+{
+	(void)env;
+	if (is_Call(node)) {
+		ir_node *ptr = get_Call_ptr(node);
+		if (!is_Address(ptr))
+			return;
+		ir_entity *target = get_fold_target(get_Address_entity(ptr));
+		if (target != NULL)
+			set_Call_ptr(node, new_r_Address(get_irn_irg(node), target));
+	} else if (is_Address(node)) {
+		ir_entity *ent    = get_Address_entity(node);
+		ir_entity *target = get_fold_target(ent);
+		if (target != NULL && !needs_identity(ent))
+			exchange(node, new_r_Address(get_irn_irg(node), target));
+	}
+}
+
+static void redirect_const_node(ir_node *node, void *env)
+{
+	(void)env;
+	if (!is_Address(node))
+		return;
+	ir_entity *ent    = get_Address_entity(node);
+	ir_entity *target = get_fold_target(ent);
+	if (target != NULL && !needs_identity(ent))
+		set_Address_entity(node, target);
+}
+
+static void redirect_initializer(ir_initializer_t *initializer)
+{
+	switch (get_initializer_kind(initializer)) {
+	case IR_INITIALIZER_CONST:
+		irg_walk(get_initializer_const_value(initializer),
+		         redirect_const_node, NULL, NULL);
+		return;
+	case IR_INITIALIZER_TARVAL:
+	case IR_INITIALIZER_NULL:
+		return;
+	case IR_INITIALIZER_COMPOUND:
+		for (size_t i = 0, n = get_initializer_compound_n_entries(initializer);
+		     i < n; ++i) {
+			redirect_initializer(get_initializer_compound_value(initializer, i));
+		}
+		return;
+	}
+}
+
+/**
+ * Redirects the references to folded functions in initializers and aliases.
+ */
+static void redirect_entities(void)
+{
+	for (ir_segment_t s = IR_SEGMENT_FIRST; s <= IR_SEGMENT_LAST; ++s) {
+		ir_type *segment = get_segment_type(s);
+		for (size_t i = 0, n = get_compound_n_members(segment); i < n; ++i) {
+			ir_entity *ent = get_compound_member(segment, i);
+			if (is_alias_entity(ent)) {
+				ir_entity *aliased = get_entity_alias(ent);
+				ir_entity *target  = get_fold_target(aliased);
+				if (target != NULL && !needs_identity(aliased))
+					set_entity_alias(ent, target);
+			} else if (get_entity_kind(ent) == IR_ENTITY_NORMAL) {
+				ir_initializer_t *initializer = get_entity_initializer(ent);
+				if (initializer != NULL)
+					redirect_initializer(initializer);
+			}
+		}
+	}
+}
+
+/**
+ * Replaces the body of @p ent by a call of @p target.
+ */
+static void create_thunk(ir_entity *ent, ir_entity *target)
+{
+	ir_type  *mtp      = get_entity_type(ent);
+	size_t    n_params = get_method_n_params(mtp);
+	size_t    n_ress   = get_method_n_ress(mtp);
+	ir_graph *irg      = new_ir_graph(ent, 0);
+	ir_node  *block    = get_r_cur_block(irg);
+	ir_node  *args     = get_irg_args(irg);
+
+	ir_node **in = ALLOCAN(ir_node*, n_params);
+	for (size_t i = 0; i < n_params; ++i) {
+		ir_mode *mode = get_type_mode(get_method_param_type(mtp, i));
+		in[i] = new_r_Proj(args, mode, i);
+	}
+	ir_node *callee = new_r_Address(irg, target);
+	ir_node *call   = new_r_Call(block, get_irg_initial_mem(irg), callee,
+	                             n_params, in, get_entity_type(target));
+	ir_node *mem    = new_r_Proj(call, mode_M, pn_Call_M);
+	ir_node *ress   = new_r_Proj(call, mode_T, pn_Call_T_result);
+
+	ir_node **results = ALLOCAN(ir_node*, n_ress);
+	for (size_t i = 0; i < n_ress; ++i) {
+		ir_mode *mode = get_type_mode(get_method_res_type(mtp, i));
+		results[i] = new_r_Proj(ress, mode, i);
+	}
+	ir_node *ret = new_r_Return(block, mem, n_ress, results);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	irg_finalize_cons(irg);
+}
+
+/**
+ * Removes the folded function @p ent. If it is externally visible an alias
+ * with the same name is created.
+ */
+static void replace_by_alias(ir_entity *ent, ir_entity *target)
+{
+	if (entity_is_externally_visible(ent)) {
+		ir_type      *owner      = get_entity_owner(ent);
+		ident        *name       = get_entity_ident(ent);
+		ident        *ld_name    = get_entity_ld_ident(ent);
+		ir_type      *type       = get_entity_type(ent);
+		ir_visibility visibility = get_entity_visibility(ent);
+		ir_linkage    linkage    = get_entity_linkage(ent);
+		dbg_info     *dbgi       = get_entity_dbg_info(ent);
+		free_entity(ent);
+
+		ir_entity *alias = new_alias_entity(owner, name, target, type,
+		                                    visibility);
+		set_entity_ld_ident(alias, ld_name);
+		set_entity_linkage(alias, linkage);
+		set_entity_dbg_info(alias, dbgi);
+	} else {
+		free_entity(ent);
+	}
+}
+
+static int cmp_func_hash(void const *a, void const *b)
+{
+	func_info_t const *const f0 = *(func_info_t const**)a;
+	func_info_t const *const f1 = *(func_info_t const**)b;
+	if (f0->hash != f1->hash)
+		return f0->hash < f1->hash ? -1 : 1;
+	/* keep the module order within a class, the first function survives */
+	return f0 < f1 ? -1 : f0 > f1;
+}
+
+void opt_fold_identical_functions(void)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.foldfunctions");
+
+	size_t        n_irgs = get_irp_n_irgs();
+	func_info_t  *infos  = XMALLOCNZ(func_info_t, n_irgs);
+	func_info_t **sorted = XMALLOCN(func_info_t*, n_irgs);
+	size_t        n      = 0;
+	foreach_irp_irg(i, irg) {
+		if (!is_candidate(irg))
+			continue;
+		func_info_t *info = &infos[n];
+		ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK);
+		info->irg   = irg;
+		info->ent   = get_irg_entity(irg);
+		info->nodes = number_nodes(irg);
+		info->hash  = hash_graph(irg, info->nodes);
+		sorted[n++] = info;
+	}
+	QSORT(sorted, n, cmp_func_hash);
+
+	/* compare the functions within each run of equal hashes against the
+	 * leaders of the classes found so far */
+	folded = pmap_create();
+	for (size_t i = 0; i < n;) {
+		size_t end = i + 1;
+		while (end < n && sorted[end]->hash == sorted[i]->hash)
+			++end;
+		for (size_t f = i; f < end; ++f) {
+			func_info_t *func = sorted[f];
+			for (size_t l = i; l < f; ++l) {
+				func_info_t *leader = sorted[l];
+				if (leader->leader != NULL || !functions_equal(leader, func))
+					continue;
+				DB((dbg, LEVEL_1, "fold %+F into %+F\n", func->ent, leader->ent));
+				func->leader = leader;
+				pmap_insert(folded, func->ent, func);
+				break;
+			}
+		}
+		i = end;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		func_info_t *info = sorted[i];
+		DEL_ARR_F(info->nodes);
+		ir_free_resources(info->irg, IR_RESOURCE_IRN_LINK);
+	}
+
+	if (pmap_count(folded) > 0) {
+		free_irp_callee_info();
+		foreach_irp_irg(i, irg) {
+			if (!pmap_contains(folded, get_irg_entity(irg)))
+				irg_walk_graph(irg, NULL, redirect_node, NULL);
+		}
+		redirect_entities();
+
+		foreach_pmap(folded, entry) {
+			func_info_t *info   = (func_info_t*)entry->value;
+			ir_entity   *target = info->leader->ent;
+			free_ir_graph(info->irg);
+			if (needs_identity(info->ent))
+				create_thunk(info->ent, target);
+			else
+				replace_by_alias(info->ent, target);
+		}
+	}
+
+	pmap_destroy(folded);
+	free(sorted);
+	free(infos);
+}
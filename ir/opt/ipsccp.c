@@ -0,0 +1,702 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Interprocedural sparse conditional constant and range propagation.
+ *
+ * Every graph gets a summary holding a lattice element for each argument
+ * and each result. Argument facts of functions whose address is not taken
+ * are the meet of the values passed at all reachable call sites, result
+ * facts are the meet of the values returned by all reachable Returns.
+ * Inside a graph, reachability and values are computed optimistically as in
+ * sparse conditional constant propagation, using the argument facts for the
+ * Proj(Start) arguments and the result facts of the callees for Call
+ * results.
+ *
+ * Graphs are evaluated alternately in top-down and bottom-up order of the
+ * callgraph until no summary changes, so facts flow from callers into
+ * callees and from callees back to their callers.
+ *
+ * Finally arguments and call results with a constant value are replaced by
+ * that constant, Cond nodes with a known direction get a constant selector
+ * and arguments with a known value range are confirmed. Local optimizations
+ * and control flow optimization remove the impossible branches afterwards.
+ */
+#include "array.h"
+#include "callgraph.h"
+#include "cgana.h"
+#include "debug.h"
+#include "entity_t.h"
+#include "ircons.h"
+#include "iredges_t.h"
+#include "irgmod.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irnode_t.h"
+#include "iropt_t.h"
+#include "iroptimize.h"
+#include "irprog_t.h"
+#include "irtools.h"
+#include "obst.h"
+#include "tv.h"
+#include "xmalloc.h"
+#include <stdbool.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** Number of times a summary fact may be lowered before it is widened. */
+#define MAX_FACT_UPDATES 4
+
+typedef enum fact_kind_t {
+	FACT_TOP,    /**< no value seen yet */
+	FACT_RANGE,  /**< value lies in [lo, hi], a constant if lo == hi */
+	FACT_BOTTOM, /**< value unknown */
+} fact_kind_t;
+
+/** A lattice element. */
+typedef struct fact_t {
+	fact_kind_t kind;
+	ir_tarval  *lo;
+	ir_tarval  *hi;
+	unsigned    n_updates; /**< number of updates, used for widening */
+} fact_t;
+
+/** The summary of a graph. */
+typedef struct summary_t {
+	ir_graph *irg;
+	bool      called;    /**< set if a reachable call was found */
+	size_t    n_params;
+	size_t    n_ress;
+	fact_t   *params;
+	fact_t   *ress;
+} summary_t;
+
+/** A node to be replaced after the analysis of a graph. */
+typedef struct replacement_t {
+	ir_node *node;
+	fact_t   fact;
+} replacement_t;
+
+typedef struct ipsccp_env_t {
+	struct obstack obst;     /**< obstack for summaries */
+	struct obstack fact_obst; /**< obstack for the node facts of a graph */
+	summary_t     *summary;  /**< summary of the current graph */
+	bool           changed;  /**< set if a summary changed */
+} ipsccp_env_t;
+
+static ipsccp_env_t env;
+
+static fact_t const fact_top    = { FACT_TOP, NULL, NULL, 0 };
+static fact_t const fact_bottom = { FACT_BOTTOM, NULL, NULL, 0 };
+
+static bool fact_is_constant(fact_t const *fact)
+{
+	return fact->kind == FACT_RANGE && fact->lo == fact->hi;
+}
+
+static fact_t fact_constant(ir_tarval *tv)
+{
+	if (!tarval_is_constant(tv))
+		return fact_bottom;
+	fact_t fact = { FACT_RANGE, tv, tv, 0 };
+	return fact;
+}
+
+/**
+ * Computes the meet of two facts into @p dst.
+ *
+ * @return true if @p dst changed
+ */
+static bool meet_fact(fact_t *dst, fact_t const *src)
+{
+	if (src->kind == FACT_TOP || dst->kind == FACT_BOTTOM)
+		return false;
+	if (src->kind == FACT_BOTTOM || dst->kind == FACT_TOP) {
+		dst->kind = src->kind;
+		dst->lo   = src->lo;
+		dst->hi   = src->hi;
+		return true;
+	}
+	if (dst->lo == src->lo && dst->hi == src->hi)
+		return false;
+
+	ir_mode *mode = get_tarval_mode(dst->lo);
+	if (!mode_is_int(mode) || get_tarval_mode(src->lo) != mode) {
+		dst->kind = FACT_BOTTOM;
+		return true;
+	}
+	ir_tarval *lo = tarval_cmp(src->lo, dst->lo) == ir_relation_less
+	              ? src->lo : dst->lo;
+	ir_tarval *hi = tarval_cmp(src->hi, dst->hi) == ir_relation_greater
+	              ? src->hi : dst->hi;
+	if (lo == dst->lo && hi == dst->hi)
+		return false;
+	dst->lo = lo;
+	dst->hi = hi;
+	return true;
+}
+
+/**
+ * Lowers a summary fact, widens it to bottom if it changes too often.
+ */
+static void update_fact(fact_t *dst, fact_t const *src)
+{
+	if (!meet_fact(dst, src))
+		return;
+	if (++dst->n_updates > MAX_FACT_UPDATES)
+		dst->kind = FACT_BOTTOM;
+	env.changed = true;
+}
+
+static summary_t *get_summary(ir_entity const *entity)
+{
+	return (summary_t*)get_entity_link(entity);
+}
+
+/**
+ * Returns the summary of the graph called by @p call or NULL, regardless of
+ * the signature of the call.
+ */
+static summary_t *lookup_callee_summary(ir_node const *call)
+{
+	ir_entity *callee = get_Call_callee(call);
+	if (callee == NULL)
+		return NULL;
+	ir_graph *irg = get_entity_linktime_irg(callee);
+	if (irg == NULL)
+		return NULL;
+	return get_summary(get_irg_entity(irg));
+}
+
+/**
+ * Returns the summary of the graph called by @p call or NULL.
+ */
+static summary_t *get_callee_summary(ir_node const *call)
+{
+	summary_t *summary = lookup_callee_summary(call);
+	/* the call must match the callee's signature, free_mismatched_callee()
+	 * made the callee free otherwise */
+	if (summary == NULL || get_Call_n_params(call) != summary->n_params)
+		return NULL;
+	return summary;
+}
+
+static fact_t const *eval(ir_node *node);
+
+/**
+ * The value_of function used during evaluation.
+ */
+static ir_tarval *value_of_fact(ir_node const *node)
+{
+	fact_t const *fact = eval((ir_node*)node);
+	return fact_is_constant(fact) ? fact->lo : tarval_unknown;
+}
+
+/**
+ * Checks whether a control flow predecessor is executable.
+ */
+static bool is_cfgpred_live(ir_node *pred)
+{
+	if (is_Bad(pred))
+		return false;
+	if (!get_Block_mark(get_nodes_block(pred)))
+		return false;
+	if (!is_Proj(pred))
+		return true;
+	ir_node *cond = get_Proj_pred(pred);
+	if (!is_Cond(cond))
+		return true;
+
+	fact_t const *sel = eval(get_Cond_selector(cond));
+	if (sel->kind == FACT_TOP)
+		return false;
+	if (!fact_is_constant(sel))
+		return true;
+	bool taken = sel->lo == tarval_b_true;
+	return taken == (get_Proj_num(pred) == pn_Cond_true);
+}
+
+/**
+ * Evaluates a Cmp using value ranges.
+ */
+static fact_t eval_cmp(ir_node *cmp)
+{
+	fact_t const *l = eval(get_Cmp_left(cmp));
+	fact_t const *r = eval(get_Cmp_right(cmp));
+	if (l->kind == FACT_TOP || r->kind == FACT_TOP)
+		return fact_top;
+	if (l->kind != FACT_RANGE || r->kind != FACT_RANGE
+	    || !mode_is_int(get_tarval_mode(l->lo)))
+		return fact_constant(computed_value(cmp));
+
+	ir_relation possible;
+	if (tarval_cmp(l->hi, r->lo) == ir_relation_less) {
+		possible = ir_relation_less;
+	} else if (tarval_cmp(l->lo, r->hi) == ir_relation_greater) {
+		possible = ir_relation_greater;
+	} else if (fact_is_constant(l) && l->lo == r->lo && r->lo == r->hi) {
+		possible = ir_relation_equal;
+	} else {
+		return fact_bottom;
+	}
+	ir_relation relation = get_Cmp_relation(cmp);
+	if ((possible & ~relation) == 0)
+		return fact_constant(tarval_b_true);
+	if ((possible & relation) == 0)
+		return fact_constant(tarval_b_false);
+	return fact_bottom;
+}
+
+/**
+ * Evaluates a Proj.
+ */
+static fact_t eval_proj(ir_node *proj)
+{
+	ir_node *pred = get_Proj_pred(proj);
+	if (!is_Proj(pred))
+		return fact_constant(computed_value(proj));
+
+	ir_node      *pred_pred = get_Proj_pred(pred);
+	unsigned      pn        = get_Proj_num(proj);
+	fact_t const *fact;
+	if (is_Start(pred_pred)) {
+		summary_t *summary = env.summary;
+		if (pn >= summary->n_params)
+			return fact_bottom;
+		fact = &summary->params[pn];
+	} else if (is_Call(pred_pred) && get_Proj_num(pred) == pn_Call_T_result) {
+		summary_t *summary = get_callee_summary(pred_pred);
+		if (summary == NULL || pn >= summary->n_ress)
+			return fact_bottom;
+		fact = &summary->ress[pn];
+	} else {
+		return fact_constant(computed_value(proj));
+	}
+	/* callers and callees might disagree about the modes */
+	if (fact->kind == FACT_RANGE && get_tarval_mode(fact->lo) != get_irn_mode(proj))
+		return fact_bottom;
+	return *fact;
+}
+
+/**
+ * Evaluates a node with another opcode.
+ */
+static fact_t eval_default(ir_node *node)
+{
+	ir_tarval *tv = computed_value(node);
+	if (tarval_is_constant(tv))
+		return fact_constant(tv);
+
+	/* the value is undefined as long as one of its operands is */
+	foreach_irn_in(node, i, pred) {
+		ir_mode *mode = get_irn_mode(pred);
+		if ((mode_is_data(mode) || mode == mode_b)
+		    && eval(pred)->kind == FACT_TOP)
+			return fact_top;
+	}
+	return fact_bottom;
+}
+
+/**
+ * Evaluates a node, the result is cached in the link field.
+ */
+static fact_t const *eval(ir_node *node)
+{
+	fact_t const *cached = (fact_t const*)get_irn_link(node);
+	if (cached != NULL)
+		return cached;
+	/* break cycles pessimistically */
+	set_irn_link(node, (void*)&fact_bottom);
+
+	fact_t   result;
+	ir_mode *mode = get_irn_mode(node);
+	if (!mode_is_data(mode) && mode != mode_b) {
+		result = fact_bottom;
+	} else {
+		switch (get_irn_opcode(node)) {
+		case iro_Const:
+			result = fact_constant(get_Const_tarval(node));
+			break;
+		case iro_Phi: {
+			ir_node *block = get_nodes_block(node);
+			result = fact_top;
+			foreach_irn_in(node, i, pred) {
+				if (is_cfgpred_live(get_Block_cfgpred(block, i)))
+					meet_fact(&result, eval(pred));
+			}
+			break;
+		}
+		case iro_Mux: {
+			fact_t const *sel = eval(get_Mux_sel(node));
+			if (sel->kind == FACT_TOP) {
+				result = fact_top;
+			} else if (fact_is_constant(sel)) {
+				ir_node *value = sel->lo == tarval_b_true
+				               ? get_Mux_true(node) : get_Mux_false(node);
+				result = *eval(value);
+			} else {
+				result = *eval(get_Mux_false(node));
+				meet_fact(&result, eval(get_Mux_true(node)));
+			}
+			break;
+		}
+		case iro_Confirm:
+			result = *eval(get_Confirm_value(node));
+			break;
+		case iro_Cmp:
+			result = eval_cmp(node);
+			break;
+		case iro_Proj:
+			result = eval_proj(node);
+			break;
+		case iro_Unknown:
+			result = fact_bottom;
+			break;
+		default:
+			result = eval_default(node);
+			break;
+		}
+	}
+	result.n_updates = 0;
+
+	fact_t *fact = OALLOC(&env.fact_obst, fact_t);
+	*fact = result;
+	set_irn_link(node, fact);
+	return fact;
+}
+
+typedef struct graph_nodes_t {
+	ir_node **blocks;
+	ir_node **calls;
+	ir_node **conds;
+	ir_node **projs;
+} graph_nodes_t;
+
+/**
+ * Walker: collects the nodes needed by the evaluation.
+ */
+static void collect_nodes(ir_node *node, void *data)
+{
+	graph_nodes_t *nodes = (graph_nodes_t*)data;
+	switch (get_irn_opcode(node)) {
+	case iro_Block:
+		set_Block_mark(node, false);
+		ARR_APP1(ir_node*, nodes->blocks, node);
+		break;
+	case iro_Call:
+		ARR_APP1(ir_node*, nodes->calls, node);
+		break;
+	case iro_Cond:
+		ARR_APP1(ir_node*, nodes->conds, node);
+		break;
+	case iro_Proj: {
+		ir_node *pred = get_Proj_pred(node);
+		if (is_Proj(pred) && (is_Start(get_Proj_pred(pred))
+		                      || is_Call(get_Proj_pred(pred))))
+			ARR_APP1(ir_node*, nodes->projs, node);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/**
+ * Computes the executable blocks of a graph. Afterwards the node facts
+ * are consistent with the final block marks.
+ */
+static void compute_reachability(ir_graph *irg, graph_nodes_t const *nodes)
+{
+	set_Block_mark(get_irg_start_block(irg), true);
+	bool changed;
+	do {
+		changed = false;
+		obstack_free(&env.fact_obst, NULL);
+		obstack_init(&env.fact_obst);
+		irg_walk_graph(irg, firm_clear_link, NULL, NULL);
+
+		for (size_t i = 0, n = ARR_LEN(nodes->blocks); i < n; ++i) {
+			ir_node *block = nodes->blocks[i];
+			if (get_Block_mark(block))
+				continue;
+			for (int p = 0, n_preds = get_Block_n_cfgpreds(block);
+			     p < n_preds; ++p) {
+				if (is_cfgpred_live(get_Block_cfgpred(block, p))) {
+					set_Block_mark(block, true);
+					changed = true;
+					break;
+				}
+			}
+		}
+	} while (changed);
+}
+
+/**
+ * Propagates the facts of a graph into the summaries of its callees and
+ * into its own result facts.
+ */
+static void update_summaries(ir_graph *irg, graph_nodes_t const *nodes)
+{
+	for (size_t i = 0, n = ARR_LEN(nodes->calls); i < n; ++i) {
+		ir_node   *call    = nodes->calls[i];
+		summary_t *summary = get_callee_summary(call);
+		if (summary == NULL || !get_Block_mark(get_nodes_block(call)))
+			continue;
+		if (!summary->called) {
+			summary->called = true;
+			env.changed     = true;
+		}
+		for (size_t p = 0; p < summary->n_params; ++p) {
+			update_fact(&summary->params[p], eval(get_Call_param(call, p)));
+		}
+	}
+
+	summary_t *own       = env.summary;
+	ir_node   *end_block = get_irg_end_block(irg);
+	foreach_irn_in(end_block, i, pred) {
+		if (!is_Return(pred) || !get_Block_mark(get_nodes_block(pred)))
+			continue;
+		size_t n_ress = get_Return_n_ress(pred);
+		if (n_ress != own->n_ress)
+			continue;
+		for (size_t r = 0; r < n_ress; ++r) {
+			update_fact(&own->ress[r], eval(get_Return_res(pred, r)));
+		}
+	}
+}
+
+/**
+ * Collects the nodes to replace after the analysis of a graph.
+ */
+static replacement_t *collect_replacements(graph_nodes_t const *nodes)
+{
+	replacement_t *replacements = NEW_ARR_F(replacement_t, 0);
+	for (size_t i = 0, n = ARR_LEN(nodes->conds); i < n; ++i) {
+		ir_node *cond = nodes->conds[i];
+		if (!get_Block_mark(get_nodes_block(cond)))
+			continue;
+		ir_node *sel = get_Cond_selector(cond);
+		if (is_Const(sel))
+			continue;
+		fact_t const *fact = eval(sel);
+		if (fact_is_constant(fact)) {
+			replacement_t const r = { cond, *fact };
+			ARR_APP1(replacement_t, replacements, r);
+		}
+	}
+	for (size_t i = 0, n = ARR_LEN(nodes->projs); i < n; ++i) {
+		ir_node      *proj = nodes->projs[i];
+		fact_t const *fact = eval(proj);
+		if (fact->kind != FACT_RANGE
+		    || get_tarval_mode(fact->lo) != get_irn_mode(proj))
+			continue;
+		/* only arguments get range information */
+		if (!fact_is_constant(fact) && !is_Start(get_Proj_pred(get_Proj_pred(proj))))
+			continue;
+		replacement_t const r = { proj, *fact };
+		ARR_APP1(replacement_t, replacements, r);
+	}
+	return replacements;
+}
+
+/**
+ * Applies the replacements of a graph.
+ */
+static void apply_replacements(ir_graph *irg, replacement_t const *replacements)
+{
+	ir_node *start_block = get_irg_start_block(irg);
+	for (size_t i = 0, n = ARR_LEN(replacements); i < n; ++i) {
+		ir_node      *node = replacements[i].node;
+		fact_t const *fact = &replacements[i].fact;
+		if (is_Cond(node)) {
+			DB((dbg, LEVEL_2, "%+F: selector is %T\n", node, fact->lo));
+			set_Cond_selector(node, new_r_Const(irg, fact->lo));
+		} else if (fact_is_constant(fact)) {
+			DB((dbg, LEVEL_2, "%+F: value is %T\n", node, fact->lo));
+			exchange(node, new_r_Const(irg, fact->lo));
+		} else if (get_irn_n_edges(node) > 0) {
+			DB((dbg, LEVEL_2, "%+F: value is in [%T, %T]\n", node, fact->lo,
+			    fact->hi));
+			ir_node *lo  = new_r_Const(irg, fact->lo);
+			ir_node *hi  = new_r_Const(irg, fact->hi);
+			ir_node *ge  = new_r_Confirm(start_block, node, lo,
+			                             ir_relation_greater_equal);
+			ir_node *le  = new_r_Confirm(start_block, ge, hi,
+			                             ir_relation_less_equal);
+			edges_reroute_except(node, le, ge);
+		}
+	}
+}
+
+/**
+ * Evaluates a graph. If @p transform is set, the results are used to
+ * transform the graph, else they are propagated into the summaries.
+ */
+static void evaluate_irg(ir_graph *irg, bool transform)
+{
+	summary_t *summary = get_summary(get_irg_entity(irg));
+	if (!summary->called)
+		return;
+	env.summary = summary;
+
+	graph_nodes_t nodes = {
+		.blocks = NEW_ARR_F(ir_node*, 0),
+		.calls  = NEW_ARR_F(ir_node*, 0),
+		.conds  = NEW_ARR_F(ir_node*, 0),
+		.projs  = NEW_ARR_F(ir_node*, 0),
+	};
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_LINK | IR_RESOURCE_BLOCK_MARK);
+	irg_walk_graph(irg, NULL, collect_nodes, &nodes);
+	obstack_init(&env.fact_obst);
+	/* evaluate nodes with the computed facts of their operands */
+	set_value_of_func(value_of_fact);
+
+	compute_reachability(irg, &nodes);
+	replacement_t *replacements = NULL;
+	if (transform) {
+		replacements = collect_replacements(&nodes);
+	} else {
+		update_summaries(irg, &nodes);
+	}
+
+	set_value_of_func(NULL);
+	obstack_free(&env.fact_obst, NULL);
+	ir_free_resources(irg, IR_RESOURCE_IRN_LINK | IR_RESOURCE_BLOCK_MARK);
+	DEL_ARR_F(nodes.projs);
+	DEL_ARR_F(nodes.conds);
+	DEL_ARR_F(nodes.calls);
+	DEL_ARR_F(nodes.blocks);
+
+	if (replacements != NULL) {
+		size_t n_replacements = ARR_LEN(replacements);
+		if (n_replacements > 0) {
+			assure_edges(irg);
+			apply_replacements(irg, replacements);
+		}
+		confirm_irg_properties(irg, n_replacements > 0
+			? IR_GRAPH_PROPERTIES_CONTROL_FLOW : IR_GRAPH_PROPERTIES_ALL);
+		DEL_ARR_F(replacements);
+	}
+}
+
+/**
+ * Creates the summary of a graph.
+ */
+static void create_summary(ir_graph *irg)
+{
+	ir_entity *entity = get_irg_entity(irg);
+	ir_type   *mtp    = get_entity_type(entity);
+	summary_t *summary = OALLOCZ(&env.obst, summary_t);
+	summary->irg      = irg;
+	summary->n_params = get_method_n_params(mtp);
+	summary->n_ress   = get_method_n_ress(mtp);
+	summary->params   = OALLOCN(&env.obst, fact_t, summary->n_params);
+	summary->ress     = OALLOCN(&env.obst, fact_t, summary->n_ress);
+	/* arguments of variadic functions cannot be matched */
+	fact_t const *init = is_method_variadic(mtp) ? &fact_bottom : &fact_top;
+	for (size_t i = 0; i < summary->n_params; ++i)
+		summary->params[i] = *init;
+	for (size_t i = 0; i < summary->n_ress; ++i)
+		summary->ress[i] = fact_top;
+	set_entity_link(entity, summary);
+}
+
+/**
+ * Marks a graph as called from unknown places.
+ */
+static void make_free(summary_t *summary)
+{
+	summary->called = true;
+	for (size_t i = 0; i < summary->n_params; ++i)
+		summary->params[i] = fact_bottom;
+}
+
+/**
+ * Walker: marks the callees of calls with a different number of arguments
+ * as free, the arguments of such calls cannot be matched to the parameters.
+ */
+static void free_mismatched_callee(ir_node *node, void *data)
+{
+	(void)data;
+	if (!is_Call(node))
+		return;
+	summary_t *summary = lookup_callee_summary(node);
+	if (summary != NULL && get_Call_n_params(node) != summary->n_params)
+		make_free(summary);
+}
+
+typedef struct irg_order_t {
+	ir_graph **irgs;
+	size_t     n_irgs;
+} irg_order_t;
+
+/**
+ * Callgraph walker: collects the graphs bottom-up.
+ */
+static void collect_irg(ir_graph *irg, void *data)
+{
+	irg_order_t *order = (irg_order_t*)data;
+	order->irgs[order->n_irgs++] = irg;
+}
+
+void ipsccp(void)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.ipsccp");
+
+	/* cgana uses the entity links, so run it before creating the
+	 * summaries */
+	ir_entity **free_methods;
+	size_t      n_free = cgana(&free_methods);
+
+	obstack_init(&env.obst);
+	foreach_irp_irg(i, irg) {
+		create_summary(irg);
+	}
+
+	/* free methods may be called from anywhere */
+	for (size_t i = 0; i < n_free; ++i) {
+		ir_entity *entity = free_methods[i];
+		ir_graph  *irg    = get_entity_irg(entity);
+		if (irg != NULL && get_irg_entity(irg) == entity)
+			make_free(get_summary(entity));
+	}
+	free(free_methods);
+	foreach_irp_irg(i, irg) {
+		irg_walk_graph(irg, free_mismatched_callee, NULL, NULL);
+	}
+
+	compute_callgraph();
+	size_t      n_irgs = get_irp_n_irgs();
+	irg_order_t order  = { XMALLOCN(ir_graph*, n_irgs), 0 };
+	callgraph_walk(NULL, collect_irg, &order);
+	assert(order.n_irgs == n_irgs);
+	free_callgraph();
+
+	unsigned n_rounds = 0;
+	do {
+		env.changed = false;
+		/* top-down: arguments flow from callers into callees */
+		for (size_t i = n_irgs; i-- > 0;) {
+			evaluate_irg(order.irgs[i], false);
+		}
+		/* bottom-up: results flow from callees into callers */
+		for (size_t i = 0; i < n_irgs; ++i) {
+			evaluate_irg(order.irgs[i], false);
+		}
+		++n_rounds;
+	} while (env.changed);
+	DB((dbg, LEVEL_1, "fixpoint reached after %u rounds\n", n_rounds));
+
+	for (size_t i = 0; i < n_irgs; ++i) {
+		evaluate_irg(order.irgs[i], true);
+	}
+
+	foreach_irp_irg(i, irg) {
+		set_entity_link(get_irg_entity(irg), NULL);
+	}
+	free(order.irgs);
+	obstack_free(&env.obst, NULL);
+}
@@ -0,0 +1,637 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Loop idiom recognition.
+ *
+ * Recognizes innermost counted loops which fill memory with a byte pattern
+ * or copy memory element by element:
+ *
+ *   for (i = init; i < n; ++i) d[i] = c;      =>  memset(d, c, ...)
+ *   for (i = init; i < n; ++i) d[i] = s[i];   =>  memcpy(d, s, ...)
+ *
+ * Both the head controlled form (a header with the exit test and a body
+ * block) and the foot controlled form (a single block testing the
+ * incremented induction variable) are handled. The library call is guarded
+ * by a trip count check (and for copies a check that the areas do not
+ * overlap); the original loop stays as the fallback:
+ *
+ *   if (init < n && ...) memcpy(...); else loop;
+ */
+#include "array.h"
+#include "bitfiddle.h"
+#include "debug.h"
+#include "ircons.h"
+#include "iredges_t.h"
+#include "irgmod.h"
+#include "irgraph_t.h"
+#include "irloop_t.h"
+#include "irnode_t.h"
+#include "iroptimize.h"
+#include "irouts_t.h"
+#include "irtools.h"
+#include "tv.h"
+#include "typerep.h"
+#include "util.h"
+#include <stdbool.h>
+#include <string.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** A loop recognized as memset or memcpy. */
+typedef struct idiom_t {
+	ir_node *header;    /**< the loop header */
+	ir_node *body;      /**< the block executed once per iteration */
+	int      entry;     /**< the entry predecessor of the header */
+	ir_node *iv;        /**< the induction variable Phi */
+	long     step;      /**< the increment of the induction variable */
+	ir_node *bound;     /**< the loop invariant bound of the induction var */
+	ir_node *mem_phi;   /**< the memory Phi of the header */
+	ir_node *exit_mem;  /**< the memory leaving the loop */
+	ir_node *exit_proj; /**< the control flow leaving the loop */
+	ir_node *store;     /**< the Store of each iteration */
+	ir_node *load;      /**< the Load of a copy loop or NULL */
+	unsigned size;      /**< the access size in bytes */
+} idiom_t;
+
+static bool is_in_loop(idiom_t const *idiom, ir_node const *node)
+{
+	ir_node const *block = get_nodes_block(node);
+	return block == idiom->header || block == idiom->body;
+}
+
+/**
+ * Checks whether @p node is computed from loop invariant values only.
+ */
+static bool is_invariant(idiom_t const *idiom, ir_node *node)
+{
+	if (!is_in_loop(idiom, node))
+		return true;
+	ir_mode *mode = get_irn_mode(node);
+	if (is_Phi(node) || mode == mode_M || mode == mode_T || mode == mode_X)
+		return false;
+	foreach_irn_in(node, i, pred) {
+		if (!is_invariant(idiom, pred))
+			return false;
+	}
+	return true;
+}
+
+static bool get_const_long(ir_node const *node, long *value)
+{
+	if (!is_Const(node))
+		return false;
+	ir_tarval *tv = get_Const_tarval(node);
+	if (!tarval_is_long(tv))
+		return false;
+	*value = get_tarval_long(tv);
+	return true;
+}
+
+/**
+ * Computes by how many bytes the address @p node advances in each iteration.
+ *
+ * @return false if @p node is not an affine function of the induction
+ *         variable
+ */
+static bool get_stride(idiom_t const *idiom, ir_node *node, long *stride)
+{
+	if (node == idiom->iv) {
+		*stride = idiom->step;
+		return true;
+	}
+	if (is_invariant(idiom, node)) {
+		*stride = 0;
+		return true;
+	}
+
+	long a;
+	long b;
+	switch (get_irn_opcode(node)) {
+	case iro_Add:
+		if (!get_stride(idiom, get_Add_left(node), &a)
+		    || !get_stride(idiom, get_Add_right(node), &b))
+			return false;
+		*stride = a + b;
+		return true;
+	case iro_Sub:
+		if (!get_stride(idiom, get_Sub_left(node), &a)
+		    || !get_stride(idiom, get_Sub_right(node), &b))
+			return false;
+		*stride = a - b;
+		return true;
+	case iro_Mul:
+		if (get_const_long(get_Mul_right(node), &b)) {
+			if (!get_stride(idiom, get_Mul_left(node), &a))
+				return false;
+		} else if (get_const_long(get_Mul_left(node), &b)) {
+			if (!get_stride(idiom, get_Mul_right(node), &a))
+				return false;
+		} else {
+			return false;
+		}
+		*stride = a * b;
+		return true;
+	case iro_Shl:
+		if (!get_const_long(get_Shl_right(node), &b) || b < 0 || b > 16
+		    || !get_stride(idiom, get_Shl_left(node), &a))
+			return false;
+		*stride = a << b;
+		return true;
+	case iro_Conv: {
+		/* only conversions which preserve the value */
+		ir_node *op      = get_Conv_op(node);
+		ir_mode *op_mode = get_irn_mode(op);
+		ir_mode *mode    = get_irn_mode(node);
+		if (!mode_is_int(op_mode) || !mode_is_int(mode)
+		    || get_mode_size_bits(mode) < get_mode_size_bits(op_mode)
+		    || (mode_is_signed(op_mode) && !mode_is_signed(mode)))
+			return false;
+		return get_stride(idiom, op, stride);
+	}
+	case iro_Member:
+		return get_stride(idiom, get_Member_ptr(node), stride);
+	case iro_Sel: {
+		ir_type *elem = get_array_element_type(get_Sel_type(node));
+		if (!get_stride(idiom, get_Sel_ptr(node), &a)
+		    || !get_stride(idiom, get_Sel_index(node), &b))
+			return false;
+		*stride = a + b * (long)get_type_size(elem);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+/**
+ * Checks whether storing @p value of @p size bytes repeatedly is equivalent
+ * to a memset.
+ */
+static bool is_byte_pattern(ir_node const *value, unsigned size)
+{
+	if (size == 1)
+		return true;
+	if (!is_Const(value))
+		return false;
+	ir_tarval     *tv   = get_Const_tarval(value);
+	unsigned char  byte = get_tarval_sub_bits(tv, 0);
+	for (unsigned i = 1; i < size; ++i) {
+		if (get_tarval_sub_bits(tv, i) != byte)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Finds the induction variable Phi of the test value of the exit condition
+ * and checks that it is incremented by a constant in each iteration.
+ */
+static bool find_induction_variable(idiom_t *idiom, ir_node *test)
+{
+	ir_node *iv;
+	if (idiom->header != idiom->body) {
+		/* head controlled loops test the Phi */
+		iv = test;
+	} else {
+		/* foot controlled loops test the incremented value */
+		if (!is_Add(test))
+			return false;
+		iv = get_Add_left(test);
+		if (!is_Phi(iv))
+			iv = get_Add_right(test);
+	}
+	if (!is_Phi(iv) || get_nodes_block(iv) != idiom->header)
+		return false;
+	ir_mode *mode = get_irn_mode(iv);
+	if (!mode_is_int(mode) && !mode_is_reference(mode))
+		return false;
+
+	ir_node *next = get_Phi_pred(iv, 1 - idiom->entry);
+	if (!is_Add(next))
+		return false;
+	ir_node *incr = get_Add_right(next);
+	if (get_Add_left(next) != iv) {
+		incr = get_Add_left(next);
+		if (get_Add_right(next) != iv)
+			return false;
+	}
+	if (!get_const_long(incr, &idiom->step) || idiom->step <= 0)
+		return false;
+	if (idiom->header == idiom->body && next != test)
+		return false;
+	idiom->iv = iv;
+	return true;
+}
+
+/**
+ * Analyzes the exit condition of the loop.
+ *
+ * @param cond  the Cond deciding whether to stay in the loop
+ * @param stay  the Cond Proj staying in the loop
+ */
+static bool analyze_condition(idiom_t *idiom, ir_node *cond, ir_node *stay)
+{
+	ir_node *cmp = get_Cond_selector(cond);
+	if (!is_Cmp(cmp))
+		return false;
+
+	foreach_irn_out_r(cond, i, proj) {
+		if (proj != stay)
+			idiom->exit_proj = proj;
+	}
+	if (idiom->exit_proj == NULL || get_irn_n_outs(idiom->exit_proj) != 1)
+		return false;
+
+	/* normalize to: stay in the loop iff test relation bound */
+	ir_relation relation = get_Cmp_relation(cmp);
+	if (get_Proj_num(stay) == pn_Cond_false)
+		relation = get_negated_relation(relation);
+	ir_node *test  = get_Cmp_left(cmp);
+	ir_node *bound = get_Cmp_right(cmp);
+	if (is_invariant(idiom, test)) {
+		ir_node *tmp = test;
+		test     = bound;
+		bound    = tmp;
+		relation = get_inversed_relation(relation);
+	}
+	if (!is_invariant(idiom, bound))
+		return false;
+	if (relation != ir_relation_less && relation != ir_relation_less_greater)
+		return false;
+	if (!find_induction_variable(idiom, test))
+		return false;
+	idiom->bound = bound;
+	return true;
+}
+
+/**
+ * Checks the memory operations of the loop: A Store (possibly of a value
+ * loaded in the same iteration) must be the only one.
+ */
+static bool analyze_memory(idiom_t *idiom)
+{
+	ir_node *header = idiom->header;
+	foreach_irn_out_r(header, i, node) {
+		if (is_Phi(node) && get_irn_mode(node) == mode_M) {
+			if (idiom->mem_phi != NULL)
+				return false;
+			idiom->mem_phi = node;
+		}
+	}
+	if (idiom->mem_phi == NULL)
+		return false;
+
+	ir_node *back_mem = get_Phi_pred(idiom->mem_phi, 1 - idiom->entry);
+	if (!is_Proj(back_mem))
+		return false;
+	ir_node *store = get_Proj_pred(back_mem);
+	if (!is_Store(store) || get_nodes_block(store) != idiom->body
+	    || get_Store_volatility(store) == volatility_is_volatile
+	    || ir_throws_exception(store))
+		return false;
+
+	ir_node *value = get_Store_value(store);
+	ir_mode *mode  = get_irn_mode(value);
+	if (get_mode_size_bits(mode) % 8 != 0)
+		return false;
+	unsigned size = get_mode_size_bytes(mode);
+	long     stride;
+	if (!get_stride(idiom, get_Store_ptr(store), &stride)
+	    || stride != (long)size)
+		return false;
+
+	ir_node *mem = get_Store_mem(store);
+	if (mem != idiom->mem_phi) {
+		if (!is_Proj(mem))
+			return false;
+		ir_node *load = get_Proj_pred(mem);
+		if (!is_Load(load) || get_Load_mem(load) != idiom->mem_phi
+		    || get_nodes_block(load) != idiom->body
+		    || get_Load_volatility(load) == volatility_is_volatile
+		    || ir_throws_exception(load))
+			return false;
+		idiom->load = load;
+	}
+
+	if (idiom->load != NULL) {
+		if (!is_Proj(value) || get_Proj_pred(value) != idiom->load
+		    || get_Load_mode(idiom->load) != mode
+		    || !get_stride(idiom, get_Load_ptr(idiom->load), &stride)
+		    || stride != (long)size)
+			return false;
+	} else if (!is_invariant(idiom, value) || !is_byte_pattern(value, size)) {
+		return false;
+	}
+
+	idiom->store    = store;
+	idiom->size     = size;
+	idiom->exit_mem = header == idiom->body ? back_mem : idiom->mem_phi;
+
+	/* the bytes are counted by the induction variable */
+	if (idiom->step != (long)size && idiom->step != 1)
+		return false;
+	/* the byte count gets rounded up to a multiple of the size */
+	if (idiom->step != 1 && !is_po2_or_zero(size))
+		return false;
+	return true;
+}
+
+/**
+ * Checks that the loop does nothing else and that only its memory is used
+ * after the loop.
+ */
+static bool check_loop_nodes(idiom_t const *idiom, ir_node *block)
+{
+	foreach_irn_out_r(block, i, node) {
+		ir_mode *mode = get_irn_mode(node);
+		if (mode == mode_X || is_Cond(node) || node == idiom->mem_phi)
+			continue;
+		if (node == idiom->store || node == idiom->load)
+			continue;
+		bool is_mem_proj = is_Proj(node)
+			&& (get_Proj_pred(node) == idiom->store
+			    || get_Proj_pred(node) == idiom->load);
+		if (!is_mem_proj && (mode == mode_M || mode == mode_T))
+			return false;
+
+		if (node == idiom->exit_mem)
+			continue;
+		foreach_irn_out_r(node, j, user) {
+			if (!is_End(user) && !is_in_loop(idiom, user))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Checks whether @p loop is a memset or memcpy loop.
+ */
+static bool analyze_loop(ir_loop *loop, idiom_t *idiom)
+{
+	ir_node *blocks[2];
+	size_t   n_blocks = 0;
+	for (size_t i = 0, n = get_loop_n_elements(loop); i < n; ++i) {
+		loop_element element = get_loop_element(loop, i);
+		if (*element.kind != k_ir_node || n_blocks == ARRAY_SIZE(blocks))
+			return false;
+		blocks[n_blocks++] = element.node;
+	}
+
+	/* find the header */
+	ir_node *header = NULL;
+	for (size_t b = 0; b < n_blocks; ++b) {
+		ir_node *block = blocks[b];
+		if (get_Block_n_cfgpreds(block) != 2)
+			continue;
+		for (int i = 0; i < 2; ++i) {
+			ir_node *pred = get_Block_cfgpred_block(block, i);
+			if (pred != blocks[0] && (n_blocks == 1 || pred != blocks[1])) {
+				header       = block;
+				idiom->entry = i;
+			}
+		}
+	}
+	if (header == NULL)
+		return false;
+	idiom->header = header;
+	ir_node *back = get_Block_cfgpred(header, 1 - idiom->entry);
+
+	ir_node *stay;
+	if (n_blocks == 1) {
+		idiom->body = header;
+		stay        = back;
+	} else {
+		ir_node *body = blocks[0] == header ? blocks[1] : blocks[0];
+		if (!is_Jmp(back) || get_nodes_block(back) != body
+		    || get_Block_n_cfgpreds(body) != 1)
+			return false;
+		idiom->body = body;
+		stay        = get_Block_cfgpred(body, 0);
+	}
+	if (!is_Proj(stay) || get_nodes_block(stay) != header)
+		return false;
+	ir_node *cond = get_Proj_pred(stay);
+	if (!is_Cond(cond))
+		return false;
+
+	return analyze_condition(idiom, cond, stay)
+	    && analyze_memory(idiom)
+	    && check_loop_nodes(idiom, idiom->header)
+	    && (idiom->body == idiom->header
+	        || check_loop_nodes(idiom, idiom->body));
+}
+
+/**
+ * Collects the innermost loops of a loop tree.
+ */
+static void collect_innermost_loops(ir_loop *loop, ir_loop ***loops)
+{
+	bool has_sons = false;
+	for (size_t i = 0, n = get_loop_n_elements(loop); i < n; ++i) {
+		loop_element element = get_loop_element(loop, i);
+		if (*element.kind == k_ir_loop) {
+			collect_innermost_loops(element.son, loops);
+			has_sons = true;
+		}
+	}
+	if (!has_sons && get_loop_depth(loop) > 0)
+		ARR_APP1(ir_loop*, *loops, loop);
+}
+
+/**
+ * Computes the value of an address in the first iteration by copying its
+ * computation into @p block.
+ */
+static ir_node *copy_to_preheader(idiom_t const *idiom, ir_node *node,
+                                  ir_node *block)
+{
+	if (node == idiom->iv)
+		return get_Phi_pred(node, idiom->entry);
+	if (!is_in_loop(idiom, node))
+		return node;
+
+	ir_node *copy = exact_copy(node);
+	set_nodes_block(copy, block);
+	foreach_irn_in(node, i, pred) {
+		set_irn_n(copy, i, copy_to_preheader(idiom, pred, block));
+	}
+	return copy;
+}
+
+static ir_type *get_size_type(void)
+{
+	ir_mode *offset_mode = get_reference_offset_mode(mode_P);
+	return get_type_for_mode(find_unsigned_mode(offset_mode));
+}
+
+static ir_type *get_memset_methodtype(void)
+{
+	ir_type *tp = new_type_method(3, 1, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(tp, 0, get_type_for_mode(mode_P));
+	set_method_param_type(tp, 1, get_type_for_mode(mode_Is));
+	set_method_param_type(tp, 2, get_size_type());
+	set_method_res_type  (tp, 0, get_type_for_mode(mode_P));
+	return tp;
+}
+
+static ir_type *get_memcpy_methodtype(void)
+{
+	ir_type *tp = new_type_method(3, 1, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(tp, 0, get_type_for_mode(mode_P));
+	set_method_param_type(tp, 1, get_type_for_mode(mode_P));
+	set_method_param_type(tp, 2, get_size_type());
+	set_method_res_type  (tp, 0, get_type_for_mode(mode_P));
+	return tp;
+}
+
+/**
+ * Creates the check that two areas of @p bytes bytes do not overlap.
+ */
+static ir_node *new_no_overlap(ir_node *block, ir_node *dst, ir_node *src,
+                               ir_node *bytes)
+{
+	ir_mode *offset_mode = get_reference_offset_mode(get_irn_mode(dst));
+	ir_node *offset      = new_r_Conv(block, bytes, offset_mode);
+	ir_node *dst_end     = new_r_Add(block, dst, offset);
+	ir_node *src_end     = new_r_Add(block, src, offset);
+	ir_node *before      = new_r_Cmp(block, dst_end, src,
+	                                 ir_relation_less_equal);
+	ir_node *after       = new_r_Cmp(block, src_end, dst,
+	                                 ir_relation_less_equal);
+	return new_r_Or(block, before, after);
+}
+
+/**
+ * Replaces the loop by a guarded library call.
+ */
+static void replace_loop(ir_graph *irg, idiom_t const *idiom)
+{
+	ir_node  *header = idiom->header;
+	ir_node  *store  = idiom->store;
+	dbg_info *dbgi   = get_irn_dbg_info(store);
+	ir_node  *pred   = get_Block_cfgpred(header, idiom->entry);
+	ir_node  *pre    = new_r_Block(irg, 1, &pred);
+
+	/* compute the trip count */
+	ir_node *init  = get_Phi_pred(idiom->iv, idiom->entry);
+	ir_node *bound = copy_to_preheader(idiom, idiom->bound, pre);
+	ir_mode *size_mode = get_type_mode(get_size_type());
+	/* subtract in the unsigned size mode, the difference might overflow the
+	 * signed mode of the induction variable */
+	ir_node *bytes     = new_r_Sub(pre, new_r_Conv(pre, bound, size_mode),
+	                               new_r_Conv(pre, init, size_mode));
+	if (idiom->step != (long)idiom->size) {
+		ir_node *size = new_r_Const_long(irg, size_mode, idiom->size);
+		bytes = new_r_Mul(pre, bytes, size);
+	} else if (idiom->size > 1) {
+		/* the last iteration stores a whole element even if the range is not
+		 * a multiple of the step */
+		ir_node *round = new_r_Const_long(irg, size_mode, idiom->size - 1);
+		ir_node *mask  = new_r_Const_long(irg, size_mode,
+		                                  ~(long)(idiom->size - 1));
+		bytes = new_r_And(pre, new_r_Add(pre, bytes, round), mask);
+	}
+	ir_node *guard = new_r_Cmp(pre, init, bound, ir_relation_less);
+
+	/* the call */
+	ir_node *entry_mem = get_Phi_pred(idiom->mem_phi, idiom->entry);
+	ir_node *dst       = copy_to_preheader(idiom, get_Store_ptr(store), pre);
+	ir_node *in[3];
+	ir_type *mtp;
+	char const *name;
+	in[0] = dst;
+	in[2] = bytes;
+	if (idiom->load != NULL) {
+		ir_node *src = copy_to_preheader(idiom, get_Load_ptr(idiom->load), pre);
+		in[1] = src;
+		guard = new_r_And(pre, guard, new_no_overlap(pre, dst, src, bytes));
+		mtp   = get_memcpy_methodtype();
+		name  = "memcpy";
+	} else {
+		ir_node *value = get_Store_value(store);
+		if (idiom->size == 1) {
+			value = copy_to_preheader(idiom, value, pre);
+			in[1] = new_r_Conv(pre, value, mode_Is);
+		} else {
+			ir_tarval *tv = get_Const_tarval(value);
+			in[1] = new_r_Const_long(irg, mode_Is, get_tarval_sub_bits(tv, 0));
+		}
+		mtp   = get_memset_methodtype();
+		name  = "memset";
+	}
+	DB((dbg, LEVEL_1, "%+F: replaced by %s\n", header, name));
+
+	ir_node *cond    = new_rd_Cond(dbgi, pre, guard);
+	ir_node *proj_t  = new_r_Proj(cond, mode_X, pn_Cond_true);
+	ir_node *proj_f  = new_r_Proj(cond, mode_X, pn_Cond_false);
+	ir_node *block_c = new_r_Block(irg, 1, &proj_t);
+	ir_entity *ent   = create_compilerlib_entity(name, mtp);
+	ir_node *callee  = new_r_Address(irg, ent);
+	ir_node *call    = new_rd_Call(dbgi, block_c, entry_mem, callee,
+	                               ARRAY_SIZE(in), in, mtp);
+	ir_node *call_mem = new_r_Proj(call, mode_M, pn_Call_M);
+	ir_node *jmp_c    = new_r_Jmp(block_c);
+
+	/* the loop becomes the fallback */
+	set_Block_cfgpred(header, idiom->entry, proj_f);
+
+	/* join the call with the loop exit, the outs are outdated once another
+	 * loop got replaced, so use the edges */
+	ir_node         *exit_proj  = idiom->exit_proj;
+	ir_edge_t const *exit_edge  = get_irn_out_edge_first(exit_proj);
+	ir_node         *exit_block = get_edge_src_irn(exit_edge);
+	int              exit_pos   = get_edge_src_pos(exit_edge);
+	ir_node         *join_in[]  = { exit_proj, jmp_c };
+	ir_node         *join       = new_r_Block(irg, ARRAY_SIZE(join_in), join_in);
+	set_Block_cfgpred(exit_block, exit_pos, new_r_Jmp(join));
+
+	ir_node *exit_mem  = idiom->exit_mem;
+	ir_node *mem_in[]  = { exit_mem, call_mem };
+	ir_node *phi       = new_r_Phi(join, ARRAY_SIZE(mem_in), mem_in, mode_M);
+	foreach_out_edge_safe(exit_mem, edge) {
+		ir_node *user = get_edge_src_irn(edge);
+		if (user == phi || is_End(user) || is_in_loop(idiom, user))
+			continue;
+		set_irn_n(user, get_edge_src_pos(edge), phi);
+	}
+}
+
+void opt_loop_idioms(ir_graph *irg)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.loop_idiom");
+
+	assure_irg_properties(irg, IR_GRAPH_PROPERTY_NO_UNREACHABLE_CODE
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_OUTS
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_LOOPINFO
+	                         | IR_GRAPH_PROPERTY_NO_BADS);
+
+	ir_loop **loops = NEW_ARR_F(ir_loop*, 0);
+	collect_innermost_loops(get_irg_loop(irg), &loops);
+
+	/* analyze all loops while the out edges are still valid */
+	idiom_t *idioms = NEW_ARR_F(idiom_t, 0);
+	for (size_t i = 0, n = ARR_LEN(loops); i < n; ++i) {
+		idiom_t idiom;
+		memset(&idiom, 0, sizeof(idiom));
+		if (analyze_loop(loops[i], &idiom))
+			ARR_APP1(idiom_t, idioms, idiom);
+	}
+	DEL_ARR_F(loops);
+
+	size_t n_idioms = ARR_LEN(idioms);
+	if (n_idioms > 0) {
+		assure_edges(irg);
+		for (size_t i = 0; i < n_idioms; ++i) {
+			replace_loop(irg, &idioms[i]);
+		}
+	}
+	DEL_ARR_F(idioms);
+
+	confirm_irg_properties(irg, n_idioms > 0
+		? IR_GRAPH_PROPERTIES_NONE : IR_GRAPH_PROPERTIES_ALL);
+}
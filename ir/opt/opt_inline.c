@@ -13,6 +13,7 @@
 #include "cgana.h"
 #include "debug.h"
 #include "entity_t.h"
+#include "execfreq_t.h"
 #include "irbackedge_t.h"
 #include "ircons_t.h"
 #include "iredges_t.h"
@@ -30,6 +31,7 @@
 #include "iropt_t.h"
 #include "iroptimize.h"
 #include "irouts_t.h"
+#include "irprofile.h"
 #include "irprog_t.h"
 #include "irtools.h"
 #include "list.h"
@@ -39,10 +41,16 @@
 #include "xmalloc.h"
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 
 DEBUG_ONLY(static firm_dbg_module_t *dbg;)
 
+/** Calls executed less often than this (per program run) are cold. */
+#define COLD_CALL_FREQ    0.001
+/** Callees with less nodes are usually smaller than the call sequence. */
+#define TINY_CALLEE_NODES 10
+
 /**
  * Remember the new node in the old node by using a field all nodes have.
  */
@@ -628,7 +636,8 @@ typedef struct call_entry {
 	ir_node    *call;       /**< The Call node. */
 	ir_graph   *callee;     /**< The callee IR-graph. */
 	list_head  list;        /**< List head for linking the next one. */
-	int        loop_depth;  /**< The loop depth of this call. */
+	double     freq;        /**< The execution frequency of this call relative
+	                             to the entry of its graph. */
 	int        benefice;    /**< The calculated benefice of this call. */
 	bool       all_const:1; /**< Set if this call has only constant parameters. */
 } call_entry;
@@ -646,6 +655,7 @@ typedef struct {
 	unsigned  n_call_nodes_orig; /**< for statistics */
 	unsigned  n_callers;         /**< Number of known graphs that call this graphs. */
 	unsigned  n_callers_orig;    /**< for statistics */
+	double    entry_freq;        /**< Estimated number of invocations of this graph. */
 	unsigned  got_inline:1;      /**< Set, if at least one call inside this graph was inlined. */
 	unsigned  recursive:1;       /**< Set, if this function is self recursive. */
 } inline_irg_env;
@@ -665,6 +675,7 @@ static inline_irg_env *alloc_inline_irg_env(void)
 	env->n_call_nodes_orig = 0;
 	env->n_callers         = 0;
 	env->n_callers_orig    = 0;
+	env->entry_freq        = 0.0;
 	env->got_inline        = 0;
 	env->recursive         = 0;
 	return env;
@@ -745,7 +756,7 @@ static void collect_calls2(ir_node *node, void *ctx)
 		call_entry *entry = OALLOC(&temp_obst, call_entry);
 		entry->call       = node;
 		entry->callee     = callee;
-		entry->loop_depth = get_irn_loop(get_nodes_block(node))->depth;
+		entry->freq       = get_block_execfreq(get_nodes_block(node));
 		entry->benefice   = 0;
 		entry->all_const  = false;
 
@@ -756,19 +767,19 @@ static void collect_calls2(ir_node *node, void *ctx)
 /**
  * Duplicate a call entry.
  *
- * @param entry     the original entry to duplicate
- * @param new_call  the new call node
- * @param loop_depth_delta
- *                  delta value for the loop depth
+ * @param entry      the original entry to duplicate
+ * @param new_call   the new call node
+ * @param freq_scale execution frequency of the inlined call, the frequency
+ *                   of the original entry is scaled by it
  */
 static call_entry *duplicate_call_entry(const call_entry *entry,
-                                        ir_node *new_call, int loop_depth_delta)
+                                        ir_node *new_call, double freq_scale)
 {
 	call_entry *nentry = OALLOC(&temp_obst, call_entry);
 	nentry->call       = new_call;
 	nentry->callee     = entry->callee;
 	nentry->benefice   = entry->benefice;
-	nentry->loop_depth = entry->loop_depth + loop_depth_delta;
+	nentry->freq       = entry->freq * freq_scale;
 	nentry->all_const  = entry->all_const;
 
 	return nentry;
@@ -869,6 +880,16 @@ static unsigned get_method_local_adress_weight(ir_graph *callee, size_t pos)
 	return env->local_weights[pos];
 }
 
+/**
+ * Returns the estimated number of executions of a call per program run.
+ */
+static double get_call_freq(const call_entry *entry)
+{
+	ir_graph             *caller     = get_irn_irg(entry->call);
+	inline_irg_env const *caller_env = (inline_irg_env const*)get_irg_link(caller);
+	return caller_env->entry_freq * entry->freq;
+}
+
 /**
  * Calculate a benefice value for inlining the given call.
  *
@@ -935,7 +956,16 @@ static int calc_inline_benefice(call_entry *entry, ir_graph *callee)
 	}
 	entry->all_const = all_const;
 
+	/* leave calls on cold paths alone, unless the callee is smaller than the
+	 * call itself */
 	inline_irg_env *callee_env = (inline_irg_env*)get_irg_link(callee);
+	double          freq       = get_call_freq(entry);
+	if (freq < COLD_CALL_FREQ && callee_env->n_nodes >= TINY_CALLEE_NODES) {
+		DB((dbg, LEVEL_2, "In %+F Call to %+F: cold call (freq %f)\n",
+		    call, callee, freq));
+		return entry->benefice = INT_MIN;
+	}
+
 	if (callee_env->n_callers == 1 &&
 	    callee != current_ir_graph &&
 	    !entity_is_externally_visible(ent)) {
@@ -955,11 +985,16 @@ static int calc_inline_benefice(call_entry *entry, ir_graph *callee)
 	if (callee_env->n_call_nodes == 0)
 		weight += 400;
 
-	/** it's important to inline inner loops first */
-	if (entry->loop_depth > 30)
+	/* it's important to inline hot calls first. The bonus grows with the
+	 * magnitude of the call frequency, so with estimated frequencies a call
+	 * in a loop nest of depth n gets about n*1024 */
+	double freq_weight = log10(freq) * 1024;
+	if (freq_weight > 30 * 1024)
 		weight += 30 * 1024;
+	else if (freq_weight < -30 * 1024)
+		weight -= 30 * 1024;
 	else
-		weight += entry->loop_depth * 1024;
+		weight += (int64_t)freq_weight;
 
 	/*
 	 * All arguments constant is probably a good sign, give an extra bonus
@@ -1058,12 +1093,14 @@ static void maybe_push_call(pqueue_t *pqueue, call_entry *call,
  * @param irg      the graph into which we inline
  * @param maxsize  do NOT inline if the size of irg gets
  *                 bigger than this amount
+ * @param budget   the remaining number of nodes inlining may add to the
+ *                 program, updated
  * @param inline_threshold
  *                 threshold value for inline decision
  * @param copied_graphs
  *                 map containing copied of recursive graphs
  */
-static void inline_into(ir_graph *irg, unsigned maxsize,
+static void inline_into(ir_graph *irg, unsigned maxsize, unsigned *budget,
                         int inline_threshold, pmap *copied_graphs)
 {
 	inline_irg_env *env = (inline_irg_env*)get_irg_link(irg);
@@ -1101,6 +1138,12 @@ static void inline_into(ir_graph *irg, unsigned maxsize,
 			    env->n_nodes, callee, callee_env->n_nodes));
 			continue;
 		}
+		if (!(props & mtp_property_always_inline)
+		    && callee_env->n_nodes > *budget) {
+			DB((dbg, LEVEL_2, "%+F: growth budget exhausted for %+F (%d)\n",
+			    irg, callee, callee_env->n_nodes));
+			continue;
+		}
 
 		ir_graph *calleee = pmap_get(ir_graph, copied_graphs, callee);
 		if (calleee != NULL) {
@@ -1156,7 +1199,6 @@ static void inline_into(ir_graph *irg, unsigned maxsize,
 			callee_env = alloc_inline_irg_env();
 			set_irg_link(copy, callee_env);
 
-			assure_irg_properties(copy, IR_GRAPH_PROPERTY_CONSISTENT_LOOPINFO);
 			wenv_t wenv = { .x = callee_env, .ignore_callers = true };
 			irg_walk_graph(copy, NULL, collect_calls2, &wenv);
 
@@ -1196,7 +1238,7 @@ static void inline_into(ir_graph *irg, unsigned maxsize,
 		--env->n_call_nodes;
 
 		/* we just generate a bunch of new calls */
-		int loop_depth = curr_call->loop_depth;
+		double freq = curr_call->freq;
 		list_for_each_entry(call_entry, centry, &callee_env->calls, list) {
 			inline_irg_env *penv = (inline_irg_env*)get_irg_link(centry->callee);
 
@@ -1218,7 +1260,7 @@ static void inline_into(ir_graph *irg, unsigned maxsize,
 			assert(is_Call(new_call));
 
 			call_entry *new_entry
-				= duplicate_call_entry(centry, new_call, loop_depth);
+				= duplicate_call_entry(centry, new_call, freq);
 			list_add_tail(&new_entry->list, &env->calls);
 			maybe_push_call(pqueue, new_entry, inline_threshold);
 		}
@@ -1226,18 +1268,96 @@ static void inline_into(ir_graph *irg, unsigned maxsize,
 
 		env->n_call_nodes += callee_env->n_call_nodes;
 		env->n_nodes += callee_env->n_nodes;
+		*budget      -= MIN(*budget, callee_env->n_nodes);
 		--callee_env->n_callers;
 	}
 	ir_free_resources(irg, IR_RESOURCE_IRN_LINK|IR_RESOURCE_PHI_LIST);
 	del_pqueue(pqueue);
 }
 
-/*
- * Heuristic inliner. Calculates a benefice value for every call and inlines
- * those calls with a value higher than the threshold.
+/**
+ * Estimates how often each graph is entered by propagating the call
+ * frequencies top-down through the call graph. Graphs which may be called
+ * from outside start with one invocation, back edges of recursive calls are
+ * ignored.
+ *
+ * @param irgs    the graphs in bottom-up call graph order
+ * @param n_irgs  the number of graphs
  */
-void inline_functions(unsigned maxsize, int inline_threshold,
-                      opt_ptr after_inline_opt)
+static void compute_entry_freqs(ir_graph **irgs, size_t n_irgs)
+{
+	for (size_t i = n_irgs; i-- > 0; ) {
+		ir_graph       *irg = irgs[i];
+		inline_irg_env *env = (inline_irg_env*)get_irg_link(irg);
+		if (env->n_callers == 0
+		    || entity_is_externally_visible(get_irg_entity(irg)))
+			env->entry_freq += 1.0;
+
+		list_for_each_entry(call_entry, entry, &env->calls, list) {
+			inline_irg_env *callee_env
+				= (inline_irg_env*)get_irg_link(entry->callee);
+			if (callee_env != env)
+				callee_env->entry_freq += env->entry_freq * entry->freq;
+		}
+	}
+}
+
+/**
+ * Determines the inline threshold which spends the growth budget on the
+ * calls with the highest benefice first.
+ *
+ * @param irgs    the graphs
+ * @param n_irgs  the number of graphs
+ * @param budget  the number of nodes inlining may add to the program
+ * @param inline_threshold
+ *                the minimum threshold value for inline decision
+ */
+static int calc_budget_threshold(ir_graph **irgs, size_t n_irgs,
+                                 unsigned budget, int inline_threshold)
+{
+	pqueue_t *pqueue = new_pqueue();
+	for (size_t i = 0; i < n_irgs; ++i) {
+		ir_graph       *irg = irgs[i];
+		inline_irg_env *env = (inline_irg_env*)get_irg_link(irg);
+
+		current_ir_graph = irg;
+		list_for_each_entry(call_entry, entry, &env->calls, list) {
+			int benefice = calc_inline_benefice(entry, entry->callee);
+			if (benefice >= inline_threshold)
+				pqueue_put(pqueue, entry, benefice);
+		}
+	}
+
+	/* greedily take the calls with the highest benefice that still fit */
+	int threshold = inline_threshold;
+	while (!pqueue_empty(pqueue)) {
+		call_entry     *entry      = (call_entry*)pqueue_pop_front(pqueue);
+		inline_irg_env *callee_env = (inline_irg_env*)get_irg_link(entry->callee);
+		if (callee_env->n_nodes > budget)
+			continue;
+		budget   -= callee_env->n_nodes;
+		threshold = entry->benefice;
+	}
+	del_pqueue(pqueue);
+
+	DB((dbg, LEVEL_1, "inline threshold for growth budget: %d\n", threshold));
+	return threshold;
+}
+
+/**
+ * Heuristic inliner with a per-graph size limit and a program wide growth
+ * limit.
+ *
+ * @param maxsize  do NOT inline if the size of a graph gets bigger than this
+ * @param growth   the program may grow by this many percent, UINT_MAX for
+ *                 no limit
+ * @param inline_threshold
+ *                 threshold value for inline decision
+ * @param after_inline_opt
+ *                 optimizations performed on graphs where calls were inlined
+ */
+static void do_inline_functions(unsigned maxsize, unsigned growth,
+                                int inline_threshold, opt_ptr after_inline_opt)
 {
 	ir_graph *rem = current_ir_graph;
 	obstack_init(&temp_obst);
@@ -1252,6 +1372,11 @@ void inline_functions(unsigned maxsize, int inline_threshold,
 	for (size_t i = 0; i < n_irgs; ++i)
 		set_irg_link(irgs[i], alloc_inline_irg_env());
 
+	/* Use profile data for the call frequencies if we have some. */
+	bool have_profile = ir_profile_has_data();
+	if (have_profile)
+		ir_create_execfreqs_from_profile();
+
 	/* Precompute information in temporary data structure. */
 	wenv_t wenv;
 	wenv.ignore_callers = false;
@@ -1261,14 +1386,28 @@ void inline_functions(unsigned maxsize, int inline_threshold,
 		free_callee_info(irg);
 
 		wenv.x = (inline_irg_env*)get_irg_link(irg);
-		assure_loopinfo(irg);
+		if (!have_profile)
+			ir_estimate_execfreq(irg);
 		irg_walk_graph(irg, NULL, collect_calls2, &wenv);
 	}
+	compute_entry_freqs(irgs, n_irgs);
+
+	unsigned budget = UINT_MAX;
+	if (growth != UINT_MAX) {
+		unsigned n_nodes = 0;
+		for (size_t i = 0; i < n_irgs; ++i) {
+			inline_irg_env *env = (inline_irg_env*)get_irg_link(irgs[i]);
+			n_nodes += env->n_nodes;
+		}
+		budget           = (unsigned)((uint64_t)n_nodes * growth / 100);
+		inline_threshold = calc_budget_threshold(irgs, n_irgs, budget,
+		                                         inline_threshold);
+	}
 
 	/* -- and now inline. -- */
 	for (size_t i = 0; i < n_irgs; ++i) {
 		ir_graph *irg = irgs[i];
-		inline_into(irg, maxsize, inline_threshold, copied_graphs);
+		inline_into(irg, maxsize, &budget, inline_threshold, copied_graphs);
 	}
 
 	for (size_t i = 0; i < n_irgs; ++i) {
@@ -1303,6 +1442,326 @@ void inline_functions(unsigned maxsize, int inline_threshold,
 	current_ir_graph = rem;
 }
 
+void inline_functions(unsigned maxsize, int inline_threshold,
+                      opt_ptr after_inline_opt)
+{
+	do_inline_functions(maxsize, UINT_MAX, inline_threshold, after_inline_opt);
+}
+
+void inline_functions_growth(unsigned growth, int inline_threshold,
+                             opt_ptr after_inline_opt)
+{
+	do_inline_functions(UINT_MAX, growth, inline_threshold, after_inline_opt);
+}
+
+/**
+ * Checks whether a value of the head of a function can be copied into a
+ * different graph: it must be computed without memory or control flow
+ * dependencies from the arguments and constants only.
+ * Counts the nodes which have to be copied.
+ */
+static bool is_head_value(ir_node *node, unsigned *n_nodes)
+{
+	if (irn_visited_else_mark(node))
+		return true;
+	ir_graph *irg = get_irn_irg(node);
+	if (is_Proj(node))
+		return get_Proj_pred(node) == get_irg_args(irg);
+	if (get_irn_pinned(node) != op_pin_state_floats
+	    || get_irn_mode(node) == mode_M || is_Member(node))
+		return false;
+
+	if (!is_irn_start_block_placed(node))
+		++*n_nodes;
+	foreach_irn_in(node, i, pred) {
+		if (!is_head_value(pred, n_nodes))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Copies a value accepted by is_head_value() into the head graph. The link
+ * fields of the nodes point to their copies.
+ */
+static ir_node *copy_head_value(ir_node *node, ir_graph *head)
+{
+	if (irn_visited_else_mark(node))
+		return get_new_node(node);
+
+	ir_node *copy;
+	if (is_Proj(node)) {
+		ir_mode *mode = get_irn_mode(node);
+		unsigned pn   = get_Proj_num(node);
+		copy = new_r_Proj(get_irg_args(head), mode, pn);
+	} else {
+		int       arity = get_irn_arity(node);
+		ir_node **in    = ALLOCAN(ir_node*, arity);
+		foreach_irn_in(node, i, pred) {
+			in[i] = copy_head_value(pred, head);
+		}
+		copy = new_ir_node(get_irn_dbg_info(node), head,
+		                   get_irg_start_block(head), get_irn_op(node),
+		                   get_irn_mode(node), arity, in);
+		copy_node_attr(head, node, copy);
+		copy = optimize_node(copy);
+	}
+	set_new_node(node, copy);
+	return copy;
+}
+
+/** Describes the head of a function which may be inlined partially. */
+typedef struct partial_head {
+	ir_node  *cond;      /**< The Cond deciding between fast and slow path. */
+	ir_node  *ret;       /**< The Return of the fast path. */
+	unsigned  fast_pn;   /**< The Proj number of the fast path. */
+	unsigned  n_nodes;   /**< The number of nodes of the head. */
+} partial_head;
+
+/**
+ * Walker: counts the nodes of a graph.
+ */
+static void count_nodes(ir_node *node, void *env)
+{
+	unsigned *n_nodes = (unsigned*)env;
+	if (!is_nop(node) && !is_Block(node))
+		++*n_nodes;
+}
+
+/**
+ * Checks whether a graph starts with a cheap test leading to an early return
+ * while the remaining part is big.
+ */
+static bool find_partial_head(ir_graph *irg, unsigned max_head_size,
+                              partial_head *head)
+{
+	ir_entity *ent   = get_irg_entity(irg);
+	ir_type   *mtp   = get_entity_type(ent);
+	unsigned   props = get_entity_additional_properties(ent);
+	if (props & (mtp_property_noinline | mtp_property_always_inline))
+		return false;
+	if (is_method_variadic(mtp))
+		return false;
+	for (size_t i = 0, n = get_method_n_params(mtp); i < n; ++i) {
+		if (is_aggregate_type(get_method_param_type(mtp, i)))
+			return false;
+	}
+	for (size_t i = 0, n = get_method_n_ress(mtp); i < n; ++i) {
+		if (is_aggregate_type(get_method_res_type(mtp, i)))
+			return false;
+	}
+
+	ir_node *start_block = get_irg_start_block(irg);
+	ir_node *end_block   = get_irg_end_block(irg);
+	ir_node *initial_mem = get_irg_initial_mem(irg);
+	bool     found       = false;
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_VISITED);
+	foreach_irn_in(end_block, i, ret) {
+		if (!is_Return(ret) || get_Return_mem(ret) != initial_mem)
+			continue;
+		ir_node *block = get_nodes_block(ret);
+		if (get_Block_n_cfgpreds(block) != 1)
+			continue;
+		ir_node *proj = get_Block_cfgpred(block, 0);
+		if (!is_Proj(proj))
+			continue;
+		ir_node *cond = get_Proj_pred(proj);
+		if (!is_Cond(cond) || get_nodes_block(cond) != start_block)
+			continue;
+
+		inc_irg_visited(irg);
+		unsigned n_nodes = 1;
+		if (!is_head_value(get_Cond_selector(cond), &n_nodes))
+			continue;
+		bool pure = true;
+		for (size_t r = 0, n = get_Return_n_ress(ret); r < n; ++r) {
+			if (!is_head_value(get_Return_res(ret, r), &n_nodes)) {
+				pure = false;
+				break;
+			}
+		}
+		if (!pure || n_nodes > max_head_size)
+			continue;
+
+		head->cond    = cond;
+		head->ret     = ret;
+		head->fast_pn = get_Proj_num(proj);
+		head->n_nodes = n_nodes;
+		found         = true;
+		break;
+	}
+	ir_free_resources(irg, IR_RESOURCE_IRN_VISITED);
+	if (!found)
+		return false;
+
+	/* only worth it if inlining the whole function is too expensive */
+	unsigned n_nodes = 0;
+	irg_walk_graph(irg, NULL, count_nodes, &n_nodes);
+	return n_nodes - head->n_nodes >= 4 * head->n_nodes;
+}
+
+/**
+ * Splits a graph into a head, which keeps the entity of the function, and an
+ * outlined remainder. The head performs the test and the early return and
+ * calls the remainder otherwise.
+ *
+ * @return the graph of the head
+ */
+static ir_graph *split_partial_head(ir_graph *irg, partial_head const *head)
+{
+	ir_entity *ent  = get_irg_entity(irg);
+	ir_type   *mtp  = get_entity_type(ent);
+	ir_node   *cond = head->cond;
+	dbg_info  *dbgi = get_irn_dbg_info(cond);
+
+	/* the original graph becomes the outlined remainder */
+	ident     *cold_id = new_id_fmt("%s.cold", get_entity_ident(ent));
+	ir_entity *cold    = clone_entity(ent, cold_id, get_entity_owner(ent));
+	set_entity_visibility(cold, ir_visibility_local);
+	set_entity_linkage(cold, IR_LINKAGE_DEFAULT);
+	add_entity_additional_properties(cold, mtp_property_noinline);
+	set_irg_entity(irg, cold);
+	set_entity_irg(cold, irg);
+
+	/* construct the head */
+	ir_graph *rem      = current_ir_graph;
+	ir_graph *head_irg = new_ir_graph(ent, 0);
+	current_ir_graph   = head_irg;
+	ir_node  *start_bl = get_irg_start_block(head_irg);
+	ir_node  *end_bl   = get_irg_end_block(head_irg);
+	ir_node  *mem      = get_irg_initial_mem(head_irg);
+
+	ir_reserve_resources(irg, IR_RESOURCE_IRN_VISITED | IR_RESOURCE_IRN_LINK);
+	inc_irg_visited(irg);
+	ir_node *sel      = copy_head_value(get_Cond_selector(cond), head_irg);
+	ir_node *new_cond = new_rd_Cond(dbgi, start_bl, sel);
+	set_Cond_jmp_pred(new_cond, get_Cond_jmp_pred(cond));
+	unsigned slow_pn  = head->fast_pn == pn_Cond_true ? pn_Cond_false
+	                                                  : pn_Cond_true;
+
+	ir_node  *fast_x   = new_r_Proj(new_cond, mode_X, head->fast_pn);
+	ir_node  *fast_bl  = new_r_Block(head_irg, 1, &fast_x);
+	ir_node  *ret      = head->ret;
+	size_t    n_res    = get_Return_n_ress(ret);
+	ir_node **res      = ALLOCAN(ir_node*, n_res);
+	for (size_t i = 0; i < n_res; ++i)
+		res[i] = copy_head_value(get_Return_res(ret, i), head_irg);
+	ir_node  *fast_ret = new_rd_Return(get_irn_dbg_info(ret), fast_bl, mem,
+	                                   n_res, res);
+	add_immBlock_pred(end_bl, fast_ret);
+	ir_free_resources(irg, IR_RESOURCE_IRN_VISITED | IR_RESOURCE_IRN_LINK);
+
+	ir_node  *slow_x   = new_r_Proj(new_cond, mode_X, slow_pn);
+	ir_node  *slow_bl  = new_r_Block(head_irg, 1, &slow_x);
+	size_t    n_params = get_method_n_params(mtp);
+	ir_node **args     = ALLOCAN(ir_node*, n_params);
+	ir_node  *irg_args = get_irg_args(head_irg);
+	for (size_t i = 0; i < n_params; ++i) {
+		ir_mode *mode = get_type_mode(get_method_param_type(mtp, i));
+		args[i] = new_r_Proj(irg_args, mode, i);
+	}
+	ir_node *addr     = new_r_Address(head_irg, cold);
+	ir_node *call     = new_rd_Call(dbgi, slow_bl, mem, addr, n_params, args,
+	                                mtp);
+	ir_node *call_mem = new_r_Proj(call, mode_M, pn_Call_M);
+	ir_node *call_res = new_r_Proj(call, mode_T, pn_Call_T_result);
+	for (size_t i = 0; i < n_res; ++i) {
+		ir_mode *mode = get_type_mode(get_method_res_type(mtp, i));
+		res[i] = new_r_Proj(call_res, mode, i);
+	}
+	ir_node *slow_ret = new_rd_Return(dbgi, slow_bl, call_mem, n_res, res);
+	add_immBlock_pred(end_bl, slow_ret);
+	irg_finalize_cons(head_irg);
+	current_ir_graph = rem;
+
+	/* the remainder always takes the slow path */
+	ir_node *cond_bl = get_nodes_block(cond);
+	foreach_out_edge_safe(cond, edge) {
+		ir_node *proj = get_edge_src_irn(edge);
+		if (get_Proj_num(proj) == head->fast_pn)
+			exchange(proj, new_r_Bad(irg, mode_X));
+		else
+			exchange(proj, new_r_Jmp(cond_bl));
+	}
+	clear_irg_properties(irg, IR_GRAPH_PROPERTIES_CONTROL_FLOW);
+	remove_unreachable_code(irg);
+	remove_bads(irg);
+
+	DB((dbg, LEVEL_1, "Split %+F into head with %u nodes and %+F\n", ent,
+	    head->n_nodes, cold));
+	return head_irg;
+}
+
+/**
+ * Walker: collects the calls of graphs which are known at link time.
+ */
+static void collect_direct_calls(ir_node *node, void *env)
+{
+	pmap *calls = (pmap*)env;
+	if (!is_Call(node))
+		return;
+	ir_entity *callee = get_Call_callee(node);
+	if (callee == NULL)
+		return;
+	ir_graph *callee_irg = get_entity_linktime_irg(callee);
+	if (callee_irg == NULL || callee_irg == get_irn_irg(node))
+		return;
+
+	ir_node **list = pmap_get(ir_node*, calls, callee_irg);
+	if (list == NULL)
+		list = NEW_ARR_F(ir_node*, 0);
+	ARR_APP1(ir_node*, list, node);
+	pmap_insert(calls, callee_irg, list);
+}
+
+void partial_inline_functions(unsigned max_head_size)
+{
+	ir_graph *rem   = current_ir_graph;
+	pmap     *calls = pmap_create();
+	foreach_irp_irg(i, irg) {
+		irg_walk_graph(irg, NULL, collect_direct_calls, calls);
+	}
+
+	/* new graphs are appended, so only look at the existing ones */
+	for (size_t i = 0, n_irgs = get_irp_n_irgs(); i < n_irgs; ++i) {
+		ir_graph *irg  = get_irp_irg(i);
+		ir_node **list = pmap_get(ir_node*, calls, irg);
+		if (list == NULL)
+			continue;
+
+		partial_head head;
+		assure_irg_properties(irg, IR_GRAPH_PROPERTY_CONSISTENT_OUT_EDGES);
+		if (find_partial_head(irg, max_head_size, &head)) {
+			ir_graph *head_irg = split_partial_head(irg, &head);
+			for (size_t c = 0, n_calls = ARR_LEN(list); c < n_calls; ++c) {
+				ir_node  *call   = list[c];
+				ir_graph *caller = get_irn_irg(call);
+				current_ir_graph = caller;
+				ir_reserve_resources(caller, IR_RESOURCE_IRN_LINK
+				                             | IR_RESOURCE_PHI_LIST);
+				collect_phiprojs_and_start_block_nodes(caller);
+				ir_reserve_resources(head_irg, IR_RESOURCE_IRN_LINK);
+				inline_method(call, head_irg);
+				ir_free_resources(head_irg, IR_RESOURCE_IRN_LINK);
+				ir_free_resources(caller, IR_RESOURCE_IRN_LINK
+				                          | IR_RESOURCE_PHI_LIST);
+			}
+			confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_NONE);
+		} else {
+			confirm_irg_properties(irg, IR_GRAPH_PROPERTIES_ALL);
+		}
+		DEL_ARR_F(list);
+		pmap_insert(calls, irg, NULL);
+	}
+	foreach_pmap(calls, entry) {
+		ir_node **list = (ir_node**)entry->value;
+		if (list != NULL)
+			DEL_ARR_F(list);
+	}
+	pmap_destroy(calls);
+	current_ir_graph = rem;
+}
+
 void firm_init_inline(void)
 {
 	FIRM_DBG_REGISTER(dbg, "firm.opt.inline");
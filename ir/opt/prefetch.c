@@ -0,0 +1,423 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Software prefetching for strided loads in loops.
+ *
+ * Finds loads in innermost loops whose address advances by a constant stride
+ * in each iteration, e.g. p = p + 4 or &a[i] with i = i + 1, and inserts a
+ * prefetch for the address the load accesses some iterations later:
+ *
+ *   loop:                          loop:
+ *     x = *p;              =>        prefetch(p + 4 * n);
+ *     p = p + 4;                     x = *p;
+ *                                    p = p + 4;
+ *
+ * Loads from the same base address with the same stride share a prefetch if
+ * they are within a cache line. Loops with a known trip count whose accesses
+ * fit into the data cache are skipped.
+ */
+#include "array.h"
+#include "debug.h"
+#include "ircons.h"
+#include "iredges_t.h"
+#include "irgraph_t.h"
+#include "irloop_t.h"
+#include "irnode_t.h"
+#include "iroptimize.h"
+#include "target_t.h"
+#include "tv.h"
+#include "typerep.h"
+#include "util.h"
+#include <stdbool.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** Loads closer than this share a prefetch. */
+#define CACHE_LINE_SIZE  64
+/** Larger strides are not considered. */
+#define MAX_STRIDE       (1L << 16)
+/** Maximal depth of the address expressions examined. */
+#define MAX_DEPTH        8
+
+/** A load, which gets a prefetch. */
+typedef struct stream_t {
+	ir_node *load;
+	ir_node *base;    /**< the address without its constant offset */
+	long     offset;  /**< the constant offset added to base */
+	long     stride;  /**< the change of the address in each iteration */
+} stream_t;
+
+static bool is_in_loop(ir_loop const *loop, ir_node const *node)
+{
+	return get_irn_loop(get_nodes_block(node)) == loop;
+}
+
+static bool get_const_long(ir_node const *node, long *value)
+{
+	if (!is_Const(node))
+		return false;
+	ir_tarval *tv = get_Const_tarval(node);
+	if (!tarval_is_long(tv))
+		return false;
+	*value = get_tarval_long(tv);
+	return true;
+}
+
+/**
+ * Checks whether @p value is @p phi plus a constant and returns the constant.
+ */
+static bool get_increment(ir_node const *phi, ir_node const *value, long *inc)
+{
+	if (is_Add(value)) {
+		ir_node const *const l = get_Add_left(value);
+		ir_node const *const r = get_Add_right(value);
+		if (l == phi)
+			return get_const_long(r, inc);
+		if (r == phi)
+			return get_const_long(l, inc);
+	} else if (is_Sub(value) && get_Sub_left(value) == phi) {
+		if (get_const_long(get_Sub_right(value), inc)) {
+			*inc = -*inc;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Returns the stride of the induction variable @p phi.
+ */
+static bool get_iv_stride(ir_node const *phi, long *stride)
+{
+	ir_node const *const block = get_nodes_block(phi);
+	bool                 found = false;
+	foreach_irn_in(phi, i, pred) {
+		if (!is_backedge(block, i))
+			continue;
+		long inc;
+		if (!get_increment(phi, pred, &inc) || (found && inc != *stride))
+			return false;
+		*stride = inc;
+		found   = true;
+	}
+	return found;
+}
+
+/**
+ * Computes the change of @p node in each iteration of @p loop.
+ */
+static bool get_stride(ir_loop const *loop, ir_node const *node, long *stride,
+                       unsigned depth)
+{
+	if (!is_in_loop(loop, node)) {
+		*stride = 0;
+		return true;
+	}
+	if (depth > MAX_DEPTH)
+		return false;
+
+	long l;
+	long r;
+	switch (get_irn_opcode(node)) {
+	case iro_Phi:
+		if (!get_iv_stride(node, stride))
+			return false;
+		break;
+	case iro_Add:
+		if (!get_stride(loop, get_Add_left(node), &l, depth + 1)
+		 || !get_stride(loop, get_Add_right(node), &r, depth + 1))
+			return false;
+		*stride = l + r;
+		break;
+	case iro_Sub:
+		if (!get_stride(loop, get_Sub_left(node), &l, depth + 1)
+		 || !get_stride(loop, get_Sub_right(node), &r, depth + 1))
+			return false;
+		*stride = l - r;
+		break;
+	case iro_Mul:
+		if (get_const_long(get_Mul_right(node), &r)) {
+			if (!get_stride(loop, get_Mul_left(node), &l, depth + 1))
+				return false;
+		} else if (get_const_long(get_Mul_left(node), &r)) {
+			if (!get_stride(loop, get_Mul_right(node), &l, depth + 1))
+				return false;
+		} else {
+			return false;
+		}
+		if (r < -MAX_STRIDE || r > MAX_STRIDE)
+			return false;
+		*stride = l * r;
+		break;
+	case iro_Shl:
+		if (!get_const_long(get_Shl_right(node), &r) || r < 0 || r > 16
+		 || !get_stride(loop, get_Shl_left(node), &l, depth + 1))
+			return false;
+		*stride = l * (1L << r);
+		break;
+	case iro_Conv: {
+		/* only extensions keep the stride */
+		ir_node const *const op       = get_Conv_op(node);
+		ir_mode const *const src_mode = get_irn_mode(op);
+		ir_mode const *const dst_mode = get_irn_mode(node);
+		if (!mode_is_int(src_mode)
+		 || get_mode_size_bits(dst_mode) < get_mode_size_bits(src_mode))
+			return false;
+		return get_stride(loop, op, stride, depth + 1);
+	}
+	case iro_Member:
+		return get_stride(loop, get_Member_ptr(node), stride, depth + 1);
+	case iro_Sel: {
+		ir_type const *const elem = get_array_element_type(get_Sel_type(node));
+		if (!get_stride(loop, get_Sel_ptr(node), &l, depth + 1)
+		 || !get_stride(loop, get_Sel_index(node), &r, depth + 1))
+			return false;
+		*stride = l + r * (long)get_type_size(elem);
+		break;
+	}
+	default:
+		return false;
+	}
+	return -MAX_STRIDE <= *stride && *stride <= MAX_STRIDE;
+}
+
+/**
+ * Computes the value of @p node in the first iteration of @p loop if it is a
+ * constant.
+ */
+static bool get_start(ir_loop const *loop, ir_node const *node, long *start)
+{
+	if (!is_in_loop(loop, node))
+		return get_const_long(node, start);
+	if (is_Phi(node)) {
+		ir_node const *const block = get_nodes_block(node);
+		foreach_irn_in(node, i, pred) {
+			if (!is_backedge(block, i))
+				return get_start(loop, pred, start);
+		}
+		return false;
+	}
+	long inc;
+	if (is_Add(node) && get_const_long(get_Add_right(node), &inc)
+	 && get_start(loop, get_Add_left(node), start)) {
+		*start += inc;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Estimates the number of iterations of @p loop from a comparison of an
+ * induction variable with a constant bound. Returns 0 if unknown.
+ */
+static unsigned long get_trip_count(ir_loop const *loop)
+{
+	for (size_t i = 0, n = get_loop_n_elements(loop); i < n; ++i) {
+		loop_element const element = get_loop_element(loop, i);
+		if (*element.kind != k_ir_node)
+			continue;
+		ir_node const *const block = element.node;
+		foreach_out_edge(block, edge) {
+			ir_node const *const cond = get_edge_src_irn(edge);
+			if (!is_Cond(cond) || !is_Cmp(get_Cond_selector(cond)))
+				continue;
+			ir_node const *const cmp   = get_Cond_selector(cond);
+			ir_node const       *iv    = get_Cmp_left(cmp);
+			ir_node const       *bound = get_Cmp_right(cmp);
+			if (is_Const(iv)) {
+				ir_node const *const tmp = iv;
+				iv    = bound;
+				bound = tmp;
+			}
+			long end;
+			long start;
+			long stride;
+			if (!get_const_long(bound, &end) || !get_start(loop, iv, &start)
+			 || !get_stride(loop, iv, &stride, 0) || stride == 0)
+				continue;
+			long const count = (end - start) / stride;
+			if (count > 0)
+				return (unsigned long)count;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Splits @p node into a base address and a constant offset.
+ */
+static ir_node *get_base(ir_node *node, long *offset)
+{
+	*offset = 0;
+	for (;;) {
+		long c;
+		if (is_Add(node) && get_const_long(get_Add_right(node), &c)) {
+			node = get_Add_left(node);
+		} else if (is_Add(node) && get_const_long(get_Add_left(node), &c)) {
+			node = get_Add_right(node);
+		} else {
+			return node;
+		}
+		*offset += c;
+	}
+}
+
+/**
+ * Checks whether one of the streams in [@p begin, @p end) already prefetches
+ * the cache line of @p stream.
+ */
+static bool is_covered(stream_t const *begin, stream_t const *end,
+                       stream_t const *stream)
+{
+	for (stream_t const *other = begin; other != end; ++other) {
+		if (other->base == stream->base && other->stride == stream->stride
+		 && other->offset - stream->offset < CACHE_LINE_SIZE
+		 && stream->offset - other->offset < CACHE_LINE_SIZE)
+			return true;
+	}
+	return false;
+}
+
+static void collect_streams(ir_loop const *loop, stream_t **streams)
+{
+	for (size_t i = 0, n = get_loop_n_elements(loop); i < n; ++i) {
+		loop_element const element = get_loop_element(loop, i);
+		if (*element.kind != k_ir_node)
+			continue;
+		foreach_out_edge(element.node, edge) {
+			ir_node *const load = get_edge_src_irn(edge);
+			if (!is_Load(load) || get_Load_volatility(load) == volatility_is_volatile)
+				continue;
+			ir_node *const ptr = get_Load_ptr(load);
+			long           stride;
+			if (!get_stride(loop, ptr, &stride, 0) || stride == 0)
+				continue;
+
+			stream_t stream;
+			stream.load   = load;
+			stream.base   = get_base(ptr, &stream.offset);
+			stream.stride = stride;
+			ARR_APP1(stream_t, *streams, stream);
+		}
+	}
+}
+
+static ir_type *get_prefetch_type(void)
+{
+	ir_type *tp = new_type_method(3, 0, false, cc_cdecl_set, mtp_no_property);
+	set_method_param_type(tp, 0, get_type_for_mode(mode_P));
+	set_method_param_type(tp, 1, get_type_for_mode(mode_Is));
+	set_method_param_type(tp, 2, get_type_for_mode(mode_Is));
+	return tp;
+}
+
+/**
+ * Inserts a prefetch of the address @p stream accesses @p iterations later in
+ * front of the load.
+ */
+static void insert_prefetch(stream_t const *stream, unsigned iterations,
+                            ir_type *type)
+{
+	ir_node  *const load  = stream->load;
+	ir_graph *const irg   = get_irn_irg(load);
+	ir_node  *const block = get_nodes_block(load);
+	ir_node  *const ptr   = get_Load_ptr(load);
+	ir_mode  *const mode  = get_reference_offset_mode(get_irn_mode(ptr));
+	long      const ahead = stream->stride * (long)iterations;
+	ir_node  *const addr  = new_r_Add(block, ptr,
+	                                  new_r_Const_long(irg, mode, ahead));
+
+	DB((dbg, LEVEL_2, "prefetching %ld bytes ahead for %+F\n", ahead, load));
+	ir_node *const in[] = {
+		addr,
+		new_r_Const_long(irg, mode_Is, 0), /* read */
+		new_r_Const_long(irg, mode_Is, 3), /* high temporal locality */
+	};
+	ir_node *const mem      = get_Load_mem(load);
+	ir_node *const prefetch = new_r_Builtin(block, mem, ARRAY_SIZE(in), in,
+	                                        ir_bk_prefetch, type);
+	set_Load_mem(load, new_r_Proj(prefetch, mode_M, pn_Builtin_M));
+}
+
+static void collect_innermost_loops(ir_loop *loop, ir_loop ***loops)
+{
+	bool has_sons = false;
+	for (size_t i = 0, n = get_loop_n_elements(loop); i < n; ++i) {
+		loop_element element = get_loop_element(loop, i);
+		if (*element.kind == k_ir_loop) {
+			collect_innermost_loops(element.son, loops);
+			has_sons = true;
+		}
+	}
+	if (!has_sons && get_loop_depth(loop) > 0)
+		ARR_APP1(ir_loop*, *loops, loop);
+}
+
+void opt_prefetch(ir_graph *irg, unsigned iterations)
+{
+	unsigned const distance = ir_target_prefetch_distance();
+	if (distance == 0)
+		return;
+
+	FIRM_DBG_REGISTER(dbg, "firm.opt.prefetch");
+
+	assure_irg_properties(irg, IR_GRAPH_PROPERTY_NO_UNREACHABLE_CODE
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_OUT_EDGES
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_LOOPINFO
+	                         | IR_GRAPH_PROPERTY_NO_BADS);
+
+	ir_loop **loops = NEW_ARR_F(ir_loop*, 0);
+	collect_innermost_loops(get_irg_loop(irg), &loops);
+
+	/* analyze all loops before the backedge information changes */
+	stream_t *streams = NEW_ARR_F(stream_t, 0);
+	for (size_t l = 0, n_loops = ARR_LEN(loops); l < n_loops; ++l) {
+		ir_loop const *const loop  = loops[l];
+		size_t         const first = ARR_LEN(streams);
+		collect_streams(loop, &streams);
+
+		/* keep only one stream per cache line */
+		size_t        n_streams = first;
+		unsigned long footprint = 0;
+		for (size_t i = first, n = ARR_LEN(streams); i < n; ++i) {
+			/* only the streams kept so far are valid, the array is
+			 * compacted in place */
+			if (is_covered(&streams[first], &streams[n_streams], &streams[i]))
+				continue;
+			footprint += (unsigned long)MAX(streams[i].stride, -streams[i].stride);
+			streams[n_streams++] = streams[i];
+		}
+		ARR_SHRINKLEN(streams, n_streams);
+
+		unsigned long const trip_count = get_trip_count(loop);
+		unsigned      const cache_size = ir_target_data_cache_size();
+		if (trip_count != 0 && footprint <= cache_size / trip_count) {
+			DB((dbg, LEVEL_1, "%+F: data of loop %ld fits into the cache\n",
+			    irg, get_loop_loop_nr(loop)));
+			ARR_SHRINKLEN(streams, first);
+		}
+	}
+	DEL_ARR_F(loops);
+
+	size_t const n_streams = ARR_LEN(streams);
+	if (n_streams > 0) {
+		ir_type *const type = get_prefetch_type();
+		for (size_t i = 0; i < n_streams; ++i) {
+			stream_t const *const stream = &streams[i];
+			unsigned n = iterations;
+			if (n == 0) {
+				unsigned long const stride = MAX(stream->stride, -stream->stride);
+				n = (unsigned)((distance + stride - 1) / stride);
+			}
+			insert_prefetch(stream, n, type);
+		}
+	}
+	DEL_ARR_F(streams);
+
+	confirm_irg_properties(irg, n_streams > 0
+		? IR_GRAPH_PROPERTIES_CONTROL_FLOW : IR_GRAPH_PROPERTIES_ALL);
+}
@@ -7,9 +7,16 @@
  * @file
  * @brief   Scalar replacement of compounds.
  * @author  Beyhan Veliev, Michael Beck
+ *
+ * Atomic values, structs and arrays accessed with constant indices are
+ * replaced by SSA values. Entities whose address is only passed to calls
+ * that do not capture it are replaced as well: Their values are stored to
+ * the frame right before such a call and reloaded afterwards if the callee
+ * may write them, so the memory copy only exists on the escaping paths.
  */
 #include "scalar_replace.h"
 
+#include "analyze_irg_args.h"
 #include "array.h"
 #include "debug.h"
 #include "hashptr.h"
@@ -69,6 +76,9 @@ static size_t path_size(path_t *p)
 
 typedef struct scalars_t {
 	ir_entity *ent;              /**< A entity for scalar replacement. */
+	unsigned   vnum_begin;       /**< The first value number of the entity. */
+	unsigned   vnum_end;         /**< Behind the last value number. */
+	bool       materialized;     /**< The entity is stored for some calls. */
 } scalars_t;
 
 DEBUG_ONLY(static firm_dbg_module_t *dbg;)
@@ -140,15 +150,65 @@ static ir_type *get_addr_type(const ir_node *addr)
 		return get_entity_type(entity);
 	} else {
 		assert(is_Sel(addr));
-		return get_Sel_type(addr);
+		return get_array_element_type(get_Sel_type(addr));
 	}
 }
 
-/*
- * Returns non-zero, if the value represented by @p node "escapes", i.e. is used
- * by anything else than a load/store.
+/**
+ * Checks whether a Sel selects an array element with a constant index
+ * inside the array bounds.
  */
-bool is_address_taken(ir_node *node)
+static bool is_const_index_Sel(const ir_node *sel)
+{
+	ir_node *index = get_Sel_index(sel);
+	if (!is_Const(index))
+		return false;
+	ir_tarval *tv = get_Const_tarval(index);
+	if (!tarval_is_long(tv))
+		return false;
+	long idx = get_tarval_long(tv);
+	return idx >= 0 && (unsigned long)idx < get_array_size(get_Sel_type(sel));
+}
+
+/**
+ * Returns the access of a call to the object at @p addr, which is passed as
+ * a parameter. ptr_access_store is set if the call may capture the address.
+ */
+static ptr_access_kind get_call_access(const ir_node *call, const ir_node *addr)
+{
+	if (get_Call_ptr(call) == addr || ir_throws_exception(call))
+		return ptr_access_all;
+	/* the address might be returned */
+	ir_type *mtp = get_Call_type(call);
+	for (size_t i = 0, n = get_method_n_ress(mtp); i < n; ++i) {
+		if (is_Pointer_type(get_method_res_type(mtp, i)))
+			return ptr_access_all;
+	}
+	ir_entity *callee = get_Call_callee(call);
+	if (callee == NULL)
+		return ptr_access_all;
+
+	mtp_additional_properties props
+		= get_entity_additional_properties(callee);
+	if (props & (mtp_property_no_write | mtp_property_pure))
+		return ptr_access_read;
+	if (get_entity_irg(callee) == NULL)
+		return ptr_access_all;
+
+	ptr_access_kind access = ptr_access_none;
+	for (size_t i = 0, n = get_Call_n_params(call); i < n; ++i) {
+		if (get_Call_param(call, i) == addr)
+			access |= get_method_param_access(callee, i);
+	}
+	return access;
+}
+
+/**
+ * Returns true, if the value represented by @p node "escapes", i.e. is used
+ * by anything else than a load/store. If @p allow_calls is set, passing the
+ * address to a call that does not capture it is not considered an escape.
+ */
+static bool address_taken(ir_node *node, bool allow_calls)
 {
 	assert(is_Member(node) || is_Sel(node));
 
@@ -189,16 +249,25 @@ bool is_address_taken(ir_node *node)
 			/* we can't handle unions correctly yet -> address taken */
 			if (is_Union_type(get_entity_owner(entity)))
 				return true;
+			if (address_taken(succ, false))
+				return true;
+			break;
 		}
 
-			/* FALLTHROUGH */
-		case iro_Sel: {
-			/* Check the Member successor of Sel */
-			bool res = is_address_taken(succ);
-			if (res)
+		case iro_Sel:
+			/* we cannot tell which element is accessed by a variable index */
+			if (!is_const_index_Sel(succ))
+				return true;
+			if (address_taken(succ, false))
+				return true;
+			break;
+
+		case iro_Call:
+			if (!allow_calls)
+				return true;
+			if (get_call_access(succ, node) & ptr_access_store)
 				return true;
 			break;
-		}
 
 		default:
 			/* another op, the address is taken */
@@ -208,6 +277,11 @@ bool is_address_taken(ir_node *node)
 	return false;
 }
 
+bool is_address_taken(ir_node *node)
+{
+	return address_taken(node, false);
+}
+
 /* we need a special address that serves as an address taken marker */
 static char _x;
 static void *ADDRESS_TAKEN = &_x;
@@ -233,13 +307,14 @@ static leaf_state_t link_all_leaf_members(ir_entity *ent, ir_node *sel)
 			state |= HAS_CHILD_LOAD_STORE;
 			continue;
 		}
-		if (is_Member(succ)) {
+		if (is_Member(succ) || is_Sel(succ)) {
 			link_all_leaf_members(ent, succ);
 			state |= HAS_CHILD_SELS;
 		} else if (is_Id(succ)) {
 			state |= link_all_leaf_members(ent, succ);
 		} else {
-			assert(is_End(succ));
+			/* Calls are materialized, see materialize_call() */
+			assert(is_End(succ) || is_Call(succ));
 		}
 	}
 	if (state & HAS_CHILD_SELS) {
@@ -259,6 +334,13 @@ static leaf_state_t link_all_leaf_members(ir_entity *ent, ir_node *sel)
 	if (link == ADDRESS_TAKEN)
 		return HAS_CHILD_LOAD_STORE | HAS_CHILD_SELS;
 
+	/* only atomic values get a value number, a compound whose members are
+	 * never accessed (for example one only passed to calls) stays in memory */
+	if (get_type_mode(get_addr_type(sel)) == NULL) {
+		set_entity_link(ent, ADDRESS_TAKEN);
+		return HAS_CHILD_LOAD_STORE | HAS_CHILD_SELS;
+	}
+
 	/* we know we are at a leaf, because this function is only called if
 	 * the address is NOT taken, so sel's successor(s) must be Loads or
 	 * Stores */
@@ -308,7 +390,7 @@ static bool find_possible_replacements(ir_graph *irg)
 		/* we can handle arrays, structs and atomic types yet */
 		ir_type *ent_type = get_entity_type(ent);
 		if (is_aggregate_type(ent_type) || is_atomic_type(ent_type)) {
-			if (is_address_taken(succ)) {
+			if (address_taken(succ, true)) {
 				 /* killing one */
 				if (get_entity_link(ent))
 					--res;
@@ -365,11 +447,14 @@ found_root:
  * @param vnum  the first value number we can assign
  * @param modes a flexible array, containing all the modes of
  *              the value numbers.
+ * @param addrs a flexible array, containing a leaf address for each
+ *              value number.
  *
  * @return the next free value number
  */
 static unsigned allocate_value_numbers(pset *members, ir_entity *ent,
-                                       unsigned vnum, ir_mode ***modes)
+                                       unsigned vnum, ir_mode ***modes,
+                                       ir_node ***addrs)
 {
 	set *pathes = new_set(path_cmp, 8);
 
@@ -399,9 +484,10 @@ static unsigned allocate_value_numbers(pset *members, ir_entity *ent,
 			    key->vnum));
 
 			ARR_EXTO(ir_mode *, *modes, (key->vnum + 15) & ~15);
+			ARR_EXTO(ir_node *, *addrs, (key->vnum + 15) & ~15);
 
-			ir_entity *entity = get_Member_entity(member);
-			(*modes)[key->vnum] = get_type_mode(get_entity_type(entity));
+			(*modes)[key->vnum] = get_type_mode(get_addr_type(member));
+			(*addrs)[key->vnum] = member;
 
 			assert((*modes)[key->vnum] && "Value is not atomic");
 
@@ -429,11 +515,132 @@ static unsigned allocate_value_numbers(pset *members, ir_entity *ent,
  * environment for memory walker
  */
 typedef struct env_t {
-	unsigned  nvals;   /**< number of values */
-	ir_mode **modes;   /**< the modes of the values */
-	pset     *members; /**< A set of all Member nodes that have a value num */
+	unsigned  nvals;    /**< number of values */
+	ir_mode **modes;    /**< the modes of the values */
+	ir_node **addrs;    /**< a leaf address for each value */
+	pset     *members;  /**< A set of all Member nodes that have a value num */
+	set      *set_ent;  /**< the replaced entities */
+	pset     *mat_mems; /**< Loads and Stores created for calls */
 } env_t;
 
+/**
+ * Rebuilds the leaf address @p addr in @p block, starting from the frame.
+ * The original Member and Sel nodes need not dominate @p block.
+ */
+static ir_node *rebuild_addr(ir_node *block, ir_node *addr)
+{
+	ir_graph *irg = get_irn_irg(block);
+	if (is_Member(addr)) {
+		ir_node *ptr = get_Member_ptr(addr);
+		if (ptr != get_irg_frame(irg))
+			ptr = rebuild_addr(block, ptr);
+		return new_r_Member(block, ptr, get_Member_entity(addr));
+	}
+
+	assert(is_Sel(addr));
+	ir_tarval *tv    = get_Const_tarval(get_Sel_index(addr));
+	ir_node   *index = new_r_Const(irg, tv);
+	ir_node   *ptr   = rebuild_addr(block, get_Sel_ptr(addr));
+	return new_r_Sel(block, ptr, index, get_Sel_type(addr));
+}
+
+/**
+ * Stores the values of an entity before a call, which gets its address,
+ * and reloads them afterwards if the callee may modify them.
+ */
+static void materialize_call(ir_node *call, scalars_t *scalars,
+                             ptr_access_kind access, env_t *env)
+{
+	ir_graph *irg   = get_irn_irg(call);
+	ir_node  *block = get_nodes_block(call);
+	dbg_info *dbgi  = get_irn_dbg_info(call);
+	set_r_cur_block(irg, block);
+
+	DB((dbg, SET_LEVEL_3, "materializing %+F for %+F\n", scalars->ent, call));
+	scalars->materialized = true;
+
+	ir_node *mem = get_Call_mem(call);
+	for (unsigned vnum = scalars->vnum_begin; vnum < scalars->vnum_end; ++vnum) {
+		ir_node *addr  = rebuild_addr(block, env->addrs[vnum]);
+		ir_node *val   = get_r_value(irg, vnum, env->modes[vnum]);
+		ir_node *store = new_rd_Store(dbgi, block, mem, addr, val,
+		                              get_addr_type(addr), cons_none);
+		pset_insert_ptr(env->mat_mems, store);
+		mem = new_r_Proj(store, mode_M, pn_Store_M);
+	}
+	set_Call_mem(call, mem);
+
+	if (!(access & ptr_access_write))
+		return;
+
+	/* The reloads follow the call in the memory chain, so the Stores for
+	 * later calls cannot overwrite the values before they are reloaded. The
+	 * users of the memory are collected first, as the outs do not know the
+	 * new Loads. */
+	ir_node  *call_mem = new_r_Proj(call, mode_M, pn_Call_M);
+	ir_node **users    = NEW_ARR_F(ir_node*, 0);
+	foreach_irn_out_r(call, i, proj) {
+		if (!is_Proj(proj) || get_Proj_num(proj) != pn_Call_M)
+			continue;
+		call_mem = proj;
+		foreach_irn_out_r(proj, j, user) {
+			ARR_APP1(ir_node*, users, user);
+		}
+	}
+
+	mem = call_mem;
+	for (unsigned vnum = scalars->vnum_begin; vnum < scalars->vnum_end; ++vnum) {
+		ir_node *addr = rebuild_addr(block, env->addrs[vnum]);
+		ir_mode *mode = env->modes[vnum];
+		ir_node *load = new_rd_Load(dbgi, block, mem, addr, mode,
+		                            get_addr_type(addr), cons_none);
+		pset_insert_ptr(env->mat_mems, load);
+		set_r_value(irg, vnum, new_r_Proj(load, mode, pn_Load_res));
+		mem = new_r_Proj(load, mode_M, pn_Load_M);
+	}
+
+	for (size_t i = 0, n = ARR_LEN(users); i < n; ++i) {
+		ir_node *user = users[i];
+		foreach_irn_in(user, j, pred) {
+			if (pred == call_mem)
+				set_irn_n(user, j, mem);
+		}
+	}
+	DEL_ARR_F(users);
+}
+
+/**
+ * Materializes the replaced entities whose address is passed to a call.
+ */
+static void handle_call(ir_node *call, env_t *env)
+{
+	ir_graph *irg = get_irn_irg(call);
+	ir_node  *frame = get_irg_frame(irg);
+	for (size_t i = 0, n = get_Call_n_params(call); i < n; ++i) {
+		ir_node *param = get_Call_param(call, i);
+		if (!is_Member(param) || get_Member_ptr(param) != frame)
+			continue;
+
+		/* the same address may be passed more than once */
+		bool seen = false;
+		for (size_t j = 0; j < i; ++j) {
+			if (get_Call_param(call, j) == param)
+				seen = true;
+		}
+		if (seen)
+			continue;
+
+		ir_entity *ent = get_Member_entity(param);
+		scalars_t  key;
+		key.ent = ent;
+		scalars_t *scalars = set_find(scalars_t, env->set_ent, &key,
+		                              sizeof(key), hash_ptr(ent));
+		if (scalars == NULL)
+			continue;
+		materialize_call(call, scalars, get_call_access(call, param), env);
+	}
+}
+
 /**
  * topological post-walker.
  */
@@ -444,9 +651,10 @@ static void walker(ir_node *node, void *ctx)
 	if (is_Load(node)) {
 		/* a load, check if we can resolve it */
 		ir_node *addr = get_Load_ptr(node);
-		if (!is_Member(addr))
+		if (!is_Member(addr) && !is_Sel(addr))
 			return;
-		if (!pset_find_ptr(env->members, addr))
+		if (!pset_find_ptr(env->members, addr)
+		    || pset_find_ptr(env->mat_mems, node))
 			return;
 
 		/* ok, we have a Load that will be replaced */
@@ -490,9 +698,10 @@ static void walker(ir_node *node, void *ctx)
 	} else if (is_Store(node)) {
 		/* a Store always can be replaced */
 		ir_node *addr = get_Store_ptr(node);
-		if (!is_Member(addr))
+		if (!is_Member(addr) && !is_Sel(addr))
 			return;
-		if (!pset_find_ptr(env->members, addr))
+		if (!pset_find_ptr(env->members, addr)
+		    || pset_find_ptr(env->mat_mems, node))
 			return;
 
 		unsigned vnum = get_vnum(addr);
@@ -525,6 +734,8 @@ static void walker(ir_node *node, void *ctx)
 			n_in = 3;
 		}
 		turn_into_tuple(node, n_in, in);
+	} else if (is_Call(node)) {
+		handle_call(node, env);
 	}
 }
 
@@ -532,12 +743,16 @@ static void walker(ir_node *node, void *ctx)
  * Make scalar replacement.
  *
  * @param members A set containing all Member nodes that have a value number
+ * @param set_ent A set containing the replaced entities
  * @param nvals   The number of scalars.
  * @param modes   A flexible array, containing all the modes of
  *                the value numbers.
+ * @param addrs   A flexible array, containing a leaf address for each
+ *                value number.
  */
-static void do_scalar_replacements(ir_graph *irg, pset *members, unsigned nvals,
-                                   ir_mode **modes)
+static void do_scalar_replacements(ir_graph *irg, pset *members, set *set_ent,
+                                   unsigned nvals, ir_mode **modes,
+                                   ir_node **addrs)
 {
 	ssa_cons_start(irg, (int)nvals);
 
@@ -547,10 +762,14 @@ static void do_scalar_replacements(ir_graph *irg, pset *members, unsigned nvals,
 	 */
 	DB((dbg, SET_LEVEL_3, "Substituting Loads and Stores in %+F\n", irg));
 	env_t env;
-	env.nvals  = nvals;
-	env.modes  = modes;
-	env.members = members;
+	env.nvals    = nvals;
+	env.modes    = modes;
+	env.addrs    = addrs;
+	env.members  = members;
+	env.set_ent  = set_ent;
+	env.mat_mems = pset_new_ptr(8);
 	irg_walk_blkwise_graph(irg, NULL, walker, &env);
+	del_pset(env.mat_mems);
 
 	ssa_cons_finish(irg);
 }
@@ -579,6 +798,7 @@ void scalar_replacement_opt(ir_graph *irg)
 		ir_node  *irg_frame = get_irg_frame(irg);
 		unsigned  nvals     = 0;
 		ir_mode **modes     = NEW_ARR_F(ir_mode *, 16);
+		ir_node **addrs     = NEW_ARR_F(ir_node *, 16);
 		set      *set_ent   = new_set(ent_cmp, 8);
 		pset     *sels      = pset_new_ptr(8);
 		ir_type  *frame_tp  = get_irg_frame_type(irg);
@@ -598,8 +818,8 @@ void scalar_replacement_opt(ir_graph *irg)
 				continue;
 
 			scalars_t key;
-			key.ent = ent;
-			(void)set_insert(scalars_t, set_ent, &key, sizeof(key), hash_ptr(key.ent));
+			key.ent          = ent;
+			key.materialized = false;
 
 #ifdef DEBUG_libfirm
 			ir_type *ent_type = get_entity_type(ent);
@@ -615,17 +835,22 @@ void scalar_replacement_opt(ir_graph *irg)
 			}
 #endif
 
-			nvals = allocate_value_numbers(sels, ent, nvals, &modes);
+			key.vnum_begin = nvals;
+			nvals = allocate_value_numbers(sels, ent, nvals, &modes, &addrs);
+			key.vnum_end   = nvals;
+			(void)set_insert(scalars_t, set_ent, &key, sizeof(key), hash_ptr(key.ent));
 		}
 
 		DB((dbg, SET_LEVEL_1, "  %u values will be needed\n", nvals));
 
 		/* If scalars were found. */
 		if (nvals > 0) {
-			do_scalar_replacements(irg, sels, nvals, modes);
+			do_scalar_replacements(irg, sels, set_ent, nvals, modes, addrs);
 
 			foreach_set(set_ent, scalars_t, value) {
-				free_entity(value->ent);
+				/* materialized entities stay on the frame */
+				if (!value->materialized)
+					free_entity(value->ent);
 			}
 
 			changed = true;
@@ -633,6 +858,7 @@ void scalar_replacement_opt(ir_graph *irg)
 		del_pset(sels);
 		del_set(set_ent);
 		DEL_ARR_F(modes);
+		DEL_ARR_F(addrs);
 	}
 
 	ir_free_resources(irg, IR_RESOURCE_IRN_LINK);
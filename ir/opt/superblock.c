@@ -0,0 +1,539 @@
+/*
+ * This file is part of libFirm.
+ * Copyright (C) 2016 University of Karlsruhe.
+ */
+
+/**
+ * @file
+ * @brief   Superblock formation by tail duplication.
+ *
+ * Traces are grown from the most frequently executed blocks along their most
+ * likely successors. When a trace continues into a join point, the block is
+ * duplicated for the trace predecessor, so the trace can only be entered at
+ * its head. The side entrances keep the original block:
+ *
+ *     A   B         A   B
+ *      \ /          |   |
+ *       C     =>    C'  C
+ *       |           |  /
+ *       D           D'D
+ *
+ * As all following blocks of the trace get a second predecessor this way,
+ * the whole tail of the trace is duplicated as long as the size budget
+ * allows. Straight-line code can then be merged by the control flow
+ * optimization and exposes longer regions to scheduling, if-conversion and
+ * the load/store optimizations.
+ */
+#include "array.h"
+#include "bitset.h"
+#include "debug.h"
+#include "execfreq_t.h"
+#include "ircons.h"
+#include "iredges_t.h"
+#include "irgraph_t.h"
+#include "irgwalk.h"
+#include "irloop_t.h"
+#include "irnode_t.h"
+#include "iroptimize.h"
+#include "irtools.h"
+#include "typerep.h"
+#include "util.h"
+#include <stdbool.h>
+
+DEBUG_ONLY(static firm_dbg_module_t *dbg;)
+
+/** Minimal probability of the edge along which a trace is extended. */
+#define MIN_TRACE_PROBABILITY  0.6
+/** Blocks executed less often (relative to the start block) seed no trace. */
+#define MIN_SEED_FREQ          0.1
+/** Maximal number of nodes of a single duplicated block. */
+#define MAX_TAIL_BLOCK_SIZE    40
+
+typedef struct superblock_env_t {
+	bitset_t *headers;  /**< the loop headers */
+	unsigned  budget;   /**< the number of nodes we may still duplicate */
+	bool      changed;
+} superblock_env_t;
+
+static bool is_loop_header(superblock_env_t const *env, ir_node const *block)
+{
+	size_t const idx = get_irn_idx(block);
+	return idx < bitset_size(env->headers) && bitset_is_set(env->headers, idx);
+}
+
+static void mark_loop_header(ir_node *block, void *data)
+{
+	superblock_env_t *env = (superblock_env_t*)data;
+	for (int i = 0, n = get_Block_n_cfgpreds(block); i < n; ++i) {
+		if (is_backedge(block, i)) {
+			bitset_set(env->headers, get_irn_idx(block));
+			return;
+		}
+	}
+}
+
+static void count_node(ir_node *node, void *data)
+{
+	(void)node;
+	++*(unsigned*)data;
+}
+
+/**
+ * Returns the number of nodes to copy for duplicating @p block or -1 if
+ * @p block must not be duplicated.
+ */
+static int get_duplication_cost(ir_node const *block)
+{
+	if (get_Block_entity(block) != NULL)
+		return -1;
+
+	int cost = 0;
+	foreach_out_edge(block, edge) {
+		ir_node const *const node = get_edge_src_irn(edge);
+		/* Phis are not copied, but kept blocks and other kept nodes would
+		 * need new keep alive edges */
+		if (is_End(node))
+			return -1;
+		if (is_Phi(node))
+			continue;
+		foreach_out_edge(node, user_edge) {
+			if (is_End(get_edge_src_irn(user_edge)))
+				return -1;
+		}
+		if (is_Call(node)) {
+			ir_type const *const type = get_Call_type(node);
+			if (get_method_additional_properties(type)
+			    & mtp_property_returns_twice)
+				return -1;
+		}
+		if (!is_Proj(node))
+			++cost;
+	}
+	return cost;
+}
+
+/**
+ * Returns the predecessor position of @p block reached from @p pred or -1 if
+ * there is not exactly one such position.
+ */
+static int get_pred_pos(ir_node const *block, ir_node const *pred)
+{
+	int pos = -1;
+	for (int i = 0, n = get_Block_n_cfgpreds(block); i < n; ++i) {
+		if (get_Block_cfgpred_block(block, i) != pred)
+			continue;
+		if (pos >= 0)
+			return -1;
+		pos = i;
+	}
+	return pos;
+}
+
+/**
+ * Estimates how often control flows from @p block to @p succ. Successors
+ * with a single predecessor get their own frequency, the remaining
+ * frequency of @p block is divided among the join points.
+ */
+static double get_edge_freq(ir_node const *block, ir_node const *succ)
+{
+	if (get_Block_n_cfgpreds(succ) == 1)
+		return get_block_execfreq(succ);
+
+	double   rest    = get_block_execfreq(block);
+	unsigned n_joins = 0;
+	foreach_block_succ(block, edge) {
+		ir_node const *const other = get_edge_src_irn(edge);
+		if (get_Block_n_cfgpreds(other) == 1)
+			rest -= get_block_execfreq(other);
+		else
+			++n_joins;
+	}
+	double const freq = MAX(rest, 0.0) / n_joins;
+	return MIN(freq, get_block_execfreq(succ));
+}
+
+/**
+ * Adds the new predecessor @p x to @p node, which is either a Block or a Phi.
+ */
+static void add_pred(ir_node *node, ir_node *x)
+{
+	int        const n   = get_irn_arity(node);
+	ir_node  **const ins = ALLOCAN(ir_node*, n + 1);
+	foreach_irn_in(node, i, pred) {
+		ins[i] = pred;
+	}
+	ins[n] = x;
+	set_irn_in(node, n + 1, ins);
+}
+
+/**
+ * Removes predecessor @p pos from @p node, which is either a Block or a Phi.
+ */
+static void remove_pred(ir_node *node, int pos)
+{
+	int        const n   = get_irn_arity(node);
+	ir_node  **const ins = ALLOCAN(ir_node*, n - 1);
+	int              k   = 0;
+	foreach_irn_in(node, i, pred) {
+		if (i != pos)
+			ins[k++] = pred;
+	}
+	set_irn_in(node, n - 1, ins);
+}
+
+/**
+ * Adds the new predecessor @p x to @p block and its Phis. The Phis get the
+ * value they have for predecessor @p pos, replaced by its copy if it is one
+ * of the duplicated nodes.
+ */
+static void add_copied_pred(ir_node *block, int pos, ir_node *x)
+{
+	ir_node **phis = NEW_ARR_F(ir_node*, 0);
+	foreach_out_edge(block, edge) {
+		ir_node *node = get_edge_src_irn(edge);
+		if (is_Phi(node))
+			ARR_APP1(ir_node*, phis, node);
+	}
+	for (size_t i = 0, n = ARR_LEN(phis); i < n; ++i) {
+		ir_node *phi = phis[i];
+		ir_node *val = get_Phi_pred(phi, pos);
+		if (irn_visited(val))
+			val = (ir_node*)get_irn_link(val);
+		add_pred(phi, val);
+	}
+	DEL_ARR_F(phis);
+	add_pred(block, x);
+}
+
+/**
+ * Removes predecessor @p pos from @p block and its Phis.
+ */
+static void remove_block_pred(ir_node *block, int pos)
+{
+	foreach_out_edge_safe(block, edge) {
+		ir_node *phi = get_edge_src_irn(edge);
+		if (is_Phi(phi))
+			remove_pred(phi, pos);
+	}
+	remove_pred(block, pos);
+}
+
+static ir_node *ssa_second_def;
+static ir_node *ssa_second_def_block;
+
+static ir_node *search_def_and_create_phis(ir_node *block, ir_mode *mode)
+{
+	if (block == ssa_second_def_block)
+		return ssa_second_def;
+
+	if (irn_visited(block))
+		return (ir_node*)get_irn_link(block);
+
+	ir_graph *irg = get_irn_irg(block);
+	assert(block != get_irg_start_block(irg));
+
+	int n_cfgpreds = get_Block_n_cfgpreds(block);
+	if (n_cfgpreds == 1) {
+		ir_node *pred_block = get_Block_cfgpred_block(block, 0);
+		ir_node *value      = search_def_and_create_phis(pred_block, mode);
+		set_irn_link(block, value);
+		mark_irn_visited(block);
+		return value;
+	}
+
+	ir_node **in    = ALLOCAN(ir_node*, n_cfgpreds);
+	ir_node  *dummy = new_r_Dummy(irg, mode);
+	for (int i = 0; i < n_cfgpreds; ++i) {
+		in[i] = dummy;
+	}
+	ir_node *phi = mode == mode_M ? new_r_Phi_loop(block, n_cfgpreds, in)
+	                              : new_r_Phi(block, n_cfgpreds, in, mode);
+	set_irn_link(block, phi);
+	mark_irn_visited(block);
+
+	for (int i = 0; i < n_cfgpreds; ++i) {
+		ir_node *pred_block = get_Block_cfgpred_block(block, i);
+		ir_node *pred_val   = search_def_and_create_phis(pred_block, mode);
+		set_irn_n(phi, i, pred_val);
+	}
+	return phi;
+}
+
+/**
+ * Reconstructs SSA form for the users of @p orig_val, which now may also
+ * be reached by @p second_val defined in @p second_block.
+ */
+static void construct_ssa(ir_node *orig_block, ir_node *orig_val,
+                          ir_node *second_block, ir_node *second_val)
+{
+	if (orig_val == second_val)
+		return;
+
+	ir_graph *irg = get_irn_irg(orig_val);
+	inc_irg_visited(irg);
+
+	ir_mode *mode = get_irn_mode(orig_val);
+	set_irn_link(orig_block, orig_val);
+	mark_irn_visited(orig_block);
+	ssa_second_def_block = second_block;
+	ssa_second_def       = second_val;
+
+	foreach_out_edge_safe(orig_val, edge) {
+		ir_node *user = get_edge_src_irn(edge);
+		if (is_End(user))
+			continue;
+
+		int      j          = get_edge_src_pos(edge);
+		ir_node *user_block = get_nodes_block(user);
+		ir_node *newval;
+		if (is_Phi(user)) {
+			ir_node *pred_block = get_Block_cfgpred_block(user_block, j);
+			newval = search_def_and_create_phis(pred_block, mode);
+		} else {
+			newval = search_def_and_create_phis(user_block, mode);
+		}
+
+		if (newval != user) {
+			set_irn_n(user, j, newval);
+			if (is_Phi(user) && mode == mode_M && !get_Phi_loop(user)) {
+				set_Phi_loop(user, true);
+				keep_alive(user);
+				keep_alive(user_block);
+			}
+		}
+	}
+}
+
+/**
+ * Duplicates @p block for its predecessor @p pos and returns the copy.
+ */
+static ir_node *duplicate_block(ir_node *block, int pos)
+{
+	ir_graph *irg  = get_irn_irg(block);
+	ir_node  *in[] = { get_Block_cfgpred(block, pos) };
+	ir_node  *copy = new_r_Block(irg, ARRAY_SIZE(in), in);
+
+	ir_node **nodes = NEW_ARR_F(ir_node*, 0);
+	foreach_out_edge(block, edge) {
+		ARR_APP1(ir_node*, nodes, get_edge_src_irn(edge));
+	}
+
+	/* Phis are evaluated for the predecessor, the other nodes are copied */
+	inc_irg_visited(irg);
+	size_t n_nodes = ARR_LEN(nodes);
+	for (size_t i = 0; i < n_nodes; ++i) {
+		ir_node *node = nodes[i];
+		ir_node *node_copy;
+		if (is_Phi(node)) {
+			node_copy = get_Phi_pred(node, pos);
+		} else {
+			node_copy = exact_copy(node);
+			set_nodes_block(node_copy, copy);
+		}
+		set_irn_link(node, node_copy);
+		mark_irn_visited(node);
+	}
+	for (size_t i = 0; i < n_nodes; ++i) {
+		ir_node *node = nodes[i];
+		if (is_Phi(node))
+			continue;
+		ir_node *node_copy = (ir_node*)get_irn_link(node);
+		foreach_irn_in(node, j, pred) {
+			if (irn_visited(pred))
+				set_irn_n(node_copy, j, (ir_node*)get_irn_link(pred));
+		}
+	}
+
+	/* the copied control flow enters the same successors */
+	for (size_t i = 0; i < n_nodes; ++i) {
+		ir_node *node = nodes[i];
+		if (get_irn_mode(node) != mode_X)
+			continue;
+		ir_edge_t const *edge = get_irn_out_edge_first(node);
+		if (edge == NULL)
+			continue;
+		ir_node *succ   = get_edge_src_irn(edge);
+		ir_node *x_copy = (ir_node*)get_irn_link(node);
+		add_copied_pred(succ, get_edge_src_pos(edge), x_copy);
+	}
+	remove_block_pred(block, pos);
+
+	for (size_t i = 0; i < n_nodes; ++i) {
+		ir_node *node = nodes[i];
+		ir_mode *mode = get_irn_mode(node);
+		if (mode == mode_X || mode == mode_T)
+			continue;
+		construct_ssa(block, node, copy, (ir_node*)get_irn_link(node));
+	}
+	DEL_ARR_F(nodes);
+	return copy;
+}
+
+/**
+ * Continues the trace ending in @p pred with the join point @p block by
+ * duplicating it. Returns the copy or NULL if the block was not duplicated.
+ */
+static ir_node *duplicate_tail(superblock_env_t *env, ir_node *pred,
+                               ir_node *block, double freq)
+{
+	if (is_loop_header(env, block))
+		return NULL;
+	int const pos = get_pred_pos(block, pred);
+	if (pos < 0)
+		return NULL;
+	int const cost = get_duplication_cost(block);
+	if (cost < 0 || cost > MAX_TAIL_BLOCK_SIZE || (unsigned)cost > env->budget)
+		return NULL;
+
+	DB((dbg, LEVEL_2, "duplicating %+F for %+F (%d nodes)\n", block, pred,
+	    cost));
+	env->budget -= cost;
+	env->changed = true;
+
+	double const block_freq = get_block_execfreq(block);
+	ir_node     *copy       = duplicate_block(block, pos);
+	set_block_execfreq(copy, freq);
+	set_block_execfreq(block, MAX(block_freq - freq, 0.0));
+	return copy;
+}
+
+/**
+ * Returns the most likely successor of @p block and the frequency of the
+ * edge to it in @p freq.
+ */
+static ir_node *get_likely_succ(ir_node const *block, double *freq)
+{
+	ir_node *best      = NULL;
+	double   best_freq = 0.0;
+	foreach_block_succ(block, edge) {
+		ir_node *succ      = get_edge_src_irn(edge);
+		double   succ_freq = get_edge_freq(block, succ);
+		if (succ_freq > best_freq) {
+			best      = succ;
+			best_freq = succ_freq;
+		}
+	}
+	*freq = best_freq;
+	if (best_freq < MIN_TRACE_PROBABILITY * get_block_execfreq(block))
+		return NULL;
+	return best;
+}
+
+/**
+ * Walks back from @p block as long as the predecessor most likely continues
+ * to the block, so the seed does not separate a trace from its head.
+ */
+static ir_node *find_trace_head(superblock_env_t const *env, ir_node *block,
+                                size_t max_length)
+{
+	for (size_t i = 0; i < max_length && !is_loop_header(env, block); ++i) {
+		ir_node *best      = NULL;
+		double   best_freq = 0.0;
+		for (int p = 0, n = get_Block_n_cfgpreds(block); p < n; ++p) {
+			ir_node *pred = get_Block_cfgpred_block(block, p);
+			double   freq = get_edge_freq(pred, block);
+			if (freq > best_freq) {
+				best      = pred;
+				best_freq = freq;
+			}
+		}
+		double succ_freq;
+		if (best == NULL || Block_block_visited(best)
+		    || get_likely_succ(best, &succ_freq) != block)
+			break;
+		block = best;
+	}
+	return block;
+}
+
+/**
+ * Grows a trace from @p block along the most likely successors.
+ */
+static void form_trace(superblock_env_t *env, ir_node *block)
+{
+	DB((dbg, LEVEL_3, "trace from %+F\n", block));
+	for (;;) {
+		mark_Block_block_visited(block);
+
+		double   best_freq;
+		ir_node *best = get_likely_succ(block, &best_freq);
+		if (best == NULL || Block_block_visited(best)
+		    || is_loop_header(env, best))
+			return;
+
+		if (get_Block_n_cfgpreds(best) > 1) {
+			best = duplicate_tail(env, block, best, best_freq);
+			if (best == NULL)
+				return;
+		}
+		block = best;
+	}
+}
+
+static void collect_block(ir_node *block, void *data)
+{
+	ir_node ***blocks = (ir_node***)data;
+	ARR_APP1(ir_node*, *blocks, block);
+}
+
+static int cmp_block_freq(void const *a, void const *b)
+{
+	ir_node const *const b0 = *(ir_node const**)a;
+	ir_node const *const b1 = *(ir_node const**)b;
+	double const f0 = get_block_execfreq(b0);
+	double const f1 = get_block_execfreq(b1);
+	if (f0 != f1)
+		return f0 < f1 ? 1 : -1;
+	return get_irn_idx(b0) < get_irn_idx(b1) ? -1 : 1;
+}
+
+void opt_superblocks(ir_graph *irg, unsigned max_growth)
+{
+	FIRM_DBG_REGISTER(dbg, "firm.opt.superblock");
+
+	ir_estimate_execfreq(irg);
+	assure_irg_properties(irg, IR_GRAPH_PROPERTY_NO_UNREACHABLE_CODE
+	                         | IR_GRAPH_PROPERTY_NO_BADS
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_OUT_EDGES
+	                         | IR_GRAPH_PROPERTY_CONSISTENT_LOOPINFO);
+
+	unsigned n_nodes = 0;
+	irg_walk_graph(irg, count_node, NULL, &n_nodes);
+
+	superblock_env_t env;
+	env.headers = bitset_malloc(get_irg_last_idx(irg));
+	env.budget  = (unsigned)((unsigned long long)n_nodes * max_growth / 100);
+	env.changed = false;
+	irg_block_walk_graph(irg, mark_loop_header, NULL, &env);
+
+	/* the hottest blocks get the budget first */
+	ir_node **blocks = NEW_ARR_F(ir_node*, 0);
+	irg_block_walk_graph(irg, collect_block, NULL, &blocks);
+	size_t n_blocks = ARR_LEN(blocks);
+	QSORT(blocks, n_blocks, cmp_block_freq);
+
+	ir_reserve_resources(irg, IR_RESOURCE_BLOCK_VISITED
+	                        | IR_RESOURCE_IRN_VISITED | IR_RESOURCE_IRN_LINK);
+	inc_irg_block_visited(irg);
+
+	ir_node *end_block  = get_irg_end_block(irg);
+	double   start_freq = get_block_execfreq(get_irg_start_block(irg));
+	mark_Block_block_visited(end_block);
+	for (size_t i = 0; i < n_blocks && env.budget > 0; ++i) {
+		ir_node *block = blocks[i];
+		if (get_block_execfreq(block) < MIN_SEED_FREQ * start_freq)
+			break;
+		if (!Block_block_visited(block))
+			form_trace(&env, find_trace_head(&env, block, n_blocks));
+	}
+
+	ir_free_resources(irg, IR_RESOURCE_BLOCK_VISITED
+	                     | IR_RESOURCE_IRN_VISITED | IR_RESOURCE_IRN_LINK);
+	DEL_ARR_F(blocks);
+	free(env.headers);
+
+	if (env.changed)
+		remove_End_Bads_and_doublets(get_irg_end(irg));
+	confirm_irg_properties(irg, env.changed
+		? IR_GRAPH_PROPERTIES_NONE : IR_GRAPH_PROPERTIES_ALL);
+}
@@ -0,0 +1,160 @@
+/*
+ * A small corpus of functions int f(int x) shared by the code generation
+ * tests. The builders create a function with the given name.
+ */
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include "firm.h"
+#include <stdbool.h>
+
+static ir_type *type_int;
+static ir_type *type_int_int;
+
+/** Creates the types of the corpus, call after the target is initialized. */
+static void init_corpus_types(void)
+{
+	type_int     = new_type_primitive(mode_Is);
+	type_int_int = new_type_method(1, 1, false, cc_cdecl_set,
+	                               mtp_no_property);
+	set_method_param_type(type_int_int, 0, type_int);
+	set_method_res_type(type_int_int, 0, type_int);
+}
+
+static ir_entity *new_corpus_entity(char const *name, ir_type *type)
+{
+	return new_global_entity(get_glob_type(), new_id_from_str(name), type,
+	                         ir_visibility_external, IR_LINKAGE_DEFAULT);
+}
+
+static ir_graph *begin_function(char const *name, int n_locals)
+{
+	ir_entity *ent = new_corpus_entity(name, type_int_int);
+	ir_graph  *irg = new_ir_graph(ent, n_locals);
+	set_current_ir_graph(irg);
+	return irg;
+}
+
+static void add_return(ir_node *value)
+{
+	ir_node *ret = new_Return(get_store(), 1, &value);
+	add_immBlock_pred(get_irg_end_block(current_ir_graph), ret);
+}
+
+static void finish_function(void)
+{
+	mature_immBlock(get_irg_end_block(current_ir_graph));
+	irg_finalize_cons(current_ir_graph);
+}
+
+static ir_node *get_arg(void)
+{
+	return new_Proj(get_irg_args(current_ir_graph), mode_Is, 0);
+}
+
+/* ((x * 7 + 3) / 5) ^ (x << 2) */
+static ir_graph *build_arith(char const *name)
+{
+	ir_graph *irg = begin_function(name, 0);
+	ir_node  *x   = get_arg();
+	ir_node  *t   = new_Add(new_Mul(x, new_Const_long(mode_Is, 7)),
+	                        new_Const_long(mode_Is, 3));
+	ir_node  *div = new_Div(get_store(), t, new_Const_long(mode_Is, 5),
+	                        op_pin_state_pinned);
+	set_store(new_Proj(div, mode_M, pn_Div_M));
+	ir_node  *q   = new_Proj(div, mode_Is, pn_Div_res);
+	add_return(new_Eor(q, new_Shl(x, new_Const_long(mode_Iu, 2))));
+	finish_function();
+	return irg;
+}
+
+/* sum of i * i for 0 <= i < x */
+static ir_graph *build_loop(char const *name)
+{
+	ir_graph *irg = begin_function(name, 2);
+	ir_node  *x   = get_arg();
+	set_value(0, new_Const_long(mode_Is, 0));
+	set_value(1, new_Const_long(mode_Is, 0));
+	ir_node *jmp    = new_Jmp();
+	ir_node *header = new_immBlock();
+	add_immBlock_pred(header, jmp);
+	set_cur_block(header);
+	ir_node *i    = get_value(0, mode_Is);
+	ir_node *cond = new_Cond(new_Cmp(i, x, ir_relation_less));
+
+	ir_node *body = new_immBlock();
+	add_immBlock_pred(body, new_Proj(cond, mode_X, pn_Cond_true));
+	mature_immBlock(body);
+	set_cur_block(body);
+	set_value(1, new_Add(get_value(1, mode_Is), new_Mul(i, i)));
+	set_value(0, new_Add(i, new_Const_long(mode_Is, 1)));
+	add_immBlock_pred(header, new_Jmp());
+	mature_immBlock(header);
+
+	ir_node *exit = new_immBlock();
+	add_immBlock_pred(exit, new_Proj(cond, mode_X, pn_Cond_false));
+	mature_immBlock(exit);
+	set_cur_block(exit);
+	add_return(get_value(1, mode_Is));
+	finish_function();
+	return irg;
+}
+
+/* x in [0, 6) ? x * 100 + 107 : 7, dense enough for a jump table */
+static ir_graph *build_switch(char const *name)
+{
+	ir_graph        *irg   = begin_function(name, 0);
+	ir_node         *x     = get_arg();
+	ir_switch_table *table = ir_new_switch_table(irg, 6);
+	for (unsigned i = 0; i < 6; ++i) {
+		ir_tarval *tv = new_tarval_from_long(i, mode_Is);
+		ir_switch_table_set(table, i, tv, tv, i + 1);
+	}
+	ir_node *sw  = new_Switch(x, 7, table);
+	ir_node *mem = get_store();
+	for (unsigned i = 0; i < 7; ++i) {
+		ir_node *block = new_immBlock();
+		add_immBlock_pred(block, new_Proj(sw, mode_X, i));
+		mature_immBlock(block);
+		set_cur_block(block);
+		ir_node *value = new_Const_long(mode_Is, i * 100 + 7);
+		ir_node *ret   = new_Return(mem, 1, &value);
+		add_immBlock_pred(get_irg_end_block(irg), ret);
+	}
+	finish_function();
+	return irg;
+}
+
+/* (int)((double)x * 1.5 + 0.25), the constants live in a literal section */
+static ir_graph *build_float(char const *name)
+{
+	ir_graph *irg    = begin_function(name, 0);
+	ir_node  *x      = get_arg();
+	ir_node  *factor = new_Const(new_tarval_from_double(1.5, mode_D));
+	ir_node  *addend = new_Const(new_tarval_from_double(0.25, mode_D));
+	ir_node  *d      = new_Add(new_Mul(new_Conv(x, mode_D), factor), addend);
+	add_return(new_Conv(d, mode_Is));
+	finish_function();
+	return irg;
+}
+
+/* callee(x) + *counter, calls and loads an external symbol */
+static ir_graph *build_call(char const *name, ir_entity *callee,
+                            ir_entity *counter)
+{
+	ir_graph *irg  = begin_function(name, 0);
+	ir_node  *x    = get_arg();
+	ir_node  *call = new_Call(get_store(), new_Address(callee), 1, &x,
+	                          type_int_int);
+	set_store(new_Proj(call, mode_M, pn_Call_M));
+	ir_node  *res  = new_Proj(new_Proj(call, mode_T, pn_Call_T_result),
+	                          mode_Is, 0);
+	ir_node  *load = new_Load(get_store(), new_Address(counter), mode_Is,
+	                          type_int, cons_none);
+	set_store(new_Proj(load, mode_M, pn_Load_M));
+	add_return(new_Add(res, new_Proj(load, mode_Is, pn_Load_res)));
+	finish_function();
+	return irg;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "corpus.h"
+#include "firm.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Compiles a small corpus once to assembler and once with the object file
+ * writer. The assembled output and the written object must have the same
+ * code, relocations, symbols and data. The test runs itself for both
+ * outputs, because the backend consumes the graphs, and is skipped without
+ * binutils.
+ */
+
+static int compile(char const *output, bool object)
+{
+	ir_init_library();
+	ir_target_set("x86_64-linux-gnu");
+	if (object)
+		ir_target_option("object");
+	ir_target_init();
+
+	init_corpus_types();
+	build_arith("arith");
+	build_loop("loop");
+	build_switch("switch");
+	build_float("float");
+	build_call("call", new_corpus_entity("external", type_int_int),
+	           new_corpus_entity("counter", type_int));
+	be_lower_for_target();
+
+	FILE *out = fopen(output, "wb");
+	if (out == NULL)
+		return 1;
+	be_main(out, "elf_writer");
+	fclose(out);
+	ir_finish();
+	return 0;
+}
+
+static int run(char const *command)
+{
+	fflush(stdout);
+	return system(command);
+}
+
+static char        directory[] = "/tmp/firm_elf_writer_XXXXXX";
+static char const *files[]     = {
+	"out.s", "as.o", "direct.o", "as.txt", "direct.txt",
+};
+
+static void remove_files(void)
+{
+	char path[4096];
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+		snprintf(path, sizeof(path), "%s/%s", directory, files[i]);
+		remove(path);
+	}
+	rmdir(directory);
+}
+
+/*
+ * Dumps both objects with @p dump, filters the output through @p filter and
+ * compares the results.
+ */
+static bool compare(char const *dump, char const *filter)
+{
+	char command[4096];
+	snprintf(command, sizeof(command), "%s %s/as.o %s > %s/as.txt", dump,
+	         directory, filter, directory);
+	if (run(command) != 0)
+		return false;
+	snprintf(command, sizeof(command), "%s %s/direct.o %s > %s/direct.txt",
+	         dump, directory, filter, directory);
+	if (run(command) != 0)
+		return false;
+	snprintf(command, sizeof(command), "diff -u %s/as.txt %s/direct.txt",
+	         directory, directory);
+	if (run(command) != 0) {
+		fprintf(stderr, "Test failed: %s of the object file writer differs "
+		        "from the assembler\n", dump);
+		return false;
+	}
+	return true;
+}
+
+static int test(char const *self)
+{
+	char command[4096];
+	snprintf(command, sizeof(command), "\"%s\" asm %s/out.s", self,
+	         directory);
+	if (run(command) != 0)
+		return 1;
+	snprintf(command, sizeof(command), "\"%s\" object %s/direct.o", self,
+	         directory);
+	if (run(command) != 0)
+		return 1;
+	snprintf(command, sizeof(command), "as --64 -o %s/as.o %s/out.s",
+	         directory, directory);
+	if (run(command) != 0) {
+		printf("assembler does not support x86_64, skipping test\n");
+		return 0;
+	}
+
+	/* the file name in the header of the output differs and the choice of
+	 * padding nops depends on the assembler version */
+	if (!compare("objdump -dr --no-show-raw-insn",
+	             "| grep -v -e 'file format' -e nop"))
+		return 1;
+	/* the assembler output has no file symbol and orders the symbols
+	 * differently */
+	if (!compare("objdump -t",
+	             "| grep -v -e 'file format' -e 'df \\*ABS\\*' | sort"))
+		return 1;
+	if (!compare("objdump -s -j .rodata -j .data", "| grep -v 'file format'"))
+		return 1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 3)
+		return compile(argv[2], strcmp(argv[1], "object") == 0);
+
+	if (run("as --version >/dev/null 2>&1") != 0
+	 || run("objdump --version >/dev/null 2>&1") != 0) {
+		printf("binutils not found, skipping test\n");
+		return 0;
+	}
+
+	if (mkdtemp(directory) == NULL)
+		return 1;
+	int const res = test(argv[0]);
+	remove_files();
+	return res;
+}
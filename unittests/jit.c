@@ -0,0 +1,175 @@
+#include "corpus.h"
+#include "firm.h"
+#include "jit.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+static int      result = 0;
+
+#define check(expr) do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: Test failed: %s\n", __FILE__, __LINE__, \
+			        #expr); \
+			result = 1; \
+		} \
+	} while (0)
+
+typedef int (*int_func)(int);
+
+static int host_counter = 5;
+
+static int host_func(int x)
+{
+	return x * 3 + 1;
+}
+
+static int loop_expected(int x)
+{
+	int sum = 0;
+	for (int i = 0; i < x; ++i)
+		sum += i * i;
+	return sum;
+}
+
+#define HOT_THRESHOLD 4
+
+static unsigned n_optimized = 0;
+
+static void optimize(ir_graph *irg)
+{
+	(void)irg;
+	++n_optimized;
+}
+
+/*
+ * Calls the loop function through a lazy stub until it gets promoted to the
+ * optimized tier.
+ */
+static void check_tiers(ir_graph *irg)
+{
+	ir_jit_runtime_t *runtime = be_new_jit_runtime(NULL, optimize,
+	                                               HOT_THRESHOLD);
+	/* the target has no lazy compilation */
+	if (runtime == NULL)
+		return;
+	ir_entity *entity = get_irg_entity(irg);
+	int_func   func   = (int_func)be_jit_runtime_add(runtime, irg);
+	check(be_jit_runtime_get_tier(runtime, entity) == 0);
+
+	for (int x = 0; x < 3 * HOT_THRESHOLD; ++x) {
+		check(func(x) == loop_expected(x));
+		unsigned tier = be_jit_runtime_get_tier(runtime, entity);
+		if (x == 0)
+			check(tier == 1);
+		else
+			check(tier == 1 || tier == 2);
+	}
+	check(be_jit_runtime_get_tier(runtime, entity) == 2);
+	check(n_optimized == 1);
+	be_destroy_jit_runtime(runtime);
+}
+
+static int switch_expected(int x)
+{
+	return x >= 0 && x < 6 ? (x + 1) * 100 + 7 : 7;
+}
+
+static int_func jit_compile(ir_jit_segment_t *segment, ir_graph *irg)
+{
+	ir_jit_function_t *function = be_jit_compile(segment, irg);
+	check(function != NULL);
+	if (function == NULL)
+		return NULL;
+	return (int_func)be_jit_install_function(function);
+}
+
+/*
+ * Frees a function and installs a smaller one, which takes the memory of the
+ * freed function.
+ */
+static void check_reuse(ir_graph *freed, ir_graph *kept, ir_graph *reused)
+{
+	ir_jit_segment_t  *segment  = be_new_jit_segment();
+	ir_jit_function_t *function = be_jit_compile(segment, freed);
+	check(function != NULL);
+	if (function == NULL) {
+		be_destroy_jit_segment(segment);
+		return;
+	}
+	int_func freed_func = (int_func)be_jit_install_function(function);
+	/* keeps the freed memory from merging with the rest of the segment */
+	int_func kept_func  = jit_compile(segment, kept);
+	for (int x = -5; x < 10; ++x)
+		check(freed_func(x) == switch_expected(x));
+	be_jit_free_function(function);
+
+	int_func reused_func = jit_compile(segment, reused);
+	check(reused_func == freed_func);
+	for (int x = -5; x < 10; ++x) {
+		if (reused_func != NULL)
+			check(reused_func(x) == loop_expected(x));
+		if (kept_func != NULL)
+			check(kept_func(x) == (((x * 7 + 3) / 5) ^ (x << 2)));
+	}
+	be_destroy_jit_segment(segment);
+}
+
+int main(void)
+{
+	ir_init();
+
+	init_corpus_types();
+	ir_entity *host    = new_corpus_entity("host_func", type_int_int);
+	ir_entity *counter = new_corpus_entity("host_counter", type_int);
+
+	ir_graph *arith  = build_arith("arith");
+	ir_graph *loop   = build_loop("loop");
+	ir_graph *sw     = build_switch("switch");
+	ir_graph *flt    = build_float("float");
+	ir_graph *call   = build_call("call", host, counter);
+	ir_graph *lazy   = build_loop("lazy");
+	ir_graph *freed  = build_switch("freed");
+	ir_graph *kept   = build_arith("kept");
+	ir_graph *reused = build_loop("reused");
+	be_lower_for_target();
+
+	ir_jit_segment_t *segment = be_new_jit_segment();
+	/* the host has no jit support */
+	ir_jit_function_t *probe = be_jit_compile(segment, arith);
+	if (probe == NULL) {
+		be_destroy_jit_segment(segment);
+		ir_finish();
+		return 0;
+	}
+	int_func arith_func = (int_func)be_jit_install_function(probe);
+
+	be_jit_set_entity_addr(host, (void const*)host_func);
+	be_jit_set_entity_addr(counter, &host_counter);
+	int_func loop_func   = jit_compile(segment, loop);
+	int_func switch_func = jit_compile(segment, sw);
+	int_func float_func  = jit_compile(segment, flt);
+	int_func call_func   = jit_compile(segment, call);
+
+	for (int x = -20; x < 20; ++x) {
+		check(arith_func(x) == (((x * 7 + 3) / 5) ^ (x << 2)));
+
+		if (loop_func != NULL)
+			check(loop_func(x) == loop_expected(x));
+
+		if (switch_func != NULL)
+			check(switch_func(x) == switch_expected(x));
+
+		if (float_func != NULL)
+			check(float_func(x) == (int)((double)x * 1.5 + 0.25));
+
+		if (call_func != NULL)
+			check(call_func(x) == host_func(x) + host_counter);
+	}
+
+	check_tiers(lazy);
+	check_reuse(freed, kept, reused);
+
+	be_destroy_jit_segment(segment);
+	ir_finish();
+	return result;
+}
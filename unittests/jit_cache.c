@@ -0,0 +1,207 @@
+#include "corpus.h"
+#include "firm.h"
+#include "jit.h"
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Stores a function in the jit cache, loads it back and checks that
+ * truncated and corrupted entries are rejected or at least cannot make the
+ * emitter write outside of the function.
+ */
+
+#define N_GRAPHS 1024
+#define TAIL     768
+#define GUARD    64
+
+static int result = 0;
+
+#define check(expr) do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: Test failed: %s\n", __FILE__, __LINE__, \
+			        #expr); \
+			result = 1; \
+		} \
+	} while (0)
+
+typedef int (*int_func)(int);
+
+static ir_graph **graphs;
+static unsigned   next_graph;
+static char       entry_path[4096];
+
+static int expected(int x)
+{
+	return x >= 0 && x < 6 ? (x + 1) * 100 + 7 : 7;
+}
+
+static bool find_entry(char const *directory)
+{
+	DIR *dir = opendir(directory);
+	if (dir == NULL)
+		return false;
+	bool found = false;
+	for (struct dirent *e; (e = readdir(dir)) != NULL;) {
+		size_t len = strlen(e->d_name);
+		if (len > 4 && strcmp(e->d_name + len - 4, ".jit") == 0) {
+			snprintf(entry_path, sizeof(entry_path), "%s/%s", directory,
+			         e->d_name);
+			found = true;
+		}
+	}
+	closedir(dir);
+	return found;
+}
+
+static char *read_entry(size_t *size)
+{
+	FILE *in = fopen(entry_path, "rb");
+	if (in == NULL)
+		return NULL;
+	fseek(in, 0, SEEK_END);
+	*size = (size_t)ftell(in);
+	fseek(in, 0, SEEK_SET);
+	char *data = malloc(*size + 1);
+	if (fread(data, 1, *size, in) != *size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(in);
+	return data;
+}
+
+static void write_entry(char const *data, size_t size)
+{
+	FILE *out = fopen(entry_path, "wb");
+	fwrite(data, 1, size, out);
+	fclose(out);
+}
+
+/*
+ * Loads the function from the cache or compiles the next graph, which sets
+ * @p compiled. The name is part of the cache key, so the graph is named
+ * "switch" while it is compiled. The function may come from a corrupted
+ * entry, so it is only emitted, which must stay within its size.
+ */
+static ir_jit_function_t *load_or_compile(ir_jit_cache_t *cache,
+                                          ir_jit_segment_t *segment,
+                                          bool *compiled)
+{
+	if (next_graph >= N_GRAPHS) {
+		fprintf(stderr, "Test failed: out of graphs\n");
+		exit(1);
+	}
+	ir_graph          *irg      = graphs[next_graph];
+	ir_entity         *entity   = get_irg_entity(irg);
+	ident             *unique   = get_entity_ident(entity);
+	ident             *name     = new_id_from_str("switch");
+	set_entity_ident(entity, name);
+	set_entity_ld_ident(entity, name);
+	ir_jit_function_t *function = be_jit_compile_cached(cache, segment, irg);
+	set_entity_ident(entity, unique);
+	set_entity_ld_ident(entity, unique);
+	check(function != NULL);
+	*compiled = irg_is_constrained(irg, IR_GRAPH_CONSTRAINT_BACKEND);
+	if (*compiled)
+		++next_graph;
+
+	unsigned size   = be_get_function_size(function);
+	char    *buffer = malloc(size + GUARD);
+	memset(buffer, 0xAA, size + GUARD);
+	be_emit_function(buffer, function);
+	for (unsigned i = size; i < size + GUARD; ++i)
+		check(buffer[i] == (char)0xAA);
+	free(buffer);
+	return function;
+}
+
+static void check_function(ir_jit_function_t *function)
+{
+	int_func func = (int_func)be_jit_install_function(function);
+	for (int x = -5; x < 10; ++x)
+		check(func(x) == expected(x));
+	be_jit_free_function(function);
+}
+
+int main(void)
+{
+	ir_init();
+	init_corpus_types();
+
+	char directory[] = "/tmp/firm_jit_cache_XXXXXX";
+	if (mkdtemp(directory) == NULL) {
+		ir_finish();
+		return 0;
+	}
+	ir_jit_cache_t *cache = be_new_jit_cache(directory);
+
+	graphs = malloc(N_GRAPHS * sizeof(*graphs));
+	for (unsigned i = 0; i < N_GRAPHS; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "switch%u", i);
+		graphs[i] = build_switch(name);
+	}
+	be_lower_for_target();
+
+	ir_jit_segment_t *segment = be_new_jit_segment();
+	/* the host has no jit or cache support */
+	ir_jit_function_t *probe = be_jit_compile(segment, graphs[next_graph++]);
+	if (probe == NULL || cache == NULL) {
+		if (cache != NULL)
+			be_destroy_jit_cache(cache);
+		be_destroy_jit_segment(segment);
+		rmdir(directory);
+		ir_finish();
+		return 0;
+	}
+	be_jit_free_function(probe);
+
+	/* store the entry and load it back */
+	bool compiled;
+	check_function(load_or_compile(cache, segment, &compiled));
+	check(compiled);
+	check(find_entry(directory));
+	size_t size;
+	char  *original = read_entry(&size);
+	check(original != NULL);
+	if (original == NULL)
+		return 1;
+
+	check_function(load_or_compile(cache, segment, &compiled));
+	check(!compiled);
+
+	/* a truncated entry is rejected and replaced */
+	for (size_t length = 0; length < size; length += 1 + size / 64) {
+		write_entry(original, length);
+		check_function(load_or_compile(cache, segment, &compiled));
+		check(compiled);
+		check_function(load_or_compile(cache, segment, &compiled));
+		check(!compiled);
+	}
+
+	/* a corrupted byte is rejected or the emitter stays within bounds, the
+	 * function is stored after the fingerprint and structure */
+	unsigned n_rejected = 0;
+	for (size_t i = size > TAIL ? size - TAIL : 0; i < size; ++i) {
+		original[i] ^= 0xFF;
+		write_entry(original, size);
+		original[i] ^= 0xFF;
+		be_jit_free_function(load_or_compile(cache, segment, &compiled));
+		if (compiled)
+			++n_rejected;
+	}
+	check(n_rejected > 0);
+
+	remove(entry_path);
+	rmdir(directory);
+	free(original);
+	free(graphs);
+	be_destroy_jit_cache(cache);
+	be_destroy_jit_segment(segment);
+	ir_finish();
+	return result;
+}
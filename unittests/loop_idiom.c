@@ -0,0 +1,113 @@
+#include "firm.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+static ir_type *type_int;
+static int      result = 0;
+
+#define check(expr) do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: Test failed: %s\n", __FILE__, __LINE__, \
+			        #expr); \
+			result = 1; \
+		} \
+	} while (0)
+
+/* for (i = 0; i < 6; i += step) *(int*)(base + i * scale) = 0; */
+static void build_memset_loop(ir_node *base, long step, long scale)
+{
+	ir_mode *offset_mode = get_reference_offset_mode(mode_P);
+	set_value(0, new_Const_long(mode_Is, 0));
+	ir_node *jmp    = new_Jmp();
+	ir_node *header = new_immBlock();
+	add_immBlock_pred(header, jmp);
+	set_cur_block(header);
+	ir_node *i    = get_value(0, mode_Is);
+	ir_node *cmp  = new_Cmp(i, new_Const_long(mode_Is, 6), ir_relation_less);
+	ir_node *cond = new_Cond(cmp);
+
+	ir_node *body = new_immBlock();
+	add_immBlock_pred(body, new_Proj(cond, mode_X, pn_Cond_true));
+	mature_immBlock(body);
+	set_cur_block(body);
+	ir_node *offset = new_Mul(new_Conv(i, offset_mode),
+	                          new_Const_long(offset_mode, scale));
+	ir_node *store  = new_Store(get_store(), new_Add(base, offset),
+	                            new_Const_long(mode_Is, 0), type_int,
+	                            cons_none);
+	set_store(new_Proj(store, mode_M, pn_Store_M));
+	set_value(0, new_Add(i, new_Const_long(mode_Is, step)));
+	add_immBlock_pred(header, new_Jmp());
+	mature_immBlock(header);
+
+	ir_node *exit = new_immBlock();
+	add_immBlock_pred(exit, new_Proj(cond, mode_X, pn_Cond_false));
+	mature_immBlock(exit);
+	set_cur_block(exit);
+}
+
+static void check_cf_users(ir_node *node, void *env)
+{
+	(void)env;
+	if (get_irn_mode(node) == mode_X && !is_Block(node) && !is_End(node))
+		check(get_irn_n_outs(node) == 1);
+}
+
+static void collect_sizes(ir_node *node, void *env)
+{
+	long *sizes = (long*)env;
+	if (!is_Call(node))
+		return;
+	ir_node *size = get_Call_param(node, 2);
+	check(is_Const(size));
+	if (is_Const(size)) {
+		long bytes = get_tarval_long(get_Const_tarval(size));
+		sizes[bytes == 24 ? 0 : 1] = bytes;
+	}
+}
+
+int main(void)
+{
+	ir_init();
+	/* local optimizations would turn the "i < 6" into "i <= 5" */
+	set_optimize(0);
+	type_int = new_type_primitive(mode_Is);
+
+	ir_type *type_ptr = new_type_pointer(type_int);
+	ir_type *mtp      = new_type_method(1, 0, false, cc_cdecl_set,
+	                                    mtp_no_property);
+	set_method_param_type(mtp, 0, type_ptr);
+	ir_entity *ent = new_global_entity(get_glob_type(), new_id_from_str("f"),
+	                                   mtp, ir_visibility_external,
+	                                   IR_LINKAGE_DEFAULT);
+	ir_graph  *irg = new_ir_graph(ent, 1);
+	set_current_ir_graph(irg);
+
+	/* two loops back to back, the exit of the first one is the entry of the
+	 * second one */
+	ir_node *base = new_Proj(get_irg_args(irg), mode_P, 0);
+	build_memset_loop(base, 1, 4);
+	/* stores 8 bytes although the range is 6 */
+	build_memset_loop(base, 4, 1);
+
+	ir_node *ret = new_Return(get_store(), 0, NULL);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	mature_immBlock(get_irg_end_block(irg));
+	irg_finalize_cons(irg);
+
+	opt_loop_idioms(irg);
+	check(irg_verify(irg));
+	assure_irg_properties(irg, IR_GRAPH_PROPERTY_CONSISTENT_OUTS);
+	irg_walk_graph(irg, NULL, check_cf_users, NULL);
+
+	/* fold the byte counts */
+	set_optimize(1);
+	optimize_graph_df(irg);
+	long sizes[2] = { 0, 0 };
+	irg_walk_graph(irg, NULL, collect_sizes, sizes);
+	check(sizes[0] == 24);
+	check(sizes[1] == 8);
+
+	ir_finish();
+	return result;
+}
@@ -0,0 +1,142 @@
+#include "firm.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+static ir_type   *type_int;
+static ir_type   *type_s;
+static ir_entity *member_a;
+static ir_entity *member_b;
+static int        result = 0;
+
+#define check(expr) do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: Test failed: %s\n", __FILE__, __LINE__, \
+			        #expr); \
+			result = 1; \
+		} \
+	} while (0)
+
+static void store_member(ir_node *ptr, ir_entity *member, long value)
+{
+	ir_node *addr  = new_Member(ptr, member);
+	ir_node *store = new_Store(get_store(), addr,
+	                           new_Const_long(mode_Is, value), type_int,
+	                           cons_none);
+	set_store(new_Proj(store, mode_M, pn_Store_M));
+}
+
+static ir_node *load_member(ir_node *ptr, ir_entity *member)
+{
+	ir_node *load = new_Load(get_store(), new_Member(ptr, member), mode_Is,
+	                         type_int, cons_none);
+	set_store(new_Proj(load, mode_M, pn_Load_M));
+	return new_Proj(load, mode_Is, pn_Load_res);
+}
+
+/* void name(struct s *p) { p->b = 7; } */
+static ir_entity *build_writer(char const *name, ir_type *mtp)
+{
+	ir_entity *ent = new_global_entity(get_glob_type(), new_id_from_str(name),
+	                                   mtp, ir_visibility_local,
+	                                   IR_LINKAGE_DEFAULT);
+	ir_graph  *irg = new_ir_graph(ent, 0);
+	set_current_ir_graph(irg);
+	store_member(new_Proj(get_irg_args(irg), mode_P, 0), member_b, 7);
+	ir_node *ret = new_Return(get_store(), 0, NULL);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	mature_immBlock(get_irg_end_block(irg));
+	irg_finalize_cons(irg);
+	return ent;
+}
+
+static void call(ir_entity *callee, ir_node *ptr)
+{
+	ir_node *call = new_Call(get_store(), new_Address(callee), 1, &ptr,
+	                         get_entity_type(callee));
+	set_store(new_Proj(call, mode_M, pn_Call_M));
+}
+
+/* Returns whether a Load of member b lies on the memory chain from @p node
+ * up to a Call. */
+static bool reload_precedes(ir_node *node)
+{
+	for (;;) {
+		if (is_Proj(node)) {
+			node = get_Proj_pred(node);
+		} else if (is_Store(node)) {
+			node = get_Store_mem(node);
+		} else if (is_Load(node)) {
+			ir_node *ptr = get_Load_ptr(node);
+			if (is_Member(ptr) && get_Member_entity(ptr) == member_b)
+				return true;
+			node = get_Load_mem(node);
+		} else {
+			return false;
+		}
+	}
+}
+
+static void check_store(ir_node *node, void *env)
+{
+	int *n_found = (int*)env;
+	if (!is_Store(node))
+		return;
+	ir_node *value = get_Store_value(node);
+	if (!is_Const(value) || get_tarval_long(get_Const_tarval(value)) != 5)
+		return;
+	++*n_found;
+	check(reload_precedes(get_Store_mem(node)));
+}
+
+int main(void)
+{
+	ir_init();
+	type_int = new_type_primitive(mode_Is);
+	type_s   = new_type_struct(new_id_from_str("s"));
+	member_a = new_entity(type_s, new_id_from_str("a"), type_int);
+	member_b = new_entity(type_s, new_id_from_str("b"), type_int);
+	default_layout_compound_type(type_s);
+
+	ir_type *type_ptr = new_type_pointer(type_s);
+	ir_type *mtp      = new_type_method(1, 0, false, cc_cdecl_set,
+	                                    mtp_no_property);
+	set_method_param_type(mtp, 0, type_ptr);
+	ir_entity *g = build_writer("g", mtp);
+	ir_entity *h = build_writer("h", mtp);
+
+	ir_type *type_f = new_type_method(0, 1, false, cc_cdecl_set,
+	                                  mtp_no_property);
+	set_method_res_type(type_f, 0, type_int);
+	ir_entity *ent = new_global_entity(get_glob_type(), new_id_from_str("f"),
+	                                   type_f, ir_visibility_external,
+	                                   IR_LINKAGE_DEFAULT);
+	ir_graph  *irg = new_ir_graph(ent, 0);
+	set_current_ir_graph(irg);
+	ir_entity *s = new_entity(get_irg_frame_type(irg), new_id_from_str("s"),
+	                          type_s);
+
+	/* s.a = 1; s.b = 2; g(&s); t = s.b; s.b = 5; h(&s); return t + s.a; */
+	ir_node *frame = get_irg_frame(irg);
+	store_member(new_Member(frame, s), member_a, 1);
+	store_member(new_Member(frame, s), member_b, 2);
+	call(g, new_Member(frame, s));
+	ir_node *t = load_member(new_Member(frame, s), member_b);
+	store_member(new_Member(frame, s), member_b, 5);
+	call(h, new_Member(frame, s));
+	ir_node *res = new_Add(t, load_member(new_Member(frame, s), member_a));
+	ir_node *ret = new_Return(get_store(), 1, &res);
+	add_immBlock_pred(get_irg_end_block(irg), ret);
+	mature_immBlock(get_irg_end_block(irg));
+	irg_finalize_cons(irg);
+
+	scalar_replacement_opt(irg);
+	check(irg_verify(irg));
+
+	/* the Store of 5 before h() must come after the reload of b after g() */
+	int n_found = 0;
+	irg_walk_graph(irg, NULL, check_store, &n_found);
+	check(n_found == 1);
+
+	ir_finish();
+	return result;
+}